@@ -0,0 +1,348 @@
+#include "aes_async.h"
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_stats.h"
+#include "aes_thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Most jobs one worker takes from a queue at a time
+static const size_t MAX_COALESCED_JOBS = 256;
+
+struct AESAsyncQueue::Pending {
+    AESJob job;
+    // Exactly one of these is set. An unused promise would store a
+    // broken_promise error when destroyed, which costs more than a job.
+    AESJobCallback callback;
+    std::unique_ptr<std::promise<std::vector<unsigned char> > > promise;
+    bool done;
+    
+    explicit Pending(AESJob job) : job(std::move(job)), done(false) {}
+    
+    void complete(std::vector<unsigned char> result) {
+        done = true;
+        if (promise) {
+            promise->set_value(std::move(result));
+            return;
+        }
+        try {
+            callback(std::move(result), std::exception_ptr());
+        } catch (...) {
+        }
+    }
+    
+    void fail(std::exception_ptr error) {
+        done = true;
+        if (promise) {
+            promise->set_exception(error);
+            return;
+        }
+        try {
+            callback(std::vector<unsigned char>(), error);
+        } catch (...) {
+        }
+    }
+};
+
+AESAsyncQueue::AESAsyncQueue(unsigned int threads, size_t coalesceBytes)
+    : coalesceBytes(coalesceBytes), nextQueue(0), pending(0), sleeping(0), stopping(false) {
+    if (threads == 0) {
+        threads = AESThreadPool::instance().size();
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        try {
+            workers.push_back(std::thread(&AESAsyncQueue::workerLoop, this, static_cast<size_t>(i)));
+        } catch (const std::exception&) {
+            // Thread creation is not available; submit() runs jobs itself
+            break;
+        }
+    }
+}
+
+AESAsyncQueue::~AESAsyncQueue() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+std::future<std::vector<unsigned char> > AESAsyncQueue::submit(AESJob job) {
+    Pending* entry = new Pending(std::move(job));
+    entry->promise.reset(new std::promise<std::vector<unsigned char> >());
+    std::future<std::vector<unsigned char> > result = entry->promise->get_future();
+    enqueue(entry);
+    return result;
+}
+
+void AESAsyncQueue::submit(AESJob job, AESJobCallback callback) {
+    Pending* entry = new Pending(std::move(job));
+    entry->callback = std::move(callback);
+    enqueue(entry);
+}
+
+void AESAsyncQueue::enqueue(Pending* job) {
+    if (workers.empty()) {
+        std::vector<Pending*> batch(1, job);
+        runBatch(batch);
+        return;
+    }
+    
+    // pending changes under the queue lock, so it never counts a job that
+    // is not in a queue and a woken worker does not spin waiting for one
+    Queue& queue = *queues[nextQueue++ % workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+        pending++;
+    }
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        idle = sleeping > 0;
+    }
+    // Busy workers find the job without being woken
+    if (idle) {
+        wake.notify_one();
+    }
+}
+
+// Takes one large job, or a run of small jobs up to coalesceBytes, from the
+// front of the worker's own queue or the back of another one
+bool AESAsyncQueue::take(Queue& queue, bool fromFront, std::vector<Pending*>& batch) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    size_t bytes = 0;
+    while (!queue.jobs.empty() && batch.size() < MAX_COALESCED_JOBS) {
+        Pending* next = fromFront ? queue.jobs.front() : queue.jobs.back();
+        size_t size = next->job.data.size();
+        if (!batch.empty() && (size > coalesceBytes || bytes + size > coalesceBytes)) {
+            break;
+        }
+        if (fromFront) {
+            queue.jobs.pop_front();
+        } else {
+            queue.jobs.pop_back();
+        }
+        batch.push_back(next);
+        bytes += size;
+        if (size > coalesceBytes) {
+            break;
+        }
+    }
+    pending -= batch.size();
+    return !batch.empty();
+}
+
+void AESAsyncQueue::workerLoop(size_t index) {
+    std::vector<Pending*> batch;
+    for (;;) {
+        batch.clear();
+        bool found = take(*queues[index], true, batch);
+        for (size_t i = 1; !found && i < queues.size(); i++) {
+            found = take(*queues[(index + i) % queues.size()], false, batch);
+        }
+        if (found) {
+            runBatch(batch);
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping++;
+        wake.wait(lock, [this] { return stopping || pending > 0; });
+        sleeping--;
+        if (stopping && pending == 0) {
+            return;
+        }
+    }
+}
+
+// A job on its own, through the same calls as the synchronous API
+static std::vector<unsigned char> runJob(AESJob& job) {
+    std::vector<unsigned char>& data = job.data;
+    size_t len = data.size();
+    switch (job.operation) {
+    case AESJob::CBC_ENCRYPT:
+        data.resize(AESEncryption::encryptedSize(len));
+        job.cipher.encrypt(data.data(), len);
+        break;
+    case AESJob::CBC_DECRYPT:
+        data.resize(job.cipher.decrypt(data.data(), len));
+        break;
+    case AESJob::CTR:
+        job.cipher.encryptCtr(data.data(), len, data.data());
+        break;
+    }
+    return std::move(data);
+}
+
+// Coalesced CBC encryption: the padded messages are packed into one arena
+// and interleaved in the kernel, one block of each message per call
+static void cbcEncryptJobs(AESJob** jobs, size_t count, const AESKey& key, const unsigned char* ivs,
+                           std::vector<std::vector<unsigned char> >& results) {
+    std::vector<size_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + AESEncryption::encryptedSize(jobs[i]->data.size());
+    }
+    std::vector<unsigned char> arena(offsets[count]);
+    for (size_t i = 0; i < count; i++) {
+        const std::vector<unsigned char>& data = jobs[i]->data;
+        size_t padding = offsets[i + 1] - offsets[i] - data.size();
+        if (!data.empty()) {
+            std::memcpy(&arena[offsets[i]], data.data(), data.size());
+        }
+        std::memset(&arena[offsets[i] + data.size()], static_cast<int>(padding), padding);
+    }
+    
+    AES_STAT_SCOPE(AESStatOperation::BATCH_ENCRYPT, key.kernel().index, arena.size(), arena.size() / 16);
+    cbcEncryptRecordsWithIvs(key.kernel(), key.schedule(), ivs, arena.data(), offsets.data(), count);
+    for (size_t i = 0; i < count; i++) {
+        results[i].assign(arena.begin() + offsets[i], arena.begin() + offsets[i + 1]);
+    }
+}
+
+// Coalesced CBC decryption: every block of every message in one pass
+// through the multi-block kernel. The caller has checked the lengths.
+static void cbcDecryptJobs(AESJob** jobs, size_t count, const AESKey& key, const unsigned char* ivs,
+                           std::vector<std::vector<unsigned char> >& results) {
+    std::vector<size_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + jobs[i]->data.size();
+    }
+    std::vector<unsigned char> in(offsets[count]);
+    std::vector<unsigned char> out(offsets[count]);
+    for (size_t i = 0; i < count; i++) {
+        std::memcpy(&in[offsets[i]], jobs[i]->data.data(), jobs[i]->data.size());
+    }
+    
+    AES_STAT_SCOPE(AESStatOperation::BATCH_DECRYPT, key.kernel().index, in.size(), in.size() / 16);
+    cbcDecryptRecordsWithIvs(key.kernel(), key.schedule(), ivs, in.data(), out.data(), offsets.data(), count);
+    for (size_t i = 0; i < count; i++) {
+        results[i].assign(out.begin() + offsets[i], out.begin() + offsets[i + 1]);
+    }
+}
+
+// Coalesced CTR: the counter blocks of every message are encrypted in one
+// kernel call and XORed into the messages in place
+static void ctrJobs(AESJob** jobs, size_t count, const AESKey& key, const unsigned char* ivs,
+                    std::vector<std::vector<unsigned char> >& results) {
+    std::vector<size_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + (jobs[i]->data.size() + 15) / 16 * 16;
+    }
+    std::vector<unsigned char> keystream(offsets[count]);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t block = 0; offsets[i] + block * 16 < offsets[i + 1]; block++) {
+            unsigned char* counter = &keystream[offsets[i] + block * 16];
+            std::memcpy(counter, ivs + 16 * i, 16);
+            ctrAdd(counter, block);
+        }
+    }
+    
+    AES_STAT_SCOPE(AESStatOperation::CTR, key.kernel().index, keystream.size(), keystream.size() / 16);
+    key.kernel().encryptBlocks(key.schedule(), keystream.data(), keystream.data(), keystream.size() / 16);
+    for (size_t i = 0; i < count; i++) {
+        std::vector<unsigned char>& data = jobs[i]->data;
+        xorBytes(data.data(), data.data(), &keystream[offsets[i]], data.size());
+        results[i] = std::move(data);
+    }
+}
+
+static bool sameGroup(const AESJob& a, const AESJob& b) {
+    return a.operation == b.operation && a.cipher.sharedKey() == b.cipher.sharedKey();
+}
+
+void AESAsyncQueue::runBatch(std::vector<Pending*>& batch) {
+    // Jobs sharing a key and an operation become neighbours, in submission
+    // order within each group
+    std::stable_sort(batch.begin(), batch.end(), [](const Pending* a, const Pending* b) {
+        if (a->job.cipher.sharedKey() != b->job.cipher.sharedKey()) {
+            return std::less<const AESKey*>()(a->job.cipher.sharedKey().get(), b->job.cipher.sharedKey().get());
+        }
+        return a->job.operation < b->job.operation;
+    });
+    
+    for (size_t first = 0; first < batch.size();) {
+        size_t last = first + 1;
+        while (last < batch.size() && sameGroup(batch[first]->job, batch[last]->job)) {
+            last++;
+        }
+        
+        try {
+            if (last - first == 1) {
+                batch[first]->complete(runJob(batch[first]->job));
+            } else {
+                // CBC decryption jobs with a bad length fail on their own;
+                // empty input decrypts to nothing, as in decrypt()
+                std::vector<AESJob*> jobs;
+                std::vector<Pending*> owners;
+                std::vector<unsigned char> ivs;
+                for (size_t i = first; i < last; i++) {
+                    AESJob& job = batch[i]->job;
+                    if (job.operation == AESJob::CBC_DECRYPT && job.data.size() % 16 != 0) {
+                        batch[i]->fail(std::make_exception_ptr(
+                            std::invalid_argument("Encrypted data size must be a multiple of the block size")));
+                        continue;
+                    }
+                    if (job.operation == AESJob::CBC_DECRYPT && job.data.empty()) {
+                        batch[i]->complete(std::vector<unsigned char>());
+                        continue;
+                    }
+                    jobs.push_back(&job);
+                    owners.push_back(batch[i]);
+                    ivs.insert(ivs.end(), job.cipher.iv, job.cipher.iv + 16);
+                }
+                
+                std::vector<std::vector<unsigned char> > results(jobs.size());
+                if (!jobs.empty()) {
+                    const AESKey& key = *jobs[0]->cipher.sharedKey();
+                    switch (jobs[0]->operation) {
+                    case AESJob::CBC_ENCRYPT:
+                        cbcEncryptJobs(jobs.data(), jobs.size(), key, ivs.data(), results);
+                        break;
+                    case AESJob::CBC_DECRYPT:
+                        cbcDecryptJobs(jobs.data(), jobs.size(), key, ivs.data(), results);
+                        break;
+                    case AESJob::CTR:
+                        ctrJobs(jobs.data(), jobs.size(), key, ivs.data(), results);
+                        break;
+                    }
+                }
+                
+                for (size_t i = 0; i < owners.size(); i++) {
+                    if (owners[i]->job.operation != AESJob::CBC_DECRYPT) {
+                        owners[i]->complete(std::move(results[i]));
+                        continue;
+                    }
+                    std::vector<unsigned char>& plain = results[i];
+                    size_t padding;
+                    try {
+                        padding = AESKey::paddingLength(plain.data() + plain.size() - 16);
+                    } catch (...) {
+                        owners[i]->fail(std::current_exception());
+                        continue;
+                    }
+                    plain.resize(plain.size() - padding);
+                    owners[i]->complete(std::move(plain));
+                }
+            }
+        } catch (...) {
+            for (size_t i = first; i < last; i++) {
+                if (!batch[i]->done) {
+                    batch[i]->fail(std::current_exception());
+                }
+            }
+        }
+        first = last;
+    }
+    
+    for (Pending* job : batch) {
+        delete job;
+    }
+}
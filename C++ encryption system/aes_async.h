@@ -0,0 +1,91 @@
+#ifndef AES_ASYNC_H
+#define AES_ASYNC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "aes_encryption.h"
+
+// One message for AESAsyncQueue: the operation, the cipher (key and IV) and
+// the input, which the job owns. CBC uses PKCS#7 padding as in
+// AESEncryption::encrypt and decrypt; CTR takes the IV as its initial counter.
+struct AESJob {
+    enum Operation { CBC_ENCRYPT, CBC_DECRYPT, CTR };
+    
+    Operation operation;
+    AESEncryption cipher;
+    std::vector<unsigned char> data;
+    
+    AESJob(Operation operation, const AESEncryption& cipher, std::vector<unsigned char> data)
+        : operation(operation), cipher(cipher), data(std::move(data)) {}
+    AESJob(Operation operation, const AESEncryption& cipher, const std::string& data)
+        : operation(operation), cipher(cipher), data(data.begin(), data.end()) {}
+};
+
+// Called on a queue thread with the output, or with a non-null error (the
+// exception the synchronous call would have thrown) and an empty output.
+// Exceptions thrown by the callback are discarded.
+typedef std::function<void(std::vector<unsigned char> result, std::exception_ptr error)> AESJobCallback;
+
+// Runs jobs on its own worker threads so the submitting thread never waits
+// for the cipher.
+//
+// Every worker has its own queue. Submissions are spread over the queues,
+// and a worker whose queue is empty steals from the others. A worker takes
+// all the small jobs at the front of its queue at once (up to coalesceBytes
+// of input) and runs the jobs that share a key and an operation together:
+// CBC encryption interleaves the messages in the multi-block kernel as
+// encryptBatch does, and CBC decryption and CTR put the blocks of every
+// message through one kernel call. When the queue is short each job runs on
+// its own as soon as it arrives, so coalescing only adds batching under load.
+// Jobs coalesce only when their ciphers share an AESKey (the same sharedKey()
+// or withIv() family); larger jobs run alone and may use the AESThreadPool.
+class AESAsyncQueue {
+public:
+    // threads = 0 uses one worker per thread of the AESThreadPool. Jobs of at
+    // most coalesceBytes are considered small.
+    explicit AESAsyncQueue(unsigned int threads = 0, size_t coalesceBytes = 4096);
+    // Finishes every submitted job, then stops the workers
+    ~AESAsyncQueue();
+    
+    std::future<std::vector<unsigned char> > submit(AESJob job);
+    void submit(AESJob job, AESJobCallback callback);
+    
+    unsigned int threads() const { return static_cast<unsigned int>(workers.size()); }
+    
+private:
+    struct Pending;
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Pending*> jobs;
+    };
+    
+    size_t coalesceBytes;
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue;
+    std::atomic<size_t> pending;    // submitted jobs not yet taken by a worker
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    unsigned int sleeping;          // workers waiting for jobs, guarded by sleepMutex
+    bool stopping;                  // guarded by sleepMutex
+    
+    AESAsyncQueue(const AESAsyncQueue&);
+    AESAsyncQueue& operator=(const AESAsyncQueue&);
+    
+    void enqueue(Pending* job);
+    bool take(Queue& queue, bool fromFront, std::vector<Pending*>& batch);
+    void workerLoop(size_t index);
+    void runBatch(std::vector<Pending*>& batch);
+};
+
+#endif
@@ -0,0 +1,578 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "aes_encryption.h"
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_siv.h"
+#include "aes_thread_pool.h"
+#include "aes_tuning.h"
+
+#ifdef AES_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Benchmark for the block kernels, the cipher modes and the public API.
+//
+// Every (operation, kernel, size, thread count) case is run twice: a
+// throughput pass timed as a whole, then a latency pass that times each call
+// separately for the percentiles. Cycles are TSC reference cycles on x86
+// (calibrated against the steady clock); elsewhere they are only reported
+// when --ghz gives the clock rate.
+
+struct BenchOptions {
+    std::vector<size_t> sizes;
+    std::vector<unsigned int> threads;
+    std::vector<std::string> kernels;
+    std::vector<std::string> operations;
+    size_t keyBytes;
+    double minSeconds;
+    double ghz;
+    std::string jsonPath;
+};
+
+struct BenchResult {
+    std::string operation;
+    std::string kernel;
+    size_t size;
+    unsigned int threads;
+    size_t iterations;
+    double seconds;
+    double gbps;
+    double cyclesPerByte;
+    double p50, p90, p99, p999, maxLatency;    // nanoseconds per call
+};
+
+// One benchmarked call: processes size bytes with the given thread count
+typedef std::function<void(size_t size, unsigned int threads)> BenchCall;
+
+struct BenchOperation {
+    std::string name;
+    bool perKernel;       // run once per kernel rather than on the active kernel only
+    bool threaded;        // uses the worker pool
+    size_t fixedSize;     // nonzero: always this many bytes, regardless of --sizes
+};
+
+static const BenchOperation OPERATIONS[] = {
+    { "block-encrypt",     true,  false, 0 },
+    { "block-decrypt",     true,  false, 0 },
+    { "cbc-encrypt",       true,  false, 0 },
+    { "cbc-decrypt",       true,  true,  0 },
+    { "ctr",               true,  true,  0 },
+    { "gcm-encrypt",       true,  true,  0 },
+    { "gcm-decrypt",       true,  true,  0 },
+    { "xts-encrypt",       true,  true,  0 },
+    { "cbc-messages",      true,  true,  0 },
+    { "siv-encrypt",       false, false, 0 },
+    { "siv-messages",      false, true,  0 },
+    { "encryptString",     false, false, 0 },
+    { "decryptString",     false, false, 0 },
+    { "encrypt<T>",        false, false, sizeof(uint64_t) },
+    { "decrypt<T>",        false, false, sizeof(uint64_t) },
+    { "encryptFixed<T>",   false, false, sizeof(uint64_t) },
+    { "decrypt<T>(array)", false, false, sizeof(uint64_t) },
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "\n"
+              << "Options:\n"
+              << "  --sizes LIST         message sizes in bytes, K/M/G suffixes allowed\n"
+              << "                       (default 16,64,256,1K,4K,16K,64K,256K,1M,4M,16M,64M,256M,1G)\n"
+              << "  --max-size N         drop default sizes above N\n"
+              << "  --threads LIST       thread counts (default 1,2,4,... up to all cores)\n"
+              << "  --kernels LIST       vaes,aesni,bitsliced,ttable (default: all available)\n"
+              << "  --key-bits N         128, 192 or 256 (default 128)\n"
+              << "  --ops LIST           operations (default: all), from:\n"
+              << "                       ";
+    for (const BenchOperation& op : OPERATIONS) {
+        std::cerr << op.name << (&op == &OPERATIONS[sizeof(OPERATIONS) / sizeof(OPERATIONS[0]) - 1] ? "\n" : ",");
+    }
+    std::cerr << "  --min-time SECONDS   minimum time per case and pass (default 0.2)\n"
+              << "  --ghz N              clock rate for cycles/byte where there is no TSC\n"
+              << "  --json FILE          write results as JSON (- for stdout)\n"
+              << "\n"
+              << "Multiple threads only apply to the pooled operations on sizes above "
+              << parallelChunkBytes() / 1024 << " KiB.\n";
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static size_t parseSize(const std::string& text) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    std::string suffix(end);
+    if (end == text.c_str() || suffix.size() > 1) {
+        throw std::invalid_argument("Invalid size '" + text + "'");
+    }
+    if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    } else if (suffix == "G" || suffix == "g") {
+        value <<= 30;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("Invalid size '" + text + "'");
+    }
+    if (value == 0 || value % 16 != 0) {
+        throw std::invalid_argument("Sizes must be nonzero multiples of 16 bytes: '" + text + "'");
+    }
+    return static_cast<size_t>(value);
+}
+
+static BenchOptions parseOptions(int argc, char* argv[]) {
+    BenchOptions options;
+    options.keyBytes = 16;
+    options.minSeconds = 0.2;
+    options.ghz = 0;
+    size_t maxSize = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + arg);
+        }
+        std::string value = argv[++i];
+        if (arg == "--sizes") {
+            for (const std::string& item : splitList(value)) {
+                options.sizes.push_back(parseSize(item));
+            }
+        } else if (arg == "--max-size") {
+            maxSize = parseSize(value);
+        } else if (arg == "--threads") {
+            for (const std::string& item : splitList(value)) {
+                int threads = std::atoi(item.c_str());
+                if (threads <= 0) {
+                    throw std::invalid_argument("Invalid thread count '" + item + "'");
+                }
+                options.threads.push_back(static_cast<unsigned int>(threads));
+            }
+        } else if (arg == "--kernels") {
+            options.kernels = splitList(value);
+        } else if (arg == "--key-bits") {
+            int bits = std::atoi(value.c_str());
+            if (bits != 128 && bits != 192 && bits != 256) {
+                throw std::invalid_argument("Key size must be 128, 192 or 256 bits");
+            }
+            options.keyBytes = static_cast<size_t>(bits / 8);
+        } else if (arg == "--ops") {
+            options.operations = splitList(value);
+        } else if (arg == "--min-time") {
+            options.minSeconds = std::atof(value.c_str());
+        } else if (arg == "--ghz") {
+            options.ghz = std::atof(value.c_str());
+        } else if (arg == "--json") {
+            options.jsonPath = value;
+        } else {
+            throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    
+    if (options.sizes.empty()) {
+        for (size_t size = 16; size <= (size_t(1) << 30); size *= 4) {
+            if (maxSize == 0 || size <= maxSize) {
+                options.sizes.push_back(size);
+            }
+        }
+    }
+    if (options.threads.empty()) {
+        unsigned int all = AESThreadPool::instance().size();
+        for (unsigned int threads = 1; threads < all; threads *= 2) {
+            options.threads.push_back(threads);
+        }
+        options.threads.push_back(all);
+    }
+    return options;
+}
+
+// Tick counter: the TSC on x86, the steady clock in nanoseconds elsewhere
+static uint64_t readTicks() {
+#ifdef AES_X86
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Cycles per tick of readTicks(), or 0 when the clock rate is unknown
+static double cyclesPerTick(const BenchOptions& options) {
+#ifdef AES_X86
+    (void)options;
+    return 1.0;
+#else
+    return options.ghz;
+#endif
+}
+
+// Clock rate in GHz that the cycle counts refer to, or 0 when unknown
+static double cycleRateGhz(const BenchOptions& options) {
+#ifdef AES_X86
+    (void)options;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startTicks = readTicks();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50)) {
+    }
+    uint64_t ticks = readTicks() - startTicks;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ticks / seconds / 1e9;
+#else
+    return options.ghz;
+#endif
+}
+
+static double percentile(std::vector<double>& sorted, double fraction) {
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Runs one case: picks an iteration count that fills minSeconds, measures
+// throughput over the whole loop, then the latency of each call
+static BenchResult runCase(const BenchCall& call, size_t size, unsigned int threads, double minSeconds, double tickCycles) {
+    typedef std::chrono::steady_clock Clock;
+    
+    // Warm up (page faults, pool start-up) and estimate the cost of one call;
+    // calls that already take longer than minSeconds are not repeated
+    Clock::time_point start = Clock::now();
+    call(size, threads);
+    double once = std::chrono::duration<double>(Clock::now() - start).count();
+    if (once < minSeconds) {
+        start = Clock::now();
+        call(size, threads);
+        once = std::max(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+    }
+    size_t iterations = static_cast<size_t>(std::min(std::max(minSeconds / once, 1.0), 10000000.0));
+    
+    uint64_t startTicks = readTicks();
+    start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        call(size, threads);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double cycles = (readTicks() - startTicks) * tickCycles;
+    
+    // Per-call timings; capped so tiny messages do not need huge sample buffers
+    size_t samples = std::min<size_t>(iterations, 1000000);
+    std::vector<double> latencies(samples);
+    for (size_t i = 0; i < samples; i++) {
+        Clock::time_point callStart = Clock::now();
+        call(size, threads);
+        latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - callStart).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    
+    BenchResult result;
+    result.size = size;
+    result.threads = threads;
+    result.iterations = iterations;
+    result.seconds = seconds;
+    result.gbps = static_cast<double>(size) * iterations / seconds / 1e9;
+    result.cyclesPerByte = cycles / (static_cast<double>(size) * iterations);
+    result.p50 = percentile(latencies, 0.5);
+    result.p90 = percentile(latencies, 0.9);
+    result.p99 = percentile(latencies, 0.99);
+    result.p999 = percentile(latencies, 0.999);
+    result.maxLatency = latencies.back();
+    return result;
+}
+
+// Buffers shared by every case, sized for the largest message
+struct BenchBuffers {
+    std::vector<unsigned char> in;
+    std::vector<unsigned char> out;
+    std::vector<unsigned char> cipher;    // valid ciphertext of in for gcm-decrypt, allocated on first use
+    unsigned char tag[16];
+};
+
+static BenchCall makeCall(const std::string& name, const AESKernel& kernel, const AESEncryption& aes,
+                          BenchBuffers& buffers, size_t size) {
+    const AESKeySchedule& ks = aes.sharedKey()->schedule();
+    static const unsigned char iv[16] = { 0 };
+    static const unsigned char nonce[12] = { 0 };
+    unsigned char* in = buffers.in.data();
+    unsigned char* out = buffers.out.data();
+    if (name == "gcm-decrypt" && buffers.cipher.size() < buffers.in.size()) {
+        buffers.cipher.resize(buffers.in.size());
+    }
+    unsigned char* cipher = buffers.cipher.data();
+    unsigned char* tag = buffers.tag;
+    
+    if (name == "block-encrypt") {
+        return [&kernel, &ks, in, out](size_t n, unsigned int) { kernel.encryptBlocks(ks, in, out, n / 16); };
+    }
+    if (name == "block-decrypt") {
+        return [&kernel, &ks, in, out](size_t n, unsigned int) { kernel.decryptBlocks(ks, in, out, n / 16); };
+    }
+    if (name == "cbc-encrypt") {
+        return [&kernel, &ks, in, out](size_t n, unsigned int) { cbcEncrypt(kernel, ks, iv, in, out, n); };
+    }
+    if (name == "cbc-decrypt") {
+        return [&kernel, &ks, in, out](size_t n, unsigned int t) { cbcDecryptParallel(kernel, ks, iv, in, out, n, t); };
+    }
+    if (name == "ctr") {
+        return [&kernel, &ks, in, out](size_t n, unsigned int t) { ctrXorParallel(kernel, ks, iv, in, out, n, t); };
+    }
+    if (name == "gcm-encrypt" || name == "gcm-decrypt") {
+        // The GHASH key for the kernel under test, derived once per case like AESKey does
+        std::shared_ptr<AESGhashKey> ghash = std::make_shared<AESGhashKey>();
+        ghashExpandKey(*ghash, kernel, ks);
+        if (name == "gcm-encrypt") {
+            return [&kernel, &ks, ghash, in, out, tag](size_t n, unsigned int t) {
+                gcmEncrypt(kernel, ks, *ghash, nonce, sizeof(nonce), nullptr, 0, in, out, n, tag, t);
+            };
+        }
+        gcmEncrypt(kernel, ks, *ghash, nonce, sizeof(nonce), nullptr, 0, in, cipher, size, tag, 0);
+        return [&kernel, &ks, ghash, cipher, out, tag](size_t n, unsigned int t) {
+            if (!gcmDecrypt(kernel, ks, *ghash, nonce, sizeof(nonce), nullptr, 0, cipher, out, n, tag, t)) {
+                throw std::runtime_error("GCM tag mismatch in benchmark");
+            }
+        };
+    }
+    if (name == "xts-encrypt") {
+        // 4 KiB sectors (one sector for smaller sizes); the data schedule
+        // doubles as the tweak schedule, which costs the same
+        if (size < 16) {
+            throw std::invalid_argument("xts-encrypt needs sizes of at least 16 bytes");
+        }
+        return [&kernel, &ks, in, out](size_t n, unsigned int t) {
+            size_t sectorSize = n < 4096 ? n : 4096;
+            xtsEncrypt(kernel, ks, ks, 0, in, out, sectorSize, n / sectorSize, t);
+        };
+    }
+    if (name == "cbc-messages") {
+        // Independent messages of mixed, packet-like sizes whose padded
+        // ciphertexts fill exactly size bytes of out
+        static const size_t PADDED_SIZES[] = { 48, 208, 576, 1408 };
+        if (size % 16 != 0) {
+            throw std::invalid_argument("cbc-messages needs sizes that are a multiple of 16 bytes");
+        }
+        std::shared_ptr<std::vector<AESCbcMessage> > messages = std::make_shared<std::vector<AESCbcMessage> >();
+        size_t offset = 0;
+        for (size_t i = 0; offset < size; i++) {
+            size_t padded = std::min(PADDED_SIZES[i % 4], size - offset);
+            AESCbcMessage message = { iv, in + offset, padded - 1 - i % 15, out + offset };
+            messages->push_back(message);
+            offset += padded;
+        }
+        return [&kernel, &ks, messages](size_t, unsigned int t) {
+            cbcEncryptMessages(kernel, ks, messages->data(), messages->size(), t);
+        };
+    }
+    if (name == "siv-encrypt" || name == "siv-messages") {
+        // Keys twice as long as the others: CMAC key and CTR key
+        std::vector<unsigned char> sivKey(2 * aes.sharedKey()->keySize(), 0x2b);
+        std::shared_ptr<AESSiv> siv = std::make_shared<AESSiv>(sivKey);
+        if (name == "siv-encrypt") {
+            std::shared_ptr<std::vector<unsigned char> > sealed =
+                std::make_shared<std::vector<unsigned char> >(AESSiv::encryptedSize(size));
+            return [siv, sealed, in](size_t n, unsigned int) { siv->encrypt(nullptr, 0, in, n, sealed->data()); };
+        }
+        // A column of 8-byte values under one associated-data string
+        static const unsigned char column[] = "column";
+        size_t count = size / 8;
+        std::shared_ptr<std::vector<unsigned char> > sealed =
+            std::make_shared<std::vector<unsigned char> >(count * AESSiv::encryptedSize(8));
+        std::shared_ptr<std::vector<AESSivMessage> > messages = std::make_shared<std::vector<AESSivMessage> >();
+        for (size_t i = 0; i < count; i++) {
+            AESSivMessage message = { in + 8 * i, 8, sealed->data() + i * AESSiv::encryptedSize(8) };
+            messages->push_back(message);
+        }
+        return [siv, sealed, messages](size_t, unsigned int t) {
+            siv->encryptMessages(messages->data(), messages->size(), column, sizeof(column) - 1, t);
+        };
+    }
+    if (name == "encryptString") {
+        std::shared_ptr<std::string> text = std::make_shared<std::string>(reinterpret_cast<const char*>(in), size);
+        return [&aes, text](size_t, unsigned int) { aes.encryptString(*text); };
+    }
+    if (name == "decryptString") {
+        std::shared_ptr<std::string> hex = std::make_shared<std::string>(
+            aes.encryptString(std::string(reinterpret_cast<const char*>(in), size)));
+        return [&aes, hex](size_t, unsigned int) { aes.decryptString(*hex); };
+    }
+    if (name == "encrypt<T>") {
+        return [&aes](size_t, unsigned int) { aes.encrypt<uint64_t>(0x0123456789abcdefULL); };
+    }
+    if (name == "decrypt<T>") {
+        std::shared_ptr<std::vector<unsigned char> > data =
+            std::make_shared<std::vector<unsigned char> >(aes.encrypt<uint64_t>(0x0123456789abcdefULL));
+        return [&aes, data](size_t, unsigned int) { aes.decrypt<uint64_t>(*data); };
+    }
+    if (name == "encryptFixed<T>") {
+        return [&aes](size_t, unsigned int) { aes.encryptFixed<uint64_t>(0x0123456789abcdefULL); };
+    }
+    if (name == "decrypt<T>(array)") {
+        std::array<uint8_t, AESEncryption::paddedSize<uint64_t> > data = aes.encryptFixed<uint64_t>(0x0123456789abcdefULL);
+        return [&aes, data](size_t, unsigned int) { aes.decrypt<uint64_t>(data); };
+    }
+    throw std::invalid_argument("Unknown operation '" + name + "'");
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results, size_t keyBytes, double ghz) {
+    out << std::setprecision(6);
+    out << "{\n"
+        << "  \"default_kernel\": \"" << activeKernel().name << "\",\n"
+        << "  \"key_bits\": " << keyBytes * 8 << ",\n"
+        << "  \"pool_threads\": " << AESThreadPool::instance().size() << ",\n"
+        << "  \"tuning\": \"" << aesTuning().describe() << "\",\n"
+        << "  \"cycle_rate_ghz\": " << ghz << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {\"operation\": \"" << r.operation << "\", \"kernel\": \"" << r.kernel << "\""
+            << ", \"size\": " << r.size << ", \"threads\": " << r.threads
+            << ", \"iterations\": " << r.iterations << ", \"seconds\": " << r.seconds
+            << ", \"gb_per_s\": " << r.gbps << ", \"cycles_per_byte\": ";
+        if (ghz > 0) {
+            out << r.cyclesPerByte;
+        } else {
+            out << "null";
+        }
+        out << ", \"latency_ns\": {\"p50\": " << r.p50 << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99
+            << ", \"p999\": " << r.p999 << ", \"max\": " << r.maxLatency << "}}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+static std::string formatSize(size_t size) {
+    std::ostringstream text;
+    if (size >= (size_t(1) << 30) && size % (size_t(1) << 30) == 0) {
+        text << (size >> 30) << "G";
+    } else if (size >= (size_t(1) << 20) && size % (size_t(1) << 20) == 0) {
+        text << (size >> 20) << "M";
+    } else if (size >= 1024 && size % 1024 == 0) {
+        text << (size >> 10) << "K";
+    } else {
+        text << size;
+    }
+    return text.str();
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+        
+        // Kernels available on this host, filtered by --kernels
+        std::vector<const AESKernel*> kernels;
+        const AESKernel* candidates[] = { vaesKernel(), aesniKernel(), &bitslicedKernel(), &ttableKernel() };
+        for (const AESKernel* kernel : candidates) {
+            if (kernel != nullptr && (options.kernels.empty() ||
+                std::find(options.kernels.begin(), options.kernels.end(), kernel->name) != options.kernels.end())) {
+                kernels.push_back(kernel);
+            }
+        }
+        
+        std::vector<const BenchOperation*> operations;
+        for (const BenchOperation& op : OPERATIONS) {
+            if (options.operations.empty() ||
+                std::find(options.operations.begin(), options.operations.end(), op.name) != options.operations.end()) {
+                operations.push_back(&op);
+            }
+        }
+        for (const std::string& name : options.operations) {
+            bool known = false;
+            for (const BenchOperation& op : OPERATIONS) {
+                known = known || op.name == name;
+            }
+            if (!known) {
+                throw std::invalid_argument("Unknown operation '" + name + "'");
+            }
+        }
+        
+        size_t maxSize = *std::max_element(options.sizes.begin(), options.sizes.end());
+        BenchBuffers buffers;
+        buffers.in.resize(maxSize);
+        buffers.out.resize(maxSize);
+        for (size_t i = 0; i < maxSize; i++) {
+            buffers.in[i] = static_cast<unsigned char>(i * 131 + 7);
+        }
+        
+        AESEncryption aes(std::vector<unsigned char>(options.keyBytes, 0x2b), std::vector<unsigned char>(16, 0));
+        double ghz = cycleRateGhz(options);
+        double tickCycles = cyclesPerTick(options);
+        
+        std::vector<BenchResult> results;
+        bool table = options.jsonPath != "-";
+        if (table) {
+            std::cout << std::left << std::setw(19) << "operation" << std::setw(11) << "kernel" << std::right
+                      << std::setw(7) << "size" << std::setw(8) << "threads" << std::setw(10) << "GB/s"
+                      << std::setw(10) << "cyc/B" << std::setw(11) << "p50 ns" << std::setw(11) << "p99 ns"
+                      << std::setw(12) << "p99.9 ns" << std::endl;
+        }
+        
+        for (const BenchOperation* op : operations) {
+            std::vector<const AESKernel*> opKernels = op->perKernel ? kernels : std::vector<const AESKernel*>(1, &activeKernel());
+            std::vector<size_t> sizes = op->fixedSize != 0 ? std::vector<size_t>(1, op->fixedSize) : options.sizes;
+            for (const AESKernel* kernel : opKernels) {
+                for (size_t size : sizes) {
+                    // The kernel variant for the benchmark key's round count
+                    const AESKernel& variant = kernel->forRounds(aes.sharedKey()->schedule().rounds);
+                    BenchCall call = makeCall(op->name, variant, aes, buffers, size);
+                    for (unsigned int threads : options.threads) {
+                        // Serial operations and single-chunk messages ignore the thread count
+                        if (threads > 1 && (!op->threaded || size <= parallelChunkBytes())) {
+                            continue;
+                        }
+                        BenchResult result = runCase(call, size, threads, options.minSeconds, tickCycles);
+                        result.operation = op->name;
+                        result.kernel = kernel->name;
+                        results.push_back(result);
+                        
+                        if (table) {
+                            std::cout << std::left << std::setw(19) << result.operation << std::setw(11) << result.kernel
+                                      << std::right << std::setw(7) << formatSize(size) << std::setw(8) << threads
+                                      << std::fixed << std::setprecision(3) << std::setw(10) << result.gbps
+                                      << std::setprecision(2) << std::setw(10) << result.cyclesPerByte
+                                      << std::setprecision(0) << std::setw(11) << result.p50 << std::setw(11) << result.p99
+                                      << std::setw(12) << result.p999 << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+        
+        if (options.jsonPath == "-") {
+            writeJson(std::cout, results, options.keyBytes, ghz);
+        } else if (!options.jsonPath.empty()) {
+            std::ofstream file(options.jsonPath.c_str());
+            writeJson(file, results, options.keyBytes, ghz);
+            if (!file) {
+                throw std::runtime_error("Cannot write '" + options.jsonPath + "'");
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,233 @@
+#include "aes_codec.h"
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AES_CODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const uint8_t INVALID = 0xff;
+
+// Reverse lookup tables, built once: character -> digit value or INVALID
+struct CodecTables {
+    uint8_t hex[256];
+    uint8_t base64[256];
+    
+    CodecTables() {
+        std::memset(hex, INVALID, sizeof(hex));
+        std::memset(base64, INVALID, sizeof(base64));
+        for (int i = 0; i < 16; i++) {
+            hex[static_cast<uint8_t>(HEX_DIGITS[i])] = static_cast<uint8_t>(i);
+            if (i >= 10) {
+                hex[static_cast<uint8_t>(HEX_DIGITS[i] - 'a' + 'A')] = static_cast<uint8_t>(i);
+            }
+        }
+        for (int i = 0; i < 64; i++) {
+            base64[static_cast<uint8_t>(BASE64_ALPHABET[i])] = static_cast<uint8_t>(i);
+        }
+    }
+};
+
+static const CodecTables& tables() {
+    static const CodecTables instance;
+    return instance;
+}
+
+#ifdef AES_CODEC_SSE2
+
+// Nibble values 0..15 to lowercase hex digits
+static inline __m128i nibblesToHex(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    return _mm_add_epi8(nibbles, _mm_add_epi8(_mm_set1_epi8('0'), letters));
+}
+
+// Hex digits to nibble values; clears valid to zero bits for any other character
+static inline __m128i hexToNibbles(__m128i chars, int& valid) {
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    
+    // Unsigned range checks: x <= n exactly when saturating x - n is zero
+    __m128i zero = _mm_setzero_si128();
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_subs_epu8(digit, _mm_set1_epi8(9)), zero);
+    __m128i isLetter = _mm_cmpeq_epi8(_mm_subs_epu8(letter, _mm_set1_epi8(5)), zero);
+    valid &= _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter));
+    
+    return _mm_or_si128(_mm_and_si128(isDigit, digit),
+                        _mm_andnot_si128(isDigit, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+#endif
+
+void hexEncode(const uint8_t* in, size_t len, char* out) {
+    size_t i = 0;
+#ifdef AES_CODEC_SSE2
+    const __m128i lowNibble = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibble);
+        __m128i low = _mm_and_si128(bytes, lowNibble);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2), nibblesToHex(_mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2 + 16), nibblesToHex(_mm_unpackhi_epi8(high, low)));
+    }
+#endif
+    for (; i < len; i++) {
+        out[i * 2] = HEX_DIGITS[in[i] >> 4];
+        out[i * 2 + 1] = HEX_DIGITS[in[i] & 0x0f];
+    }
+}
+
+bool hexDecode(const char* in, size_t len, uint8_t* out) {
+    if (len % 2 != 0) {
+        return false;
+    }
+    
+    size_t i = 0;
+#ifdef AES_CODEC_SSE2
+    int valid = 0xffff;
+    const __m128i lowByte = _mm_set1_epi16(0x00ff);
+    for (; i + 32 <= len; i += 32) {
+        __m128i first = hexToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), valid);
+        __m128i second = hexToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16)), valid);
+        
+        // Each 16-bit lane holds (high digit, low digit); combine to one byte
+        first = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(first, lowByte), 4), _mm_srli_epi16(first, 8));
+        second = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(second, lowByte), 4), _mm_srli_epi16(second, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 2), _mm_packus_epi16(first, second));
+    }
+    if (valid != 0xffff) {
+        return false;
+    }
+#endif
+
+    const uint8_t* hex = tables().hex;
+    uint8_t bad = 0;
+    for (; i < len; i += 2) {
+        uint8_t high = hex[static_cast<uint8_t>(in[i])];
+        uint8_t low = hex[static_cast<uint8_t>(in[i + 1])];
+        bad |= (high | low) & 0xf0;
+        out[i / 2] = static_cast<uint8_t>((high << 4) | (low & 0x0f));
+    }
+    return bad == 0;
+}
+
+void base64Encode(const uint8_t* in, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t group = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+        out[0] = BASE64_ALPHABET[group >> 18];
+        out[1] = BASE64_ALPHABET[(group >> 12) & 0x3f];
+        out[2] = BASE64_ALPHABET[(group >> 6) & 0x3f];
+        out[3] = BASE64_ALPHABET[group & 0x3f];
+        out += 4;
+    }
+    
+    size_t rest = len - i;
+    if (rest > 0) {
+        uint32_t group = static_cast<uint32_t>(in[i]) << 16;
+        if (rest == 2) {
+            group |= static_cast<uint32_t>(in[i + 1]) << 8;
+        }
+        out[0] = BASE64_ALPHABET[group >> 18];
+        out[1] = BASE64_ALPHABET[(group >> 12) & 0x3f];
+        out[2] = rest == 2 ? BASE64_ALPHABET[(group >> 6) & 0x3f] : '=';
+        out[3] = '=';
+    }
+}
+
+bool base64Decode(const char* in, size_t len, uint8_t* out, size_t* outLen) {
+    if (len % 4 != 0) {
+        return false;
+    }
+    
+    size_t padding = 0;
+    if (len > 0 && in[len - 1] == '=') {
+        padding = in[len - 2] == '=' ? 2 : 1;
+    }
+    
+    const uint8_t* table = tables().base64;
+    uint8_t bad = 0;
+    size_t written = 0;
+    size_t full = len - (padding > 0 ? 4 : 0);
+    for (size_t i = 0; i < full; i += 4) {
+        uint8_t a = table[static_cast<uint8_t>(in[i])];
+        uint8_t b = table[static_cast<uint8_t>(in[i + 1])];
+        uint8_t c = table[static_cast<uint8_t>(in[i + 2])];
+        uint8_t d = table[static_cast<uint8_t>(in[i + 3])];
+        bad |= a | b | c | d;
+        uint32_t group = (static_cast<uint32_t>(a) << 18) | (static_cast<uint32_t>(b) << 12) |
+                         (static_cast<uint32_t>(c) << 6) | d;
+        out[written++] = static_cast<uint8_t>(group >> 16);
+        out[written++] = static_cast<uint8_t>(group >> 8);
+        out[written++] = static_cast<uint8_t>(group);
+    }
+    
+    if (padding > 0) {
+        const char* last = in + full;
+        uint8_t a = table[static_cast<uint8_t>(last[0])];
+        uint8_t b = table[static_cast<uint8_t>(last[1])];
+        uint8_t c = padding == 1 ? table[static_cast<uint8_t>(last[2])] : 0;
+        bad |= a | b | c;
+        
+        // The bits below the last encoded byte must be zero (canonical form)
+        if ((padding == 2 && (b & 0x0f) != 0) || (padding == 1 && (c & 0x03) != 0)) {
+            return false;
+        }
+        out[written++] = static_cast<uint8_t>((a << 2) | (b >> 4));
+        if (padding == 1) {
+            out[written++] = static_cast<uint8_t>((b << 4) | (c >> 2));
+        }
+    }
+    
+    // Any INVALID entry has the top bits set, which no 6-bit value does
+    if ((bad & 0xc0) != 0) {
+        return false;
+    }
+    *outLen = written;
+    return true;
+}
+
+std::string encodeBytes(const uint8_t* data, size_t len, AESEncoding encoding) {
+    std::string result;
+    switch (encoding) {
+    case AESEncoding::HEX:
+        result.resize(hexEncodedSize(len));
+        hexEncode(data, len, &result[0]);
+        break;
+    case AESEncoding::BASE64:
+        result.resize(base64EncodedSize(len));
+        base64Encode(data, len, &result[0]);
+        break;
+    case AESEncoding::RAW:
+        result.assign(reinterpret_cast<const char*>(data), len);
+        break;
+    }
+    return result;
+}
+
+std::vector<unsigned char> decodeBytes(const char* text, size_t len, AESEncoding encoding) {
+    std::vector<unsigned char> result;
+    switch (encoding) {
+    case AESEncoding::HEX:
+        result.resize(len / 2);
+        if (!hexDecode(text, len, result.data())) {
+            throw std::invalid_argument("Invalid hex string");
+        }
+        break;
+    case AESEncoding::BASE64: {
+        result.resize(base64DecodedMaxSize(len));
+        size_t decoded = 0;
+        if (!base64Decode(text, len, result.data(), &decoded)) {
+            throw std::invalid_argument("Invalid base64 string");
+        }
+        result.resize(decoded);
+        break;
+    }
+    case AESEncoding::RAW:
+        result.assign(text, text + len);
+        break;
+    }
+    return result;
+}
@@ -0,0 +1,40 @@
+#ifndef AES_CODEC_H
+#define AES_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Text encodings for ciphertext. RAW keeps the bytes as they are (in a
+// std::string where a string is returned).
+enum class AESEncoding { HEX, BASE64, RAW };
+
+// Table-driven hex and base64 codecs (SSE2 for hex on x86-64).
+//
+// The pointer functions never allocate or throw: encoders write exactly
+// *EncodedSize(len) characters (no terminator) and decoders return false on
+// malformed input, leaving the output unspecified. Hex output is lowercase;
+// hex input accepts either case. Base64 uses the standard alphabet with '='
+// padding and rejects whitespace and non-canonical trailing bits.
+
+inline size_t hexEncodedSize(size_t len) { return len * 2; }
+void hexEncode(const uint8_t* in, size_t len, char* out);
+// len must be even; writes len / 2 bytes
+bool hexDecode(const char* in, size_t len, uint8_t* out);
+
+inline size_t base64EncodedSize(size_t len) { return (len + 2) / 3 * 4; }
+void base64Encode(const uint8_t* in, size_t len, char* out);
+// Upper bound on the decoded size of len characters
+inline size_t base64DecodedMaxSize(size_t len) { return len / 4 * 3; }
+// Writes the decoded bytes to out and their count to *outLen
+bool base64Decode(const char* in, size_t len, uint8_t* out, size_t* outLen);
+
+// Convenience wrappers; decodeBytes throws std::invalid_argument on malformed input
+std::string encodeBytes(const uint8_t* data, size_t len, AESEncoding encoding);
+std::vector<unsigned char> decodeBytes(const char* text, size_t len, AESEncoding encoding);
+inline std::vector<unsigned char> decodeBytes(const std::string& text, AESEncoding encoding) {
+    return decodeBytes(text.data(), text.size(), encoding);
+}
+
+#endif
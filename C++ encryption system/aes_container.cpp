@@ -0,0 +1,256 @@
+#include "aes_container.h"
+#include "aes_mapped_file.h"
+#include "aes_thread_pool.h"
+#include <cstring>
+#include <stdexcept>
+
+static const char HEADER_MAGIC[8] = { 'A', 'E', 'S', 'C', 'H', 'N', 'K', '1' };
+static const char FOOTER_MAGIC[8] = { 'A', 'E', 'S', 'C', 'I', 'D', 'X', '1' };
+
+static const size_t NONCE_SIZE = 12;
+// Chunk numbers run up to 0xfffffffe; the last nonce belongs to the index
+static const uint32_t INDEX_NONCE = 0xffffffff;
+
+static void storeLittleEndian(uint8_t* p, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+static uint64_t loadLittleEndian(const uint8_t* p, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = bytes; i > 0; i--) {
+        v = (v << 8) | p[i - 1];
+    }
+    return v;
+}
+
+// file id || chunk number as a 32-bit big-endian integer
+static void chunkNonce(const uint8_t* fileId, uint32_t chunk, uint8_t* nonce) {
+    std::memcpy(nonce, fileId, AESContainer::FILE_ID_SIZE);
+    for (int i = 0; i < 4; i++) {
+        nonce[AESContainer::FILE_ID_SIZE + i] = static_cast<uint8_t>(chunk >> (24 - 8 * i));
+    }
+}
+
+static size_t chunksFor(size_t len, size_t chunkSize) {
+    return len / chunkSize + (len % chunkSize != 0 ? 1 : 0);
+}
+
+static void checkChunkSize(size_t chunkSize) {
+    if (chunkSize == 0 || chunkSize % 16 != 0 || chunkSize > AESContainer::MAX_CHUNK_SIZE) {
+        throw std::invalid_argument("Container chunk size must be a non-zero multiple of 16 bytes up to 1 GiB");
+    }
+}
+
+// Additional data of the index tag: header, index and the length field of the footer
+static std::vector<uint8_t> indexAad(const uint8_t* header, const uint8_t* index, size_t chunks, const uint8_t* length) {
+    std::vector<uint8_t> aad(AESContainer::HEADER_SIZE + chunks * AESContainer::TAG_SIZE + 8);
+    std::memcpy(aad.data(), header, AESContainer::HEADER_SIZE);
+    if (chunks > 0) {
+        std::memcpy(aad.data() + AESContainer::HEADER_SIZE, index, chunks * AESContainer::TAG_SIZE);
+    }
+    std::memcpy(aad.data() + aad.size() - 8, length, 8);
+    return aad;
+}
+
+static void writeHeader(uint8_t* header, size_t chunkSize, const uint8_t* fileId) {
+    std::memset(header, 0, AESContainer::HEADER_SIZE);
+    std::memcpy(header, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+    storeLittleEndian(header + 8, chunkSize, 4);
+    std::memcpy(header + 16, fileId, AESContainer::FILE_ID_SIZE);
+}
+
+// Seals chunks [first, first + chunks) of the plaintext at in into out, and
+// their tags into index
+static void sealChunks(const AESKey& key, const uint8_t* header, size_t chunkSize, size_t first, size_t chunks,
+                       const uint8_t* in, size_t len, uint8_t* out, uint8_t* index, unsigned int threads) {
+    AESThreadPool::instance().parallelFor(chunks, threads, [&](size_t i) {
+        uint8_t nonce[NONCE_SIZE];
+        chunkNonce(header + 16, static_cast<uint32_t>(first + i), nonce);
+        size_t offset = i * chunkSize;
+        size_t bytes = len - offset < chunkSize ? len - offset : chunkSize;
+        key.encryptGcm(nonce, NONCE_SIZE, header, AESContainer::HEADER_SIZE, in + offset, bytes, out + offset,
+                       index + i * AESContainer::TAG_SIZE, 1);
+    });
+}
+
+// Fills in the footer after the index of chunks tags for len bytes of plaintext
+static void writeFooter(const AESKey& key, const uint8_t* header, const uint8_t* index, size_t chunks, uint64_t len,
+                        uint8_t* footer) {
+    std::memset(footer, 0, AESContainer::FOOTER_SIZE);
+    storeLittleEndian(footer, len, 8);
+    std::memcpy(footer + 24, FOOTER_MAGIC, sizeof(FOOTER_MAGIC));
+    
+    uint8_t nonce[NONCE_SIZE];
+    chunkNonce(header + 16, INDEX_NONCE, nonce);
+    std::vector<uint8_t> aad = indexAad(header, index, chunks, footer);
+    key.encryptGcm(nonce, NONCE_SIZE, aad.data(), aad.size(), nullptr, 0, nullptr, footer + 8, 1);
+}
+
+size_t AESContainer::encryptedSize(size_t len, size_t chunkSize) {
+    checkChunkSize(chunkSize);
+    return HEADER_SIZE + len + chunksFor(len, chunkSize) * TAG_SIZE + FOOTER_SIZE;
+}
+
+void AESContainer::encrypt(const AESKey& key, const uint8_t* fileId, const uint8_t* in, size_t len, uint8_t* out,
+                           size_t chunkSize, unsigned int threads) {
+    checkChunkSize(chunkSize);
+    size_t chunks = chunksFor(len, chunkSize);
+    if (chunks >= INDEX_NONCE) {
+        throw std::invalid_argument("Container plaintext has too many chunks");
+    }
+    
+    uint8_t* header = out;
+    writeHeader(header, chunkSize, fileId);
+    uint8_t* index = out + HEADER_SIZE + len;
+    sealChunks(key, header, chunkSize, 0, chunks, in, len, out + HEADER_SIZE, index, threads);
+    writeFooter(key, header, index, chunks, len, index + chunks * TAG_SIZE);
+}
+
+AESContainerWriter::AESContainerWriter(std::shared_ptr<const AESKey> key, const uint8_t* fileId, size_t chunkSize,
+                                       unsigned int threads)
+    : key(std::move(key)), chunkBytes(chunkSize), threads(threads), length(0), partial(false), finished(false) {
+    if (!this->key) {
+        throw std::invalid_argument("Key must not be null");
+    }
+    checkChunkSize(chunkSize);
+    writeHeader(headerBytes, chunkSize, fileId);
+}
+
+void AESContainerWriter::write(const uint8_t* in, size_t len, uint8_t* out) {
+    if (finished || (partial && len > 0)) {
+        throw std::invalid_argument("Container writes after a partial chunk or finish()");
+    }
+    size_t first = index.size() / AESContainer::TAG_SIZE;
+    size_t chunks = chunksFor(len, chunkBytes);
+    if (chunks >= INDEX_NONCE - first) {
+        throw std::invalid_argument("Container plaintext has too many chunks");
+    }
+    
+    index.resize(index.size() + chunks * AESContainer::TAG_SIZE);
+    sealChunks(*key, headerBytes, chunkBytes, first, chunks, in, len, out, &index[first * AESContainer::TAG_SIZE],
+               threads);
+    length += len;
+    partial = len % chunkBytes != 0;
+}
+
+std::vector<uint8_t> AESContainerWriter::finish() {
+    if (finished) {
+        throw std::invalid_argument("Container is already finished");
+    }
+    finished = true;
+    size_t chunks = index.size() / AESContainer::TAG_SIZE;
+    std::vector<uint8_t> trailer(index);
+    trailer.resize(index.size() + AESContainer::FOOTER_SIZE);
+    writeFooter(*key, headerBytes, index.data(), chunks, length, &trailer[index.size()]);
+    return trailer;
+}
+
+AESContainerReader::AESContainerReader(std::shared_ptr<const AESKey> key, const uint8_t* data, size_t size)
+    : key(std::move(key)), data(data), length(0), chunkBytes(0), chunks(0) {
+    open(size);
+}
+
+AESContainerReader::AESContainerReader(std::shared_ptr<const AESKey> key, const std::string& path)
+    : key(std::move(key)), file(new AESMappedFile(path, AESMappedFile::READ_RANDOM)), data(file->data()),
+      length(0), chunkBytes(0), chunks(0) {
+    open(file->size());
+}
+
+AESContainerReader::~AESContainerReader() {
+}
+
+void AESContainerReader::open(size_t size) {
+    if (!key) {
+        throw std::invalid_argument("Key must not be null");
+    }
+    
+    const size_t minimum = AESContainer::HEADER_SIZE + AESContainer::FOOTER_SIZE;
+    if (size < minimum) {
+        throw std::runtime_error("Not an encrypted container");
+    }
+    const uint8_t* header = data;
+    const uint8_t* footer = data + size - AESContainer::FOOTER_SIZE;
+    if (std::memcmp(header, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0 ||
+        std::memcmp(footer + 24, FOOTER_MAGIC, sizeof(FOOTER_MAGIC)) != 0) {
+        throw std::runtime_error("Not an encrypted container");
+    }
+    if (loadLittleEndian(header + 12, 4) != 0 || loadLittleEndian(header + 24, 8) != 0) {
+        throw std::runtime_error("Unsupported container version");
+    }
+    
+    chunkBytes = static_cast<size_t>(loadLittleEndian(header + 8, 4));
+    uint64_t plainLength = loadLittleEndian(footer, 8);
+    if (chunkBytes == 0 || chunkBytes % 16 != 0 || chunkBytes > AESContainer::MAX_CHUNK_SIZE ||
+        plainLength > size - minimum) {
+        throw std::runtime_error("Container is truncated or corrupt");
+    }
+    length = static_cast<size_t>(plainLength);
+    chunks = chunksFor(length, chunkBytes);
+    if (chunks >= INDEX_NONCE || AESContainer::encryptedSize(length, chunkBytes) != size) {
+        throw std::runtime_error("Container is truncated or corrupt");
+    }
+    
+    uint8_t nonce[NONCE_SIZE];
+    chunkNonce(header + 16, INDEX_NONCE, nonce);
+    std::vector<uint8_t> aad = indexAad(header, data + AESContainer::HEADER_SIZE + length, chunks, footer);
+    try {
+        key->decryptGcm(nonce, NONCE_SIZE, aad.data(), aad.size(), nullptr, 0, nullptr, footer + 8, 1);
+    } catch (const std::runtime_error&) {
+        throw std::runtime_error("Container index failed authentication");
+    }
+}
+
+void AESContainerReader::read(size_t offset, size_t len, uint8_t* out, unsigned int threads) const {
+    if (offset > length || len > length - offset) {
+        throw std::out_of_range("Read past the end of the container");
+    }
+    if (len == 0) {
+        return;
+    }
+    
+    const uint8_t* header = data;
+    const uint8_t* index = data + AESContainer::HEADER_SIZE + length;
+    size_t first = offset / chunkBytes;
+    size_t last = (offset + len - 1) / chunkBytes;
+    
+    try {
+        AESThreadPool::instance().parallelFor(last - first + 1, threads, [&](size_t i) {
+            size_t chunk = first + i;
+            size_t chunkStart = chunk * chunkBytes;
+            size_t chunkLength = length - chunkStart < chunkBytes ? length - chunkStart : chunkBytes;
+            size_t begin = offset > chunkStart ? offset : chunkStart;
+            size_t end = offset + len < chunkStart + chunkLength ? offset + len : chunkStart + chunkLength;
+            
+            uint8_t nonce[NONCE_SIZE];
+            chunkNonce(header + 16, static_cast<uint32_t>(chunk), nonce);
+            const uint8_t* in = data + AESContainer::HEADER_SIZE + chunkStart;
+            const uint8_t* tag = index + chunk * AESContainer::TAG_SIZE;
+            
+            // The tag covers the whole chunk, so a chunk the range only
+            // partly overlaps is decrypted into scratch space first
+            if (begin == chunkStart && end == chunkStart + chunkLength) {
+                key->decryptGcm(nonce, NONCE_SIZE, header, AESContainer::HEADER_SIZE, in, chunkLength,
+                                out + (chunkStart - offset), tag, 1);
+            } else {
+                std::vector<uint8_t> plain(chunkLength);
+                key->decryptGcm(nonce, NONCE_SIZE, header, AESContainer::HEADER_SIZE, in, chunkLength,
+                                plain.data(), tag, 1);
+                std::memcpy(out + (begin - offset), plain.data() + (begin - chunkStart), end - begin);
+            }
+        });
+    } catch (...) {
+        std::memset(out, 0, len);
+        throw;
+    }
+}
+
+std::vector<unsigned char> AESContainerReader::read(size_t offset, size_t len) const {
+    if (offset > length || len > length - offset) {
+        throw std::out_of_range("Read past the end of the container");
+    }
+    std::vector<unsigned char> result(len);
+    read(offset, len, result.data());
+    return result;
+}
@@ -0,0 +1,130 @@
+#ifndef AES_CONTAINER_H
+#define AES_CONTAINER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "aes_encryption.h"
+
+class AESMappedFile;
+
+// Seekable encrypted container. The plaintext is cut into fixed-size chunks
+// that are encrypted with AES-GCM independently, so any byte range can be
+// read by authenticating and decrypting only the chunks it overlaps. Layout,
+// with all integers little-endian:
+//
+//   header  32 bytes  "AESCHNK1", chunk size (4), zero (4), file id (8), zero (8)
+//   chunks            the ciphertext of chunk 0, 1, ... back to back; every
+//                     chunk but the last is exactly chunk size bytes
+//   index   16 * n    the GCM tag of each chunk
+//   footer  32 bytes  plaintext length (8), index tag (16), "AESCIDX1"
+//
+// Chunk i is encrypted under the nonce file id || i (a 32-bit big-endian
+// chunk number) with the header as additional data. The index tag is a GMAC
+// under the nonce file id || 0xffffffff over the header, the index and the
+// length, so a reader detects truncated, reordered or spliced chunks as well
+// as modified ones. Ciphertext stays at the same offset as its plaintext
+// (plus the header), so the index needs no offsets.
+//
+// The file id keeps the nonces of different containers apart. It must never
+// repeat under one key; 8 random bytes are safe for about 2^24 containers.
+class AESContainer {
+public:
+    static const size_t HEADER_SIZE = 32;
+    static const size_t FOOTER_SIZE = 32;
+    static const size_t TAG_SIZE = 16;
+    static const size_t FILE_ID_SIZE = 8;
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+    // Chunk sizes are multiples of 16 bytes up to this size
+    static const size_t MAX_CHUNK_SIZE = 1024 * 1024 * 1024;
+    
+    // Size of the container for len bytes of plaintext
+    static size_t encryptedSize(size_t len, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+    
+    // Writes the container for len bytes at in to out, which holds
+    // encryptedSize(len, chunkSize) bytes and must not overlap in. Chunks are
+    // encrypted on the worker pool; threads = 0 uses the pool default. Throws
+    // std::invalid_argument for a bad chunk size or a plaintext of 2^32 - 1
+    // chunks or more.
+    static void encrypt(const AESKey& key, const uint8_t* fileId, const uint8_t* in, size_t len, uint8_t* out,
+                        size_t chunkSize = DEFAULT_CHUNK_SIZE, unsigned int threads = 0);
+};
+
+// Writes a container front to back while the plaintext arrives, for outputs
+// that cannot seek such as pipes: the header first, then each chunk as soon
+// as it is sealed, then the index and footer. The bytes are the same as
+// AESContainer::encrypt writes for the same key and file id.
+class AESContainerWriter {
+public:
+    // Throws std::invalid_argument for a bad chunk size
+    AESContainerWriter(std::shared_ptr<const AESKey> key, const uint8_t* fileId,
+                       size_t chunkSize = AESContainer::DEFAULT_CHUNK_SIZE, unsigned int threads = 0);
+    
+    // The HEADER_SIZE bytes that start the container
+    const uint8_t* header() const { return headerBytes; }
+    
+    // Encrypts the next len bytes of plaintext into out, which holds len bytes
+    // and must not overlap in. Every call but the last must cover whole
+    // chunks; the chunks are sealed on the worker pool. Throws
+    // std::invalid_argument otherwise, or once the container would reach
+    // 2^32 - 1 chunks.
+    void write(const uint8_t* in, size_t len, uint8_t* out);
+    
+    // Seals the index and returns the bytes that end the container (the
+    // index and the footer). No writes may follow.
+    std::vector<uint8_t> finish();
+    
+private:
+    std::shared_ptr<const AESKey> key;
+    uint8_t headerBytes[AESContainer::HEADER_SIZE];
+    size_t chunkBytes;
+    unsigned int threads;
+    std::vector<uint8_t> index;
+    uint64_t length;
+    bool partial;     // a call wrote a partial chunk, so it was the last one
+    bool finished;
+};
+
+// Random-access reader for a container in memory or in a file. The
+// constructor checks the layout and authenticates the index, which costs one
+// GHASH over the index and does not touch the chunks; it throws
+// std::runtime_error if either fails. The reader is immutable afterwards and
+// can be shared between threads.
+class AESContainerReader {
+public:
+    // data must stay valid while the reader is in use
+    AESContainerReader(std::shared_ptr<const AESKey> key, const uint8_t* data, size_t size);
+    // Maps the file; only the pages of the chunks that are read get loaded
+    AESContainerReader(std::shared_ptr<const AESKey> key, const std::string& path);
+    ~AESContainerReader();
+    
+    // Plaintext length
+    size_t size() const { return length; }
+    size_t chunkSize() const { return chunkBytes; }
+    size_t chunkCount() const { return chunks; }
+    
+    // Decrypts plaintext bytes [offset, offset + len) into out. Only the
+    // chunks overlapping the range are authenticated and decrypted, several
+    // at once on the worker pool (threads = 0 uses the pool default). Throws
+    // std::out_of_range for a range past the end, and std::runtime_error if a
+    // chunk does not verify, in which case out is zeroed.
+    void read(size_t offset, size_t len, uint8_t* out, unsigned int threads = 0) const;
+    std::vector<unsigned char> read(size_t offset, size_t len) const;
+    
+private:
+    std::shared_ptr<const AESKey> key;
+    std::unique_ptr<AESMappedFile> file;
+    const uint8_t* data;
+    size_t length;
+    size_t chunkBytes;
+    size_t chunks;
+    
+    void open(size_t size);
+    
+    AESContainerReader(const AESContainerReader&);
+    AESContainerReader& operator=(const AESContainerReader&);
+};
+
+#endif
@@ -1,417 +1,657 @@
 #include "aes_encryption.h"
-#include <iostream>
-#include <iomanip>
-#include <sstream>
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_stats.h"
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
 
-// AES S-box for SubBytes operation
-static const unsigned char SBOX[256] = {
-    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
-    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
-    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
-    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
-    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
-    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
-    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
-    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
-    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
-    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
-    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
-    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
-    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
-    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
-    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
-    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
-};
-
-// Inverse S-box for InvSubBytes operation
-static const unsigned char INV_SBOX[256] = {
-    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
-    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
-    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
-    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
-    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
-    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
-    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
-    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
-    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
-    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
-    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
-    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
-    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
-    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
-    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
-    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
-};
-
-// Rcon values for key expansion
-static const unsigned char RCON[11] = {
-    0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
-};
-
-// Galois field multiplication for MixColumns
-unsigned char gmul(unsigned char a, unsigned char b) {
-    unsigned char p = 0;
-    unsigned char high_bit;
+// Multiplication in GF(2^8) modulo x^8 + x^4 + x^3 + x + 1, used only to
+// build the tables below at compile time
+static constexpr uint8_t gmul(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
     for (int i = 0; i < 8; i++) {
         if (b & 1) {
             p ^= a;
         }
-        high_bit = (a & 0x80);
-        a <<= 1;
-        if (high_bit) {
-            a ^= 0x1b; // Irreducible polynomial x^8 + x^4 + x^3 + x + 1
-        }
+        a = static_cast<uint8_t>((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
         b >>= 1;
     }
     return p;
 }
 
-// Constructors
-AESEncryption::AESEncryption(const std::vector<unsigned char>& key, const std::vector<unsigned char>& iv) {
-    // AES-128 requires a 16-byte key
-    if (key.size() != 16) {
-        throw std::invalid_argument("Key must be 16 bytes (128 bits) for AES-128");
-    }
-    
-    // IV should also be 16 bytes
-    if (iv.size() != 16) {
-        throw std::invalid_argument("IV must be 16 bytes (128 bits)");
-    }
-    
-    this->key = key;
-    this->iv = iv;
+static constexpr uint8_t rotl8(uint8_t x, int n) {
+    return static_cast<uint8_t>((x << n) | (x >> (8 - n)));
 }
 
-AESEncryption::AESEncryption(const std::string& keyStr, const std::string& ivStr) {
-    // Convert string key to bytes
-    for (char c : keyStr) {
-        key.push_back(static_cast<unsigned char>(c));
-    }
+// Lookup tables, generated by the compiler and stored as constant data.
+// sbox and invSbox are SubBytes and InvSubBytes, rcon the key expansion round
+// constants. te[x] is the MixColumns column produced by SubBytes(x) in row 0,
+// td[x] the InvMixColumns column produced by InvSubBytes(x) in row 0; the
+// contribution of rows 1-3 is the same word rotated left by 8, 16 or 24 bits.
+struct AESTables {
+    uint8_t sbox[256];
+    uint8_t invSbox[256];
+    uint8_t rcon[11];
+    uint32_t te[256];
+    uint32_t td[256];
+};
+
+static constexpr AESTables makeTables() {
+    AESTables t = {};
+    
+    // S-box: p runs through every non-zero element as powers of the generator
+    // 3 while q tracks its inverse; the inverse then goes through the affine
+    // transformation (FIPS-197 5.1.1). Zero has no inverse and maps to 0x63.
+    uint8_t p = 1;
+    uint8_t q = 1;
+    do {
+        p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0));
+        q = static_cast<uint8_t>(q ^ (q << 1));
+        q = static_cast<uint8_t>(q ^ (q << 2));
+        q = static_cast<uint8_t>(q ^ (q << 4));
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+        t.sbox[p] = static_cast<uint8_t>(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63);
+    } while (p != 1);
+    t.sbox[0] = 0x63;
     
-    // Ensure key is exactly 16 bytes (pad or truncate)
-    if (key.size() < 16) {
-        // Pad with zeros
-        key.resize(16, 0);
-    } else if (key.size() > 16) {
-        // Truncate
-        key.resize(16);
+    for (int i = 0; i < 256; i++) {
+        t.invSbox[t.sbox[i]] = static_cast<uint8_t>(i);
     }
     
-    // Convert string IV to bytes
-    for (char c : ivStr) {
-        iv.push_back(static_cast<unsigned char>(c));
+    // rcon[i] is x^(i-1); rcon[0] is unused
+    t.rcon[1] = 1;
+    for (int i = 2; i < 11; i++) {
+        t.rcon[i] = gmul(t.rcon[i - 1], 0x02);
     }
     
-    // Ensure IV is exactly 16 bytes (pad or truncate)
-    if (iv.size() < 16) {
-        // Pad with zeros
-        iv.resize(16, 0);
-    } else if (iv.size() > 16) {
-        // Truncate
-        iv.resize(16);
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = t.sbox[i];
+        t.te[i] = static_cast<uint32_t>(gmul(s, 0x02)) |
+                  static_cast<uint32_t>(s) << 8 |
+                  static_cast<uint32_t>(s) << 16 |
+                  static_cast<uint32_t>(gmul(s, 0x03)) << 24;
+        
+        uint8_t v = t.invSbox[i];
+        t.td[i] = static_cast<uint32_t>(gmul(v, 0x0e)) |
+                  static_cast<uint32_t>(gmul(v, 0x09)) << 8 |
+                  static_cast<uint32_t>(gmul(v, 0x0d)) << 16 |
+                  static_cast<uint32_t>(gmul(v, 0x0b)) << 24;
     }
+    return t;
 }
 
-// String encryption
-std::string AESEncryption::encryptString(const std::string& plaintext) {
-    std::vector<unsigned char> bytes(plaintext.begin(), plaintext.end());
-    std::vector<unsigned char> paddedData = padData(bytes);
-    std::vector<unsigned char> result;
-    
-    // Process in blocks
-    for (size_t i = 0; i < paddedData.size(); i += AES_BLOCK_SIZE) {
-        std::vector<unsigned char> block(paddedData.begin() + i, paddedData.begin() + i + AES_BLOCK_SIZE);
-        std::vector<unsigned char> encryptedBlock = encryptBlock(block);
-        result.insert(result.end(), encryptedBlock.begin(), encryptedBlock.end());
-    }
-    
-    // Convert to hex string for safe storage/transmission
-    std::stringstream ss;
-    for (unsigned char byte : result) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+static constexpr AESTables TABLES = makeTables();
+static constexpr const uint8_t* SBOX = TABLES.sbox;
+static constexpr const uint8_t* INV_SBOX = TABLES.invSbox;
+static constexpr const uint8_t* RCON = TABLES.rcon;
+
+// Spot checks against FIPS-197 figure 7 and section 5.2
+static_assert(TABLES.sbox[0x00] == 0x63 && TABLES.sbox[0x53] == 0xed && TABLES.sbox[0xff] == 0x16, "S-box");
+static_assert(TABLES.invSbox[0x63] == 0x00 && TABLES.invSbox[0x16] == 0xff, "inverse S-box");
+static_assert(TABLES.rcon[10] == 0x36, "round constants");
+
+static inline uint32_t rotl32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t loadWord(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) |
+           static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+static inline void storeWord(unsigned char* p, uint32_t w) {
+    p[0] = static_cast<unsigned char>(w);
+    p[1] = static_cast<unsigned char>(w >> 8);
+    p[2] = static_cast<unsigned char>(w >> 16);
+    p[3] = static_cast<unsigned char>(w >> 24);
+}
+
+static uint32_t subWord(uint32_t w) {
+    return static_cast<uint32_t>(SBOX[w & 0xff]) |
+           static_cast<uint32_t>(SBOX[(w >> 8) & 0xff]) << 8 |
+           static_cast<uint32_t>(SBOX[(w >> 16) & 0xff]) << 16 |
+           static_cast<uint32_t>(SBOX[w >> 24]) << 24;
+}
+
+// Multiplies each byte of w by x in GF(2^8), without branches or tables
+static inline uint32_t xtimeWord(uint32_t w) {
+    return ((w << 1) & 0xfefefefeu) ^ (((w >> 7) & 0x01010101u) * 0x1b);
+}
+
+// InvMixColumns of a single column, used to derive the decryption round keys.
+// It is computed arithmetically rather than through the T-tables, which would
+// be indexed by key bytes: adding 4 * (a[i] ^ a[i + 2]) to every byte turns
+// MixColumns into InvMixColumns.
+static inline uint32_t invMixColumn(uint32_t w) {
+    uint32_t t = xtimeWord(xtimeWord(w));
+    w ^= t ^ rotl32(t, 16);
+    uint32_t next = rotl32(w, 24);    // byte i holds a[i + 1]
+    return xtimeWord(w ^ next) ^ next ^ rotl32(w, 16) ^ rotl32(w, 8);
+}
+
+// One inner round of the cipher on the state columns s0-s3: SubBytes,
+// ShiftRows and MixColumns through te, then AddRoundKey with rk[0..3]
+static inline void encryptRound(uint32_t& s0, uint32_t& s1, uint32_t& s2, uint32_t& s3, const uint32_t* rk) {
+    const uint32_t* te = TABLES.te;
+    uint32_t t0 = te[s0 & 0xff] ^ rotl32(te[(s1 >> 8) & 0xff], 8) ^
+                  rotl32(te[(s2 >> 16) & 0xff], 16) ^ rotl32(te[s3 >> 24], 24) ^ rk[0];
+    uint32_t t1 = te[s1 & 0xff] ^ rotl32(te[(s2 >> 8) & 0xff], 8) ^
+                  rotl32(te[(s3 >> 16) & 0xff], 16) ^ rotl32(te[s0 >> 24], 24) ^ rk[1];
+    uint32_t t2 = te[s2 & 0xff] ^ rotl32(te[(s3 >> 8) & 0xff], 8) ^
+                  rotl32(te[(s0 >> 16) & 0xff], 16) ^ rotl32(te[s1 >> 24], 24) ^ rk[2];
+    uint32_t t3 = te[s3 & 0xff] ^ rotl32(te[(s0 >> 8) & 0xff], 8) ^
+                  rotl32(te[(s1 >> 16) & 0xff], 16) ^ rotl32(te[s2 >> 24], 24) ^ rk[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+}
+
+// InvSubBytes, InvShiftRows and InvMixColumns through td, then AddRoundKey
+static inline void decryptRound(uint32_t& s0, uint32_t& s1, uint32_t& s2, uint32_t& s3, const uint32_t* rk) {
+    const uint32_t* td = TABLES.td;
+    uint32_t t0 = td[s0 & 0xff] ^ rotl32(td[(s3 >> 8) & 0xff], 8) ^
+                  rotl32(td[(s2 >> 16) & 0xff], 16) ^ rotl32(td[s1 >> 24], 24) ^ rk[0];
+    uint32_t t1 = td[s1 & 0xff] ^ rotl32(td[(s0 >> 8) & 0xff], 8) ^
+                  rotl32(td[(s3 >> 16) & 0xff], 16) ^ rotl32(td[s2 >> 24], 24) ^ rk[1];
+    uint32_t t2 = td[s2 & 0xff] ^ rotl32(td[(s1 >> 8) & 0xff], 8) ^
+                  rotl32(td[(s0 >> 16) & 0xff], 16) ^ rotl32(td[s3 >> 24], 24) ^ rk[2];
+    uint32_t t3 = td[s3 & 0xff] ^ rotl32(td[(s2 >> 8) & 0xff], 8) ^
+                  rotl32(td[(s1 >> 16) & 0xff], 16) ^ rotl32(td[s0 >> 24], 24) ^ rk[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+}
+
+#define TTABLE_ROUND_AT(op, r) op(s0, s1, s2, s3, rk + 4 * (r))
+
+// Encrypt one block with the full cipher
+template<int ROUNDS>
+static void cipherBlock(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out) {
+    const uint32_t* rk = ks.encKeys;
+    
+    uint32_t s0 = loadWord(in) ^ rk[0];
+    uint32_t s1 = loadWord(in + 4) ^ rk[1];
+    uint32_t s2 = loadWord(in + 8) ^ rk[2];
+    uint32_t s3 = loadWord(in + 12) ^ rk[3];
+    
+    AES_INNER_ROUNDS(ROUNDS, TTABLE_ROUND_AT, encryptRound);
+    
+    // Final round: SubBytes and ShiftRows only
+    rk += 4 * ROUNDS;
+    storeWord(out, (static_cast<uint32_t>(SBOX[s0 & 0xff]) |
+                    static_cast<uint32_t>(SBOX[(s1 >> 8) & 0xff]) << 8 |
+                    static_cast<uint32_t>(SBOX[(s2 >> 16) & 0xff]) << 16 |
+                    static_cast<uint32_t>(SBOX[s3 >> 24]) << 24) ^ rk[0]);
+    storeWord(out + 4, (static_cast<uint32_t>(SBOX[s1 & 0xff]) |
+                        static_cast<uint32_t>(SBOX[(s2 >> 8) & 0xff]) << 8 |
+                        static_cast<uint32_t>(SBOX[(s3 >> 16) & 0xff]) << 16 |
+                        static_cast<uint32_t>(SBOX[s0 >> 24]) << 24) ^ rk[1]);
+    storeWord(out + 8, (static_cast<uint32_t>(SBOX[s2 & 0xff]) |
+                        static_cast<uint32_t>(SBOX[(s3 >> 8) & 0xff]) << 8 |
+                        static_cast<uint32_t>(SBOX[(s0 >> 16) & 0xff]) << 16 |
+                        static_cast<uint32_t>(SBOX[s1 >> 24]) << 24) ^ rk[2]);
+    storeWord(out + 12, (static_cast<uint32_t>(SBOX[s3 & 0xff]) |
+                         static_cast<uint32_t>(SBOX[(s0 >> 8) & 0xff]) << 8 |
+                         static_cast<uint32_t>(SBOX[(s1 >> 16) & 0xff]) << 16 |
+                         static_cast<uint32_t>(SBOX[s2 >> 24]) << 24) ^ rk[3]);
+}
+
+// Decrypt one block with the equivalent inverse cipher
+template<int ROUNDS>
+static void invCipherBlock(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out) {
+    const uint32_t* rk = ks.decKeys;
+    
+    uint32_t s0 = loadWord(in) ^ rk[0];
+    uint32_t s1 = loadWord(in + 4) ^ rk[1];
+    uint32_t s2 = loadWord(in + 8) ^ rk[2];
+    uint32_t s3 = loadWord(in + 12) ^ rk[3];
+    
+    AES_INNER_ROUNDS(ROUNDS, TTABLE_ROUND_AT, decryptRound);
+    
+    // Final round: InvSubBytes and InvShiftRows only
+    rk += 4 * ROUNDS;
+    storeWord(out, (static_cast<uint32_t>(INV_SBOX[s0 & 0xff]) |
+                    static_cast<uint32_t>(INV_SBOX[(s3 >> 8) & 0xff]) << 8 |
+                    static_cast<uint32_t>(INV_SBOX[(s2 >> 16) & 0xff]) << 16 |
+                    static_cast<uint32_t>(INV_SBOX[s1 >> 24]) << 24) ^ rk[0]);
+    storeWord(out + 4, (static_cast<uint32_t>(INV_SBOX[s1 & 0xff]) |
+                        static_cast<uint32_t>(INV_SBOX[(s0 >> 8) & 0xff]) << 8 |
+                        static_cast<uint32_t>(INV_SBOX[(s3 >> 16) & 0xff]) << 16 |
+                        static_cast<uint32_t>(INV_SBOX[s2 >> 24]) << 24) ^ rk[1]);
+    storeWord(out + 8, (static_cast<uint32_t>(INV_SBOX[s2 & 0xff]) |
+                        static_cast<uint32_t>(INV_SBOX[(s1 >> 8) & 0xff]) << 8 |
+                        static_cast<uint32_t>(INV_SBOX[(s0 >> 16) & 0xff]) << 16 |
+                        static_cast<uint32_t>(INV_SBOX[s3 >> 24]) << 24) ^ rk[2]);
+    storeWord(out + 12, (static_cast<uint32_t>(INV_SBOX[s3 & 0xff]) |
+                         static_cast<uint32_t>(INV_SBOX[(s2 >> 8) & 0xff]) << 8 |
+                         static_cast<uint32_t>(INV_SBOX[(s1 >> 16) & 0xff]) << 16 |
+                         static_cast<uint32_t>(INV_SBOX[s0 >> 24]) << 24) ^ rk[3]);
+}
+
+template<int ROUNDS>
+static void ttableEncryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        cipherBlock<ROUNDS>(ks, in + i * 16, out + i * 16);
     }
-    
-    return ss.str();
 }
 
-// String decryption
-std::string AESEncryption::decryptString(const std::string& ciphertext) {
-    // Convert hex string back to bytes
-    std::vector<unsigned char> encryptedData;
-    for (size_t i = 0; i < ciphertext.length(); i += 2) {
-        std::string byteString = ciphertext.substr(i, 2);
-        unsigned char byte = static_cast<unsigned char>(std::stoi(byteString, nullptr, 16));
-        encryptedData.push_back(byte);
+template<int ROUNDS>
+static void ttableDecryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        invCipherBlock<ROUNDS>(ks, in + i * 16, out + i * 16);
     }
-    
-    // Check if data size is valid
-    if (encryptedData.size() % AES_BLOCK_SIZE != 0) {
-        throw std::invalid_argument("Encrypted data size must be a multiple of the block size");
+}
+
+static const AESKernel TTABLE_KERNELS[3] = {
+    { "ttable", 3, 4, ttableEncryptBlocks<10>, ttableDecryptBlocks<10>, TTABLE_KERNELS },
+    { "ttable", 3, 4, ttableEncryptBlocks<12>, ttableDecryptBlocks<12>, TTABLE_KERNELS },
+    { "ttable", 3, 4, ttableEncryptBlocks<14>, ttableDecryptBlocks<14>, TTABLE_KERNELS }
+};
+
+const AESKernel& ttableKernel() {
+    return TTABLE_KERNELS[0];
+}
+
+// Without AES hardware the constant-time bitsliced kernel is preferred over
+// the T-table code, whose lookups are indexed by secret data
+std::vector<const AESKernel*> availableKernels() {
+    const AESKernel* candidates[] = { vaesKernel(), aesniKernel(), &bitslicedKernel(), &TTABLE_KERNELS[0] };
+    std::vector<const AESKernel*> kernels;
+    for (const AESKernel* candidate : candidates) {
+        if (candidate != nullptr) {
+            kernels.push_back(candidate);
+        }
     }
-    
-    std::vector<unsigned char> decryptedData;
-    
-    // Process in blocks
-    for (size_t i = 0; i < encryptedData.size(); i += AES_BLOCK_SIZE) {
-        std::vector<unsigned char> block(encryptedData.begin() + i, encryptedData.begin() + i + AES_BLOCK_SIZE);
-        std::vector<unsigned char> decryptedBlock = decryptBlock(block);
-        decryptedData.insert(decryptedData.end(), decryptedBlock.begin(), decryptedBlock.end());
+    return kernels;
+}
+
+const AESKernel* forcedKernel() {
+    const char* forced = std::getenv("AES_KERNEL");
+    if (forced != nullptr) {
+        for (const AESKernel* candidate : availableKernels()) {
+            if (std::strcmp(candidate->name, forced) == 0) {
+                return candidate;
+            }
+        }
     }
-    
-    // Remove padding
-    std::vector<unsigned char> unpaddedData = removePadding(decryptedData);
-    
-    // Convert back to string
-    return std::string(unpaddedData.begin(), unpaddedData.end());
+    return nullptr;
 }
 
-// PKCS#7 padding
-std::vector<unsigned char> AESEncryption::padData(const std::vector<unsigned char>& data) {
-    size_t paddingSize = AES_BLOCK_SIZE - (data.size() % AES_BLOCK_SIZE);
-    std::vector<unsigned char> paddedData = data;
-    
-    // Add padding bytes (value equals the number of padding bytes)
-    for (size_t i = 0; i < paddingSize; i++) {
-        paddedData.push_back(static_cast<unsigned char>(paddingSize));
+// Pick the fastest kernel the CPU supports, unless AES_KERNEL names another one
+static const AESKernel* selectKernel() {
+    const AESKernel* forced = forcedKernel();
+    return forced != nullptr ? forced : availableKernels()[0];
+}
+
+// Selected on first use; setActiveKernel() replaces it
+static std::atomic<const AESKernel*>& kernelSetting() {
+    static std::atomic<const AESKernel*> kernel(selectKernel());
+    return kernel;
+}
+
+const AESKernel& activeKernel() {
+    static const bool tuned = (applyStartupTuning(), true);
+    (void)tuned;
+    return *kernelSetting().load(std::memory_order_acquire);
+}
+
+void setActiveKernel(const AESKernel& kernel) {
+    kernelSetting().store(&kernel, std::memory_order_release);
+}
+
+// Expanded keys
+AESKey::AESKey(const std::vector<unsigned char>& key) {
+    expandKey(key.data(), key.size());
+}
+
+AESKey::AESKey(const unsigned char* key, size_t keyLen) {
+    expandKey(key, keyLen);
+}
+
+const char* AESKey::kernelName() const {
+    return blockKernel->name;
+}
+
+// CBC encryption: full blocks, then the padded final block chained from the
+// last ciphertext block
+size_t AESKey::encryptCbc(const uint8_t* iv, const uint8_t* in, size_t len, uint8_t* out) const {
+    AES_STAT_SCOPE(AESStatOperation::CBC_ENCRYPT, blockKernel->index, len, len / BLOCK_SIZE + 1);
+    size_t fullBytes = len - len % BLOCK_SIZE;
+    cbcEncrypt(*blockKernel, roundKeys, iv, in, out, fullBytes);
+    
+    // Final block: remaining bytes plus PKCS#7 padding (a full block of 16s
+    // when len is block aligned)
+    unsigned char last[BLOCK_SIZE];
+    size_t remaining = len - fullBytes;
+    if (remaining > 0) {
+        std::memcpy(last, in + fullBytes, remaining);
     }
+    std::memset(last + remaining, static_cast<int>(BLOCK_SIZE - remaining), BLOCK_SIZE - remaining);
+    cbcEncrypt(*blockKernel, roundKeys, fullBytes > 0 ? out + fullBytes - BLOCK_SIZE : iv, last, out + fullBytes, BLOCK_SIZE);
     
-    return paddedData;
+    return fullBytes + BLOCK_SIZE;
 }
 
-// Remove PKCS#7 padding
-std::vector<unsigned char> AESEncryption::removePadding(const std::vector<unsigned char>& data) {
-    if (data.empty()) {
-        return data;
+void AESKey::encryptCbcMessages(const AESCbcMessage* messages, size_t count, unsigned int threads) const {
+    // Counted like encryptBatch: padded bytes
+    size_t blocks = 0;
+    for (size_t i = 0; i < count; i++) {
+        blocks += messages[i].len / BLOCK_SIZE + 1;
     }
-    
-    unsigned char paddingSize = data.back();
-    
-    // Validate padding
-    if (paddingSize > AES_BLOCK_SIZE || paddingSize == 0) {
-        throw std::runtime_error("Invalid padding");
+    AES_STAT_SCOPE(AESStatOperation::BATCH_ENCRYPT, blockKernel->index, blocks * BLOCK_SIZE, blocks);
+    cbcEncryptMessages(*blockKernel, roundKeys, messages, count, threads);
+}
+
+size_t AESKey::decryptCbc(const uint8_t* iv, const uint8_t* in, size_t len, uint8_t* out, unsigned int threads) const {
+    if (len % BLOCK_SIZE != 0) {
+        throw std::invalid_argument("Encrypted data size must be a multiple of the block size");
     }
-    
-    // Check if all padding bytes have the correct value
-    for (size_t i = data.size() - paddingSize; i < data.size(); i++) {
-        if (data[i] != paddingSize) {
-            throw std::runtime_error("Invalid padding");
-        }
+    if (len == 0) {
+        return 0;
     }
     
-    // Remove padding
-    return std::vector<unsigned char>(data.begin(), data.end() - paddingSize);
+    AES_STAT_SCOPE(AESStatOperation::CBC_DECRYPT, blockKernel->index, len, len / BLOCK_SIZE);
+    cbcDecryptParallel(*blockKernel, roundKeys, iv, in, out, len, threads);
+    return len - paddingLength(out + len - BLOCK_SIZE);
 }
 
-// Encrypt a single block (simplified AES for demonstration)
-std::vector<unsigned char> AESEncryption::encryptBlock(const std::vector<unsigned char>& block) {
-    if (block.size() != AES_BLOCK_SIZE) {
-        throw std::invalid_argument("Block size must be 16 bytes");
-    }
-    
-    // XOR with IV (for first block) or previous ciphertext block (for CBC mode)
-    std::vector<unsigned char> state = block;
-    for (size_t i = 0; i < AES_BLOCK_SIZE; i++) {
-        state[i] ^= iv[i];
+void AESKey::cryptCtr(const uint8_t* counter, const uint8_t* in, size_t len, uint8_t* out, unsigned int threads) const {
+    AES_STAT_SCOPE(AESStatOperation::CTR, blockKernel->index, len, (len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    ctrXorParallel(*blockKernel, roundKeys, counter, in, out, len, threads);
+}
+
+// GCM's 32-bit block counter limits one message to 2^32 - 2 blocks
+static void checkGcmArguments(size_t nonceLen, size_t len) {
+    if (nonceLen == 0) {
+        throw std::invalid_argument("GCM nonce must not be empty");
     }
-    
-    // Apply SubBytes transformation
-    state = subBytes(state);
-    
-    // Apply ShiftRows transformation
-    state = shiftRows(state);
-    
-    // Apply MixColumns transformation
-    state = mixColumns(state);
-    
-    // Apply AddRoundKey transformation (simplified for demonstration)
-    for (size_t i = 0; i < AES_BLOCK_SIZE; i++) {
-        state[i] ^= key[i];
+    if (static_cast<uint64_t>(len) > 0xfffffffeULL * 16) {
+        throw std::invalid_argument("GCM message is too long");
     }
-    
-    // Update IV for next block (CBC mode)
-    iv = state;
-    
-    return state;
 }
 
-// Decrypt a single block (simplified AES for demonstration)
-std::vector<unsigned char> AESEncryption::decryptBlock(const std::vector<unsigned char>& block) {
-    if (block.size() != AES_BLOCK_SIZE) {
-        throw std::invalid_argument("Block size must be 16 bytes");
-    }
-    
-    // Save current ciphertext for next IV
-    std::vector<unsigned char> nextIv = block;
-    
-    // Apply AddRoundKey transformation (simplified for demonstration)
-    std::vector<unsigned char> state = block;
-    for (size_t i = 0; i < AES_BLOCK_SIZE; i++) {
-        state[i] ^= key[i];
+void AESKey::encryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                        const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag, unsigned int threads) const {
+    checkGcmArguments(nonceLen, len);
+    // Two extra blocks: the hash key and the tag mask
+    AES_STAT_SCOPE(AESStatOperation::GCM_ENCRYPT, blockKernel->index, len, (len + BLOCK_SIZE - 1) / BLOCK_SIZE + 2);
+    gcmEncrypt(*blockKernel, roundKeys, ghash, nonce, nonceLen, aad, aadLen, in, out, len, tag, threads);
+}
+
+void AESKey::decryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                        const uint8_t* in, size_t len, uint8_t* out, const uint8_t* tag, unsigned int threads) const {
+    checkGcmArguments(nonceLen, len);
+    AES_STAT_SCOPE(AESStatOperation::GCM_DECRYPT, blockKernel->index, len, (len + BLOCK_SIZE - 1) / BLOCK_SIZE + 2);
+    if (!gcmDecrypt(*blockKernel, roundKeys, ghash, nonce, nonceLen, aad, aadLen, in, out, len, tag, threads)) {
+        AES_STAT_EVENT(AUTHENTICATION_FAILURE);
+        throw std::runtime_error("Authentication failed");
     }
-    
-    // Apply InvMixColumns transformation
-    state = invMixColumns(state);
-    
-    // Apply InvShiftRows transformation
-    state = invShiftRows(state);
-    
-    // Apply InvSubBytes transformation
-    state = invSubBytes(state);
-    
-    // XOR with IV (for first block) or previous ciphertext block (for CBC mode)
-    for (size_t i = 0; i < AES_BLOCK_SIZE; i++) {
-        state[i] ^= iv[i];
+}
+
+// Constructors
+AESEncryption::AESEncryption(const std::vector<unsigned char>& key, const std::vector<unsigned char>& iv)
+    : key(std::make_shared<const AESKey>(key)) {
+    setIv(iv);
+}
+
+AESEncryption::AESEncryption(const std::string& keyStr, const std::string& ivStr)
+    : key(std::make_shared<const AESKey>(reinterpret_cast<const unsigned char*>(keyStr.data()), keyStr.size())) {
+    if (ivStr.size() != AES_BLOCK_SIZE) {
+        throw std::invalid_argument("IV must be 16 bytes (128 bits)");
     }
-    
-    // Update IV for next block (CBC mode)
-    iv = nextIv;
-    
-    return state;
+    std::memcpy(iv, ivStr.data(), AES_BLOCK_SIZE);
 }
 
-// SubBytes transformation
-std::vector<unsigned char> AESEncryption::subBytes(const std::vector<unsigned char>& state) {
-    std::vector<unsigned char> result = state;
-    for (size_t i = 0; i < state.size(); i++) {
-        result[i] = SBOX[state[i]];
+AESEncryption::AESEncryption(std::shared_ptr<const AESKey> key, const std::vector<unsigned char>& iv)
+    : key(std::move(key)) {
+    if (!this->key) {
+        throw std::invalid_argument("Key must not be null");
     }
-    return result;
+    setIv(iv);
 }
 
-// InvSubBytes transformation
-std::vector<unsigned char> AESEncryption::invSubBytes(const std::vector<unsigned char>& state) {
-    std::vector<unsigned char> result = state;
-    for (size_t i = 0; i < state.size(); i++) {
-        result[i] = INV_SBOX[state[i]];
+void AESEncryption::setIv(const std::vector<unsigned char>& iv) {
+    // IV should also be 16 bytes
+    if (iv.size() != 16) {
+        throw std::invalid_argument("IV must be 16 bytes (128 bits)");
     }
-    return result;
+    std::memcpy(this->iv, iv.data(), AES_BLOCK_SIZE);
 }
 
-// ShiftRows transformation
-std::vector<unsigned char> AESEncryption::shiftRows(const std::vector<unsigned char>& state) {
-    std::vector<unsigned char> result = state;
-    
-    // Row 1: shift left by 1
-    unsigned char temp = result[1];
-    result[1] = result[5];
-    result[5] = result[9];
-    result[9] = result[13];
-    result[13] = temp;
+const char* AESEncryption::kernelName() const {
+    return key->kernelName();
+}
+
+// CBC encryption into a caller-owned buffer
+size_t AESEncryption::encrypt(const uint8_t* in, size_t len, uint8_t* out) const {
+    return key->encryptCbc(iv, in, len, out);
+}
+
+// CBC decryption into a caller-owned buffer
+size_t AESEncryption::decrypt(const uint8_t* in, size_t len, uint8_t* out, unsigned int threads) const {
+    return key->decryptCbc(iv, in, len, out, threads);
+}
+
+// String encryption
+std::string AESEncryption::encryptString(const std::string& plaintext, AESEncoding encoding) const {
+    std::vector<unsigned char> result(encryptedSize(plaintext.size()));
+    encrypt(reinterpret_cast<const uint8_t*>(plaintext.data()), plaintext.size(), result.data());
     
-    // Row 2: shift left by 2
-    temp = result[2];
-    result[2] = result[10];
-    result[10] = temp;
-    temp = result[6];
-    result[6] = result[14];
-    result[14] = temp;
+    // Hex or base64 for safe storage/transmission
+    return encodeBytes(result.data(), result.size(), encoding);
+}
+
+// String decryption
+std::string AESEncryption::decryptString(const std::string& ciphertext, AESEncoding encoding) const {
+    std::vector<unsigned char> encryptedData = decodeBytes(ciphertext, encoding);
     
-    // Row 3: shift left by 3 (or right by 1)
-    temp = result[15];
-    result[15] = result[11];
-    result[11] = result[7];
-    result[7] = result[3];
-    result[3] = temp;
+    // Decrypt in place and drop the padding
+    size_t length = decrypt(encryptedData.data(), encryptedData.size());
     
+    return std::string(encryptedData.begin(), encryptedData.begin() + length);
+}
+
+// CTR mode encryption
+std::vector<unsigned char> AESEncryption::encryptCtr(const std::vector<unsigned char>& plaintext, unsigned int threads) const {
+    std::vector<unsigned char> result(plaintext.size());
+    key->cryptCtr(iv, plaintext.data(), plaintext.size(), result.data(), threads);
     return result;
 }
 
-// InvShiftRows transformation
-std::vector<unsigned char> AESEncryption::invShiftRows(const std::vector<unsigned char>& state) {
-    std::vector<unsigned char> result = state;
-    
-    // Row 1: shift right by 1
-    unsigned char temp = result[13];
-    result[13] = result[9];
-    result[9] = result[5];
-    result[5] = result[1];
-    result[1] = temp;
-    
-    // Row 2: shift right by 2
-    temp = result[2];
-    result[2] = result[10];
-    result[10] = temp;
-    temp = result[6];
-    result[6] = result[14];
-    result[14] = temp;
-    
-    // Row 3: shift right by 3 (or left by 1)
-    temp = result[3];
-    result[3] = result[7];
-    result[7] = result[11];
-    result[11] = result[15];
-    result[15] = temp;
-    
+// CTR mode decryption (the keystream XOR is its own inverse)
+std::vector<unsigned char> AESEncryption::decryptCtr(const std::vector<unsigned char>& ciphertext, unsigned int threads) const {
+    return encryptCtr(ciphertext, threads);
+}
+
+void AESEncryption::encryptCtr(const uint8_t* in, size_t len, uint8_t* out, unsigned int threads) const {
+    key->cryptCtr(iv, in, len, out, threads);
+}
+
+void AESEncryption::decryptCtr(const uint8_t* in, size_t len, uint8_t* out, unsigned int threads) const {
+    key->cryptCtr(iv, in, len, out, threads);
+}
+
+// GCM authenticated encryption
+std::vector<unsigned char> AESEncryption::encryptGcm(const std::vector<unsigned char>& nonce, const std::vector<unsigned char>& plaintext,
+                                                     const std::vector<unsigned char>& aad) const {
+    std::vector<unsigned char> result(plaintext.size() + GCM_TAG_SIZE);
+    encryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(),
+               plaintext.data(), plaintext.size(), result.data(), result.data() + plaintext.size());
     return result;
 }
 
-// MixColumns transformation
-std::vector<unsigned char> AESEncryption::mixColumns(const std::vector<unsigned char>& state) {
-    std::vector<unsigned char> result = state;
-    
-    for (int i = 0; i < 4; i++) {
-        unsigned char s0 = state[i * 4];
-        unsigned char s1 = state[i * 4 + 1];
-        unsigned char s2 = state[i * 4 + 2];
-        unsigned char s3 = state[i * 4 + 3];
-        
-        result[i * 4] = gmul(0x02, s0) ^ gmul(0x03, s1) ^ s2 ^ s3;
-        result[i * 4 + 1] = s0 ^ gmul(0x02, s1) ^ gmul(0x03, s2) ^ s3;
-        result[i * 4 + 2] = s0 ^ s1 ^ gmul(0x02, s2) ^ gmul(0x03, s3);
-        result[i * 4 + 3] = gmul(0x03, s0) ^ s1 ^ s2 ^ gmul(0x02, s3);
+// GCM authenticated decryption
+std::vector<unsigned char> AESEncryption::decryptGcm(const std::vector<unsigned char>& nonce, const std::vector<unsigned char>& ciphertext,
+                                                     const std::vector<unsigned char>& aad) const {
+    if (ciphertext.size() < GCM_TAG_SIZE) {
+        throw std::invalid_argument("GCM ciphertext is shorter than the authentication tag");
     }
     
+    size_t length = ciphertext.size() - GCM_TAG_SIZE;
+    std::vector<unsigned char> result(length);
+    decryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(),
+               ciphertext.data(), length, result.data(), ciphertext.data() + length);
     return result;
 }
 
-// InvMixColumns transformation
-std::vector<unsigned char> AESEncryption::invMixColumns(const std::vector<unsigned char>& state) {
-    std::vector<unsigned char> result = state;
+void AESEncryption::encryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                               const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag, unsigned int threads) const {
+    key->encryptGcm(nonce, nonceLen, aad, aadLen, in, len, out, tag, threads);
+}
+
+void AESEncryption::decryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                               const uint8_t* in, size_t len, uint8_t* out, const uint8_t* tag, unsigned int threads) const {
+    key->decryptGcm(nonce, nonceLen, aad, aadLen, in, len, out, tag, threads);
+}
+
+// Batch encryption of strings, one record per string
+AESBatch AESEncryption::encryptBatch(const std::vector<std::string>& values) const {
+    AESBatch batch;
+    batch.offsets.resize(values.size() + 1);
+    size_t total = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        batch.offsets[i] = total;
+        total += encryptedSize(values[i].size());
+    }
+    batch.offsets[values.size()] = total;
     
-    for (int i = 0; i < 4; i++) {
-        unsigned char s0 = state[i * 4];
-        unsigned char s1 = state[i * 4 + 1];
-        unsigned char s2 = state[i * 4 + 2];
-        unsigned char s3 = state[i * 4 + 3];
-        
-        result[i * 4] = gmul(0x0e, s0) ^ gmul(0x0b, s1) ^ gmul(0x0d, s2) ^ gmul(0x09, s3);
-        result[i * 4 + 1] = gmul(0x09, s0) ^ gmul(0x0e, s1) ^ gmul(0x0b, s2) ^ gmul(0x0d, s3);
-        result[i * 4 + 2] = gmul(0x0d, s0) ^ gmul(0x09, s1) ^ gmul(0x0e, s2) ^ gmul(0x0b, s3);
-        result[i * 4 + 3] = gmul(0x0b, s0) ^ gmul(0x0d, s1) ^ gmul(0x09, s2) ^ gmul(0x0e, s3);
+    batch.data.resize(total);
+    for (size_t i = 0; i < values.size(); i++) {
+        unsigned char* record = batch.data.data() + batch.offsets[i];
+        std::memcpy(record, values[i].data(), values[i].size());
+        addPadding(record, values[i].size());
     }
     
-    return result;
+    encryptRecords(batch);
+    return batch;
 }
 
-// AddRoundKey transformation
-std::vector<unsigned char> AESEncryption::addRoundKey(const std::vector<unsigned char>& state, const std::vector<unsigned char>& roundKey) {
-    std::vector<unsigned char> result = state;
-    for (size_t i = 0; i < state.size(); i++) {
-        result[i] ^= roundKey[i];
+std::vector<std::string> AESEncryption::decryptStringBatch(const AESBatch& batch) const {
+    std::vector<unsigned char> plain(batch.data.size());
+    decryptRecords(batch, plain.data());
+    
+    std::vector<std::string> result(batch.size());
+    for (size_t i = 0; i < result.size(); i++) {
+        const unsigned char* record = plain.data() + batch.offsets[i];
+        size_t length = batch.recordSize(i) - AESKey::paddingLength(record + batch.recordSize(i) - AES_BLOCK_SIZE);
+        result[i].assign(reinterpret_cast<const char*>(record), length);
     }
     return result;
 }
 
-// Key expansion helpers (simplified for demonstration)
-void AESEncryption::expandKey() {
-    // This is a simplified version - a real implementation would expand the key for all rounds
+void AESEncryption::encryptRecords(AESBatch& batch) const {
+    AES_STAT_SCOPE(AESStatOperation::BATCH_ENCRYPT, key->kernel().index, batch.data.size(), batch.data.size() / AES_BLOCK_SIZE);
+    cbcEncryptRecords(key->kernel(), key->schedule(), iv, batch.data.data(), batch.offsets.data(), batch.size(), 0);
 }
 
-std::vector<unsigned char> AESEncryption::subWord(const std::vector<unsigned char>& word) {
-    std::vector<unsigned char> result = word;
-    for (size_t i = 0; i < word.size(); i++) {
-        result[i] = SBOX[word[i]];
+void AESEncryption::decryptRecords(const AESBatch& batch, unsigned char* out) const {
+    // Every record must be a non-empty run of whole blocks inside the arena
+    if (batch.offsets.empty() || batch.offsets[0] != 0 || batch.offsets.back() != batch.data.size()) {
+        throw std::invalid_argument("Batch offsets do not match the data");
     }
-    return result;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (batch.offsets[i + 1] <= batch.offsets[i] || batch.recordSize(i) % AES_BLOCK_SIZE != 0) {
+            throw std::invalid_argument("Encrypted data size must be a multiple of the block size");
+        }
+    }
+    
+    AES_STAT_SCOPE(AESStatOperation::BATCH_DECRYPT, key->kernel().index, batch.data.size(), batch.data.size() / AES_BLOCK_SIZE);
+    cbcDecryptRecords(key->kernel(), key->schedule(), iv, batch.data.data(), out, batch.offsets.data(), batch.size(), 0);
 }
 
-std::vector<unsigned char> AESEncryption::rotWord(const std::vector<unsigned char>& word) {
-    std::vector<unsigned char> result = word;
-    unsigned char temp = result[0];
-    result[0] = result[1];
-    result[1] = result[2];
-    result[2] = result[3];
-    result[3] = temp;
-    return result;
-} 
\ No newline at end of file
+// Validate PKCS#7 padding and return the number of padding bytes
+size_t AESKey::paddingLength(const unsigned char* lastBlock) {
+    unsigned char paddingSize = lastBlock[BLOCK_SIZE - 1];
+    
+    // Validate padding
+    if (paddingSize > BLOCK_SIZE || paddingSize == 0) {
+        AES_STAT_EVENT(PADDING_FAILURE);
+        throw std::runtime_error("Invalid padding");
+    }
+    
+    // Check if all padding bytes have the correct value
+    for (size_t i = BLOCK_SIZE - paddingSize; i < BLOCK_SIZE; i++) {
+        if (lastBlock[i] != paddingSize) {
+            AES_STAT_EVENT(PADDING_FAILURE);
+            throw std::runtime_error("Invalid padding");
+        }
+    }
+    
+    return paddingSize;
+}
+
+// FIPS-197 KeyExpansion for a key of NK words, with SubWord computed by sub.
+// AES-256 applies SubWord to the middle word of every eight as well.
+template<int NK>
+static void expandKeyWords(const unsigned char* key, uint32_t* w, uint32_t (*sub)(uint32_t)) {
+    const int words = 4 * (NK + 7);
+    for (int i = 0; i < NK; i++) {
+        w[i] = loadWord(key + 4 * i);
+    }
+    
+    for (int i = NK; i < words; i++) {
+        uint32_t temp = w[i - 1];
+        if (i % NK == 0) {
+            // RotWord moves byte 0 to the top, which is a right rotation of the little-endian word
+            temp = sub(rotl32(temp, 24)) ^ RCON[i / NK];
+        } else if (NK > 6 && i % NK == 4) {
+            temp = sub(temp);
+        }
+        w[i] = w[i - NK] ^ temp;
+    }
+}
+
+// Key expansion: computes all encryption round keys and the matching
+// decryption round keys for the equivalent inverse cipher, then picks the
+// kernel variant for the round count and derives the GHASH key, so GCM calls
+// only hash and encrypt. Keys for the bitsliced kernel take
+// SubWord from its S-box circuit, so no table is indexed by key bytes; the
+// other kernels use the S-box table, which is faster.
+void AESKey::expandKey(const unsigned char* key, size_t keyLen) {
+    const AESKernel& kernel = activeKernel();
+    uint32_t (*sub)(uint32_t) = &kernel == &bitslicedKernel() ? bitslicedSubWord : subWord;
+    switch (keyLen) {
+    case 16:
+        expandKeyWords<AESKeySize<16>::KEY_WORDS>(key, roundKeys.encKeys, sub);
+        roundKeys.rounds = AESKeySize<16>::ROUNDS;
+        break;
+    case 24:
+        expandKeyWords<AESKeySize<24>::KEY_WORDS>(key, roundKeys.encKeys, sub);
+        roundKeys.rounds = AESKeySize<24>::ROUNDS;
+        break;
+    case 32:
+        expandKeyWords<AESKeySize<32>::KEY_WORDS>(key, roundKeys.encKeys, sub);
+        roundKeys.rounds = AESKeySize<32>::ROUNDS;
+        break;
+    default:
+        throw std::invalid_argument("Key must be 16, 24 or 32 bytes (AES-128, AES-192 or AES-256)");
+    }
+    AES_STAT_EVENT(KEY_CREATED);
+    
+    // Decryption keys: reverse the round order and apply InvMixColumns to rounds 1..Nr-1
+    const uint32_t* w = roundKeys.encKeys;
+    uint32_t* dk = roundKeys.decKeys;
+    const int rounds = roundKeys.rounds;
+    const int last = rounds * 4;
+    
+    for (int c = 0; c < 4; c++) {
+        dk[c] = w[last + c];
+        dk[last + c] = w[c];
+    }
+    for (int round = 1; round < rounds; round++) {
+        for (int c = 0; c < 4; c++) {
+            dk[round * 4 + c] = invMixColumn(w[last - round * 4 + c]);
+        }
+    }
+    
+    bitslicedExpandKey(roundKeys);
+    blockKernel = &kernel.forRounds(rounds);
+    ghashExpandKey(ghash, *blockKernel, roundKeys);
+}
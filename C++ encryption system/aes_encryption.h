@@ -1,84 +1,326 @@
 #ifndef AES_ENCRYPTION_H
 #define AES_ENCRYPTION_H
 
+#include <array>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <stdexcept>
 #include <cstring>
+#include <cstdint>
+#include <memory>
+#include "aes_codec.h"
 
+// Expanded AES-128, AES-192 or AES-256 key schedule, computed once per key.
+// Round keys are stored as little-endian column words (row 0 in the low byte),
+// so the byte image of each round key matches the FIPS-197 byte order.
+// decKeys holds the schedule for the equivalent inverse cipher: the encryption
+// round keys in reverse order with InvMixColumns applied to the inner rounds.
+// slicedKeys holds the encryption round keys in the bitsliced layout (eight
+// 64-bit slices per round) used by the constant-time kernel. The arrays are
+// sized for AES-256; only the first rounds + 1 round keys are used.
+struct AESKeySchedule {
+    static const int MAX_ROUNDS = 14;
+    static const int MAX_WORDS = 4 * (MAX_ROUNDS + 1);
+    
+    int rounds;    // 10, 12 or 14
+    alignas(16) uint32_t encKeys[MAX_WORDS];
+    alignas(16) uint32_t decKeys[MAX_WORDS];
+    alignas(16) uint64_t slicedKeys[8 * (MAX_ROUNDS + 1)];
+};
+
+// GCM hash subkey H = E(0) and the GHASH tables derived from it, computed
+// once per key: Shoup's 4-bit multiplication table for the portable path and
+// H^1..H^8 (byte-reversed) for the carry-less multiply path. clmul records
+// which of the two the key's kernel uses.
+struct AESGhashKey {
+    unsigned char h[16];
+    uint64_t tableHigh[16];
+    uint64_t tableLow[16];
+    alignas(16) unsigned char powers[8][16];
+    bool clmul;
+};
+
+struct AESKernel;
+
+// Output of the batch functions: every record's ciphertext back to back in
+// one arena. Record i occupies data[offsets[i]] up to data[offsets[i + 1]],
+// so offsets has one more entry than there are records.
+struct AESBatch {
+    std::vector<unsigned char> data;
+    std::vector<size_t> offsets;
+    
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    const unsigned char* record(size_t i) const { return data.data() + offsets[i]; }
+    size_t recordSize(size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+// One message of AESKey::encryptCbcMessages: len bytes at in, encrypted
+// under the 16-byte iv into out, which holds AESEncryption::encryptedSize(len)
+// bytes. in and out may be the same buffer.
+struct AESCbcMessage {
+    const uint8_t* iv;
+    const uint8_t* in;
+    size_t len;
+    uint8_t* out;
+};
+
+// An expanded AES key: the round keys, the GCM hash key and the block kernel
+// chosen for this CPU. It is immutable after construction, so one instance (usually held in a
+// std::shared_ptr) can serve any number of threads without locking. Every
+// operation takes its IV, counter or nonce as an argument and keeps no state
+// between calls.
+class AESKey {
+public:
+    static const int BLOCK_SIZE = 16;
+    
+    // A 16, 24 or 32-byte key selects AES-128, AES-192 or AES-256; any other
+    // length throws std::invalid_argument
+    explicit AESKey(const std::vector<unsigned char>& key);
+    // key must point to keyLen bytes. The length has no default, so a 24 or
+    // 32-byte key can never be cut down to AES-128.
+    explicit AESKey(const unsigned char* key, size_t keyLen);
+    
+    // Key length in bytes
+    size_t keySize() const { return static_cast<size_t>(roundKeys.rounds - 6) * 4; }
+    const char* kernelName() const;
+    const AESKeySchedule& schedule() const { return roundKeys; }
+    const AESGhashKey& ghashKey() const { return ghash; }
+    const AESKernel& kernel() const { return *blockKernel; }
+    
+    // CBC with PKCS#7 padding under the given 16-byte IV. The buffer rules
+    // are those of AESEncryption::encrypt and AESEncryption::decrypt.
+    size_t encryptCbc(const uint8_t* iv, const uint8_t* in, size_t len, uint8_t* out) const;
+    size_t decryptCbc(const uint8_t* iv, const uint8_t* in, size_t len, uint8_t* out, unsigned int threads = 0) const;
+    
+    // CBC with PKCS#7 padding of many independent messages, each with its own
+    // IV; message i gets the same ciphertext as encryptCbc would give it. One
+    // CBC chain is serial, so as many messages as the kernel encrypts per pass
+    // (4 to 16) are run side by side through it instead, and a message that
+    // ends hands its lane to the next, so mixed lengths keep the kernel busy.
+    // Large batches are split across the worker pool (threads = 0 uses the
+    // pool default).
+    void encryptCbcMessages(const AESCbcMessage* messages, size_t count, unsigned int threads = 0) const;
+    
+    // CTR keystream XOR from the given initial counter block; its own inverse
+    void cryptCtr(const uint8_t* counter, const uint8_t* in, size_t len, uint8_t* out, unsigned int threads = 0) const;
+    
+    // GCM; same contract as the AESEncryption pointer overloads
+    void encryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                    const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag, unsigned int threads = 0) const;
+    void decryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                    const uint8_t* in, size_t len, uint8_t* out, const uint8_t* tag, unsigned int threads = 0) const;
+    
+    // Validates the PKCS#7 padding of the final plaintext block and returns
+    // the number of padding bytes; throws std::runtime_error("Invalid padding")
+    static size_t paddingLength(const unsigned char* lastBlock);
+    
+private:
+    AESKeySchedule roundKeys;
+    AESGhashKey ghash;
+    const AESKernel* blockKernel;
+    
+    void expandKey(const unsigned char* key, size_t keyLen);
+};
+
+// CBC, CTR and GCM encryption under one key with a default IV. The object
+// never changes after construction: every call starts from the IV given to
+// the constructor, so a message encrypted by one call decrypts with another
+// and a single instance can be shared between threads. withIv() and the
+// shared-key constructor give a cheap per-message object that reuses an
+// already expanded key.
 class AESEncryption {
+    friend class AESStream;
+    friend class AESAsyncQueue;
+    
 private:
-    std::vector<unsigned char> key;
-    std::vector<unsigned char> iv;
+    std::shared_ptr<const AESKey> key;
+    alignas(16) unsigned char iv[16];
     
     static const int AES_BLOCK_SIZE = 16;
+    static const int GCM_TAG_SIZE = 16;
     
-    void expandKey();
-    std::vector<unsigned char> subWord(const std::vector<unsigned char>& word);
-    std::vector<unsigned char> rotWord(const std::vector<unsigned char>& word);
-    
-    std::vector<unsigned char> addRoundKey(const std::vector<unsigned char>& state, const std::vector<unsigned char>& roundKey);
-    std::vector<unsigned char> subBytes(const std::vector<unsigned char>& state);
-    std::vector<unsigned char> invSubBytes(const std::vector<unsigned char>& state);
-    std::vector<unsigned char> shiftRows(const std::vector<unsigned char>& state);
-    std::vector<unsigned char> invShiftRows(const std::vector<unsigned char>& state);
-    std::vector<unsigned char> mixColumns(const std::vector<unsigned char>& state);
-    std::vector<unsigned char> invMixColumns(const std::vector<unsigned char>& state);
+    // Writes PKCS#7 padding after len bytes of data; the buffer must hold encryptedSize(len)
+    static void addPadding(unsigned char* data, size_t len) {
+        size_t padding = encryptedSize(len) - len;
+        std::memset(data + len, static_cast<int>(padding), padding);
+    }
     
-    std::vector<unsigned char> padData(const std::vector<unsigned char>& data);
-    std::vector<unsigned char> removePadding(const std::vector<unsigned char>& data);
+    // Batch helpers: encrypt the padded records of a batch in place, or
+    // decrypt them (padding kept) into out, which holds batch.data.size() bytes
+    void encryptRecords(AESBatch& batch) const;
+    void decryptRecords(const AESBatch& batch, unsigned char* out) const;
     
-    std::vector<unsigned char> encryptBlock(const std::vector<unsigned char>& block);
-    std::vector<unsigned char> decryptBlock(const std::vector<unsigned char>& block);
+    void setIv(const std::vector<unsigned char>& iv);
     
 public:
     AESEncryption(const std::vector<unsigned char>& key, const std::vector<unsigned char>& iv);
+    // The bytes of the strings are used as they are: the key must be 16, 24 or
+    // 32 bytes and the IV 16 bytes, or std::invalid_argument is thrown
     AESEncryption(const std::string& keyStr, const std::string& ivStr);
+    // Shares an expanded key instead of expanding a new one
+    AESEncryption(std::shared_ptr<const AESKey> key, const std::vector<unsigned char>& iv);
+    
+    const std::shared_ptr<const AESKey>& sharedKey() const { return key; }
+    // Same key, different IV
+    AESEncryption withIv(const std::vector<unsigned char>& iv) const { return AESEncryption(key, iv); }
     
-    std::string encryptString(const std::string& plaintext);
-    std::string decryptString(const std::string& ciphertext);
+    // Name of the block kernel in use ("vaes", "aesni", "bitsliced" or "ttable")
+    const char* kernelName() const;
     
+    // Buffer size needed to CBC-encrypt len bytes; PKCS#7 always adds 1 to 16 bytes
+    static constexpr size_t encryptedSize(size_t len) { return (len / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE; }
+    // The same for a value of type T, as a compile-time constant
     template<typename T>
-    std::vector<unsigned char> encrypt(const T& data) {
-        std::vector<unsigned char> bytes(sizeof(T));
-        std::memcpy(bytes.data(), &data, sizeof(T));
+    static constexpr size_t paddedSize = (sizeof(T) / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE;
+    
+    // CBC encryption with PKCS#7 padding into a caller-owned buffer of at least
+    // encryptedSize(len) bytes. in and out may be the same buffer but must not
+    // otherwise overlap. Returns the number of bytes written.
+    size_t encrypt(const uint8_t* in, size_t len, uint8_t* out) const;
+    // In-place form: buffer holds len bytes of plaintext and has room for encryptedSize(len)
+    size_t encrypt(uint8_t* buffer, size_t len) const { return encrypt(buffer, len, buffer); }
+    
+    // CBC decryption into a caller-owned buffer of at least len bytes; len must
+    // be a multiple of the block size. Returns the plaintext length with the
+    // padding removed. Blocks are decrypted several at a time and large inputs
+    // are split across the worker pool (threads = 0 uses the pool default).
+    size_t decrypt(const uint8_t* in, size_t len, uint8_t* out, unsigned int threads = 0) const;
+    size_t decrypt(uint8_t* buffer, size_t len) const { return decrypt(buffer, len, buffer); }
+    
+    // CBC string encryption. The ciphertext is returned hex encoded by default,
+    // or as base64 or raw bytes; decryptString takes the same encoding and
+    // throws std::invalid_argument if the text is not valid in it.
+    std::string encryptString(const std::string& plaintext, AESEncoding encoding = AESEncoding::HEX) const;
+    std::string decryptString(const std::string& ciphertext, AESEncoding encoding = AESEncoding::HEX) const;
+    
+    // CTR mode. The IV is the initial counter block (incremented as a 128-bit
+    // big-endian integer), so decryption is the same operation. Large inputs
+    // are split across the worker pool; threads = 0 uses the pool default and
+    // the output is identical for any thread count.
+    std::vector<unsigned char> encryptCtr(const std::vector<unsigned char>& plaintext, unsigned int threads = 0) const;
+    std::vector<unsigned char> decryptCtr(const std::vector<unsigned char>& ciphertext, unsigned int threads = 0) const;
+    // Pointer form; out needs len bytes and may be the same buffer as in
+    void encryptCtr(const uint8_t* in, size_t len, uint8_t* out, unsigned int threads = 0) const;
+    void decryptCtr(const uint8_t* in, size_t len, uint8_t* out, unsigned int threads = 0) const;
+    
+    // AES-GCM authenticated encryption. Returns the ciphertext followed by the
+    // 16-byte tag; aad is authenticated but not encrypted. The nonce should be
+    // 12 bytes and must never repeat under the same key.
+    std::vector<unsigned char> encryptGcm(const std::vector<unsigned char>& nonce, const std::vector<unsigned char>& plaintext,
+                                          const std::vector<unsigned char>& aad = std::vector<unsigned char>()) const;
+    // Throws std::runtime_error if the tag does not verify
+    std::vector<unsigned char> decryptGcm(const std::vector<unsigned char>& nonce, const std::vector<unsigned char>& ciphertext,
+                                          const std::vector<unsigned char>& aad = std::vector<unsigned char>()) const;
+    
+    // Pointer form: out receives len bytes of ciphertext and the tag is written
+    // to tag[0..15]. For decryption, out is left zeroed if the tag does not
+    // verify. in and out may be the same buffer. Like CTR, large inputs are
+    // split across the worker pool.
+    void encryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                    const uint8_t* in, size_t len, uint8_t* out, uint8_t* tag, unsigned int threads = 0) const;
+    void decryptGcm(const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                    const uint8_t* in, size_t len, uint8_t* out, const uint8_t* tag, unsigned int threads = 0) const;
+    
+    // Batch CBC encryption of many small records in one call. Each record is
+    // padded and encrypted as a separate message, so it can be decrypted on
+    // its own, with IV + i (as a 128-bit big-endian counter) for record i.
+    // Independent records are interleaved through the block kernel and large
+    // batches are split across the worker pool.
+    template<typename T>
+    AESBatch encryptBatch(const T* values, size_t count) const {
+        const size_t recordSize = encryptedSize(sizeof(T));
+        AESBatch batch;
+        batch.data.resize(recordSize * count);
+        batch.offsets.resize(count + 1);
+        for (size_t i = 0; i < count; i++) {
+            batch.offsets[i] = i * recordSize;
+            std::memcpy(&batch.data[i * recordSize], &values[i], sizeof(T));
+            addPadding(&batch.data[i * recordSize], sizeof(T));
+        }
+        batch.offsets[count] = count * recordSize;
         
-        std::vector<unsigned char> paddedData = padData(bytes);
-        std::vector<unsigned char> result;
+        encryptRecords(batch);
+        return batch;
+    }
+    
+    template<typename T>
+    AESBatch encryptBatch(const std::vector<T>& values) const {
+        return encryptBatch(values.data(), values.size());
+    }
+    
+    AESBatch encryptBatch(const std::vector<std::string>& values) const;
+    
+    // Inverse of encryptBatch; record i must still be at index i
+    template<typename T>
+    std::vector<T> decryptBatch(const AESBatch& batch) const {
+        std::vector<unsigned char> plain(batch.data.size());
+        decryptRecords(batch, plain.data());
         
-        for (size_t i = 0; i < paddedData.size(); i += AES_BLOCK_SIZE) {
-            std::vector<unsigned char> block(paddedData.begin() + i, paddedData.begin() + i + AES_BLOCK_SIZE);
-            std::vector<unsigned char> encryptedBlock = encryptBlock(block);
-            result.insert(result.end(), encryptedBlock.begin(), encryptedBlock.end());
+        std::vector<T> result(batch.size());
+        for (size_t i = 0; i < result.size(); i++) {
+            size_t length = batch.recordSize(i) - AESKey::paddingLength(&plain[batch.offsets[i + 1] - AES_BLOCK_SIZE]);
+            if (length < sizeof(T)) {
+                throw std::runtime_error("Decrypted data is too small for the requested type");
+            }
+            std::memcpy(&result[i], &plain[batch.offsets[i]], sizeof(T));
         }
-        
         return result;
     }
     
+    std::vector<std::string> decryptStringBatch(const AESBatch& batch) const;
+    
     template<typename T>
-    T decrypt(const std::vector<unsigned char>& encryptedData) {
-        if (encryptedData.size() % AES_BLOCK_SIZE != 0) {
-            throw std::invalid_argument("Encrypted data size must be a multiple of the block size");
-        }
-        
-        std::vector<unsigned char> decryptedData;
+    std::vector<unsigned char> encrypt(const T& data) const {
+        std::vector<unsigned char> result(encryptedSize(sizeof(T)));
+        std::memcpy(result.data(), &data, sizeof(T));
+        encrypt(result.data(), sizeof(T));
+        return result;
+    }
+    
+    template<typename T>
+    T decrypt(const std::vector<unsigned char>& encryptedData) const {
+        std::vector<unsigned char> decryptedData(encryptedData.size());
+        size_t length = decrypt(encryptedData.data(), encryptedData.size(), decryptedData.data());
         
-        for (size_t i = 0; i < encryptedData.size(); i += AES_BLOCK_SIZE) {
-            std::vector<unsigned char> block(encryptedData.begin() + i, encryptedData.begin() + i + AES_BLOCK_SIZE);
-            std::vector<unsigned char> decryptedBlock = decryptBlock(block);
-            decryptedData.insert(decryptedData.end(), decryptedBlock.begin(), decryptedBlock.end());
+        T result;
+        if (length < sizeof(T)) {
+            throw std::runtime_error("Decrypted data is too small for the requested type");
         }
+        std::memcpy(&result, decryptedData.data(), sizeof(T));
         
-        std::vector<unsigned char> unpaddedData = removePadding(decryptedData);
+        return result;
+    }
+    
+    // Fixed-size form of encrypt<T>: the same ciphertext in a std::array on
+    // the stack, with no heap allocation on either side. For per-value work
+    // where the vector's allocation would cost more than the cipher.
+    template<typename T>
+    std::array<uint8_t, paddedSize<T> > encryptFixed(const T& data) const {
+        static_assert(std::is_trivially_copyable<T>::value, "encryptFixed needs a trivially copyable type");
+        std::array<uint8_t, paddedSize<T> > result;
+        std::memcpy(result.data(), &data, sizeof(T));
+        encrypt(result.data(), sizeof(T));
+        return result;
+    }
+    
+    template<typename T>
+    T decrypt(const std::array<uint8_t, paddedSize<T> >& encryptedData) const {
+        static_assert(std::is_trivially_copyable<T>::value, "decrypt<T> needs a trivially copyable type");
+        std::array<uint8_t, paddedSize<T> > decryptedData;
+        size_t length = decrypt(encryptedData.data(), encryptedData.size(), decryptedData.data(), 1);
         
         T result;
-        if (unpaddedData.size() < sizeof(T)) {
+        if (length < sizeof(T)) {
             throw std::runtime_error("Decrypted data is too small for the requested type");
         }
-        std::memcpy(&result, unpaddedData.data(), sizeof(T));
+        std::memcpy(&result, decryptedData.data(), sizeof(T));
         
         return result;
     }
 };
 
-#endif 
\ No newline at end of file
+template<typename T>
+constexpr size_t AESEncryption::paddedSize;
+
+#endif
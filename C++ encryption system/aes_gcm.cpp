@@ -0,0 +1,421 @@
+#include "aes_modes.h"
+#include "aes_thread_pool.h"
+#include <cstring>
+#include <vector>
+
+#ifdef AES_X86
+#include <immintrin.h>
+#endif
+
+// AES-GCM (NIST SP 800-38D).
+//
+// Encryption and authentication run as one pass: the data is processed in
+// stripes small enough to stay in L1, and each stripe is CTR-encrypted and
+// then fed to GHASH while it is still hot, so the buffer is read and written
+// once. GHASH uses PCLMULQDQ with an 8-block aggregated reduction when the
+// CPU has it, and Shoup's 4-bit table method otherwise.
+//
+// Large buffers are split into chunks on the worker pool. Each chunk hashes
+// its own ciphertext from a zero state; because GHASH is linear, the chunk
+// digests are then chained as X = X * H^m + S for a chunk of m blocks.
+
+static const size_t GCM_STRIPE_BLOCKS = 32;
+
+// Portable GHASH: 4-bit table multiplication
+
+// Reduction constants for the four bits shifted out per step
+static const uint64_t GHASH_LAST4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void tableInit(AESGhashKey& key, const unsigned char* h) {
+    uint64_t vh = loadBigEndian64(h);
+    uint64_t vl = loadBigEndian64(h + 8);
+    
+    // Index 8 (bit pattern 1000) is the field element 1, i.e. H itself
+    key.tableHigh[8] = vh;
+    key.tableLow[8] = vl;
+    key.tableHigh[0] = 0;
+    key.tableLow[0] = 0;
+    
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t t = (vl & 1) * 0xe1000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ (t << 32);
+        key.tableHigh[i] = vh;
+        key.tableLow[i] = vl;
+    }
+    
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            key.tableHigh[i + j] = key.tableHigh[i] ^ key.tableHigh[j];
+            key.tableLow[i + j] = key.tableLow[i] ^ key.tableLow[j];
+        }
+    }
+}
+
+// x = x * H
+static void tableMultiply(const AESGhashKey& key, unsigned char* x) {
+    unsigned char lo = x[15] & 0xf;
+    uint64_t zh = key.tableHigh[lo];
+    uint64_t zl = key.tableLow[lo];
+    
+    for (int i = 15; i >= 0; i--) {
+        lo = x[i] & 0xf;
+        unsigned char hi = (x[i] >> 4) & 0xf;
+        
+        if (i != 15) {
+            unsigned char rem = static_cast<unsigned char>(zl & 0xf);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (GHASH_LAST4[rem] << 48);
+            zh ^= key.tableHigh[lo];
+            zl ^= key.tableLow[lo];
+        }
+        
+        unsigned char rem = static_cast<unsigned char>(zl & 0xf);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (GHASH_LAST4[rem] << 48);
+        zh ^= key.tableHigh[hi];
+        zl ^= key.tableLow[hi];
+    }
+    
+    storeBigEndian64(x, zh);
+    storeBigEndian64(x + 8, zl);
+}
+
+static void tableBlocks(const AESGhashKey& key, unsigned char* state, const unsigned char* data, size_t blocks) {
+    for (size_t b = 0; b < blocks; b++) {
+        for (int i = 0; i < 16; i++) {
+            state[i] ^= data[b * 16 + i];
+        }
+        tableMultiply(key, state);
+    }
+}
+
+#ifdef AES_X86
+
+// Carry-less multiply GHASH (Gueron and Kounavis, "Intel Carry-Less
+// Multiplication Instruction and its Usage for Computing the GCM Mode").
+// Blocks are byte-reversed so PCLMULQDQ sees GHASH's reflected polynomials.
+
+AES_TARGET("ssse3")
+static inline __m128i byteReverse(__m128i x) {
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+// 256-bit carry-less product of a and b, accumulated into (lo, hi)
+AES_TARGET("pclmul,sse2")
+static inline void clmulAccumulate(__m128i a, __m128i b, __m128i& lo, __m128i& hi) {
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x11);
+    lo = _mm_xor_si128(lo, _mm_xor_si128(t0, _mm_slli_si128(t1, 8)));
+    hi = _mm_xor_si128(hi, _mm_xor_si128(t2, _mm_srli_si128(t1, 8)));
+}
+
+// Shifts the 256-bit product left by one bit (reflection) and reduces it
+// modulo x^128 + x^7 + x^2 + x + 1. Both steps are linear, so the sum of
+// several products needs only one reduction.
+AES_TARGET("sse2")
+static inline __m128i clmulReduce(__m128i lo, __m128i hi) {
+    __m128i carryLo = _mm_srli_epi32(lo, 31);
+    __m128i carryHi = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i cross = _mm_srli_si128(carryLo, 12);
+    carryHi = _mm_slli_si128(carryHi, 4);
+    carryLo = _mm_slli_si128(carryLo, 4);
+    lo = _mm_or_si128(lo, carryLo);
+    hi = _mm_or_si128(_mm_or_si128(hi, carryHi), cross);
+    
+    __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    __m128i b = _mm_srli_si128(a, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+    __m128i c = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    c = _mm_xor_si128(c, b);
+    lo = _mm_xor_si128(lo, c);
+    return _mm_xor_si128(hi, lo);
+}
+
+AES_TARGET("pclmul,sse2")
+static inline __m128i clmulMultiply(__m128i a, __m128i b) {
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    clmulAccumulate(a, b, lo, hi);
+    return clmulReduce(lo, hi);
+}
+
+AES_TARGET("pclmul,ssse3")
+static void clmulInit(AESGhashKey& key, const unsigned char* h) {
+    __m128i h1 = byteReverse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)));
+    __m128i power = h1;
+    for (int i = 0; i < 8; i++) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(key.powers[i]), power);
+        power = clmulMultiply(power, h1);
+    }
+}
+
+AES_TARGET("pclmul,ssse3")
+static void clmulBlocks(const AESGhashKey& key, unsigned char* state, const unsigned char* data, size_t blocks) {
+    const __m128i* powers = reinterpret_cast<const __m128i*>(key.powers);
+    const __m128i* in = reinterpret_cast<const __m128i*>(data);
+    __m128i x = byteReverse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)));
+    
+    // X = (X + C0) H^8 + C1 H^7 + ... + C7 H, reduced once per eight blocks
+    for (; blocks >= 8; blocks -= 8) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        clmulAccumulate(_mm_xor_si128(x, byteReverse(_mm_loadu_si128(in))), _mm_load_si128(powers + 7), lo, hi);
+        for (int i = 1; i < 8; i++) {
+            clmulAccumulate(byteReverse(_mm_loadu_si128(in + i)), _mm_load_si128(powers + 7 - i), lo, hi);
+        }
+        x = clmulReduce(lo, hi);
+        in += 8;
+    }
+    
+    __m128i h1 = _mm_load_si128(powers);
+    for (; blocks > 0; blocks--) {
+        x = clmulMultiply(_mm_xor_si128(x, byteReverse(_mm_loadu_si128(in))), h1);
+        in++;
+    }
+    
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), byteReverse(x));
+}
+
+#endif
+
+// The carry-less multiply path is used together with the hardware AES
+// kernels; forcing a portable AES kernel selects the table GHASH as well
+void ghashExpandKey(AESGhashKey& key, const AESKernel& kernel, const AESKeySchedule& ks) {
+    std::memset(key.h, 0, 16);
+    kernel.encryptBlocks(ks, key.h, key.h, 1);
+#ifdef AES_X86
+    key.clmul = cpuSupportsClmul() && (kernel.variants == aesniKernel() || kernel.variants == vaesKernel());
+    if (key.clmul) {
+        clmulInit(key, key.h);
+        return;
+    }
+#else
+    key.clmul = false;
+#endif
+    tableInit(key, key.h);
+}
+
+static void ghashBlocks(const AESGhashKey& key, unsigned char* state, const unsigned char* data, size_t blocks) {
+#ifdef AES_X86
+    if (key.clmul) {
+        clmulBlocks(key, state, data, blocks);
+        return;
+    }
+#endif
+    tableBlocks(key, state, data, blocks);
+}
+
+// GHASH over data of any length, zero-padding the final partial block
+static void ghashBytes(const AESGhashKey& key, unsigned char* state, const unsigned char* data, size_t len) {
+    ghashBlocks(key, state, data, len / 16);
+    size_t rest = len % 16;
+    if (rest > 0) {
+        unsigned char last[16] = {0};
+        std::memcpy(last, data + len - rest, rest);
+        ghashBlocks(key, state, last, 1);
+    }
+}
+
+// Increments the low 32 bits of a counter block (inc32)
+static inline void increment32(unsigned char* counter) {
+    for (int i = 15; i >= 12; i--) {
+        if (++counter[i] != 0) {
+            break;
+        }
+    }
+}
+
+// Adds n to the low 32 bits of a counter block, modulo 2^32
+static inline void add32(unsigned char* counter, uint32_t n) {
+    uint32_t low = (static_cast<uint32_t>(counter[12]) << 24) | (static_cast<uint32_t>(counter[13]) << 16) |
+                   (static_cast<uint32_t>(counter[14]) << 8) | counter[15];
+    low += n;
+    counter[12] = static_cast<unsigned char>(low >> 24);
+    counter[13] = static_cast<unsigned char>(low >> 16);
+    counter[14] = static_cast<unsigned char>(low >> 8);
+    counter[15] = static_cast<unsigned char>(low);
+}
+
+// x = x * y in GF(2^128), bit by bit (SP 800-38D algorithm 1). Only used a
+// few times per message to combine chunk digests.
+static void gfMultiply(unsigned char* x, const unsigned char* y) {
+    uint64_t vh = loadBigEndian64(y);
+    uint64_t vl = loadBigEndian64(y + 8);
+    uint64_t zh = 0;
+    uint64_t zl = 0;
+    
+    for (int i = 0; i < 128; i++) {
+        uint64_t bit = (x[i / 8] >> (7 - i % 8)) & 1;
+        zh ^= vh & (0 - bit);
+        zl ^= vl & (0 - bit);
+        uint64_t reduce = (vl & 1) * 0xe100000000000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ reduce;
+    }
+    
+    storeBigEndian64(x, zh);
+    storeBigEndian64(x + 8, zl);
+}
+
+// out = h^n by square-and-multiply
+static void gfPower(const unsigned char* h, uint64_t n, unsigned char* out) {
+    unsigned char base[16];
+    std::memcpy(base, h, 16);
+    std::memset(out, 0, 16);
+    out[0] = 0x80;    // the field element 1
+    
+    while (n > 0) {
+        if (n & 1) {
+            gfMultiply(out, base);
+        }
+        unsigned char square[16];
+        std::memcpy(square, base, 16);
+        gfMultiply(base, square);
+        n >>= 1;
+    }
+}
+
+// Derives the pre-counter block J0 and starts the GHASH state with the AAD
+static void gcmSetup(const AESGhashKey& key, const unsigned char* nonce, size_t nonceLen,
+                     const unsigned char* aad, size_t aadLen, unsigned char* j0, unsigned char* state) {
+    if (nonceLen == 12) {
+        std::memcpy(j0, nonce, 12);
+        j0[12] = 0;
+        j0[13] = 0;
+        j0[14] = 0;
+        j0[15] = 1;
+    } else {
+        std::memset(j0, 0, 16);
+        ghashBytes(key, j0, nonce, nonceLen);
+        unsigned char lengths[16] = {0};
+        storeBigEndian64(lengths + 8, static_cast<uint64_t>(nonceLen) * 8);
+        ghashBlocks(key, j0, lengths, 1);
+    }
+    
+    std::memset(state, 0, 16);
+    ghashBytes(key, state, aad, aadLen);
+}
+
+static void gcmFinish(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& key,
+                      const unsigned char* j0, unsigned char* state, size_t aadLen, size_t len, unsigned char* tag) {
+    unsigned char lengths[16];
+    storeBigEndian64(lengths, static_cast<uint64_t>(aadLen) * 8);
+    storeBigEndian64(lengths + 8, static_cast<uint64_t>(len) * 8);
+    ghashBlocks(key, state, lengths, 1);
+    
+    unsigned char mask[16];
+    kernel.encryptBlocks(ks, j0, mask, 1);
+    for (int i = 0; i < 16; i++) {
+        tag[i] = state[i] ^ mask[i];
+    }
+}
+
+// One pass of CTR (inc32) and GHASH over the data, stripe by stripe. GHASH
+// always covers the ciphertext: after encryption, or before decryption.
+static void gcmCrypt(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& key,
+                     const unsigned char* j0, unsigned char* state, bool encrypting,
+                     const unsigned char* in, unsigned char* out, size_t len) {
+    unsigned char counter[16];
+    std::memcpy(counter, j0, 16);
+    
+    alignas(16) unsigned char stripe[GCM_STRIPE_BLOCKS * 16];
+    while (len > 0) {
+        size_t bytes = len < sizeof(stripe) ? len : sizeof(stripe);
+        size_t blocks = (bytes + 15) / 16;
+        
+        for (size_t i = 0; i < blocks; i++) {
+            increment32(counter);
+            std::memcpy(stripe + i * 16, counter, 16);
+        }
+        kernel.encryptBlocks(ks, stripe, stripe, blocks);
+        
+        if (!encrypting) {
+            ghashBytes(key, state, in, bytes);
+        }
+        xorBytes(out, in, stripe, bytes);
+        if (encrypting) {
+            ghashBytes(key, state, out, bytes);
+        }
+        
+        in += bytes;
+        out += bytes;
+        len -= bytes;
+    }
+}
+
+// gcmCrypt split into parallelChunkBytes() chunks on the worker pool
+static void gcmCryptParallel(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& key,
+                             const unsigned char* j0, unsigned char* state, bool encrypting,
+                             const unsigned char* in, unsigned char* out, size_t len, unsigned int threads) {
+    const size_t chunkBytes = parallelChunkBytes();
+    size_t chunks = (len + chunkBytes - 1) / chunkBytes;
+    if (chunks <= 1 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        gcmCrypt(kernel, ks, key, j0, state, encrypting, in, out, len);
+        return;
+    }
+    
+    std::vector<unsigned char> digests(chunks * 16, 0);
+    AESThreadPool::instance().parallelFor(chunks, threads, [&](size_t chunk) {
+        size_t offset = chunk * chunkBytes;
+        size_t bytes = len - offset < chunkBytes ? len - offset : chunkBytes;
+        unsigned char counter[16];
+        std::memcpy(counter, j0, 16);
+        add32(counter, static_cast<uint32_t>(offset / 16));
+        gcmCrypt(kernel, ks, key, counter, &digests[chunk * 16], encrypting, in + offset, out + offset, bytes);
+    });
+    
+    // All chunks but the last are full, so each step multiplies by H^m; the
+    // last step uses H^k for the k blocks of the final chunk
+    unsigned char chunkPower[16];
+    unsigned char lastPower[16];
+    gfPower(key.h, chunkBytes / 16, chunkPower);
+    gfPower(key.h, (len - (chunks - 1) * chunkBytes + 15) / 16, lastPower);
+    
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        gfMultiply(state, chunk + 1 < chunks ? chunkPower : lastPower);
+        xorBytes(state, state, &digests[chunk * 16], 16);
+    }
+}
+
+void gcmEncrypt(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& ghash,
+                const unsigned char* nonce, size_t nonceLen, const unsigned char* aad, size_t aadLen,
+                const unsigned char* in, unsigned char* out, size_t len, unsigned char* tag, unsigned int threads) {
+    unsigned char j0[16];
+    unsigned char state[16];
+    gcmSetup(ghash, nonce, nonceLen, aad, aadLen, j0, state);
+    gcmCryptParallel(kernel, ks, ghash, j0, state, true, in, out, len, threads);
+    gcmFinish(kernel, ks, ghash, j0, state, aadLen, len, tag);
+}
+
+bool gcmDecrypt(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& ghash,
+                const unsigned char* nonce, size_t nonceLen, const unsigned char* aad, size_t aadLen,
+                const unsigned char* in, unsigned char* out, size_t len, const unsigned char* tag,
+                unsigned int threads) {
+    unsigned char j0[16];
+    unsigned char state[16];
+    gcmSetup(ghash, nonce, nonceLen, aad, aadLen, j0, state);
+    gcmCryptParallel(kernel, ks, ghash, j0, state, false, in, out, len, threads);
+    
+    unsigned char expected[16];
+    gcmFinish(kernel, ks, ghash, j0, state, aadLen, len, expected);
+    
+    // Constant-time tag comparison
+    unsigned char diff = 0;
+    for (int i = 0; i < 16; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff != 0) {
+        if (len > 0) {
+            std::memset(out, 0, len);
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,316 @@
+#include "aes_kernels.h"
+
+#ifdef AES_X86
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Blocks kept in flight per loop iteration. AESENC has a latency of several
+// cycles but a throughput of one or two per cycle, so independent blocks are
+// interleaved to keep the AES units busy.
+static const int AESNI_LANES = 8;
+static const int VAES_LANES = 4;  // 4 x 4 blocks per zmm register
+
+// One round applied to every lane; written out so the lanes stay in registers
+#define AES_ROUND8(op, key) \
+    do { \
+        b0 = op(b0, key); b1 = op(b1, key); b2 = op(b2, key); b3 = op(b3, key); \
+        b4 = op(b4, key); b5 = op(b5, key); b6 = op(b6, key); b7 = op(b7, key); \
+    } while (0)
+
+#define AES_ROUND4(op, key) \
+    do { \
+        b0 = op(b0, key); b1 = op(b1, key); b2 = op(b2, key); b3 = op(b3, key); \
+    } while (0)
+
+// Round r of the loaded schedule rk, for AES_INNER_ROUNDS
+#define AES_ROUND8_AT(op, r) AES_ROUND8(op, rk[r])
+#define AES_ROUND4_AT(op, r) AES_ROUND4(op, rk[r])
+#define AES_ROUND1_AT(op, r) (b = op(b, rk[r]))
+
+// CPU feature detection
+struct X86Features {
+    bool aesni;
+    bool clmul;
+    bool vaes512;
+    
+    X86Features() : aesni(false), clmul(false), vaes512(false) {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        unsigned int maxLeaf = cpuid(0, 0, eax, ebx, ecx, edx);
+        if (maxLeaf < 1) {
+            return;
+        }
+        
+        cpuid(1, 0, eax, ebx, ecx, edx);
+        aesni = (ecx & (1u << 25)) != 0;
+        clmul = (ecx & (1u << 1)) != 0 && (ecx & (1u << 9)) != 0;
+        bool osxsave = (ecx & (1u << 27)) != 0;
+        
+        if (maxLeaf < 7 || !osxsave) {
+            return;
+        }
+        
+        // The OS must save the AVX-512 register state (XCR0 bits 1, 2, 5, 6 and 7)
+        if ((xgetbv0() & 0xe6) != 0xe6) {
+            return;
+        }
+        
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        bool avx512f = (ebx & (1u << 16)) != 0;
+        bool vaes = (ecx & (1u << 9)) != 0;
+        vaes512 = aesni && avx512f && vaes;
+    }
+    
+    static unsigned int cpuid(unsigned int leaf, unsigned int subleaf,
+                              unsigned int& eax, unsigned int& ebx, unsigned int& ecx, unsigned int& edx) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int regs[4];
+        __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+        eax = regs[0];
+        ebx = regs[1];
+        ecx = regs[2];
+        edx = regs[3];
+#else
+        __cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+#endif
+        return eax;
+    }
+    
+    static unsigned long long xgetbv0() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        return _xgetbv(0);
+#else
+        unsigned int lo, hi;
+        __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+    }
+};
+
+static const X86Features& cpuFeatures() {
+    static const X86Features features;
+    return features;
+}
+
+// AES-NI kernel: 128-bit AESENC/AESDEC, eight blocks interleaved
+template<int ROUNDS>
+AES_TARGET("aes,sse2")
+static void aesniEncryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    __m128i rk[ROUNDS + 1];
+    for (int r = 0; r <= ROUNDS; r++) {
+        rk[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(ks.encKeys) + r);
+    }
+    
+    for (; blocks >= AESNI_LANES; blocks -= AESNI_LANES) {
+        const __m128i* src = reinterpret_cast<const __m128i*>(in);
+        __m128i* dst = reinterpret_cast<__m128i*>(out);
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + 0), rk[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + 1), rk[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + 2), rk[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + 3), rk[0]);
+        __m128i b4 = _mm_xor_si128(_mm_loadu_si128(src + 4), rk[0]);
+        __m128i b5 = _mm_xor_si128(_mm_loadu_si128(src + 5), rk[0]);
+        __m128i b6 = _mm_xor_si128(_mm_loadu_si128(src + 6), rk[0]);
+        __m128i b7 = _mm_xor_si128(_mm_loadu_si128(src + 7), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND8_AT, _mm_aesenc_si128);
+        AES_ROUND8(_mm_aesenclast_si128, rk[ROUNDS]);
+        _mm_storeu_si128(dst + 0, b0);
+        _mm_storeu_si128(dst + 1, b1);
+        _mm_storeu_si128(dst + 2, b2);
+        _mm_storeu_si128(dst + 3, b3);
+        _mm_storeu_si128(dst + 4, b4);
+        _mm_storeu_si128(dst + 5, b5);
+        _mm_storeu_si128(dst + 6, b6);
+        _mm_storeu_si128(dst + 7, b7);
+        in += AESNI_LANES * 16;
+        out += AESNI_LANES * 16;
+    }
+    
+    for (; blocks > 0; blocks--) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND1_AT, _mm_aesenc_si128);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_aesenclast_si128(b, rk[ROUNDS]));
+        in += 16;
+        out += 16;
+    }
+}
+
+template<int ROUNDS>
+AES_TARGET("aes,sse2")
+static void aesniDecryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    // decKeys is already in equivalent inverse cipher form, which is what AESDEC expects
+    __m128i rk[ROUNDS + 1];
+    for (int r = 0; r <= ROUNDS; r++) {
+        rk[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(ks.decKeys) + r);
+    }
+    
+    for (; blocks >= AESNI_LANES; blocks -= AESNI_LANES) {
+        const __m128i* src = reinterpret_cast<const __m128i*>(in);
+        __m128i* dst = reinterpret_cast<__m128i*>(out);
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128(src + 0), rk[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128(src + 1), rk[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128(src + 2), rk[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128(src + 3), rk[0]);
+        __m128i b4 = _mm_xor_si128(_mm_loadu_si128(src + 4), rk[0]);
+        __m128i b5 = _mm_xor_si128(_mm_loadu_si128(src + 5), rk[0]);
+        __m128i b6 = _mm_xor_si128(_mm_loadu_si128(src + 6), rk[0]);
+        __m128i b7 = _mm_xor_si128(_mm_loadu_si128(src + 7), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND8_AT, _mm_aesdec_si128);
+        AES_ROUND8(_mm_aesdeclast_si128, rk[ROUNDS]);
+        _mm_storeu_si128(dst + 0, b0);
+        _mm_storeu_si128(dst + 1, b1);
+        _mm_storeu_si128(dst + 2, b2);
+        _mm_storeu_si128(dst + 3, b3);
+        _mm_storeu_si128(dst + 4, b4);
+        _mm_storeu_si128(dst + 5, b5);
+        _mm_storeu_si128(dst + 6, b6);
+        _mm_storeu_si128(dst + 7, b7);
+        in += AESNI_LANES * 16;
+        out += AESNI_LANES * 16;
+    }
+    
+    for (; blocks > 0; blocks--) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND1_AT, _mm_aesdec_si128);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_aesdeclast_si128(b, rk[ROUNDS]));
+        in += 16;
+        out += 16;
+    }
+}
+
+// VAES kernel: the same round function on four blocks per 512-bit register,
+// sixteen blocks per iteration. Runs shorter than one register fall back to AES-NI.
+AES_TARGET("avx512f")
+static inline __m512i broadcastRoundKey(const uint32_t* keys, int round) {
+    // The zero-masked form avoids reading an undefined source register
+    return _mm512_maskz_broadcast_i32x4(0xffff, _mm_load_si128(reinterpret_cast<const __m128i*>(keys) + round));
+}
+
+template<int ROUNDS>
+AES_TARGET("vaes,avx512f")
+static void vaesEncryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    // Single blocks (CBC chaining) are not worth broadcasting the key schedule
+    if (blocks < 4) {
+        aesniEncryptBlocks<ROUNDS>(ks, in, out, blocks);
+        return;
+    }
+    
+    __m512i rk[ROUNDS + 1];
+    for (int r = 0; r <= ROUNDS; r++) {
+        rk[r] = broadcastRoundKey(ks.encKeys, r);
+    }
+    
+    for (; blocks >= VAES_LANES * 4; blocks -= VAES_LANES * 4) {
+        __m512i b0 = _mm512_xor_si512(_mm512_loadu_si512(in), rk[0]);
+        __m512i b1 = _mm512_xor_si512(_mm512_loadu_si512(in + 64), rk[0]);
+        __m512i b2 = _mm512_xor_si512(_mm512_loadu_si512(in + 128), rk[0]);
+        __m512i b3 = _mm512_xor_si512(_mm512_loadu_si512(in + 192), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND4_AT, _mm512_aesenc_epi128);
+        AES_ROUND4(_mm512_aesenclast_epi128, rk[ROUNDS]);
+        _mm512_storeu_si512(out, b0);
+        _mm512_storeu_si512(out + 64, b1);
+        _mm512_storeu_si512(out + 128, b2);
+        _mm512_storeu_si512(out + 192, b3);
+        in += VAES_LANES * 64;
+        out += VAES_LANES * 64;
+    }
+    
+    for (; blocks >= 4; blocks -= 4) {
+        __m512i b = _mm512_xor_si512(_mm512_loadu_si512(in), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND1_AT, _mm512_aesenc_epi128);
+        _mm512_storeu_si512(out, _mm512_aesenclast_epi128(b, rk[ROUNDS]));
+        in += 64;
+        out += 64;
+    }
+    
+    if (blocks > 0) {
+        aesniEncryptBlocks<ROUNDS>(ks, in, out, blocks);
+    }
+}
+
+template<int ROUNDS>
+AES_TARGET("vaes,avx512f")
+static void vaesDecryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    // Single blocks (CBC chaining) are not worth broadcasting the key schedule
+    if (blocks < 4) {
+        aesniDecryptBlocks<ROUNDS>(ks, in, out, blocks);
+        return;
+    }
+    
+    __m512i rk[ROUNDS + 1];
+    for (int r = 0; r <= ROUNDS; r++) {
+        rk[r] = broadcastRoundKey(ks.decKeys, r);
+    }
+    
+    for (; blocks >= VAES_LANES * 4; blocks -= VAES_LANES * 4) {
+        __m512i b0 = _mm512_xor_si512(_mm512_loadu_si512(in), rk[0]);
+        __m512i b1 = _mm512_xor_si512(_mm512_loadu_si512(in + 64), rk[0]);
+        __m512i b2 = _mm512_xor_si512(_mm512_loadu_si512(in + 128), rk[0]);
+        __m512i b3 = _mm512_xor_si512(_mm512_loadu_si512(in + 192), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND4_AT, _mm512_aesdec_epi128);
+        AES_ROUND4(_mm512_aesdeclast_epi128, rk[ROUNDS]);
+        _mm512_storeu_si512(out, b0);
+        _mm512_storeu_si512(out + 64, b1);
+        _mm512_storeu_si512(out + 128, b2);
+        _mm512_storeu_si512(out + 192, b3);
+        in += VAES_LANES * 64;
+        out += VAES_LANES * 64;
+    }
+    
+    for (; blocks >= 4; blocks -= 4) {
+        __m512i b = _mm512_xor_si512(_mm512_loadu_si512(in), rk[0]);
+        AES_INNER_ROUNDS(ROUNDS, AES_ROUND1_AT, _mm512_aesdec_epi128);
+        _mm512_storeu_si512(out, _mm512_aesdeclast_epi128(b, rk[ROUNDS]));
+        in += 64;
+        out += 64;
+    }
+    
+    if (blocks > 0) {
+        aesniDecryptBlocks<ROUNDS>(ks, in, out, blocks);
+    }
+}
+
+static const AESKernel AESNI_KERNELS[3] = {
+    { "aesni", 1, 8, aesniEncryptBlocks<10>, aesniDecryptBlocks<10>, AESNI_KERNELS },
+    { "aesni", 1, 8, aesniEncryptBlocks<12>, aesniDecryptBlocks<12>, AESNI_KERNELS },
+    { "aesni", 1, 8, aesniEncryptBlocks<14>, aesniDecryptBlocks<14>, AESNI_KERNELS }
+};
+static const AESKernel VAES_KERNELS[3] = {
+    { "vaes", 0, 16, vaesEncryptBlocks<10>, vaesDecryptBlocks<10>, VAES_KERNELS },
+    { "vaes", 0, 16, vaesEncryptBlocks<12>, vaesDecryptBlocks<12>, VAES_KERNELS },
+    { "vaes", 0, 16, vaesEncryptBlocks<14>, vaesDecryptBlocks<14>, VAES_KERNELS }
+};
+
+const AESKernel* aesniKernel() {
+    return cpuFeatures().aesni ? &AESNI_KERNELS[0] : nullptr;
+}
+
+const AESKernel* vaesKernel() {
+    return cpuFeatures().vaes512 ? &VAES_KERNELS[0] : nullptr;
+}
+
+bool cpuSupportsClmul() {
+    return cpuFeatures().clmul;
+}
+
+#else
+
+// Not an x86 target (e.g. the Emscripten build): only the portable kernel exists
+const AESKernel* aesniKernel() {
+    return nullptr;
+}
+
+const AESKernel* vaesKernel() {
+    return nullptr;
+}
+
+bool cpuSupportsClmul() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,499 @@
+#include "aes_kernels.h"
+
+// Constant-time bitsliced AES (the "ct64" representation).
+//
+// Eight blocks are processed together. After the orthogonalization step,
+// slice q[i] holds bit i of every state byte of every block, so SubBytes is a
+// boolean circuit and ShiftRows/MixColumns are fixed shifts and rotations.
+// Nothing is indexed by secret data, which removes the cache-timing leak of
+// the SBOX/T-table lookups.
+//
+// A slice word is two 64-bit lanes; each lane carries four blocks. With
+// GCC/Clang vector extensions the lanes map onto one SSE2/NEON/wasm-SIMD
+// register, elsewhere they are a plain pair of integers.
+
+#if defined(__GNUC__) || defined(__clang__)
+
+typedef uint64_t SliceWord __attribute__((vector_size(16)));
+
+static inline SliceWord makeWord(uint64_t lane0, uint64_t lane1) {
+    SliceWord w = { lane0, lane1 };
+    return w;
+}
+
+static inline uint64_t wordLane(const SliceWord& w, int lane) {
+    return w[lane];
+}
+
+#else
+
+struct SliceWord {
+    uint64_t v[2];
+};
+
+static inline SliceWord makeWord(uint64_t lane0, uint64_t lane1) {
+    SliceWord w = { { lane0, lane1 } };
+    return w;
+}
+
+static inline uint64_t wordLane(const SliceWord& w, int lane) {
+    return w.v[lane];
+}
+
+static inline SliceWord operator^(const SliceWord& a, const SliceWord& b) { return makeWord(a.v[0] ^ b.v[0], a.v[1] ^ b.v[1]); }
+static inline SliceWord operator&(const SliceWord& a, const SliceWord& b) { return makeWord(a.v[0] & b.v[0], a.v[1] & b.v[1]); }
+static inline SliceWord operator|(const SliceWord& a, const SliceWord& b) { return makeWord(a.v[0] | b.v[0], a.v[1] | b.v[1]); }
+static inline SliceWord operator&(const SliceWord& a, uint64_t m) { return makeWord(a.v[0] & m, a.v[1] & m); }
+static inline SliceWord operator^(const SliceWord& a, uint64_t m) { return makeWord(a.v[0] ^ m, a.v[1] ^ m); }
+static inline SliceWord operator~(const SliceWord& a) { return makeWord(~a.v[0], ~a.v[1]); }
+static inline SliceWord operator<<(const SliceWord& a, int n) { return makeWord(a.v[0] << n, a.v[1] << n); }
+static inline SliceWord operator>>(const SliceWord& a, int n) { return makeWord(a.v[0] >> n, a.v[1] >> n); }
+
+#endif
+
+static const int LANE_BLOCKS = 4;
+static const int BATCH_BLOCKS = 2 * LANE_BLOCKS;
+
+// Bit-matrix transposition between the byte layout and the bitsliced layout.
+// It is an involution, so the same function converts in both directions.
+template<typename W>
+static inline void swapBits(W& x, W& y, uint64_t lowMask, uint64_t highMask, int shift) {
+    W a = x;
+    W b = y;
+    x = (a & lowMask) | ((b & lowMask) << shift);
+    y = ((a & highMask) >> shift) | (b & highMask);
+}
+
+template<typename W>
+static inline void ortho(W* q) {
+    swapBits(q[0], q[1], 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1);
+    swapBits(q[2], q[3], 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1);
+    swapBits(q[4], q[5], 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1);
+    swapBits(q[6], q[7], 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1);
+    
+    swapBits(q[0], q[2], 0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2);
+    swapBits(q[1], q[3], 0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2);
+    swapBits(q[4], q[6], 0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2);
+    swapBits(q[5], q[7], 0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2);
+    
+    swapBits(q[0], q[4], 0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4);
+    swapBits(q[1], q[5], 0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4);
+    swapBits(q[2], q[6], 0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4);
+    swapBits(q[3], q[7], 0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4);
+}
+
+static inline uint32_t loadWord(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) |
+           static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+static inline void storeWord(unsigned char* p, uint32_t w) {
+    p[0] = static_cast<unsigned char>(w);
+    p[1] = static_cast<unsigned char>(w >> 8);
+    p[2] = static_cast<unsigned char>(w >> 16);
+    p[3] = static_cast<unsigned char>(w >> 24);
+}
+
+// Spread one block (four little-endian column words) over two 64-bit words,
+// in the order expected by ortho(). Four blocks fill q[0..3] and q[4..7].
+static inline void interleaveIn(uint64_t& q0, uint64_t& q1, const uint32_t* w) {
+    uint64_t x0 = w[0];
+    uint64_t x1 = w[1];
+    uint64_t x2 = w[2];
+    uint64_t x3 = w[3];
+    x0 = (x0 | (x0 << 16)) & 0x0000FFFF0000FFFFULL;
+    x1 = (x1 | (x1 << 16)) & 0x0000FFFF0000FFFFULL;
+    x2 = (x2 | (x2 << 16)) & 0x0000FFFF0000FFFFULL;
+    x3 = (x3 | (x3 << 16)) & 0x0000FFFF0000FFFFULL;
+    x0 = (x0 | (x0 << 8)) & 0x00FF00FF00FF00FFULL;
+    x1 = (x1 | (x1 << 8)) & 0x00FF00FF00FF00FFULL;
+    x2 = (x2 | (x2 << 8)) & 0x00FF00FF00FF00FFULL;
+    x3 = (x3 | (x3 << 8)) & 0x00FF00FF00FF00FFULL;
+    q0 = x0 | (x2 << 8);
+    q1 = x1 | (x3 << 8);
+}
+
+static inline void interleaveOut(uint32_t* w, uint64_t q0, uint64_t q1) {
+    uint64_t x0 = q0 & 0x00FF00FF00FF00FFULL;
+    uint64_t x1 = q1 & 0x00FF00FF00FF00FFULL;
+    uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+    uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+    x0 = (x0 | (x0 >> 8)) & 0x0000FFFF0000FFFFULL;
+    x1 = (x1 | (x1 >> 8)) & 0x0000FFFF0000FFFFULL;
+    x2 = (x2 | (x2 >> 8)) & 0x0000FFFF0000FFFFULL;
+    x3 = (x3 | (x3 >> 8)) & 0x0000FFFF0000FFFFULL;
+    w[0] = static_cast<uint32_t>(x0) | static_cast<uint32_t>(x0 >> 16);
+    w[1] = static_cast<uint32_t>(x1) | static_cast<uint32_t>(x1 >> 16);
+    w[2] = static_cast<uint32_t>(x2) | static_cast<uint32_t>(x2 >> 16);
+    w[3] = static_cast<uint32_t>(x3) | static_cast<uint32_t>(x3 >> 16);
+}
+
+// Load up to eight blocks into bitsliced form; missing blocks are zero
+static inline void loadBatch(SliceWord* q, const unsigned char* in, size_t blocks) {
+    uint64_t lanes[2][8] = { { 0 } };
+    for (int lane = 0; lane < 2; lane++) {
+        for (int i = 0; i < LANE_BLOCKS; i++) {
+            size_t block = static_cast<size_t>(lane * LANE_BLOCKS + i);
+            uint32_t w[4] = { 0, 0, 0, 0 };
+            if (block < blocks) {
+                for (int c = 0; c < 4; c++) {
+                    w[c] = loadWord(in + block * 16 + c * 4);
+                }
+            }
+            interleaveIn(lanes[lane][i], lanes[lane][i + 4], w);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        q[i] = makeWord(lanes[0][i], lanes[1][i]);
+    }
+    ortho(q);
+}
+
+static inline void storeBatch(unsigned char* out, SliceWord* q, size_t blocks) {
+    ortho(q);
+    for (int lane = 0; lane < 2; lane++) {
+        for (int i = 0; i < LANE_BLOCKS; i++) {
+            size_t block = static_cast<size_t>(lane * LANE_BLOCKS + i);
+            if (block >= blocks) {
+                return;
+            }
+            uint32_t w[4];
+            interleaveOut(w, wordLane(q[i], lane), wordLane(q[i + 4], lane));
+            for (int c = 0; c < 4; c++) {
+                storeWord(out + block * 16 + c * 4, w[c]);
+            }
+        }
+    }
+}
+
+// SubBytes as the 113-gate circuit of Boyar and Peralta ("A new combinational
+// logic minimization technique with applications to cryptology", 2009).
+// x0 is the most significant bit of the input byte, s0 of the output.
+static inline void sbox(SliceWord* q) {
+    SliceWord x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4];
+    SliceWord x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+    
+    // Top linear transformation
+    SliceWord y14 = x3 ^ x5;
+    SliceWord y13 = x0 ^ x6;
+    SliceWord y9 = x0 ^ x3;
+    SliceWord y8 = x0 ^ x5;
+    SliceWord t0 = x1 ^ x2;
+    SliceWord y1 = t0 ^ x7;
+    SliceWord y4 = y1 ^ x3;
+    SliceWord y12 = y13 ^ y14;
+    SliceWord y2 = y1 ^ x0;
+    SliceWord y5 = y1 ^ x6;
+    SliceWord y3 = y5 ^ y8;
+    SliceWord t1 = x4 ^ y12;
+    SliceWord y15 = t1 ^ x5;
+    SliceWord y20 = t1 ^ x1;
+    SliceWord y6 = y15 ^ x7;
+    SliceWord y10 = y15 ^ t0;
+    SliceWord y11 = y20 ^ y9;
+    SliceWord y7 = x7 ^ y11;
+    SliceWord y17 = y10 ^ y11;
+    SliceWord y19 = y10 ^ y8;
+    SliceWord y16 = t0 ^ y11;
+    SliceWord y21 = y13 ^ y16;
+    SliceWord y18 = x0 ^ y16;
+    
+    // Non-linear section
+    SliceWord t2 = y12 & y15;
+    SliceWord t3 = y3 & y6;
+    SliceWord t4 = t3 ^ t2;
+    SliceWord t5 = y4 & x7;
+    SliceWord t6 = t5 ^ t2;
+    SliceWord t7 = y13 & y16;
+    SliceWord t8 = y5 & y1;
+    SliceWord t9 = t8 ^ t7;
+    SliceWord t10 = y2 & y7;
+    SliceWord t11 = t10 ^ t7;
+    SliceWord t12 = y9 & y11;
+    SliceWord t13 = y14 & y17;
+    SliceWord t14 = t13 ^ t12;
+    SliceWord t15 = y8 & y10;
+    SliceWord t16 = t15 ^ t12;
+    SliceWord t17 = t4 ^ t14;
+    SliceWord t18 = t6 ^ t16;
+    SliceWord t19 = t9 ^ t14;
+    SliceWord t20 = t11 ^ t16;
+    SliceWord t21 = t17 ^ y20;
+    SliceWord t22 = t18 ^ y19;
+    SliceWord t23 = t19 ^ y21;
+    SliceWord t24 = t20 ^ y18;
+    
+    SliceWord t25 = t21 ^ t22;
+    SliceWord t26 = t21 & t23;
+    SliceWord t27 = t24 ^ t26;
+    SliceWord t28 = t25 & t27;
+    SliceWord t29 = t28 ^ t22;
+    SliceWord t30 = t23 ^ t24;
+    SliceWord t31 = t22 ^ t26;
+    SliceWord t32 = t31 & t30;
+    SliceWord t33 = t32 ^ t24;
+    SliceWord t34 = t23 ^ t33;
+    SliceWord t35 = t27 ^ t33;
+    SliceWord t36 = t24 & t35;
+    SliceWord t37 = t36 ^ t34;
+    SliceWord t38 = t27 ^ t36;
+    SliceWord t39 = t29 & t38;
+    SliceWord t40 = t25 ^ t39;
+    
+    SliceWord t41 = t40 ^ t37;
+    SliceWord t42 = t29 ^ t33;
+    SliceWord t43 = t29 ^ t40;
+    SliceWord t44 = t33 ^ t37;
+    SliceWord t45 = t42 ^ t41;
+    SliceWord z0 = t44 & y15;
+    SliceWord z1 = t37 & y6;
+    SliceWord z2 = t33 & x7;
+    SliceWord z3 = t43 & y16;
+    SliceWord z4 = t40 & y1;
+    SliceWord z5 = t29 & y7;
+    SliceWord z6 = t42 & y11;
+    SliceWord z7 = t45 & y17;
+    SliceWord z8 = t41 & y10;
+    SliceWord z9 = t44 & y12;
+    SliceWord z10 = t37 & y3;
+    SliceWord z11 = t33 & y4;
+    SliceWord z12 = t43 & y13;
+    SliceWord z13 = t40 & y5;
+    SliceWord z14 = t29 & y2;
+    SliceWord z15 = t42 & y9;
+    SliceWord z16 = t45 & y14;
+    SliceWord z17 = t41 & y8;
+    
+    // Bottom linear transformation
+    SliceWord t46 = z15 ^ z16;
+    SliceWord t47 = z10 ^ z11;
+    SliceWord t48 = z5 ^ z13;
+    SliceWord t49 = z9 ^ z10;
+    SliceWord t50 = z2 ^ z12;
+    SliceWord t51 = z2 ^ z5;
+    SliceWord t52 = z7 ^ z8;
+    SliceWord t53 = z0 ^ z3;
+    SliceWord t54 = z6 ^ z7;
+    SliceWord t55 = z16 ^ z17;
+    SliceWord t56 = z12 ^ t48;
+    SliceWord t57 = t50 ^ t53;
+    SliceWord t58 = z4 ^ t46;
+    SliceWord t59 = z3 ^ t54;
+    SliceWord t60 = t46 ^ t57;
+    SliceWord t61 = z14 ^ t57;
+    SliceWord t62 = t52 ^ t58;
+    SliceWord t63 = t49 ^ t58;
+    SliceWord t64 = z4 ^ t59;
+    SliceWord t65 = t61 ^ t62;
+    SliceWord t66 = z1 ^ t63;
+    SliceWord s0 = t59 ^ t63;
+    SliceWord s6 = t56 ^ ~t62;
+    SliceWord s7 = t48 ^ ~t60;
+    SliceWord t67 = t64 ^ t65;
+    SliceWord s3 = t53 ^ t66;
+    SliceWord s4 = t51 ^ t66;
+    SliceWord s5 = t47 ^ t65;
+    SliceWord s1 = t64 ^ ~s3;
+    SliceWord s2 = t55 ^ ~t67;
+    
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+// Inverse of the S-box affine map: x = A^-1(y ^ 0x63), with the 0x63
+// constant folded in as complemented slices
+static inline void invAffine(SliceWord* q) {
+    SliceWord q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3];
+    SliceWord q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+    q[7] = q1 ^ q4 ^ q6;
+    q[6] = q0 ^ q3 ^ q5;
+    q[5] = q7 ^ q2 ^ q4;
+    q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2;
+    q[2] = q4 ^ q7 ^ q1;
+    q[1] = q3 ^ q6 ^ q0;
+    q[0] = q2 ^ q5 ^ q7;
+}
+
+// InvSubBytes(y) = A^-1(SubBytes(A^-1(y ^ 0x63)) ^ 0x63), reusing the forward circuit
+static inline void invSbox(SliceWord* q) {
+    invAffine(q);
+    sbox(q);
+    invAffine(q);
+}
+
+static inline void shiftRows(SliceWord* q) {
+    for (int i = 0; i < 8; i++) {
+        SliceWord x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL) |
+               ((x & 0x00000000FFF00000ULL) >> 4) |
+               ((x & 0x00000000000F0000ULL) << 12) |
+               ((x & 0x0000FF0000000000ULL) >> 8) |
+               ((x & 0x000000FF00000000ULL) << 8) |
+               ((x & 0xF000000000000000ULL) >> 12) |
+               ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+static inline void invShiftRows(SliceWord* q) {
+    for (int i = 0; i < 8; i++) {
+        SliceWord x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL) |
+               ((x & 0x000000000FFF0000ULL) << 4) |
+               ((x & 0x00000000F0000000ULL) >> 12) |
+               ((x & 0x000000FF00000000ULL) << 8) |
+               ((x & 0x0000FF0000000000ULL) >> 8) |
+               ((x & 0x000F000000000000ULL) << 12) |
+               ((x & 0xFFF0000000000000ULL) >> 4);
+    }
+}
+
+// Rotations of the four columns held in each 64-bit lane
+static inline SliceWord rotateRow(const SliceWord& x) {
+    return (x >> 16) | (x << 48);
+}
+
+static inline SliceWord rotateHalf(const SliceWord& x) {
+    return (x << 32) | (x >> 32);
+}
+
+static inline void mixColumns(SliceWord* q) {
+    SliceWord q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    SliceWord q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    SliceWord r0 = rotateRow(q0), r1 = rotateRow(q1), r2 = rotateRow(q2), r3 = rotateRow(q3);
+    SliceWord r4 = rotateRow(q4), r5 = rotateRow(q5), r6 = rotateRow(q6), r7 = rotateRow(q7);
+    
+    q[0] = q7 ^ r7 ^ r0 ^ rotateHalf(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotateHalf(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ rotateHalf(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotateHalf(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotateHalf(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ rotateHalf(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ rotateHalf(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ rotateHalf(q7 ^ r7);
+}
+
+static inline void invMixColumns(SliceWord* q) {
+    SliceWord q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    SliceWord q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    SliceWord r0 = rotateRow(q0), r1 = rotateRow(q1), r2 = rotateRow(q2), r3 = rotateRow(q3);
+    SliceWord r4 = rotateRow(q4), r5 = rotateRow(q5), r6 = rotateRow(q6), r7 = rotateRow(q7);
+    
+    q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ rotateHalf(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+    q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ rotateHalf(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+    q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ rotateHalf(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+    q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^ rotateHalf(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+    q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^ rotateHalf(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+    q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^ rotateHalf(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+    q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ rotateHalf(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+    q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ rotateHalf(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+static inline void addRoundKey(SliceWord* q, const uint64_t* sk) {
+    for (int i = 0; i < 8; i++) {
+        q[i] = q[i] ^ sk[i];
+    }
+}
+
+// One inner round of encryption, and of the straightforward inverse cipher
+// (which uses the encryption round keys in reverse order)
+static inline void encryptRound(SliceWord* q, const uint64_t* sk) {
+    sbox(q);
+    shiftRows(q);
+    mixColumns(q);
+    addRoundKey(q, sk);
+}
+
+static inline void decryptRound(SliceWord* q, const uint64_t* sk) {
+    invShiftRows(q);
+    invSbox(q);
+    addRoundKey(q, sk);
+    invMixColumns(q);
+}
+
+#define BITSLICED_ROUND_AT(op, r) op(q, ks.slicedKeys + 8 * (r))
+#define BITSLICED_INV_ROUND_AT(op, r) op(q, ks.slicedKeys + 8 * (ROUNDS - (r)))
+
+template<int ROUNDS>
+static void bitslicedEncryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    while (blocks > 0) {
+        size_t n = blocks < static_cast<size_t>(BATCH_BLOCKS) ? blocks : BATCH_BLOCKS;
+        SliceWord q[8];
+        loadBatch(q, in, n);
+        
+        addRoundKey(q, ks.slicedKeys);
+        AES_INNER_ROUNDS(ROUNDS, BITSLICED_ROUND_AT, encryptRound);
+        sbox(q);
+        shiftRows(q);
+        addRoundKey(q, ks.slicedKeys + ROUNDS * 8);
+        
+        storeBatch(out, q, n);
+        in += n * 16;
+        out += n * 16;
+        blocks -= n;
+    }
+}
+
+template<int ROUNDS>
+static void bitslicedDecryptBlocks(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks) {
+    while (blocks > 0) {
+        size_t n = blocks < static_cast<size_t>(BATCH_BLOCKS) ? blocks : BATCH_BLOCKS;
+        SliceWord q[8];
+        loadBatch(q, in, n);
+        
+        addRoundKey(q, ks.slicedKeys + ROUNDS * 8);
+        AES_INNER_ROUNDS(ROUNDS, BITSLICED_INV_ROUND_AT, decryptRound);
+        invShiftRows(q);
+        invSbox(q);
+        addRoundKey(q, ks.slicedKeys);
+        
+        storeBatch(out, q, n);
+        in += n * 16;
+        out += n * 16;
+        blocks -= n;
+    }
+}
+
+void bitslicedExpandKey(AESKeySchedule& ks) {
+    // Each round key is replicated into all four block positions of a lane and
+    // transposed like a data block; both lanes then share the same words
+    for (int round = 0; round <= ks.rounds; round++) {
+        uint64_t q[8];
+        for (int i = 0; i < LANE_BLOCKS; i++) {
+            interleaveIn(q[i], q[i + 4], ks.encKeys + round * 4);
+        }
+        ortho(q);
+        for (int i = 0; i < 8; i++) {
+            ks.slicedKeys[round * 8 + i] = q[i];
+        }
+    }
+}
+
+uint32_t bitslicedSubWord(uint32_t w) {
+    // The word is the first column of an otherwise zero block
+    unsigned char block[16] = { 0 };
+    storeWord(block, w);
+    SliceWord q[8];
+    loadBatch(q, block, 1);
+    sbox(q);
+    storeBatch(block, q, 1);
+    return loadWord(block);
+}
+
+static const AESKernel BITSLICED_KERNELS[3] = {
+    { "bitsliced", 2, 8, bitslicedEncryptBlocks<10>, bitslicedDecryptBlocks<10>, BITSLICED_KERNELS },
+    { "bitsliced", 2, 8, bitslicedEncryptBlocks<12>, bitslicedDecryptBlocks<12>, BITSLICED_KERNELS },
+    { "bitsliced", 2, 8, bitslicedEncryptBlocks<14>, bitslicedDecryptBlocks<14>, BITSLICED_KERNELS }
+};
+
+const AESKernel& bitslicedKernel() {
+    return BITSLICED_KERNELS[0];
+}
@@ -0,0 +1,99 @@
+#ifndef AES_KERNELS_H
+#define AES_KERNELS_H
+
+#include <cstddef>
+#include <vector>
+#include "aes_encryption.h"
+
+// x86 code paths are compiled with per-function target attributes, so the
+// rest of the library needs no ISA-specific compiler flags
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AES_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AES_TARGET(features)
+#else
+#define AES_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+// Internal block-cipher kernels shared by AESEncryption and the cipher modes.
+// Each kernel runs the raw AES block function (no chaining) over a run of
+// consecutive 16-byte blocks; in and out may be the same buffer.
+typedef void (*AESBlocksFn)(const AESKeySchedule& ks, const unsigned char* in, unsigned char* out, size_t blocks);
+
+// Every kernel is compiled once per key size, with the round count as a
+// template constant. The variants of a kernel are stored side by side and
+// AESKey picks its variant when the key is expanded, so the block functions
+// never test the key length.
+struct AESKernel {
+    const char* name;
+    size_t index;    // position in the stats kernel order (aes_stats.h)
+    size_t lanes;    // blocks per pass of the main loop, the chains that CBC runs side by side
+    AESBlocksFn encryptBlocks;
+    AESBlocksFn decryptBlocks;
+    const AESKernel* variants;    // this kernel for 10, 12 and 14 rounds
+    
+    const AESKernel& forRounds(int rounds) const { return variants[(rounds - 10) / 2]; }
+};
+
+// Key length and round count of AES-128, AES-192 and AES-256 (FIPS-197 table 4)
+template<int KEY_BYTES>
+struct AESKeySize {
+    static const int KEY_WORDS = KEY_BYTES / 4;
+    static const int ROUNDS = KEY_WORDS + 6;
+};
+
+// Expands to round(op, r) for r = 1 .. rounds - 1, the rounds between the
+// initial AddRoundKey and the final round, written out in full. rounds is a
+// template constant of the kernel, so the key-size tests fold away and every
+// variant is a straight run of rounds with no loop and no branch.
+#define AES_INNER_ROUNDS(rounds, round, op) \
+    do { \
+        round(op, 1); round(op, 2); round(op, 3); round(op, 4); round(op, 5); \
+        round(op, 6); round(op, 7); round(op, 8); round(op, 9); \
+        if ((rounds) > 10) { round(op, 10); round(op, 11); } \
+        if ((rounds) > 12) { round(op, 12); round(op, 13); } \
+    } while (0)
+
+// The accessors below return the AES-128 variant of each kernel; forRounds()
+// gives the others.
+
+// Portable T-table kernel, always available (aes_encryption.cpp)
+const AESKernel& ttableKernel();
+
+// Constant-time bitsliced kernel, eight blocks per batch (aes_kernel_bitsliced.cpp).
+// bitslicedExpandKey() fills AESKeySchedule::slicedKeys from encKeys.
+// bitslicedSubWord() is SubWord of the key schedule through the S-box circuit,
+// so keys for this kernel are expanded without indexing SBOX by key bytes.
+const AESKernel& bitslicedKernel();
+void bitslicedExpandKey(AESKeySchedule& ks);
+uint32_t bitslicedSubWord(uint32_t w);
+
+// Hardware kernels (aes_kernel_aesni.cpp); nullptr when the CPU or the
+// target architecture does not support them
+const AESKernel* aesniKernel();
+const AESKernel* vaesKernel();
+
+// True when the CPU has PCLMULQDQ and SSSE3 (carry-less multiply GHASH)
+bool cpuSupportsClmul();
+
+// The kernels this host supports, in the default order of preference: VAES,
+// AES-NI, bitsliced, T-table
+std::vector<const AESKernel*> availableKernels();
+
+// The kernel the AES_KERNEL environment variable ("vaes", "aesni",
+// "bitsliced", "ttable") names, or nullptr when it is unset or names a
+// kernel this host does not support
+const AESKernel* forcedKernel();
+
+// Kernel that newly expanded keys use. It is selected from the CPU features
+// on first use: the forced kernel if any, otherwise the first available one.
+// The first call also applies the AES_TUNING startup tuning (aes_tuning.h),
+// and setActiveKernel() replaces it later; keys expanded before keep theirs.
+const AESKernel& activeKernel();
+void setActiveKernel(const AESKernel& kernel);
+
+// Applies AES_TUNING if it is set (aes_tuning.cpp); called once by activeKernel()
+void applyStartupTuning();
+
+#endif
@@ -0,0 +1,163 @@
+#include "aes_mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AES_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::runtime_error fileError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+#ifdef AES_HAVE_MMAP
+
+// Reserves the blocks of a new output, so a full disk is reported here rather
+// than as SIGBUS when a mapped page is first written. ftruncate alone would
+// leave a sparse file; it is the fallback where preallocation is unsupported.
+static int allocate(int fd, size_t size) {
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+    if (size > 0) {
+        int error = ::posix_fallocate(fd, 0, static_cast<off_t>(size));
+        if (error != EINVAL && error != EOPNOTSUPP) {
+            errno = error;
+            return error == 0 ? 0 : -1;
+        }
+    }
+#endif
+    return ::ftruncate(fd, static_cast<off_t>(size));
+}
+
+AESMappedFile::AESMappedFile(const std::string& path, Access access, size_t size)
+    : path(path), access(access), bytes(nullptr), length(0), fd(-1) {
+    if (access != WRITE) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw fileError("Cannot open", path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw fileError("Cannot stat", path);
+        }
+        length = static_cast<size_t>(info.st_size);
+    } else {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw fileError("Cannot create", path);
+        }
+        if (allocate(fd, size) != 0) {
+            std::runtime_error error = fileError("Cannot allocate space for", path);
+            ::close(fd);
+            ::unlink(path.c_str());
+            throw error;
+        }
+        length = size;
+    }
+    
+    // mmap rejects empty ranges; an empty file simply has no data
+    if (length == 0) {
+        return;
+    }
+    
+    int protection = access == WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = access == WRITE ? MAP_SHARED : MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    // Fault the whole range in up front rather than one page at a time from
+    // inside the worker threads
+    if (access != READ_RANDOM) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* mapping = ::mmap(nullptr, length, protection, flags, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::runtime_error error = fileError("Cannot map", path);
+        ::close(fd);
+        if (access == WRITE) {
+            ::unlink(path.c_str());
+        }
+        throw error;
+    }
+    bytes = static_cast<uint8_t*>(mapping);
+    
+    // The cipher walks the input front to back exactly once, while a random
+    // reader should not trigger readahead of pages it will never use
+    if (access == READ) {
+        ::madvise(mapping, length, MADV_SEQUENTIAL);
+    } else if (access == READ_RANDOM) {
+        ::madvise(mapping, length, MADV_RANDOM);
+    }
+}
+
+void AESMappedFile::unmap() {
+    if (bytes != nullptr) {
+        ::munmap(bytes, length);
+        bytes = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void AESMappedFile::close(size_t finalSize) {
+    if (access == WRITE && fd >= 0) {
+        if (bytes != nullptr) {
+            ::munmap(bytes, length);
+            bytes = nullptr;
+        }
+        if (finalSize != length && ::ftruncate(fd, static_cast<off_t>(finalSize)) != 0) {
+            throw fileError("Cannot resize", path);
+        }
+        length = finalSize;
+    }
+    unmap();
+}
+
+#else
+
+AESMappedFile::AESMappedFile(const std::string& path, Access access, size_t size)
+    : path(path), access(access), bytes(nullptr), length(0), fd(-1) {
+    if (access != WRITE) {
+        std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw fileError("Cannot open", path);
+        }
+        fallback.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(fallback.data()), fallback.size());
+    } else {
+        fallback.resize(size);
+        fd = 0;    // marks the buffer as not yet written out
+    }
+    bytes = fallback.data();
+    length = fallback.size();
+}
+
+void AESMappedFile::unmap() {
+    bytes = nullptr;
+    fd = -1;
+}
+
+void AESMappedFile::close(size_t finalSize) {
+    if (access == WRITE && fd >= 0) {
+        std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(fallback.data()), finalSize);
+        if (!file) {
+            throw fileError("Cannot write", path);
+        }
+    }
+    unmap();
+}
+
+#endif
+
+AESMappedFile::~AESMappedFile() {
+    unmap();
+}
@@ -0,0 +1,49 @@
+#ifndef AES_MAPPED_FILE_H
+#define AES_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A file mapped into memory for the command-line tool and the container
+// reader. Read mappings are private and read-only; write mappings create (or
+// truncate) the file and allocate its full size up front so every chunk can be
+// written in place by any thread. A write mapping that cannot be set up
+// removes the file again.
+// Platforms without mmap fall back to reading or writing the whole file
+// through a heap buffer. Errors throw std::runtime_error.
+class AESMappedFile {
+public:
+    // READ prefaults the whole file for one front-to-back pass; READ_RANDOM
+    // leaves pages to be faulted in as they are touched, for readers that
+    // only need a few parts of a large file
+    enum Access { READ, READ_RANDOM, WRITE };
+    
+    AESMappedFile(const std::string& path, Access access, size_t size = 0);
+    ~AESMappedFile();
+    
+    const uint8_t* data() const { return bytes; }
+    uint8_t* data() { return bytes; }
+    size_t size() const { return length; }
+    
+    // Writes out a mapped output file, shrinking it to finalSize bytes (for
+    // outputs whose exact size is only known at the end). The mapping is
+    // released; data() must not be used afterwards.
+    void close(size_t finalSize);
+    
+private:
+    std::string path;
+    Access access;
+    uint8_t* bytes;
+    size_t length;
+    int fd;
+    std::vector<uint8_t> fallback;
+    
+    void unmap();
+    
+    AESMappedFile(const AESMappedFile&);
+    AESMappedFile& operator=(const AESMappedFile&);
+};
+
+#endif
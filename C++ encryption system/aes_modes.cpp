@@ -0,0 +1,380 @@
+#include "aes_modes.h"
+#include "aes_thread_pool.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+// Counter blocks encrypted per kernel call
+static const size_t CTR_STRIPE_BLOCKS = 32;
+
+// Ciphertext blocks decrypted per kernel call in CBC mode
+static const size_t CBC_STRIPE_BLOCKS = 32;
+
+// Most independent CBC chains encrypted side by side by cbcEncryptRecords and
+// cbcEncryptMessages; each kernel gets as many as it encrypts per pass
+static const size_t CBC_MAX_LANES = 16;
+
+static std::atomic<size_t> chunkBytesSetting(AES_DEFAULT_CHUNK_BYTES);
+
+size_t parallelChunkBytes() {
+    return chunkBytesSetting.load(std::memory_order_relaxed);
+}
+
+void setParallelChunkBytes(size_t bytes) {
+    chunkBytesSetting.store(bytes, std::memory_order_relaxed);
+}
+
+void xorBytes(unsigned char* out, const unsigned char* a, const unsigned char* b, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        x ^= y;
+        std::memcpy(out + i, &x, 8);
+    }
+    for (; i < len; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+void ctrAdd(unsigned char* counter, uint64_t n) {
+    uint64_t hi = loadBigEndian64(counter);
+    uint64_t lo = loadBigEndian64(counter + 8);
+    uint64_t sum = lo + n;
+    if (sum < lo) {
+        hi++;
+    }
+    storeBigEndian64(counter, hi);
+    storeBigEndian64(counter + 8, sum);
+}
+
+void ctrXor(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* counter,
+            uint64_t blockOffset, const unsigned char* in, unsigned char* out, size_t len) {
+    uint64_t hi = loadBigEndian64(counter);
+    uint64_t lo = loadBigEndian64(counter + 8);
+    uint64_t start = lo + blockOffset;
+    if (start < lo) {
+        hi++;
+    }
+    lo = start;
+    
+    alignas(16) unsigned char stripe[CTR_STRIPE_BLOCKS * 16];
+    while (len > 0) {
+        size_t bytes = len < sizeof(stripe) ? len : sizeof(stripe);
+        size_t blocks = (bytes + 15) / 16;
+        
+        for (size_t i = 0; i < blocks; i++) {
+            storeBigEndian64(stripe + i * 16, hi);
+            storeBigEndian64(stripe + i * 16 + 8, lo);
+            if (++lo == 0) {
+                hi++;
+            }
+        }
+        kernel.encryptBlocks(ks, stripe, stripe, blocks);
+        xorBytes(out, in, stripe, bytes);
+        
+        in += bytes;
+        out += bytes;
+        len -= bytes;
+    }
+}
+
+void ctrXorParallel(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* counter,
+                    const unsigned char* in, unsigned char* out, size_t len, unsigned int threads) {
+    ctrXorParallel(kernel, ks, counter, in, out, len, threads, parallelChunkBytes());
+}
+
+void ctrXorParallel(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* counter,
+                    const unsigned char* in, unsigned char* out, size_t len, unsigned int threads,
+                    size_t chunkBytes) {
+    size_t chunks = (len + chunkBytes - 1) / chunkBytes;
+    if (chunks <= 1 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        ctrXor(kernel, ks, counter, 0, in, out, len);
+        return;
+    }
+    
+    AESThreadPool::instance().parallelFor(chunks, threads, [&](size_t chunk) {
+        size_t offset = chunk * chunkBytes;
+        size_t bytes = len - offset < chunkBytes ? len - offset : chunkBytes;
+        ctrXor(kernel, ks, counter, offset / 16, in + offset, out + offset, bytes);
+    });
+}
+
+void cbcEncrypt(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                const unsigned char* in, unsigned char* out, size_t len) {
+    alignas(16) unsigned char state[16];
+    std::memcpy(state, iv, 16);
+    for (size_t i = 0; i < len; i += 16) {
+        xorBlock(state, state, in + i);
+        kernel.encryptBlocks(ks, state, state, 1);
+        std::memcpy(out + i, state, 16);
+    }
+}
+
+void cbcDecrypt(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                const unsigned char* in, unsigned char* out, size_t len) {
+    alignas(16) unsigned char previous[16];
+    std::memcpy(previous, iv, 16);
+    
+    // Each stripe is decrypted into a scratch buffer first, so the ciphertext
+    // it chains from is still intact when out is the same buffer as in
+    alignas(16) unsigned char stripe[CBC_STRIPE_BLOCKS * 16];
+    while (len > 0) {
+        size_t bytes = len < sizeof(stripe) ? len : sizeof(stripe);
+        
+        kernel.decryptBlocks(ks, in, stripe, bytes / 16);
+        xorBytes(stripe, stripe, previous, 16);
+        xorBytes(stripe + 16, stripe + 16, in, bytes - 16);
+        std::memcpy(previous, in + bytes - 16, 16);
+        std::memcpy(out, stripe, bytes);
+        
+        in += bytes;
+        out += bytes;
+        len -= bytes;
+    }
+}
+
+void cbcDecryptParallel(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                        const unsigned char* in, unsigned char* out, size_t len, unsigned int threads) {
+    const size_t chunkBytes = parallelChunkBytes();
+    size_t chunks = (len + chunkBytes - 1) / chunkBytes;
+    if (chunks <= 1 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        cbcDecrypt(kernel, ks, iv, in, out, len);
+        return;
+    }
+    
+    // Copy the chaining block of every chunk up front: when decrypting in
+    // place, a neighbouring chunk may overwrite it before it is read
+    std::vector<unsigned char> chainBlocks(chunks * 16);
+    std::memcpy(&chainBlocks[0], iv, 16);
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        std::memcpy(&chainBlocks[chunk * 16], in + chunk * chunkBytes - 16, 16);
+    }
+    
+    AESThreadPool::instance().parallelFor(chunks, threads, [&](size_t chunk) {
+        size_t offset = chunk * chunkBytes;
+        size_t bytes = len - offset < chunkBytes ? len - offset : chunkBytes;
+        cbcDecrypt(kernel, ks, &chainBlocks[chunk * 16], in + offset, out + offset, bytes);
+    });
+}
+
+// Splits items [0, count) into runs of about parallelChunkBytes(), where
+// bytes(i) is the size of item i; returns the index where each run starts,
+// plus count at the end
+template<typename Bytes>
+static std::vector<size_t> chunkStarts(size_t count, Bytes bytes) {
+    const size_t chunkBytes = parallelChunkBytes();
+    std::vector<size_t> starts(1, 0);
+    size_t runBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (runBytes >= chunkBytes) {
+            starts.push_back(i);
+            runBytes = 0;
+        }
+        runBytes += bytes(i);
+    }
+    starts.push_back(count);
+    return starts;
+}
+
+static std::vector<size_t> recordChunks(const size_t* offsets, size_t count) {
+    return chunkStarts(count, [offsets](size_t i) { return offsets[i + 1] - offsets[i]; });
+}
+
+// Where each record's IV comes from: consecutive counter values from one
+// base IV, or one stored IV per record
+struct RecordIvs {
+    const unsigned char* ivs;
+    bool perRecord;
+    
+    void get(size_t record, unsigned char* iv) const {
+        if (perRecord) {
+            std::memcpy(iv, ivs + 16 * record, 16);
+        } else {
+            std::memcpy(iv, ivs, 16);
+            ctrAdd(iv, record);
+        }
+    }
+};
+
+// CBC chains for cbcEncryptLanes: records packed in one buffer, encrypted in place
+struct PackedRecords {
+    const RecordIvs& ivs;
+    unsigned char* data;
+    const size_t* offsets;
+    
+    size_t start(size_t record, unsigned char* iv) const {
+        ivs.get(record, iv);
+        return (offsets[record + 1] - offsets[record]) / 16;
+    }
+    void xorInput(size_t record, size_t block, unsigned char* state) const {
+        xorBlock(state, state, data + offsets[record] + 16 * block);
+    }
+    void store(size_t record, size_t block, const unsigned char* state) const {
+        std::memcpy(data + offsets[record] + 16 * block, state, 16);
+    }
+};
+
+// CBC chains for cbcEncryptLanes: separate messages, with the PKCS#7 padded
+// final block built as it is needed
+struct PaddedMessages {
+    const AESCbcMessage* messages;
+    
+    size_t start(size_t m, unsigned char* iv) const {
+        std::memcpy(iv, messages[m].iv, 16);
+        return messages[m].len / 16 + 1;
+    }
+    void xorInput(size_t m, size_t block, unsigned char* state) const {
+        const AESCbcMessage& message = messages[m];
+        size_t offset = 16 * block;
+        if (message.len - offset >= 16) {
+            xorBlock(state, state, message.in + offset);
+            return;
+        }
+        unsigned char last[16];
+        size_t remaining = message.len - offset;
+        if (remaining > 0) {
+            std::memcpy(last, message.in + offset, remaining);
+        }
+        std::memset(last + remaining, static_cast<int>(16 - remaining), 16 - remaining);
+        xorBlock(state, state, last);
+    }
+    void store(size_t m, size_t block, const unsigned char* state) const {
+        std::memcpy(messages[m].out + 16 * block, state, 16);
+    }
+};
+
+// Runs the CBC chains [first, last) of source side by side, one block of
+// every active chain per kernel call. Lane k's slot of the stripe holds the
+// chaining value of its chain between calls. When a chain ends, its lane is
+// refilled with the next chain not yet started, so the kernel sees full
+// stripes until the last few chains, whatever their lengths.
+template<typename Source>
+static void cbcEncryptLanes(const AESKernel& kernel, const AESKeySchedule& ks, const Source& source,
+                            size_t first, size_t last) {
+    const size_t lanes = kernel.lanes < CBC_MAX_LANES ? kernel.lanes : CBC_MAX_LANES;
+    alignas(16) unsigned char stripe[CBC_MAX_LANES * 16];
+    size_t chain[CBC_MAX_LANES];
+    size_t block[CBC_MAX_LANES];
+    size_t blocks[CBC_MAX_LANES];
+    size_t active = 0;
+    size_t next = first;
+    
+    for (;;) {
+        while (active < lanes && next < last) {
+            chain[active] = next;
+            block[active] = 0;
+            blocks[active] = source.start(next, stripe + active * 16);
+            active++;
+            next++;
+        }
+        if (active == 0) {
+            break;
+        }
+        
+        for (size_t k = 0; k < active; k++) {
+            source.xorInput(chain[k], block[k], stripe + k * 16);
+        }
+        kernel.encryptBlocks(ks, stripe, stripe, active);
+        
+        for (size_t k = 0; k < active;) {
+            source.store(chain[k], block[k], stripe + k * 16);
+            if (++block[k] == blocks[k]) {
+                // Move the last lane into the finished one
+                active--;
+                chain[k] = chain[active];
+                block[k] = block[active];
+                blocks[k] = blocks[active];
+                std::memcpy(stripe + k * 16, stripe + active * 16, 16);
+            } else {
+                k++;
+            }
+        }
+    }
+}
+
+static void cbcDecryptRecordRange(const AESKernel& kernel, const AESKeySchedule& ks, const RecordIvs& ivs,
+                                  const unsigned char* in, unsigned char* out, const size_t* offsets,
+                                  size_t first, size_t last) {
+    alignas(16) unsigned char stripe[CBC_STRIPE_BLOCKS * 16];
+    unsigned char recordIv[16];
+    ivs.get(first, recordIv);
+    
+    size_t record = first;
+    size_t begin = offsets[first];
+    size_t total = offsets[last] - begin;
+    for (size_t done = 0; done < total; done += sizeof(stripe)) {
+        size_t bytes = total - done < sizeof(stripe) ? total - done : sizeof(stripe);
+        kernel.decryptBlocks(ks, in + begin + done, stripe, bytes / 16);
+        
+        for (size_t k = 0; k < bytes; k += 16) {
+            size_t position = begin + done + k;
+            if (position >= offsets[record + 1]) {
+                while (position >= offsets[record + 1]) {
+                    record++;
+                }
+                ivs.get(record, recordIv);
+            }
+            const unsigned char* previous = position == offsets[record] ? recordIv : in + position - 16;
+            xorBlock(out + position, stripe + k, previous);
+        }
+    }
+}
+
+void cbcEncryptRecords(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                       unsigned char* data, const size_t* offsets, size_t count, unsigned int threads) {
+    std::vector<size_t> starts = recordChunks(offsets, count);
+    RecordIvs ivs = { iv, false };
+    PackedRecords records = { ivs, data, offsets };
+    if (starts.size() <= 2 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        cbcEncryptLanes(kernel, ks, records, 0, count);
+        return;
+    }
+    
+    AESThreadPool::instance().parallelFor(starts.size() - 1, threads, [&](size_t chunk) {
+        cbcEncryptLanes(kernel, ks, records, starts[chunk], starts[chunk + 1]);
+    });
+}
+
+void cbcDecryptRecords(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                       const unsigned char* in, unsigned char* out, const size_t* offsets, size_t count,
+                       unsigned int threads) {
+    std::vector<size_t> starts = recordChunks(offsets, count);
+    RecordIvs ivs = { iv, false };
+    if (starts.size() <= 2 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        cbcDecryptRecordRange(kernel, ks, ivs, in, out, offsets, 0, count);
+        return;
+    }
+    
+    AESThreadPool::instance().parallelFor(starts.size() - 1, threads, [&](size_t chunk) {
+        cbcDecryptRecordRange(kernel, ks, ivs, in, out, offsets, starts[chunk], starts[chunk + 1]);
+    });
+}
+
+void cbcEncryptRecordsWithIvs(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* ivs,
+                              unsigned char* data, const size_t* offsets, size_t count) {
+    RecordIvs recordIvs = { ivs, true };
+    PackedRecords records = { recordIvs, data, offsets };
+    cbcEncryptLanes(kernel, ks, records, 0, count);
+}
+
+void cbcDecryptRecordsWithIvs(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* ivs,
+                              const unsigned char* in, unsigned char* out, const size_t* offsets, size_t count) {
+    RecordIvs recordIvs = { ivs, true };
+    cbcDecryptRecordRange(kernel, ks, recordIvs, in, out, offsets, 0, count);
+}
+
+void cbcEncryptMessages(const AESKernel& kernel, const AESKeySchedule& ks, const AESCbcMessage* messages,
+                        size_t count, unsigned int threads) {
+    std::vector<size_t> starts = chunkStarts(count, [messages](size_t i) { return messages[i].len; });
+    PaddedMessages source = { messages };
+    if (starts.size() <= 2 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        cbcEncryptLanes(kernel, ks, source, 0, count);
+        return;
+    }
+    
+    AESThreadPool::instance().parallelFor(starts.size() - 1, threads, [&](size_t chunk) {
+        cbcEncryptLanes(kernel, ks, source, starts[chunk], starts[chunk + 1]);
+    });
+}
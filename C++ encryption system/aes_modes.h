@@ -0,0 +1,193 @@
+#ifndef AES_MODES_H
+#define AES_MODES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "aes_kernels.h"
+
+// Internal building blocks of the cipher modes, shared by AESEncryption and
+// the tools built on top of it.
+
+// Bytes handed to one pool task by the parallel modes: 256 KiB unless the
+// tuner (aes_tuning.h) picked another size for this host. The size may change
+// while other threads run, so each call reads it once and uses that value
+// throughout. setParallelChunkBytes() takes a positive multiple of 16.
+static const size_t AES_DEFAULT_CHUNK_BYTES = 256 * 1024;
+size_t parallelChunkBytes();
+void setParallelChunkBytes(size_t bytes);
+
+// Compilers do not reliably turn the byte loops into a single load and byte
+// swap, and the counter modes call these once or twice per block
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define AES_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+static inline uint64_t loadBigEndian64(const unsigned char* p) {
+#ifdef AES_BSWAP64
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return AES_BSWAP64(v);
+#else
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+#endif
+}
+
+static inline void storeBigEndian64(unsigned char* p, uint64_t v) {
+#ifdef AES_BSWAP64
+    v = AES_BSWAP64(v);
+    std::memcpy(p, &v, 8);
+#else
+    for (int i = 7; i >= 0; i--) {
+        p[i] = static_cast<unsigned char>(v);
+        v >>= 8;
+    }
+#endif
+}
+
+// Little-endian forms for the XTS tweak; AES_BSWAP64 is only defined on
+// little-endian hosts, where these are plain loads and stores
+static inline uint64_t loadLittleEndian64(const unsigned char* p) {
+#ifdef AES_BSWAP64
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+#else
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+#endif
+}
+
+static inline void storeLittleEndian64(unsigned char* p, uint64_t v) {
+#ifdef AES_BSWAP64
+    std::memcpy(p, &v, 8);
+#else
+    for (int i = 0; i < 8; i++) {
+        p[i] = static_cast<unsigned char>(v);
+        v >>= 8;
+    }
+#endif
+}
+
+// out = a XOR b; out may alias either input
+void xorBytes(unsigned char* out, const unsigned char* a, const unsigned char* b, size_t len);
+
+// xorBytes for exactly one block, inlined into per-block loops
+static inline void xorBlock(unsigned char* out, const unsigned char* a, const unsigned char* b) {
+    uint64_t x[2], y[2];
+    std::memcpy(x, a, 16);
+    std::memcpy(y, b, 16);
+    x[0] ^= y[0];
+    x[1] ^= y[1];
+    std::memcpy(out, x, 16);
+}
+
+// Adds n to a counter block interpreted as a 128-bit big-endian integer
+void ctrAdd(unsigned char* counter, uint64_t n);
+
+// CTR mode (NIST SP 800-38A): out = in XOR E(counter + blockOffset + i) for
+// consecutive blocks i. len need not be a multiple of the block size; a final
+// partial block uses the leading bytes of its keystream block. in and out may
+// be the same buffer.
+void ctrXor(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* counter,
+            uint64_t blockOffset, const unsigned char* in, unsigned char* out, size_t len);
+
+// ctrXor split into parallelChunkBytes() chunks on the worker pool. Each
+// chunk derives its counter from its offset, so the output does not depend on
+// the number of threads. threads = 0 uses the pool default. The second form
+// takes the chunk size as an argument, so the autotuner can try sizes without
+// changing the setting other callers use.
+void ctrXorParallel(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* counter,
+                    const unsigned char* in, unsigned char* out, size_t len, unsigned int threads);
+void ctrXorParallel(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* counter,
+                    const unsigned char* in, unsigned char* out, size_t len, unsigned int threads,
+                    size_t chunkBytes);
+
+// CBC encryption without padding; every block chains from the one before, so
+// this is one kernel call per block. len must be a multiple of the block
+// size; in and out may be the same buffer.
+void cbcEncrypt(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                const unsigned char* in, unsigned char* out, size_t len);
+
+// CBC decryption without padding removal. Unlike encryption, every block
+// depends only on its own ciphertext and the previous one, so blocks are
+// decrypted in stripes through the multi-block kernel and then XORed with the
+// shifted ciphertext. len must be a multiple of the block size; in and out may
+// be the same buffer.
+void cbcDecrypt(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                const unsigned char* in, unsigned char* out, size_t len);
+
+// cbcDecrypt split into parallelChunkBytes() chunks on the worker pool;
+// each chunk chains from the last ciphertext block of the one before it.
+// threads = 0 uses the pool default.
+void cbcDecryptParallel(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                        const unsigned char* in, unsigned char* out, size_t len, unsigned int threads);
+
+// CBC over many independent records packed back to back in one buffer.
+// Record i occupies [offsets[i], offsets[i + 1]) (whole blocks, at least one)
+// and starts from its own IV, iv + first + i as a 128-bit big-endian counter,
+// where first is the index of the first record passed in.
+//
+// Encryption works in place and interleaves up to 32 records, so one kernel
+// call covers the next block of each of them; when a record ends, the next
+// one takes its place. Decryption runs
+// all blocks through the kernel in stripes and fixes up the chaining
+// afterwards; in and out must not overlap. Both split large batches across
+// the worker pool (threads = 0 uses the pool default).
+void cbcEncryptRecords(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                       unsigned char* data, const size_t* offsets, size_t count, unsigned int threads);
+void cbcDecryptRecords(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* iv,
+                       const unsigned char* in, unsigned char* out, const size_t* offsets, size_t count,
+                       unsigned int threads);
+
+// The same for records that each have their own IV, record i starting from
+// ivs + 16 * i; runs on the calling thread
+void cbcEncryptRecordsWithIvs(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* ivs,
+                              unsigned char* data, const size_t* offsets, size_t count);
+void cbcDecryptRecordsWithIvs(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* ivs,
+                              const unsigned char* in, unsigned char* out, const size_t* offsets, size_t count);
+
+// CBC encryption with PKCS#7 padding of separate messages, each under its
+// own IV (see AESKey::encryptCbcMessages). Like cbcEncryptRecords, the
+// messages advance side by side through the kernel, and a lane whose message
+// ends takes the next one. Batches larger than parallelChunkBytes() are
+// split across the worker pool by message; threads = 0 uses the pool default.
+void cbcEncryptMessages(const AESKernel& kernel, const AESKeySchedule& ks, const AESCbcMessage* messages,
+                        size_t count, unsigned int threads);
+
+// AES-GCM (NIST SP 800-38D, aes_gcm.cpp). ghashExpandKey() derives the GHASH
+// key of ks for the given kernel; AESKey does this once in expandKey(). Any
+// non-empty nonce length is accepted; 12 bytes is the standard size. The tag
+// is 16 bytes. gcmDecrypt returns false and zeroes the output when the tag
+// does not verify. Inputs longer than parallelChunkBytes() are split across
+// the worker pool; threads = 0 uses the pool default.
+void ghashExpandKey(AESGhashKey& key, const AESKernel& kernel, const AESKeySchedule& ks);
+void gcmEncrypt(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& ghash,
+                const unsigned char* nonce, size_t nonceLen, const unsigned char* aad, size_t aadLen,
+                const unsigned char* in, unsigned char* out, size_t len, unsigned char* tag, unsigned int threads);
+bool gcmDecrypt(const AESKernel& kernel, const AESKeySchedule& ks, const AESGhashKey& ghash,
+                const unsigned char* nonce, size_t nonceLen, const unsigned char* aad, size_t aadLen,
+                const unsigned char* in, unsigned char* out, size_t len, const unsigned char* tag,
+                unsigned int threads);
+
+// AES-XTS (IEEE 1619, NIST SP 800-38E; aes_xts.cpp) over count data units
+// of unitSize bytes each, packed back to back. Unit i is tweaked with the
+// sequence number firstUnit + i encrypted under tweakKs. unitSize must be at
+// least one block; a partial final block uses ciphertext stealing. in and out
+// may be the same buffer. Batches larger than parallelChunkBytes() are
+// split across the worker pool by unit; threads = 0 uses the pool default.
+void xtsEncrypt(const AESKernel& kernel, const AESKeySchedule& dataKs, const AESKeySchedule& tweakKs,
+                uint64_t firstUnit, const unsigned char* in, unsigned char* out, size_t unitSize, size_t count,
+                unsigned int threads);
+void xtsDecrypt(const AESKernel& kernel, const AESKeySchedule& dataKs, const AESKeySchedule& tweakKs,
+                uint64_t firstUnit, const unsigned char* in, unsigned char* out, size_t unitSize, size_t count,
+                unsigned int threads);
+
+#endif
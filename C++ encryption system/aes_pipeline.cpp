@@ -0,0 +1,497 @@
+#include "aes_pipeline.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef AES_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static std::runtime_error ioError(const char* what, int error) {
+    return std::runtime_error(std::string(what) + ": " + std::strerror(error));
+}
+
+static long readSome(int fd, void* buffer, size_t len) {
+#ifdef _WIN32
+    return ::_read(fd, buffer, static_cast<unsigned int>(len > 0x40000000 ? 0x40000000 : len));
+#else
+    return static_cast<long>(::read(fd, buffer, len));
+#endif
+}
+
+static long writeSome(int fd, const void* buffer, size_t len) {
+#ifdef _WIN32
+    return ::_write(fd, buffer, static_cast<unsigned int>(len > 0x40000000 ? 0x40000000 : len));
+#else
+    return static_cast<long>(::write(fd, buffer, len));
+#endif
+}
+
+#ifdef AES_HAVE_IO_URING
+
+// Minimal io_uring driven through the raw system calls: one submission and one
+// completion queue shared with the kernel, used by a single thread.
+class AESPipeline::Ring {
+public:
+    Ring() : fd(-1), sqRing(nullptr), cqRing(nullptr), sqes(nullptr), sqSize(0), cqSize(0), sqesSize(0), pending(0) {}
+    
+    ~Ring() {
+        if (sqes != nullptr) {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cqRing != nullptr && cqRing != sqRing) {
+            ::munmap(cqRing, cqSize);
+        }
+        if (sqRing != nullptr) {
+            ::munmap(sqRing, sqSize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    
+    // False if the kernel has no usable io_uring
+    bool open(unsigned entries) {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        // Reads and writes at the current file position are what a pipe needs
+        if (fd < 0 || (params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+            return false;
+        }
+        
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sqSize = cqSize = sqSize > cqSize ? sqSize : cqSize;
+        }
+        sqRing = map(sqSize, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : map(cqSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+        if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr) {
+            return false;
+        }
+        
+        char* sq = static_cast<char*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+    
+    // Queues a request; the pipeline never has more in flight than the ring holds.
+    // addr is the buffer, or the request to cancel for IORING_OP_ASYNC_CANCEL.
+    void queue(uint8_t opcode, int target, const void* addr, size_t len, uint64_t userData) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        struct io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = target;
+        sqe->addr = reinterpret_cast<uint64_t>(addr);
+        sqe->len = static_cast<uint32_t>(len > 0x40000000 ? 0x40000000 : len);
+        if (opcode != IORING_OP_ASYNC_CANCEL) {
+            sqe->off = static_cast<uint64_t>(-1);
+        }
+        sqe->user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        pending++;
+    }
+    
+    // Submits the queued requests and waits until at least one has completed
+    void submitAndWait() {
+        for (;;) {
+            long submitted = ::syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted >= 0) {
+                pending -= static_cast<unsigned>(submitted);
+                return;
+            }
+            if (errno != EINTR) {
+                throw ioError("io_uring_enter", errno);
+            }
+        }
+    }
+    
+    // Takes the next completion, if there is one
+    bool next(uint64_t& userData, int& result) {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        const struct io_uring_cqe& cqe = cqes[head & cqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+    
+private:
+    int fd;
+    void* sqRing;
+    void* cqRing;
+    struct io_uring_sqe* sqes;
+    size_t sqSize;
+    size_t cqSize;
+    size_t sqesSize;
+    unsigned pending;
+    
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+    
+    void* map(size_t size, uint64_t offset) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, static_cast<off_t>(offset));
+        return p == MAP_FAILED ? nullptr : p;
+    }
+};
+
+#else
+
+class AESPipeline::Ring {
+};
+
+#endif
+
+AESPipeline::AESPipeline(int inFd, int outFd, size_t bufferSize, size_t buffers)
+    : inFd(inFd), outFd(outFd), bufferSize(bufferSize), slots(buffers > 1 ? buffers : 2), ring(nullptr), wakeFd(-1),
+      filled(0), transformed(0), drained(0), failed(false) {
+    if (bufferSize == 0) {
+        throw std::invalid_argument("Pipeline buffer size must not be zero");
+    }
+    for (Slot& s : slots) {
+        s.in.resize(bufferSize);
+        s.out.resize(bufferSize + OUTPUT_SLACK);
+        s.inLength = s.outLength = s.written = 0;
+        s.last = false;
+    }
+
+#ifdef AES_HAVE_IO_URING
+    const char* forced = std::getenv("AES_PIPE_IO");
+    if (forced == nullptr || std::strcmp(forced, "blocking") != 0) {
+        ring = new Ring();
+        wakeFd = ::eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0 || !ring->open(8)) {
+            delete ring;
+            ring = nullptr;
+            if (wakeFd >= 0) {
+                ::close(wakeFd);
+                wakeFd = -1;
+            }
+        }
+    }
+#endif
+}
+
+AESPipeline::~AESPipeline() {
+    delete ring;
+#ifdef AES_HAVE_IO_URING
+    if (wakeFd >= 0) {
+        ::close(wakeFd);
+    }
+#endif
+}
+
+const char* AESPipeline::ioName() const {
+    return ring != nullptr ? "io_uring" : "blocking";
+}
+
+void AESPipeline::fail(std::exception_ptr e) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failed) {
+            failed = true;
+            error = e;
+        }
+    }
+    changed.notify_all();
+#ifdef AES_HAVE_IO_URING
+    if (wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+#endif
+}
+
+void AESPipeline::slotTransformed() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        transformed++;
+    }
+    changed.notify_all();
+#ifdef AES_HAVE_IO_URING
+    if (wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+#endif
+}
+
+uint64_t AESPipeline::run(const Transform& transform) {
+    std::vector<std::thread> io;
+    if (ring != nullptr) {
+        io.push_back(std::thread(&AESPipeline::uringLoop, this));
+    } else {
+        io.push_back(std::thread(&AESPipeline::readLoop, this));
+        io.push_back(std::thread(&AESPipeline::writeLoop, this));
+    }
+    
+    uint64_t total = 0;
+    try {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return failed || transformed < filled; });
+                if (failed) {
+                    break;
+                }
+            }
+            Slot& s = slot(transformed);
+            s.outLength = transform(s.in.data(), s.inLength, s.last, s.out.data());
+            total += s.outLength;
+            bool last = s.last;
+            slotTransformed();
+            if (last) {
+                break;
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    
+    // A blocking reader only notices a failure once its read() returns
+    for (std::thread& thread : io) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return total;
+}
+
+void AESPipeline::readLoop() {
+    try {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return failed || filled - drained < slots.size(); });
+                if (failed) {
+                    return;
+                }
+            }
+            Slot& s = slot(filled);
+            bool end = false;
+            while (s.inLength < bufferSize) {
+                long n = readSome(inFd, s.in.data() + s.inLength, bufferSize - s.inLength);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw ioError("Cannot read input", errno);
+                }
+                if (n == 0) {
+                    end = true;
+                    break;
+                }
+                s.inLength += static_cast<size_t>(n);
+            }
+            s.last = end;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                filled++;
+            }
+            changed.notify_all();
+            if (end) {
+                return;
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+}
+
+void AESPipeline::writeLoop() {
+    try {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return failed || drained < transformed; });
+                if (failed) {
+                    return;
+                }
+            }
+            Slot& s = slot(drained);
+            while (s.written < s.outLength) {
+                long n = writeSome(outFd, s.out.data() + s.written, s.outLength - s.written);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw ioError("Cannot write output", errno);
+                }
+                s.written += static_cast<size_t>(n);
+            }
+            bool last = s.last;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                s.inLength = s.outLength = s.written = 0;
+                s.last = false;
+                drained++;
+            }
+            changed.notify_all();
+            if (last) {
+                return;
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+}
+
+#ifdef AES_HAVE_IO_URING
+
+enum RingRequest : uint64_t { READ_REQUEST, WRITE_REQUEST, WAKE_REQUEST, CANCEL_REQUEST };
+
+// Keeps one read, one write and one read of the wake eventfd in flight. A read
+// fills the slot after the last filled one until it is full or the input ends;
+// a write drains the oldest transformed slot, resubmitting after short writes.
+void AESPipeline::uringLoop() {
+    bool reading = false;
+    bool writing = false;
+    bool waking = false;
+    bool atEnd = false;
+    uint64_t wakeCount = 0;
+    
+    try {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (failed || (atEnd && drained == filled)) {
+                    break;
+                }
+                if (!reading && !atEnd && filled - drained < slots.size()) {
+                    Slot& s = slot(filled);
+                    ring->queue(IORING_OP_READ, inFd, s.in.data() + s.inLength, bufferSize - s.inLength, READ_REQUEST);
+                    reading = true;
+                }
+                if (!writing && drained < transformed) {
+                    Slot& s = slot(drained);
+                    ring->queue(IORING_OP_WRITE, outFd, s.out.data() + s.written, s.outLength - s.written, WRITE_REQUEST);
+                    writing = true;
+                }
+            }
+            if (!waking) {
+                ring->queue(IORING_OP_READ, wakeFd, &wakeCount, sizeof(wakeCount), WAKE_REQUEST);
+                waking = true;
+            }
+            ring->submitAndWait();
+            
+            uint64_t request;
+            int result;
+            while (ring->next(request, result)) {
+                if (request == WAKE_REQUEST) {
+                    waking = false;
+                    continue;
+                }
+                if (result == -EINTR || result == -EAGAIN) {
+                    (request == READ_REQUEST ? reading : writing) = false;
+                    continue;
+                }
+                if (request == READ_REQUEST) {
+                    reading = false;
+                    if (result < 0) {
+                        throw ioError("Cannot read input", -result);
+                    }
+                    Slot& s = slot(filled);
+                    s.inLength += static_cast<size_t>(result);
+                    if (result == 0) {
+                        atEnd = s.last = true;
+                    }
+                    if (result == 0 || s.inLength == bufferSize) {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            filled++;
+                        }
+                        changed.notify_all();
+                    }
+                } else if (request == WRITE_REQUEST) {
+                    writing = false;
+                    if (result < 0) {
+                        throw ioError("Cannot write output", -result);
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    Slot& s = slot(drained);
+                    s.written += static_cast<size_t>(result);
+                    if (s.written == s.outLength) {
+                        s.inLength = s.outLength = s.written = 0;
+                        s.last = false;
+                        drained++;
+                    }
+                }
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    
+    // Cancel whatever is still in flight before the buffers can go away
+    try {
+        if (reading) {
+            ring->queue(IORING_OP_ASYNC_CANCEL, -1, reinterpret_cast<const void*>(READ_REQUEST), 0, CANCEL_REQUEST);
+        }
+        if (writing) {
+            ring->queue(IORING_OP_ASYNC_CANCEL, -1, reinterpret_cast<const void*>(WRITE_REQUEST), 0, CANCEL_REQUEST);
+        }
+        if (waking) {
+            ring->queue(IORING_OP_ASYNC_CANCEL, -1, reinterpret_cast<const void*>(WAKE_REQUEST), 0, CANCEL_REQUEST);
+        }
+        while (reading || writing || waking) {
+            ring->submitAndWait();
+            uint64_t request;
+            int result;
+            while (ring->next(request, result)) {
+                if (request == READ_REQUEST) {
+                    reading = false;
+                } else if (request == WRITE_REQUEST) {
+                    writing = false;
+                } else if (request == WAKE_REQUEST) {
+                    waking = false;
+                }
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+}
+
+#else
+
+void AESPipeline::uringLoop() {
+}
+
+#endif
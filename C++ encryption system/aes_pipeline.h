@@ -0,0 +1,87 @@
+#ifndef AES_PIPELINE_H
+#define AES_PIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Streams one file descriptor into another through a transform for the
+// command-line filter mode (aes_encryption enc - -). Reading, the transform
+// and writing run at the same time on a ring of reusable buffers, so the
+// cipher keeps working while either side of the pipe blocks.
+//
+// On Linux the reads and writes go through io_uring on one I/O thread. Where
+// io_uring is not available (older kernels, seccomp filters, other systems)
+// or AES_PIPE_IO=blocking is set, a reader and a writer thread make blocking
+// calls instead. The transform always runs on the thread that calls run().
+class AESPipeline {
+public:
+    static const size_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+    static const size_t DEFAULT_BUFFERS = 4;
+    // Output bytes a transform may write beyond the length of its input
+    static const size_t OUTPUT_SLACK = 64;
+    
+    // Called once per buffer, in input order, with len bytes of input. Every
+    // buffer but the last is full; last is set for the final buffer, which
+    // may be empty. Writes at most len + OUTPUT_SLACK bytes to out and
+    // returns how many it wrote.
+    typedef std::function<size_t(const uint8_t* in, size_t len, bool last, uint8_t* out)> Transform;
+    
+    AESPipeline(int inFd, int outFd, size_t bufferSize = DEFAULT_BUFFER_SIZE, size_t buffers = DEFAULT_BUFFERS);
+    ~AESPipeline();
+    
+    // Runs until the input ends and all output has been written; call it once.
+    // The first error of any stage is rethrown here, I/O errors as
+    // std::runtime_error. Returns the number of bytes written.
+    uint64_t run(const Transform& transform);
+    
+    // "io_uring" or "blocking"
+    const char* ioName() const;
+    
+private:
+    struct Slot {
+        std::vector<uint8_t> in;
+        std::vector<uint8_t> out;
+        size_t inLength;
+        size_t outLength;
+        size_t written;
+        bool last;
+    };
+    
+    class Ring;
+    
+    int inFd;
+    int outFd;
+    size_t bufferSize;
+    std::vector<Slot> slots;
+    Ring* ring;    // null for blocking I/O
+    int wakeFd;    // eventfd that tells the io_uring thread a slot is ready to write
+    
+    // Slots move through the ring in order: filled counts the slots read,
+    // transformed those processed and drained those written out. Slot n is
+    // slots[n % slots.size()] and can be refilled once drained > n - size.
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint64_t filled;
+    uint64_t transformed;
+    uint64_t drained;
+    bool failed;
+    std::exception_ptr error;
+    
+    Slot& slot(uint64_t n) { return slots[n % slots.size()]; }
+    void fail(std::exception_ptr e);
+    void slotTransformed();
+    
+    void readLoop();
+    void writeLoop();
+    void uringLoop();
+    
+    AESPipeline(const AESPipeline&);
+    AESPipeline& operator=(const AESPipeline&);
+};
+
+#endif
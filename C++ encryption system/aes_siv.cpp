@@ -0,0 +1,457 @@
+#include "aes_siv.h"
+#include "aes_modes.h"
+#include "aes_stats.h"
+#include "aes_thread_pool.h"
+#include <atomic>
+#include <stdexcept>
+
+// AES-SIV (RFC 5297).
+//
+// S2V starts from D = CMAC(<zero>), folds in each associated-data component
+// as D = dbl(D) ^ CMAC(AD_i), and ends with V = CMAC(P xorend D), or
+// CMAC(dbl(D) ^ pad(P)) for a plaintext shorter than a block. CMAC is a
+// CBC-MAC and serial within one message, so batches run the final CMACs of up
+// to SIV_LANES messages side by side: each kernel call advances every lane by
+// one block, and a lane whose message is done takes the next one, as in
+// cbcEncryptMessages. The CMAC of the zero block depends only on the key and
+// is computed once per key, and the associated data once per batch.
+
+static const size_t SIV_LANES = 32;
+
+// RFC 5297 allows at most 126 associated-data components
+static const size_t SIV_MAX_COMPONENTS = 126;
+
+// Multiplication by x in GF(2^128), on a big-endian block
+static void dbl(const unsigned char* in, unsigned char* out) {
+    unsigned char carry = in[0] >> 7;
+    for (int i = 0; i < 15; i++) {
+        out[i] = static_cast<unsigned char>((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[15] = static_cast<unsigned char>((in[15] << 1) ^ (0x87 & (0 - carry)));
+}
+
+// CMAC (NIST SP 800-38B) of one message, one block per kernel call
+static void cmac(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* subkey1,
+                 const unsigned char* subkey2, const unsigned char* data, size_t len, unsigned char* mac) {
+    alignas(16) unsigned char state[16] = { 0 };
+    size_t blocks = len == 0 ? 1 : (len + 15) / 16;
+    for (size_t i = 0; i + 1 < blocks; i++) {
+        xorBlock(state, state, data + 16 * i);
+        kernel.encryptBlocks(ks, state, state, 1);
+    }
+    
+    alignas(16) unsigned char last[16] = { 0 };
+    size_t tail = len - 16 * (blocks - 1);
+    if (tail > 0) {
+        std::memcpy(last, data + 16 * (blocks - 1), tail);
+    }
+    if (tail < 16) {
+        last[tail] = 0x80;
+        xorBlock(last, last, subkey2);
+    } else {
+        xorBlock(last, last, subkey1);
+    }
+    xorBlock(state, state, last);
+    kernel.encryptBlocks(ks, state, mac, 1);
+}
+
+// The CTR counter: the SIV with the top bits of its last two 32-bit words
+// cleared, so 32- and 64-bit counter implementations agree
+static void sivCounter(const unsigned char* siv, unsigned char* counter) {
+    std::memcpy(counter, siv, 16);
+    counter[8] &= 0x7f;
+    counter[12] &= 0x7f;
+}
+
+// The final S2V step for one message: len bytes of plaintext at data, V to tag
+struct SivInput {
+    const unsigned char* data;
+    size_t len;
+    unsigned char* tag;
+};
+
+static size_t s2vBlocks(size_t len) {
+    return len < 16 ? 1 : (len + 15) / 16;
+}
+
+// Block j of the CMAC input T, with CMAC's own padding and subkey applied to
+// the last block
+static void s2vBlock(const SivInput& input, size_t j, const unsigned char* d, const unsigned char* dDouble,
+                     const unsigned char* subkey1, const unsigned char* subkey2, unsigned char* block) {
+    std::memset(block, 0, 16);
+    if (input.len < 16) {
+        // dbl(D) ^ pad(P) is a complete block
+        if (input.len > 0) {
+            std::memcpy(block, input.data, input.len);
+        }
+        block[input.len] = 0x80;
+        xorBlock(block, block, dDouble);
+        xorBlock(block, block, subkey1);
+        return;
+    }
+    
+    size_t start = 16 * j;
+    size_t bytes = input.len - start < 16 ? input.len - start : 16;
+    std::memcpy(block, input.data + start, bytes);
+    // xorend: D covers the last 16 bytes, which may straddle two blocks
+    size_t dStart = input.len - 16;
+    for (size_t i = 0; i < bytes; i++) {
+        if (start + i >= dStart) {
+            block[i] ^= d[start + i - dStart];
+        }
+    }
+    if (j + 1 == s2vBlocks(input.len)) {
+        if (bytes < 16) {
+            block[bytes] = 0x80;
+            xorBlock(block, block, subkey2);
+        } else {
+            xorBlock(block, block, subkey1);
+        }
+    }
+}
+
+// V for count messages that share the S2V value d of their associated data.
+// Blocks before the last two are plain message blocks and go straight into
+// the stripe; only the last two need D and the CMAC padding.
+static void s2vFinal(const AESKernel& kernel, const AESKeySchedule& ks, const unsigned char* subkey1,
+                     const unsigned char* subkey2, const unsigned char* d, const SivInput* inputs, size_t count) {
+    alignas(16) unsigned char dDouble[16];
+    dbl(d, dDouble);
+    
+    alignas(16) unsigned char stripe[SIV_LANES * 16];
+    alignas(16) unsigned char block[16];
+    size_t message[SIV_LANES];
+    size_t next[SIV_LANES];
+    size_t blocks[SIV_LANES];
+    size_t lanes = 0;
+    size_t taken = 0;
+    
+    while (lanes > 0 || taken < count) {
+        while (lanes < SIV_LANES && taken < count) {
+            message[lanes] = taken;
+            next[lanes] = 0;
+            blocks[lanes] = s2vBlocks(inputs[taken].len);
+            std::memset(stripe + 16 * lanes, 0, 16);
+            lanes++;
+            taken++;
+        }
+        
+        for (size_t l = 0; l < lanes; l++) {
+            const SivInput& input = inputs[message[l]];
+            if (next[l] + 2 < blocks[l]) {
+                xorBlock(stripe + 16 * l, stripe + 16 * l, input.data + 16 * next[l]);
+            } else {
+                s2vBlock(input, next[l], d, dDouble, subkey1, subkey2, block);
+                xorBlock(stripe + 16 * l, stripe + 16 * l, block);
+            }
+        }
+        kernel.encryptBlocks(ks, stripe, stripe, lanes);
+        
+        // Retire finished lanes and close the gaps they leave
+        size_t kept = 0;
+        for (size_t l = 0; l < lanes; l++) {
+            if (++next[l] == blocks[l]) {
+                std::memcpy(inputs[message[l]].tag, stripe + 16 * l, 16);
+                continue;
+            }
+            if (kept != l) {
+                message[kept] = message[l];
+                next[kept] = next[l];
+                blocks[kept] = blocks[l];
+                std::memcpy(stripe + 16 * kept, stripe + 16 * l, 16);
+            }
+            kept++;
+        }
+        lanes = kept;
+    }
+}
+
+// CTR under the counter derived from siv, for one message of a batch
+struct SivCtrSpan {
+    const unsigned char* siv;
+    const unsigned char* in;
+    unsigned char* out;
+    size_t len;
+};
+
+// Messages of up to SIV_LANES blocks share kernel calls: their counter blocks
+// are collected in one stripe and encrypted together. Longer ones get a
+// ctrXor call of their own.
+static void sivCtr(const AESKernel& kernel, const AESKeySchedule& ks, const SivCtrSpan* spans, size_t count) {
+    alignas(16) unsigned char stripe[SIV_LANES * 16];
+    const unsigned char* pendingIn[SIV_LANES];
+    unsigned char* pendingOut[SIV_LANES];
+    size_t pendingBytes[SIV_LANES];
+    size_t pending = 0;
+    
+    for (size_t i = 0; i <= count; i++) {
+        if (pending > 0 && (i == count || pending + (spans[i].len + 15) / 16 > SIV_LANES)) {
+            kernel.encryptBlocks(ks, stripe, stripe, pending);
+            for (size_t p = 0; p < pending; p++) {
+                xorBytes(pendingOut[p], pendingIn[p], stripe + 16 * p, pendingBytes[p]);
+            }
+            pending = 0;
+        }
+        if (i == count) {
+            break;
+        }
+        
+        const SivCtrSpan& span = spans[i];
+        alignas(16) unsigned char counter[16];
+        sivCounter(span.siv, counter);
+        if (span.len > SIV_LANES * 16) {
+            ctrXor(kernel, ks, counter, 0, span.in, span.out, span.len);
+            continue;
+        }
+        for (size_t offset = 0; offset < span.len; offset += 16) {
+            std::memcpy(stripe + 16 * pending, counter, 16);
+            ctrAdd(counter, 1);
+            pendingIn[pending] = span.in + offset;
+            pendingOut[pending] = span.out + offset;
+            pendingBytes[pending] = span.len - offset < 16 ? span.len - offset : 16;
+            pending++;
+        }
+    }
+}
+
+AESSiv::AESSiv(const std::vector<unsigned char>& key)
+    : macKey(checkKey(key.data(), key.size()), key.size() / 2), ctrKey(key.data() + key.size() / 2, key.size() / 2) {
+    init();
+}
+
+AESSiv::AESSiv(const unsigned char* key, size_t keyLen)
+    : macKey(checkKey(key, keyLen), keyLen / 2), ctrKey(key + keyLen / 2, keyLen / 2) {
+    init();
+}
+
+// Runs before either half is expanded
+const unsigned char* AESSiv::checkKey(const unsigned char* key, size_t keyLen) {
+    if (keyLen != 32 && keyLen != 48 && keyLen != 64) {
+        throw std::invalid_argument("SIV key must be 32, 48 or 64 bytes (CMAC key followed by CTR key)");
+    }
+    return key;
+}
+
+// CMAC subkeys L * x and L * x^2 with L = E(0), and the CMAC of the zero
+// block that every S2V starts from
+void AESSiv::init() {
+    alignas(16) unsigned char zero[16] = { 0 };
+    alignas(16) unsigned char l[16];
+    macKey.kernel().encryptBlocks(macKey.schedule(), zero, l, 1);
+    dbl(l, subkey1);
+    dbl(subkey1, subkey2);
+    cmac(macKey.kernel(), macKey.schedule(), subkey1, subkey2, zero, 16, zeroMac);
+}
+
+const char* AESSiv::kernelName() const {
+    return macKey.kernelName();
+}
+
+void AESSiv::s2vPrefix(const uint8_t* const* aad, const size_t* aadLens, size_t aadCount, unsigned char* d) const {
+    if (aadCount > SIV_MAX_COMPONENTS) {
+        throw std::invalid_argument("SIV takes at most 126 associated-data components");
+    }
+    std::memcpy(d, zeroMac, 16);
+    for (size_t i = 0; i < aadCount; i++) {
+        alignas(16) unsigned char mac[16];
+        cmac(macKey.kernel(), macKey.schedule(), subkey1, subkey2, aad[i], aadLens[i], mac);
+        dbl(d, d);
+        xorBlock(d, d, mac);
+    }
+}
+
+void AESSiv::encryptWith(const uint8_t* const* aad, const size_t* aadLens, size_t aadCount,
+                         const uint8_t* in, size_t len, uint8_t* out) const {
+    AES_STAT_SCOPE(AESStatOperation::SIV_ENCRYPT, macKey.kernel().index, len, 2 * ((len + 15) / 16) + 1);
+    alignas(16) unsigned char d[16];
+    s2vPrefix(aad, aadLens, aadCount, d);
+    SivInput input = { in, len, out };
+    s2vFinal(macKey.kernel(), macKey.schedule(), subkey1, subkey2, d, &input, 1);
+    
+    alignas(16) unsigned char counter[16];
+    sivCounter(out, counter);
+    ctrXorParallel(ctrKey.kernel(), ctrKey.schedule(), counter, in, out + TAG_SIZE, len, 0);
+}
+
+size_t AESSiv::decryptWith(const uint8_t* const* aad, const size_t* aadLens, size_t aadCount,
+                           const uint8_t* in, size_t len, uint8_t* out) const {
+    if (len < TAG_SIZE) {
+        throw std::invalid_argument("SIV ciphertext must be at least 16 bytes");
+    }
+    size_t plainLength = len - TAG_SIZE;
+    AES_STAT_SCOPE(AESStatOperation::SIV_DECRYPT, macKey.kernel().index, plainLength, 2 * ((plainLength + 15) / 16) + 1);
+    
+    // Copied first, since out may overwrite in
+    alignas(16) unsigned char siv[16];
+    std::memcpy(siv, in, 16);
+    alignas(16) unsigned char counter[16];
+    sivCounter(siv, counter);
+    ctrXorParallel(ctrKey.kernel(), ctrKey.schedule(), counter, in + TAG_SIZE, out, plainLength, 0);
+    
+    alignas(16) unsigned char d[16];
+    s2vPrefix(aad, aadLens, aadCount, d);
+    alignas(16) unsigned char expected[16];
+    SivInput input = { out, plainLength, expected };
+    s2vFinal(macKey.kernel(), macKey.schedule(), subkey1, subkey2, d, &input, 1);
+    
+    // Constant-time tag comparison
+    unsigned char diff = 0;
+    for (int i = 0; i < 16; i++) {
+        diff |= expected[i] ^ siv[i];
+    }
+    if (diff != 0) {
+        std::memset(out, 0, plainLength);
+        AES_STAT_EVENT(AUTHENTICATION_FAILURE);
+        throw std::runtime_error("Authentication failed");
+    }
+    return plainLength;
+}
+
+void AESSiv::encrypt(const uint8_t* aad, size_t aadLen, const uint8_t* in, size_t len, uint8_t* out) const {
+    encryptWith(&aad, &aadLen, aad != nullptr ? 1 : 0, in, len, out);
+}
+
+size_t AESSiv::decrypt(const uint8_t* aad, size_t aadLen, const uint8_t* in, size_t len, uint8_t* out) const {
+    return decryptWith(&aad, &aadLen, aad != nullptr ? 1 : 0, in, len, out);
+}
+
+std::vector<unsigned char> AESSiv::encrypt(const std::vector<unsigned char>& plaintext,
+                                           const std::vector<std::vector<unsigned char> >& aad) const {
+    std::vector<const uint8_t*> pointers(aad.size());
+    std::vector<size_t> lengths(aad.size());
+    for (size_t i = 0; i < aad.size(); i++) {
+        pointers[i] = aad[i].data();
+        lengths[i] = aad[i].size();
+    }
+    std::vector<unsigned char> result(encryptedSize(plaintext.size()));
+    encryptWith(pointers.data(), lengths.data(), aad.size(), plaintext.data(), plaintext.size(), result.data());
+    return result;
+}
+
+std::vector<unsigned char> AESSiv::decrypt(const std::vector<unsigned char>& ciphertext,
+                                           const std::vector<std::vector<unsigned char> >& aad) const {
+    std::vector<const uint8_t*> pointers(aad.size());
+    std::vector<size_t> lengths(aad.size());
+    for (size_t i = 0; i < aad.size(); i++) {
+        pointers[i] = aad[i].data();
+        lengths[i] = aad[i].size();
+    }
+    if (ciphertext.size() < TAG_SIZE) {
+        throw std::invalid_argument("SIV ciphertext must be at least 16 bytes");
+    }
+    std::vector<unsigned char> result(ciphertext.size() - TAG_SIZE);
+    decryptWith(pointers.data(), lengths.data(), aad.size(), ciphertext.data(), ciphertext.size(), result.data());
+    return result;
+}
+
+std::string AESSiv::encryptString(const std::string& plaintext, AESEncoding encoding) const {
+    std::vector<unsigned char> result(encryptedSize(plaintext.size()));
+    encrypt(nullptr, 0, reinterpret_cast<const uint8_t*>(plaintext.data()), plaintext.size(), result.data());
+    return encodeBytes(result.data(), result.size(), encoding);
+}
+
+std::string AESSiv::decryptString(const std::string& ciphertext, AESEncoding encoding) const {
+    std::vector<unsigned char> encryptedData = decodeBytes(ciphertext, encoding);
+    size_t length = decrypt(nullptr, 0, encryptedData.data(), encryptedData.size(), encryptedData.data());
+    return std::string(encryptedData.begin(), encryptedData.begin() + length);
+}
+
+void AESSiv::encryptMessages(const AESSivMessage* messages, size_t count, const uint8_t* aad, size_t aadLen,
+                             unsigned int threads) const {
+    cryptMessages(messages, count, aad, aadLen, threads, true);
+}
+
+void AESSiv::decryptMessages(const AESSivMessage* messages, size_t count, const uint8_t* aad, size_t aadLen,
+                             unsigned int threads) const {
+    cryptMessages(messages, count, aad, aadLen, threads, false);
+}
+
+// Messages are split into runs of about parallelChunkBytes() for the
+// pool. Encryption computes each run's SIVs straight into the outputs and
+// then encrypts; decryption decrypts first and recomputes the SIVs from the
+// plaintexts.
+void AESSiv::cryptMessages(const AESSivMessage* messages, size_t count, const uint8_t* aad, size_t aadLen,
+                           unsigned int threads, bool encrypting) const {
+    for (size_t i = 0; i < count; i++) {
+        if (!encrypting && messages[i].len < TAG_SIZE) {
+            throw std::invalid_argument("SIV ciphertext must be at least 16 bytes");
+        }
+    }
+#ifdef AES_STATS
+    size_t plainBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        plainBytes += encrypting ? messages[i].len : messages[i].len - TAG_SIZE;
+    }
+#endif
+    AES_STAT_SCOPE(encrypting ? AESStatOperation::SIV_ENCRYPT : AESStatOperation::SIV_DECRYPT,
+                   macKey.kernel().index, plainBytes, 2 * ((plainBytes + 15) / 16) + count);
+    
+    alignas(16) unsigned char d[16];
+    s2vPrefix(&aad, &aadLen, aad != nullptr ? 1 : 0, d);
+    
+    const size_t chunkBytes = parallelChunkBytes();
+    std::vector<size_t> starts(1, 0);
+    size_t runBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        runBytes += messages[i].len;
+        if (runBytes >= chunkBytes && i + 1 < count) {
+            starts.push_back(i + 1);
+            runBytes = 0;
+        }
+    }
+    starts.push_back(count);
+    
+    std::atomic<bool> failed(false);
+    auto run = [&](size_t chunk) {
+        size_t first = starts[chunk];
+        size_t n = starts[chunk + 1] - first;
+        std::vector<SivInput> inputs(n);
+        std::vector<SivCtrSpan> spans(n);
+        std::vector<unsigned char> expected(encrypting ? 0 : n * 16);
+        for (size_t i = 0; i < n; i++) {
+            const AESSivMessage& m = messages[first + i];
+            if (encrypting) {
+                inputs[i] = SivInput{ m.in, m.len, m.out };
+                spans[i] = SivCtrSpan{ m.out, m.in, m.out + TAG_SIZE, m.len };
+            } else {
+                inputs[i] = SivInput{ m.out, m.len - TAG_SIZE, &expected[16 * i] };
+                spans[i] = SivCtrSpan{ m.in, m.in + TAG_SIZE, m.out, m.len - TAG_SIZE };
+            }
+        }
+        
+        if (encrypting) {
+            s2vFinal(macKey.kernel(), macKey.schedule(), subkey1, subkey2, d, inputs.data(), n);
+            sivCtr(ctrKey.kernel(), ctrKey.schedule(), spans.data(), n);
+            return;
+        }
+        sivCtr(ctrKey.kernel(), ctrKey.schedule(), spans.data(), n);
+        s2vFinal(macKey.kernel(), macKey.schedule(), subkey1, subkey2, d, inputs.data(), n);
+        unsigned char diff = 0;
+        for (size_t i = 0; i < n; i++) {
+            for (int b = 0; b < 16; b++) {
+                diff |= expected[16 * i + b] ^ messages[first + i].in[b];
+            }
+        }
+        if (diff != 0) {
+            failed = true;
+        }
+    };
+    
+    if (starts.size() == 2 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        for (size_t chunk = 0; chunk + 1 < starts.size(); chunk++) {
+            run(chunk);
+        }
+    } else {
+        AESThreadPool::instance().parallelFor(starts.size() - 1, threads, run);
+    }
+    
+    if (failed) {
+        for (size_t i = 0; i < count; i++) {
+            if (messages[i].len > TAG_SIZE) {
+                std::memset(messages[i].out, 0, messages[i].len - TAG_SIZE);
+            }
+        }
+        AES_STAT_EVENT(AUTHENTICATION_FAILURE);
+        throw std::runtime_error("Authentication failed");
+    }
+}
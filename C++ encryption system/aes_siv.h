@@ -0,0 +1,121 @@
+#ifndef AES_SIV_H
+#define AES_SIV_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "aes_encryption.h"
+
+// One message of AESSiv::encryptMessages or decryptMessages: len bytes at in
+// (plaintext, or ciphertext including the 16-byte SIV) written to out, which
+// holds AESSiv::encryptedSize(len) or len - 16 bytes and must not overlap in.
+struct AESSivMessage {
+    const uint8_t* in;
+    size_t len;
+    uint8_t* out;
+};
+
+// AES-SIV (RFC 5297): deterministic authenticated encryption. The synthetic
+// IV is S2V, a CMAC-based PRF over the associated data and the plaintext; it
+// serves as the authentication tag and as the initial CTR counter. The same
+// plaintext with the same associated data and key therefore always gives the
+// same ciphertext, which can be indexed and compared for equality like the
+// plaintext. The price is that equal values are visible as equal. Ciphertexts
+// are the 16-byte SIV followed by the CTR-encrypted plaintext.
+//
+// Like AESKey, an instance is immutable after construction and can be shared
+// between threads.
+class AESSiv {
+public:
+    // The CMAC key K1 followed by the CTR key K2: 32, 48 or 64 bytes for
+    // AES-SIV with AES-128, AES-192 or AES-256
+    static const size_t KEY_SIZE = 32;
+    static const size_t TAG_SIZE = 16;
+    
+    // Throws std::invalid_argument unless the key is 32, 48 or 64 bytes
+    explicit AESSiv(const std::vector<unsigned char>& key);
+    // key must point to keyLen bytes
+    explicit AESSiv(const unsigned char* key, size_t keyLen);
+    
+    const char* kernelName() const;
+    
+    static size_t encryptedSize(size_t len) { return len + TAG_SIZE; }
+    
+    // Pointer form with one associated-data component of aadLen bytes at aad,
+    // or none when aad is null (which differs from an empty one). out holds
+    // encryptedSize(len) bytes and must not overlap in.
+    void encrypt(const uint8_t* aad, size_t aadLen, const uint8_t* in, size_t len, uint8_t* out) const;
+    // in holds len >= 16 bytes and out len - 16; returns len - 16. Throws
+    // std::runtime_error and zeroes out if the SIV does not verify. in and out
+    // may be the same buffer.
+    size_t decrypt(const uint8_t* aad, size_t aadLen, const uint8_t* in, size_t len, uint8_t* out) const;
+    
+    // Any number of associated-data components, as in RFC 5297
+    std::vector<unsigned char> encrypt(const std::vector<unsigned char>& plaintext,
+                                       const std::vector<std::vector<unsigned char> >& aad =
+                                           std::vector<std::vector<unsigned char> >()) const;
+    std::vector<unsigned char> decrypt(const std::vector<unsigned char>& ciphertext,
+                                       const std::vector<std::vector<unsigned char> >& aad =
+                                           std::vector<std::vector<unsigned char> >()) const;
+    
+    // Many messages under the same associated data, such as the values of one
+    // column with the column name as aad. The S2V chains of up to 32 messages
+    // advance side by side through the block kernel, short messages share CTR
+    // kernel calls, and large batches are split across the worker pool
+    // (threads = 0 uses the pool default). The results equal those of encrypt().
+    void encryptMessages(const AESSivMessage* messages, size_t count, const uint8_t* aad = nullptr,
+                         size_t aadLen = 0, unsigned int threads = 0) const;
+    // If any message fails to verify, every output is zeroed and
+    // std::runtime_error is thrown
+    void decryptMessages(const AESSivMessage* messages, size_t count, const uint8_t* aad = nullptr,
+                         size_t aadLen = 0, unsigned int threads = 0) const;
+    
+    // Deterministic string encryption, encoded like AESEncryption::encryptString
+    std::string encryptString(const std::string& plaintext, AESEncoding encoding = AESEncoding::HEX) const;
+    std::string decryptString(const std::string& ciphertext, AESEncoding encoding = AESEncoding::HEX) const;
+    
+    // Deterministic encryption of a trivially copyable value into a
+    // std::array, without heap allocation; no padding is needed
+    template<typename T>
+    std::array<uint8_t, sizeof(T) + TAG_SIZE> encrypt(const T& value) const {
+        static_assert(std::is_trivially_copyable<T>::value, "AESSiv::encrypt needs a trivially copyable type");
+        uint8_t plain[sizeof(T)];
+        std::memcpy(plain, &value, sizeof(T));
+        std::array<uint8_t, sizeof(T) + TAG_SIZE> result;
+        encrypt(nullptr, 0, plain, sizeof(T), result.data());
+        return result;
+    }
+    
+    template<typename T>
+    T decrypt(const std::array<uint8_t, sizeof(T) + TAG_SIZE>& encryptedValue) const {
+        static_assert(std::is_trivially_copyable<T>::value, "AESSiv::decrypt needs a trivially copyable type");
+        uint8_t plain[sizeof(T)];
+        decrypt(nullptr, 0, encryptedValue.data(), encryptedValue.size(), plain);
+        T result;
+        std::memcpy(&result, plain, sizeof(T));
+        return result;
+    }
+    
+private:
+    AESKey macKey;
+    AESKey ctrKey;
+    alignas(16) unsigned char subkey1[16];    // CMAC subkeys of the MAC key
+    alignas(16) unsigned char subkey2[16];
+    alignas(16) unsigned char zeroMac[16];    // CMAC of the zero block, where every S2V starts
+    
+    static const unsigned char* checkKey(const unsigned char* key, size_t keyLen);
+    void init();
+    void s2vPrefix(const uint8_t* const* aad, const size_t* aadLens, size_t aadCount, unsigned char* d) const;
+    void encryptWith(const uint8_t* const* aad, const size_t* aadLens, size_t aadCount,
+                     const uint8_t* in, size_t len, uint8_t* out) const;
+    size_t decryptWith(const uint8_t* const* aad, const size_t* aadLens, size_t aadCount,
+                       const uint8_t* in, size_t len, uint8_t* out) const;
+    void cryptMessages(const AESSivMessage* messages, size_t count, const uint8_t* aad, size_t aadLen,
+                       unsigned int threads, bool encrypting) const;
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "aes_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+static const char* const OPERATION_NAMES[AES_STAT_OPERATIONS] = {
+    "cbc-encrypt", "cbc-decrypt", "ctr", "gcm-encrypt", "gcm-decrypt", "batch-encrypt", "batch-decrypt",
+    "xts-encrypt", "xts-decrypt", "siv-encrypt", "siv-decrypt"
+};
+static const char* const KERNEL_NAMES[AES_STAT_KERNELS] = { "vaes", "aesni", "bitsliced", "ttable" };
+
+const char* aesStatOperationName(AESStatOperation operation) {
+    return OPERATION_NAMES[static_cast<size_t>(operation)];
+}
+
+const char* aesStatKernelName(size_t kernel) {
+    return kernel < AES_STAT_KERNELS ? KERNEL_NAMES[kernel] : "unknown";
+}
+
+size_t AESHistogram::bucketIndex(uint64_t value) {
+    if (value >> MAX_MAGNITUDE) {
+        return BUCKETS - 1;
+    }
+    
+    // Values below 2^(SUB_BUCKET_BITS + 1) map to themselves; above that, the
+    // top SUB_BUCKET_BITS + 1 bits select the bucket within each power of two
+    int bits = 0;
+    while (bits < 64 && (value >> bits) != 0) {
+        bits++;
+    }
+    int shift = std::max(bits - SUB_BUCKET_BITS - 1, 0);
+    return (static_cast<size_t>(shift) << SUB_BUCKET_BITS) + static_cast<size_t>(value >> shift);
+}
+
+uint64_t AESHistogram::bucketValue(size_t index) {
+    const size_t subBuckets = size_t(1) << SUB_BUCKET_BITS;
+    if (index < 2 * subBuckets) {
+        return index;
+    }
+    int shift = static_cast<int>(index >> SUB_BUCKET_BITS) - 1;
+    return static_cast<uint64_t>((index & (subBuckets - 1)) + subBuckets) << shift;
+}
+
+uint64_t AESHistogram::percentile(double fraction) const {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * (total - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank) {
+            return bucketValue(i);
+        }
+    }
+    return bucketValue(BUCKETS - 1);
+}
+
+uint64_t AESHistogram::min() const {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        if (counts[i] != 0) {
+            return bucketValue(i);
+        }
+    }
+    return 0;
+}
+
+uint64_t AESHistogram::max() const {
+    for (size_t i = BUCKETS; i > 0; i--) {
+        if (counts[i - 1] != 0) {
+            return bucketValue(i - 1);
+        }
+    }
+    return 0;
+}
+
+AESStatsSnapshot::AESStatsSnapshot() : paddingFailures(0), authenticationFailures(0), keysCreated(0) {
+    for (size_t op = 0; op < AES_STAT_OPERATIONS; op++) {
+        for (size_t kernel = 0; kernel < AES_STAT_KERNELS; kernel++) {
+            modes[op][kernel].calls = 0;
+            modes[op][kernel].bytes = 0;
+            modes[op][kernel].blocks = 0;
+        }
+    }
+}
+
+#ifdef AES_STATS
+
+namespace {
+
+const size_t EVENTS = 3;
+
+// One thread's counters. Only the owning thread writes them, with plain
+// relaxed load/store pairs rather than read-modify-write instructions; the
+// atomics only make concurrent snapshot reads well defined.
+struct ThreadStats {
+    std::atomic<uint64_t> modes[AES_STAT_OPERATIONS][AES_STAT_KERNELS][3];
+    std::atomic<uint64_t> latency[AES_STAT_OPERATIONS][AESHistogram::BUCKETS];
+    std::atomic<uint64_t> events[EVENTS];
+};
+
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Every thread's counters, plus the totals of threads that have exited and
+// the totals at the last reset
+struct StatsRegistry {
+    std::mutex mutex;
+    std::vector<ThreadStats*> threads;
+    AESStatsSnapshot retired;
+    AESStatsSnapshot baseline;
+};
+
+// Never destroyed: worker threads may exit during static destruction
+StatsRegistry& registry() {
+    static StatsRegistry* instance = new StatsRegistry;
+    return *instance;
+}
+
+void addThreadStats(AESStatsSnapshot& totals, const ThreadStats& stats) {
+    for (size_t op = 0; op < AES_STAT_OPERATIONS; op++) {
+        for (size_t kernel = 0; kernel < AES_STAT_KERNELS; kernel++) {
+            AESModeStats& mode = totals.modes[op][kernel];
+            mode.calls += stats.modes[op][kernel][0].load(std::memory_order_relaxed);
+            mode.bytes += stats.modes[op][kernel][1].load(std::memory_order_relaxed);
+            mode.blocks += stats.modes[op][kernel][2].load(std::memory_order_relaxed);
+        }
+        for (size_t bucket = 0; bucket < AESHistogram::BUCKETS; bucket++) {
+            uint64_t count = stats.latency[op][bucket].load(std::memory_order_relaxed);
+            if (count != 0) {
+                totals.latency[op].add(bucket, count);
+            }
+        }
+    }
+    totals.paddingFailures += stats.events[0].load(std::memory_order_relaxed);
+    totals.authenticationFailures += stats.events[1].load(std::memory_order_relaxed);
+    totals.keysCreated += stats.events[2].load(std::memory_order_relaxed);
+}
+
+// Sum of every thread, live or exited; the registry mutex must be held
+AESStatsSnapshot rawTotals(StatsRegistry& stats) {
+    AESStatsSnapshot totals = stats.retired;
+    for (const ThreadStats* thread : stats.threads) {
+        addThreadStats(totals, *thread);
+    }
+    return totals;
+}
+
+// Registers the calling thread's counters on first use and folds them into
+// the retired totals when the thread exits
+struct ThreadStatsHolder {
+    ThreadStats* stats;
+    
+    ThreadStatsHolder() : stats(new ThreadStats()) {
+        StatsRegistry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.threads.push_back(stats);
+    }
+    
+    ~ThreadStatsHolder() {
+        StatsRegistry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        addThreadStats(shared.retired, *stats);
+        shared.threads.erase(std::find(shared.threads.begin(), shared.threads.end(), stats));
+        delete stats;
+    }
+};
+
+ThreadStats& threadStats() {
+    static thread_local ThreadStatsHolder holder;
+    return *holder.stats;
+}
+
+uint64_t nowNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}
+
+bool aesStatsEnabled() {
+    return true;
+}
+
+AESStatsSnapshot aesStatsSnapshot() {
+    StatsRegistry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    AESStatsSnapshot totals = rawTotals(shared);
+    
+    // Counters only grow, so subtracting the reset point is exact
+    const AESStatsSnapshot& base = shared.baseline;
+    for (size_t op = 0; op < AES_STAT_OPERATIONS; op++) {
+        for (size_t kernel = 0; kernel < AES_STAT_KERNELS; kernel++) {
+            totals.modes[op][kernel].calls -= base.modes[op][kernel].calls;
+            totals.modes[op][kernel].bytes -= base.modes[op][kernel].bytes;
+            totals.modes[op][kernel].blocks -= base.modes[op][kernel].blocks;
+        }
+        AESHistogram latency;
+        for (size_t bucket = 0; bucket < AESHistogram::BUCKETS; bucket++) {
+            uint64_t count = totals.latency[op].bucketCount(bucket) - base.latency[op].bucketCount(bucket);
+            if (count != 0) {
+                latency.add(bucket, count);
+            }
+        }
+        totals.latency[op] = latency;
+    }
+    totals.paddingFailures -= base.paddingFailures;
+    totals.authenticationFailures -= base.authenticationFailures;
+    totals.keysCreated -= base.keysCreated;
+    return totals;
+}
+
+void aesStatsReset() {
+    StatsRegistry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.baseline = rawTotals(shared);
+}
+
+void aesStatsRecordEvent(AESStatEvent event) {
+    bump(threadStats().events[static_cast<size_t>(event)], 1);
+}
+
+AESStatScope::AESStatScope(AESStatOperation operation, size_t kernel, uint64_t bytes, uint64_t blocks)
+    : operation(operation), kernel(kernel), bytes(bytes), blocks(blocks), start(nowNanoseconds()) {
+}
+
+AESStatScope::~AESStatScope() {
+    uint64_t elapsed = nowNanoseconds() - start;
+    ThreadStats& stats = threadStats();
+    size_t op = static_cast<size_t>(operation);
+    bump(stats.modes[op][kernel][0], 1);
+    bump(stats.modes[op][kernel][1], bytes);
+    bump(stats.modes[op][kernel][2], blocks);
+    bump(stats.latency[op][AESHistogram::bucketIndex(elapsed)], 1);
+}
+
+#else
+
+bool aesStatsEnabled() {
+    return false;
+}
+
+AESStatsSnapshot aesStatsSnapshot() {
+    return AESStatsSnapshot();
+}
+
+void aesStatsReset() {
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef AES_STATS_H
+#define AES_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Optional operation statistics: bytes, blocks and calls per mode and kernel,
+// failure counters, and a latency histogram per operation.
+//
+// Collection is compiled in only when AES_STATS is defined (the CMake option
+// of the same name). Each thread records into its own counters, so recording
+// never contends with other cores; aesStatsSnapshot() adds them up. Without
+// AES_STATS the recording hooks compile to nothing and snapshots are empty.
+
+enum class AESStatOperation {
+    CBC_ENCRYPT,
+    CBC_DECRYPT,
+    CTR,
+    GCM_ENCRYPT,
+    GCM_DECRYPT,
+    BATCH_ENCRYPT,
+    BATCH_DECRYPT,
+    XTS_ENCRYPT,
+    XTS_DECRYPT,
+    SIV_ENCRYPT,
+    SIV_DECRYPT
+};
+
+static const size_t AES_STAT_OPERATIONS = 11;
+// Kernels in the order vaes, aesni, bitsliced, ttable
+static const size_t AES_STAT_KERNELS = 4;
+
+const char* aesStatOperationName(AESStatOperation operation);
+const char* aesStatKernelName(size_t kernel);
+
+// Log-linear latency histogram in nanoseconds, in the style of HdrHistogram:
+// values below 64 have their own bucket and larger values fall in one of 32
+// sub-buckets per power of two, so any recorded value is reported within
+// about 3%. Values above about 68 seconds are counted in the last bucket.
+class AESHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int MAX_MAGNITUDE = 36;
+    static const size_t BUCKETS = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+    
+    AESHistogram() : counts(BUCKETS, 0), total(0) {}
+    
+    static size_t bucketIndex(uint64_t value);
+    // Smallest value that falls in bucket index
+    static uint64_t bucketValue(size_t index);
+    
+    void record(uint64_t value, uint64_t count = 1) { add(bucketIndex(value), count); }
+    void add(size_t bucket, uint64_t count) { counts[bucket] += count; total += count; }
+    
+    uint64_t count() const { return total; }
+    uint64_t bucketCount(size_t bucket) const { return counts[bucket]; }
+    // Lower bound of the bucket holding the given fraction of recorded values
+    // (0.5 for the median, 0.99 for p99); 0 when the histogram is empty
+    uint64_t percentile(double fraction) const;
+    uint64_t min() const;
+    uint64_t max() const;
+    
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total;
+};
+
+struct AESModeStats {
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t blocks;    // block cipher invocations (streams count whole input blocks)
+};
+
+struct AESStatsSnapshot {
+    AESModeStats modes[AES_STAT_OPERATIONS][AES_STAT_KERNELS];
+    AESHistogram latency[AES_STAT_OPERATIONS];
+    uint64_t paddingFailures;           // CBC decryptions rejected for invalid padding
+    uint64_t authenticationFailures;    // GCM tags and SIVs that did not verify
+    uint64_t keysCreated;               // AESKey constructions (key expansions)
+    
+    AESStatsSnapshot();
+    
+    const AESModeStats& mode(AESStatOperation operation, size_t kernel) const {
+        return modes[static_cast<size_t>(operation)][kernel];
+    }
+    const AESHistogram& latencyOf(AESStatOperation operation) const {
+        return latency[static_cast<size_t>(operation)];
+    }
+};
+
+// True when the library was built with AES_STATS
+bool aesStatsEnabled();
+
+// Totals since the start of the process or the last aesStatsReset(),
+// including threads that have since exited
+AESStatsSnapshot aesStatsSnapshot();
+
+// Starts the totals from zero again. Operations running during the reset are
+// counted on one side of it or the other, never lost or counted twice.
+void aesStatsReset();
+
+// Recording hooks used inside the library
+enum class AESStatEvent { PADDING_FAILURE, AUTHENTICATION_FAILURE, KEY_CREATED };
+
+#ifdef AES_STATS
+
+void aesStatsRecordEvent(AESStatEvent event);
+
+// Records one call on the given kernel (its bytes, block operations and
+// latency) when it goes out of scope
+class AESStatScope {
+public:
+    AESStatScope(AESStatOperation operation, size_t kernel, uint64_t bytes, uint64_t blocks);
+    ~AESStatScope();
+    
+private:
+    AESStatOperation operation;
+    size_t kernel;
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t start;
+    
+    AESStatScope(const AESStatScope&);
+    AESStatScope& operator=(const AESStatScope&);
+};
+
+#define AES_STAT_SCOPE(operation, kernel, bytes, blocks) \
+    AESStatScope aesStatScope(operation, kernel, bytes, blocks)
+#define AES_STAT_EVENT(event) aesStatsRecordEvent(AESStatEvent::event)
+
+#else
+
+#define AES_STAT_SCOPE(operation, kernel, bytes, blocks) ((void)0)
+#define AES_STAT_EVENT(event) ((void)0)
+
+#endif
+
+#endif
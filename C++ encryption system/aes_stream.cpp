@@ -0,0 +1,172 @@
+#include "aes_stream.h"
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_stats.h"
+#include <cstring>
+
+AESStream::AESStream(const AESEncryption& cipher, Mode mode, Direction direction)
+    : key(cipher.key), schedule(key->schedule()), kernel(key->kernel()), mode(mode), direction(direction),
+      finished(false), buffered(0), blockIndex(0) {
+    std::memcpy(chain, cipher.iv, sizeof(chain));
+    std::memset(buffer, 0, sizeof(buffer));
+}
+
+size_t AESStream::update(const uint8_t* in, size_t len, uint8_t* out) {
+    if (finished) {
+        throw std::logic_error("Stream has already been finalized");
+    }
+    AES_STAT_SCOPE(mode == CTR ? AESStatOperation::CTR
+                   : direction == ENCRYPT ? AESStatOperation::CBC_ENCRYPT : AESStatOperation::CBC_DECRYPT,
+                   kernel.index, len, len / 16);
+    if (mode == CTR) {
+        return updateCtr(in, len, out);
+    }
+    return direction == ENCRYPT ? updateCbcEncrypt(in, len, out) : updateCbcDecrypt(in, len, out);
+}
+
+std::vector<unsigned char> AESStream::update(const std::vector<unsigned char>& chunk) {
+    std::vector<unsigned char> result(maxUpdateSize(chunk.size()));
+    result.resize(update(chunk.data(), chunk.size(), result.data()));
+    return result;
+}
+
+size_t AESStream::final(uint8_t* out) {
+    if (finished) {
+        throw std::logic_error("Stream has already been finalized");
+    }
+    finished = true;
+    
+    if (mode == CTR) {
+        return 0;
+    }
+    
+    if (direction == ENCRYPT) {
+        // PKCS#7: pad the pending bytes to a full block (a whole block of
+        // padding when nothing is pending)
+        std::memset(buffer + buffered, static_cast<int>(16 - buffered), 16 - buffered);
+        encryptChained(buffer, out, 1);
+        return 16;
+    }
+    
+    if (buffered == 0) {
+        return 0;
+    }
+    if (buffered != 16) {
+        throw std::invalid_argument("Encrypted data size must be a multiple of the block size");
+    }
+    
+    unsigned char last[16];
+    decryptChained(buffer, last, 1);
+    size_t length = 16 - AESKey::paddingLength(last);
+    std::memcpy(out, last, length);
+    return length;
+}
+
+std::vector<unsigned char> AESStream::final() {
+    std::vector<unsigned char> result(MAX_FINAL_SIZE);
+    result.resize(final(result.data()));
+    return result;
+}
+
+size_t AESStream::updateCbcEncrypt(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t written = 0;
+    
+    // Complete the pending block first
+    if (buffered > 0) {
+        size_t take = len < 16 - buffered ? len : 16 - buffered;
+        std::memcpy(buffer + buffered, in, take);
+        buffered += take;
+        in += take;
+        len -= take;
+        if (buffered < 16) {
+            return 0;
+        }
+        encryptChained(buffer, out, 1);
+        buffered = 0;
+        written = 16;
+    }
+    
+    size_t bulk = len & ~static_cast<size_t>(15);
+    encryptChained(in, out + written, bulk / 16);
+    written += bulk;
+    
+    buffered = len - bulk;
+    std::memcpy(buffer, in + bulk, buffered);
+    return written;
+}
+
+size_t AESStream::updateCbcDecrypt(const uint8_t* in, size_t len, uint8_t* out) {
+    // The last complete block may carry the padding, so a block is only
+    // released once at least one more byte has arrived after it
+    if (buffered < 16) {
+        size_t take = len < 16 - buffered ? len : 16 - buffered;
+        std::memcpy(buffer + buffered, in, take);
+        buffered += take;
+        in += take;
+        len -= take;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    
+    decryptChained(buffer, out, 1);
+    
+    // Decrypt all whole blocks that are followed by more input; keep the
+    // final 1..16 bytes pending
+    size_t bulk = (len - 1) & ~static_cast<size_t>(15);
+    decryptChained(in, out + 16, bulk / 16);
+    
+    buffered = len - bulk;
+    std::memcpy(buffer, in + bulk, buffered);
+    return 16 + bulk;
+}
+
+size_t AESStream::updateCtr(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t done = 0;
+    
+    // Use up the rest of the current keystream block
+    if (buffered > 0 && buffered < 16) {
+        size_t take = len < 16 - buffered ? len : 16 - buffered;
+        xorBytes(out, in, buffer + buffered, take);
+        buffered += take;
+        done = take;
+    }
+    
+    size_t bulk = (len - done) & ~static_cast<size_t>(15);
+    if (bulk > 0) {
+        unsigned char counter[16];
+        std::memcpy(counter, chain, sizeof(counter));
+        ctrAdd(counter, blockIndex);
+        ctrXorParallel(kernel, schedule, counter, in + done, out + done, bulk, 0);
+        blockIndex += bulk / 16;
+        done += bulk;
+    }
+    
+    // Start a new keystream block for the trailing bytes
+    if (done < len) {
+        std::memcpy(buffer, chain, sizeof(buffer));
+        ctrAdd(buffer, blockIndex++);
+        kernel.encryptBlocks(schedule, buffer, buffer, 1);
+        buffered = len - done;
+        xorBytes(out + done, in + done, buffer, buffered);
+    }
+    
+    return len;
+}
+
+void AESStream::encryptChained(const uint8_t* in, uint8_t* out, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        xorBytes(chain, chain, in + i * 16, 16);
+        kernel.encryptBlocks(schedule, chain, chain, 1);
+        std::memcpy(out + i * 16, chain, 16);
+    }
+}
+
+void AESStream::decryptChained(const uint8_t* in, uint8_t* out, size_t blocks) {
+    if (blocks == 0) {
+        return;
+    }
+    
+    cbcDecryptParallel(kernel, schedule, chain, in, out, blocks * 16, 0);
+    std::memcpy(chain, in + (blocks - 1) * 16, 16);
+}
@@ -0,0 +1,70 @@
+#ifndef AES_STREAM_H
+#define AES_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aes_encryption.h"
+
+// Incremental encryption or decryption of a stream of any length with a fixed
+// working set. Data is fed through update() in chunks of any size and the
+// stream is closed with final(). Partial blocks and the CBC/CTR chaining state
+// are carried between calls; CBC padding is added or checked only in final().
+//
+// The stream starts from the cipher's IV and shares its expanded key, so the
+// AESEncryption object may be destroyed or used by other threads meanwhile.
+class AESStream {
+public:
+    enum Mode { CBC, CTR };
+    enum Direction { ENCRYPT, DECRYPT };
+    
+    AESStream(const AESEncryption& cipher, Mode mode, Direction direction);
+    
+    // Upper bound on the bytes one update() call of len bytes can write
+    static size_t maxUpdateSize(size_t len) { return len + 15; }
+    // Upper bound on the bytes final() can write
+    static const size_t MAX_FINAL_SIZE = 16;
+    
+    // Processes the next chunk and returns the number of bytes written to out,
+    // which must not overlap in (CTR streams may also work in place). CBC
+    // decryption holds back the last complete block until final().
+    size_t update(const uint8_t* in, size_t len, uint8_t* out);
+    std::vector<unsigned char> update(const std::vector<unsigned char>& chunk);
+    
+    // Flushes the stream: writes the padded last block (CBC encryption) or the
+    // unpadded last block (CBC decryption); CTR writes nothing. Throws
+    // std::runtime_error on invalid padding. No further calls are allowed.
+    size_t final(uint8_t* out);
+    std::vector<unsigned char> final();
+    
+private:
+    std::shared_ptr<const AESKey> key;
+    const AESKeySchedule& schedule;
+    const AESKernel& kernel;
+    Mode mode;
+    Direction direction;
+    bool finished;
+    
+    alignas(16) unsigned char chain[16];    // CBC: previous ciphertext block; CTR: initial counter
+    alignas(16) unsigned char buffer[16];   // CBC: pending input bytes; CTR: current keystream block
+    size_t buffered;                        // CBC: bytes in buffer; CTR: keystream bytes already used
+    uint64_t blockIndex;                    // CTR: counter blocks consumed so far
+    
+    size_t updateCbcEncrypt(const uint8_t* in, size_t len, uint8_t* out);
+    size_t updateCbcDecrypt(const uint8_t* in, size_t len, uint8_t* out);
+    size_t updateCtr(const uint8_t* in, size_t len, uint8_t* out);
+    void encryptChained(const uint8_t* in, uint8_t* out, size_t blocks);
+    void decryptChained(const uint8_t* in, uint8_t* out, size_t blocks);
+};
+
+class AESStreamEncryptor : public AESStream {
+public:
+    AESStreamEncryptor(const AESEncryption& cipher, Mode mode) : AESStream(cipher, mode, ENCRYPT) {}
+};
+
+class AESStreamDecryptor : public AESStream {
+public:
+    AESStreamDecryptor(const AESEncryption& cipher, Mode mode) : AESStream(cipher, mode, DECRYPT) {}
+};
+
+#endif
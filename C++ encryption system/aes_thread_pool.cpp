@@ -0,0 +1,160 @@
+#include "aes_thread_pool.h"
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+
+struct AESThreadPool::Job {
+    const std::function<void(size_t)>* task;
+    size_t count;
+    std::atomic<size_t> next;
+    unsigned int helpers;    // workers that may still join, guarded by the pool mutex
+    unsigned int active;     // workers currently running tasks, guarded by the pool mutex
+    std::exception_ptr error;
+    std::mutex errorMutex;
+};
+
+static unsigned int configuredThreads() {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    return 1;
+#else
+    const char* env = std::getenv("AES_THREADS");
+    if (env != nullptr) {
+        int requested = std::atoi(env);
+        if (requested > 0) {
+            return static_cast<unsigned int>(requested);
+        }
+    }
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+#endif
+}
+
+AESThreadPool& AESThreadPool::instance() {
+    static AESThreadPool pool(configuredThreads());
+    return pool;
+}
+
+AESThreadPool::AESThreadPool(unsigned int threads) : stopping(false), defaultLimit(0) {
+    for (unsigned int i = 1; i < threads; i++) {
+        try {
+            workers.push_back(std::thread(&AESThreadPool::workerLoop, this));
+        } catch (const std::exception&) {
+            // Thread creation is not available; run with what we have
+            break;
+        }
+    }
+}
+
+AESThreadPool::~AESThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned int AESThreadPool::size() const {
+    return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+unsigned int AESThreadPool::defaultThreads() const {
+    unsigned int limit = defaultLimit.load(std::memory_order_relaxed);
+    return limit != 0 && limit < size() ? limit : size();
+}
+
+void AESThreadPool::setDefaultThreads(unsigned int threads) {
+    defaultLimit.store(threads, std::memory_order_relaxed);
+}
+
+unsigned int AESThreadPool::threadsFor(unsigned int maxThreads) const {
+    if (maxThreads == 0) {
+        return defaultThreads();
+    }
+    return maxThreads < size() ? maxThreads : size();
+}
+
+void AESThreadPool::runTasks(Job& job) {
+    for (size_t i = job.next++; i < job.count; i = job.next++) {
+        try {
+            (*job.task)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.errorMutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+    }
+}
+
+void AESThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) {
+            return;
+        }
+        
+        Job* job = jobs.front();
+        if (--job->helpers == 0) {
+            jobs.pop_front();
+        }
+        job->active++;
+        
+        lock.unlock();
+        runTasks(*job);
+        lock.lock();
+        
+        job->active--;
+        finished.notify_all();
+    }
+}
+
+void AESThreadPool::parallelFor(size_t count, unsigned int maxThreads, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    
+    unsigned int threads = threadsFor(maxThreads);
+    if (threads > count) {
+        threads = static_cast<unsigned int>(count);
+    }
+    
+    Job job;
+    job.task = &task;
+    job.count = count;
+    job.next = 0;
+    job.helpers = threads - 1;
+    job.active = 0;
+    
+    if (job.helpers > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&job);
+        }
+        wake.notify_all();
+    }
+    
+    runTasks(job);
+    
+    if (threads > 1) {
+        // Withdraw the job if some helpers never picked it up, then wait for
+        // the ones that did
+        std::unique_lock<std::mutex> lock(mutex);
+        if (job.helpers > 0) {
+            for (std::deque<Job*>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+                if (*it == &job) {
+                    jobs.erase(it);
+                    break;
+                }
+            }
+        }
+        finished.wait(lock, [&job] { return job.active == 0; });
+    }
+    
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef AES_THREAD_POOL_H
+#define AES_THREAD_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+// Process-wide pool of worker threads used by the bulk cipher modes.
+//
+// The pool is created on first use with one worker per hardware thread minus
+// one, because the calling thread always takes part in the work. The
+// AES_THREADS environment variable overrides the total thread count. Builds
+// without thread support (Emscripten without pthreads) get no workers and run
+// every task on the calling thread.
+class AESThreadPool {
+public:
+    static AESThreadPool& instance();
+    
+    // Threads available to one parallelFor call, including the caller
+    unsigned int size() const;
+    
+    // Threads a parallelFor call with maxThreads = 0 runs on: all of them,
+    // unless setDefaultThreads() lowered it (the tuner in aes_tuning.h does
+    // when more threads stop paying off). 0 restores all of them.
+    unsigned int defaultThreads() const;
+    void setDefaultThreads(unsigned int threads);
+    
+    // Threads a parallelFor call with maxThreads uses when there are enough tasks
+    unsigned int threadsFor(unsigned int maxThreads) const;
+    
+    // Runs task(i) for every i in [0, count) on at most maxThreads threads
+    // (0 means defaultThreads()) and returns once all tasks have finished. The
+    // first exception thrown by a task is rethrown here.
+    void parallelFor(size_t count, unsigned int maxThreads, const std::function<void(size_t)>& task);
+    
+    ~AESThreadPool();
+    
+private:
+    struct Job;
+    
+    std::vector<std::thread> workers;
+    std::deque<Job*> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping;
+    std::atomic<unsigned int> defaultLimit;    // 0 for the whole pool
+    
+    explicit AESThreadPool(unsigned int threads);
+    AESThreadPool(const AESThreadPool&);
+    AESThreadPool& operator=(const AESThreadPool&);
+    
+    void workerLoop();
+    static void runTasks(Job& job);
+};
+
+#endif
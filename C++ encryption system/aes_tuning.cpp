@@ -0,0 +1,304 @@
+#include "aes_tuning.h"
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_thread_pool.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// Bumped whenever the measurements change, so older cache files are redone
+static const int TUNING_CACHE_VERSION = 1;
+
+// Minimum time spent measuring one configuration
+static const double CASE_SECONDS = 0.04;
+
+// Input for the kernel comparison (one thread) and for the pool runs, which
+// covers 16 tasks even at the largest chunk size
+static const size_t KERNEL_BYTES = 64 * 1024;
+static const size_t POOL_BYTES = 16 * 1024 * 1024;
+
+static const size_t CHUNK_CANDIDATES[] = { 64 * 1024, 128 * 1024, 256 * 1024, 512 * 1024, 1024 * 1024 };
+
+// A thread count within this fraction of the best throughput counts as a tie
+static const double THREAD_TOLERANCE = 0.05;
+
+// What aesTuning() reports beyond the settings themselves
+static std::mutex stateMutex;
+static std::string tuningSource = "default";
+static double tuningRate = 0;
+
+// Calibrations run one at a time, since they change the shared settings
+static std::mutex calibrationMutex;
+
+std::string AESTuning::describe() const {
+    std::ostringstream line;
+    line << "kernel=" << kernel << " threads=" << threads << " chunk=";
+    if (chunkBytes % 1024 == 0) {
+        line << chunkBytes / 1024 << "KiB";
+    } else {
+        line << chunkBytes << "B";
+    }
+    line << " (" << source;
+    if (bytesPerSecond > 0) {
+        line << ", " << std::fixed << std::setprecision(2) << bytesPerSecond / 1e9 << " GB/s";
+    }
+    line << ")";
+    return line.str();
+}
+
+static const AESKernel* kernelNamed(const std::string& name) {
+    for (const AESKernel* kernel : availableKernels()) {
+        if (name == kernel->name) {
+            return kernel;
+        }
+    }
+    return nullptr;
+}
+
+static void apply(const AESKernel& kernel, unsigned int threads, size_t chunkBytes, const std::string& source,
+                  double bytesPerSecond) {
+    AESThreadPool& pool = AESThreadPool::instance();
+    setActiveKernel(kernel);
+    pool.setDefaultThreads(threads >= pool.size() ? 0 : threads);
+    setParallelChunkBytes(chunkBytes);
+    
+    std::lock_guard<std::mutex> lock(stateMutex);
+    tuningSource = source;
+    tuningRate = bytesPerSecond;
+}
+
+AESTuning aesTuning() {
+    AESTuning tuning;
+    tuning.kernel = activeKernel().name;
+    tuning.threads = AESThreadPool::instance().defaultThreads();
+    tuning.chunkBytes = parallelChunkBytes();
+    
+    std::lock_guard<std::mutex> lock(stateMutex);
+    tuning.source = tuningSource;
+    tuning.bytesPerSecond = tuningRate;
+    return tuning;
+}
+
+void aesSetTuning(const AESTuning& tuning) {
+    const AESKernel* kernel = kernelNamed(tuning.kernel);
+    if (kernel == nullptr) {
+        throw std::invalid_argument("Kernel '" + tuning.kernel + "' is not available on this host");
+    }
+    if (tuning.threads == 0) {
+        throw std::invalid_argument("Thread count must be at least 1");
+    }
+    if (tuning.chunkBytes == 0 || tuning.chunkBytes % 16 != 0) {
+        throw std::invalid_argument("Chunk size must be a positive multiple of 16 bytes");
+    }
+    
+    // Apply AES_TUNING first, so it cannot override this later
+    activeKernel();
+    std::lock_guard<std::mutex> lock(calibrationMutex);
+    apply(*kernel, tuning.threads, tuning.chunkBytes, "manual", 0);
+}
+
+// Best throughput of run, which processes bytes per call, over repeated
+// calls for at least CASE_SECONDS
+static double measure(const std::function<void()>& run, size_t bytes) {
+    typedef std::chrono::steady_clock Clock;
+    run();
+    double best = 0;
+    Clock::time_point start = Clock::now();
+    for (;;) {
+        Clock::time_point before = Clock::now();
+        run();
+        Clock::time_point after = Clock::now();
+        double seconds = std::chrono::duration<double>(after - before).count();
+        if (seconds > 0 && bytes / seconds > best) {
+            best = bytes / seconds;
+        }
+        if (std::chrono::duration<double>(after - start).count() >= CASE_SECONDS) {
+            return best;
+        }
+    }
+}
+
+// Identifies the hosts a cache file applies to
+static std::string hostSignature() {
+    std::ostringstream signature;
+    signature << "kernels=";
+    std::vector<const AESKernel*> kernels = availableKernels();
+    for (size_t i = 0; i < kernels.size(); i++) {
+        signature << (i > 0 ? "," : "") << kernels[i]->name;
+    }
+    const AESKernel* forced = forcedKernel();
+    signature << " forced=" << (forced != nullptr ? forced->name : "none")
+              << " pool=" << AESThreadPool::instance().size();
+    return signature.str();
+}
+
+// Cache file: one "name value" pair per line
+static bool readCache(const std::string& path, AESTuning& tuning) {
+    std::ifstream file(path.c_str());
+    if (!file) {
+        return false;
+    }
+    
+    int version = 0;
+    std::string host;
+    double bytesPerSecond = 0;
+    tuning.threads = 0;
+    tuning.chunkBytes = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        fields >> name;
+        if (name == "version") {
+            fields >> version;
+        } else if (name == "host") {
+            std::getline(fields >> std::ws, host);
+        } else if (name == "kernel") {
+            fields >> tuning.kernel;
+        } else if (name == "threads") {
+            fields >> tuning.threads;
+        } else if (name == "chunk") {
+            fields >> tuning.chunkBytes;
+        } else if (name == "throughput") {
+            fields >> bytesPerSecond;
+        }
+    }
+    
+    tuning.bytesPerSecond = bytesPerSecond;
+    return version == TUNING_CACHE_VERSION && host == hostSignature() && kernelNamed(tuning.kernel) != nullptr &&
+           tuning.threads > 0 && tuning.chunkBytes > 0 && tuning.chunkBytes % 16 == 0;
+}
+
+static void writeCache(const std::string& path, const AESTuning& tuning) {
+    std::ofstream file(path.c_str(), std::ios::trunc);
+    file << "# aes_encryption tuning cache; delete to recalibrate\n"
+         << "version " << TUNING_CACHE_VERSION << "\n"
+         << "host " << hostSignature() << "\n"
+         << "kernel " << tuning.kernel << "\n"
+         << "threads " << tuning.threads << "\n"
+         << "chunk " << tuning.chunkBytes << "\n"
+         << "throughput " << std::fixed << std::setprecision(0) << tuning.bytesPerSecond << "\n";
+}
+
+static AESTuning calibrate() {
+    AESThreadPool& pool = AESThreadPool::instance();
+    
+    // Timing does not depend on the key, so an all-zero schedule will do
+    AESKeySchedule ks;
+    std::memset(&ks, 0, sizeof(ks));
+    ks.rounds = 10;
+    unsigned char counter[16] = { 0 };
+    std::vector<unsigned char> data(POOL_BYTES, 0x5a);
+    
+    // Kernels, compared on one thread. T-table is only used when forced.
+    const AESKernel* best = forcedKernel();
+    if (best == nullptr) {
+        double bestRate = 0;
+        for (const AESKernel* kernel : availableKernels()) {
+            if (std::strcmp(kernel->name, "ttable") == 0) {
+                continue;
+            }
+            double rate = measure([&] { ctrXor(*kernel, ks, counter, 0, &data[0], &data[0], KERNEL_BYTES); },
+                                  KERNEL_BYTES);
+            if (rate > bestRate) {
+                best = kernel;
+                bestRate = rate;
+            }
+        }
+    }
+    
+    AESTuning tuning;
+    tuning.kernel = best->name;
+    tuning.threads = 1;
+    tuning.chunkBytes = AES_DEFAULT_CHUNK_BYTES;
+    tuning.source = "calibrated";
+    
+    // The candidate chunk size is passed to each call, so bulk calls running
+    // meanwhile keep the current setting
+    auto poolRate = [&](size_t chunkBytes, unsigned int threads) {
+        return measure([&] {
+            ctrXorParallel(*best, ks, counter, &data[0], &data[0], POOL_BYTES, threads, chunkBytes);
+        }, POOL_BYTES);
+    };
+    
+    if (pool.size() == 1) {
+        tuning.bytesPerSecond = poolRate(tuning.chunkBytes, 1);
+        return tuning;
+    }
+    
+    // Chunk size with every thread busy, then the thread count at that size
+    double bestRate = 0;
+    for (size_t chunkBytes : CHUNK_CANDIDATES) {
+        double rate = poolRate(chunkBytes, pool.size());
+        if (rate > bestRate) {
+            tuning.chunkBytes = chunkBytes;
+            bestRate = rate;
+        }
+    }
+    
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < pool.size(); threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(pool.size());
+    
+    std::vector<double> rates;
+    bestRate = 0;
+    for (unsigned int threads : threadCounts) {
+        rates.push_back(poolRate(tuning.chunkBytes, threads));
+        if (rates.back() > bestRate) {
+            bestRate = rates.back();
+        }
+    }
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        if (rates[i] >= bestRate * (1 - THREAD_TOLERANCE)) {
+            tuning.threads = threadCounts[i];
+            tuning.bytesPerSecond = rates[i];
+            break;
+        }
+    }
+    return tuning;
+}
+
+// aesAutotune without applying AES_TUNING first, which would recurse when
+// called from there
+static AESTuning autotune(const std::string& cachePath) {
+    std::lock_guard<std::mutex> lock(calibrationMutex);
+    
+    AESTuning tuning;
+    if (!cachePath.empty() && readCache(cachePath, tuning)) {
+        tuning.source = "cache";
+    } else {
+        tuning = calibrate();
+        if (!cachePath.empty()) {
+            writeCache(cachePath, tuning);
+        }
+    }
+    
+    apply(*kernelNamed(tuning.kernel), tuning.threads, tuning.chunkBytes, tuning.source, tuning.bytesPerSecond);
+    return tuning;
+}
+
+AESTuning aesAutotune(const std::string& cachePath) {
+    activeKernel();
+    return autotune(cachePath);
+}
+
+void applyStartupTuning() {
+    const char* setting = std::getenv("AES_TUNING");
+    if (setting == nullptr || *setting == '\0') {
+        return;
+    }
+    try {
+        autotune(std::strcmp(setting, "auto") == 0 ? std::string() : std::string(setting));
+    } catch (const std::exception&) {
+        // Keep the defaults; tuning is an optimization
+    }
+}
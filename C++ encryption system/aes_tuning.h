@@ -0,0 +1,53 @@
+#ifndef AES_TUNING_H
+#define AES_TUNING_H
+
+#include <cstddef>
+#include <string>
+
+// Per-host tuning of the bulk operations: the block kernel that new keys use,
+// the threads a call with threads = 0 runs on, and the bytes each pool task
+// gets. Out of the box these come from the CPU features (aes_kernels.h), the
+// pool size (aes_thread_pool.h) and 256 KiB chunks. aesAutotune() measures
+// this host instead and applies the fastest configuration.
+//
+// The AES_TUNING environment variable runs the tuner when the first key is
+// created: "auto" calibrates in the process, which takes about half a second,
+// and any other value is the path of a cache file that is used when it was
+// written on a matching host, and otherwise calibrated and rewritten.
+//
+// A new kernel applies to keys created afterwards; keys that exist keep the
+// kernel they were expanded for. Thread count and chunk size apply to the
+// next bulk call on any key.
+
+struct AESTuning {
+    std::string kernel;       // "vaes", "aesni", "bitsliced" or "ttable"
+    unsigned int threads;     // default threads per bulk call, at most the pool size
+    size_t chunkBytes;        // bytes per pool task, a multiple of 16
+    std::string source;       // "default", "calibrated", "cache" or "manual"
+    double bytesPerSecond;    // CTR throughput measured with this configuration; 0 if not measured
+    
+    // One line for logs, such as "kernel=vaes threads=8 chunk=256KiB (calibrated, 9.41 GB/s)"
+    std::string describe() const;
+};
+
+// The configuration bulk operations use now
+AESTuning aesTuning();
+
+// Applies a configuration chosen by the caller (source becomes "manual").
+// Throws std::invalid_argument for a kernel this host does not support, zero
+// threads or a chunk size that is zero or not a multiple of 16.
+void aesSetTuning(const AESTuning& tuning);
+
+// Benchmarks every available kernel, then chunk sizes and thread counts for
+// CTR over the worker pool with the fastest one, applies the result and
+// returns it. The fewest threads within 5% of the best throughput win, so
+// the tuner does not claim cores that no longer pay off. The T-table kernel
+// is measured but not chosen, since its lookups are indexed by secret data,
+// and a kernel forced with AES_KERNEL is kept.
+//
+// With a cache path, a cache written on a matching host (same kernels, pool
+// size and cache version) is applied without measuring; otherwise the result
+// is written there. A cache that cannot be written is skipped silently.
+AESTuning aesAutotune(const std::string& cachePath = std::string());
+
+#endif
@@ -8,6 +8,21 @@ Module.onRuntimeInitialized = function() {
     console.log("AES Encryption module initialized");
 };
 
+/**
+ * Call an export that returns a malloc'd C string, copy the result into a
+ * JavaScript string and release the C copy
+ * @returns {string|null} - The string, or null if the call failed
+ */
+function callStringExport(name, argTypes, args) {
+    const ptr = Module.ccall(name, 'number', argTypes, args);
+    if (ptr === 0) {
+        return null;
+    }
+    const result = Module.UTF8ToString(ptr);
+    Module.ccall('aesFree', null, ['number'], [ptr]);
+    return result;
+}
+
 /**
  * Encrypt a string using AES
  * @param {string} text - The plaintext to encrypt
@@ -16,9 +31,7 @@ Module.onRuntimeInitialized = function() {
  * @returns {string} - Hex-encoded encrypted string
  */
 function encryptString(text, key, iv) {
-    // Create a wrapper for the C++ function
-    const encryptStringFunc = Module.cwrap('encryptString', 'string', ['string', 'string', 'string']);
-    return encryptStringFunc(text, key, iv);
+    return callStringExport('encryptString', ['string', 'string', 'string'], [text, key, iv]);
 }
 
 /**
@@ -29,9 +42,29 @@ function encryptString(text, key, iv) {
  * @returns {string} - Decrypted plaintext
  */
 function decryptString(encryptedHex, key, iv) {
-    // Create a wrapper for the C++ function
-    const decryptStringFunc = Module.cwrap('decryptString', 'string', ['string', 'string', 'string']);
-    return decryptStringFunc(encryptedHex, key, iv);
+    return callStringExport('decryptString', ['string', 'string', 'string'], [encryptedHex, key, iv]);
+}
+
+/**
+ * Encrypt a string using AES, returning base64 instead of hex
+ * @param {string} text - The plaintext to encrypt
+ * @param {string} key - The encryption key
+ * @param {string} iv - The initialization vector
+ * @returns {string} - Base64-encoded encrypted string
+ */
+function encryptStringBase64(text, key, iv) {
+    return callStringExport('encryptStringBase64', ['string', 'string', 'string'], [text, key, iv]);
+}
+
+/**
+ * Decrypt a base64-encoded string using AES
+ * @param {string} encryptedBase64 - The base64-encoded encrypted string
+ * @param {string} key - The encryption key
+ * @param {string} iv - The initialization vector
+ * @returns {string} - Decrypted plaintext
+ */
+function decryptStringBase64(encryptedBase64, key, iv) {
+    return callStringExport('decryptStringBase64', ['string', 'string', 'string'], [encryptedBase64, key, iv]);
 }
 
 /**
@@ -42,8 +75,7 @@ function decryptString(encryptedHex, key, iv) {
  * @returns {string} - Hex-encoded encrypted data
  */
 function encryptInt(value, key, iv) {
-    const encryptIntFunc = Module.cwrap('encryptInt', 'string', ['number', 'string', 'string']);
-    return encryptIntFunc(value, key, iv);
+    return callStringExport('encryptInt', ['number', 'string', 'string'], [value, key, iv]);
 }
 
 /**
@@ -66,8 +98,7 @@ function decryptInt(encryptedHex, key, iv) {
  * @returns {string} - Hex-encoded encrypted data
  */
 function encryptFloat(value, key, iv) {
-    const encryptFloatFunc = Module.cwrap('encryptFloat', 'string', ['number', 'string', 'string']);
-    return encryptFloatFunc(value, key, iv);
+    return callStringExport('encryptFloat', ['number', 'string', 'string'], [value, key, iv]);
 }
 
 /**
@@ -90,8 +121,7 @@ function decryptFloat(encryptedHex, key, iv) {
  * @returns {string} - Hex-encoded encrypted data
  */
 function encryptLong(value, key, iv) {
-    const encryptLongFunc = Module.cwrap('encryptLong', 'string', ['number', 'string', 'string']);
-    return encryptLongFunc(value, key, iv);
+    return callStringExport('encryptLong', ['number', 'string', 'string'], [value, key, iv]);
 }
 
 /**
@@ -106,16 +136,195 @@ function decryptLong(encryptedHex, key, iv) {
     return decryptLongFunc(encryptedHex, key, iv);
 }
 
+/**
+ * Create a handle that keeps an expanded key for repeated use
+ * @param {string} key - The encryption key (will be padded/truncated to 16 bytes)
+ * @returns {number} - Opaque handle; release it with aesDestroy
+ */
+function aesCreate(key) {
+    const aesCreateFunc = Module.cwrap('aesCreate', 'number', ['string']);
+    return aesCreateFunc(key);
+}
+
+/**
+ * Encrypt a string with the key held by a handle
+ * @param {number} handle - Handle from aesCreate
+ * @param {string} text - The plaintext to encrypt
+ * @param {string} iv - The initialization vector for this message
+ * @returns {string} - Hex-encoded encrypted string
+ */
+function aesEncrypt(handle, text, iv) {
+    return callStringExport('aesEncrypt', ['number', 'string', 'string'], [handle, text, iv]);
+}
+
+/**
+ * Decrypt a hex-encoded string with the key held by a handle
+ * @param {number} handle - Handle from aesCreate
+ * @param {string} encryptedHex - The hex-encoded encrypted string
+ * @param {string} iv - The initialization vector used for encryption
+ * @returns {string} - Decrypted plaintext
+ */
+function aesDecrypt(handle, encryptedHex, iv) {
+    return callStringExport('aesDecrypt', ['number', 'string', 'string'], [handle, encryptedHex, iv]);
+}
+
+/**
+ * Release a handle created by aesCreate
+ * @param {number} handle - Handle from aesCreate
+ */
+function aesDestroy(handle) {
+    Module.ccall('aesDestroy', null, ['number'], [handle]);
+}
+
+/**
+ * Call a buffer export on byte arrays. Inputs are copied into the module heap,
+ * the output buffer is sized with outputSize, and every heap allocation is
+ * released before returning.
+ * @param {string} name - Export name
+ * @param {number} handle - Handle passed as the first argument
+ * @param {Array} args - Uint8Array inputs, passed in order after the handle
+ * @param {Array} withLength - For each input, whether its length follows the pointer
+ * @param {number} outputSize - Capacity of the output buffer
+ * @returns {Uint8Array} - The output bytes; throws an Error with the status text on failure
+ */
+function callBufferExport(name, handle, args, withLength, outputSize) {
+    const allocations = [];
+    const allocate = function(size) {
+        const ptr = Module._malloc(Math.max(size, 1));
+        allocations.push(ptr);
+        return ptr;
+    };
+    
+    try {
+        const argTypes = ['number'];
+        const argValues = [handle];
+        args.forEach(function(bytes, i) {
+            const ptr = allocate(bytes.length);
+            Module.HEAPU8.set(bytes, ptr);
+            argTypes.push('number');
+            argValues.push(ptr);
+            if (withLength[i]) {
+                argTypes.push('number');
+                argValues.push(bytes.length);
+            }
+        });
+        
+        const out = allocate(outputSize);
+        const outLen = allocate(4);
+        Module.setValue(outLen, outputSize, 'i32');
+        const status = Module.ccall(name, 'number', argTypes.concat(['number', 'number']), argValues.concat([out, outLen]));
+        if (status !== 0) {
+            throw new Error(Module.ccall('aesErrorString', 'string', ['number'], [status]));
+        }
+        return Module.HEAPU8.slice(out, out + Module.getValue(outLen, 'i32'));
+    } finally {
+        allocations.forEach(function(ptr) { Module._free(ptr); });
+    }
+}
+
+/**
+ * Create a handle from a 16, 24 or 32-byte binary key (AES-128, AES-192 or AES-256)
+ * @param {Uint8Array} key - The key bytes
+ * @returns {number} - Opaque handle; release it with aesDestroy
+ */
+function aesCreateKey(key) {
+    const keyPtr = Module._malloc(key.length);
+    const handlePtr = Module._malloc(4);
+    try {
+        Module.HEAPU8.set(key, keyPtr);
+        const status = Module.ccall('aesCreateKey', 'number', ['number', 'number', 'number'], [keyPtr, key.length, handlePtr]);
+        if (status !== 0) {
+            throw new Error(Module.ccall('aesErrorString', 'string', ['number'], [status]));
+        }
+        return Module.getValue(handlePtr, 'i32');
+    } finally {
+        Module._free(keyPtr);
+        Module._free(handlePtr);
+    }
+}
+
+/**
+ * CBC-encrypt bytes with PKCS#7 padding
+ * @param {number} handle - Handle from aesCreate or aesCreateKey
+ * @param {Uint8Array} iv - 16-byte IV
+ * @param {Uint8Array} data - Plaintext bytes
+ * @returns {Uint8Array} - Ciphertext bytes
+ */
+function aesCbcEncryptBytes(handle, iv, data) {
+    const size = Module.ccall('aesCbcEncryptedSize', 'number', ['number'], [data.length]);
+    return callBufferExport('aesCbcEncrypt', handle, [iv, data], [false, true], size);
+}
+
+/**
+ * CBC-decrypt bytes and remove the padding
+ * @param {number} handle - Handle from aesCreate or aesCreateKey
+ * @param {Uint8Array} iv - 16-byte IV used for encryption
+ * @param {Uint8Array} data - Ciphertext bytes
+ * @returns {Uint8Array} - Plaintext bytes
+ */
+function aesCbcDecryptBytes(handle, iv, data) {
+    return callBufferExport('aesCbcDecrypt', handle, [iv, data], [false, true], data.length);
+}
+
+/**
+ * CTR-encrypt or decrypt bytes
+ * @param {number} handle - Handle from aesCreate or aesCreateKey
+ * @param {Uint8Array} counter - 16-byte initial counter block
+ * @param {Uint8Array} data - Input bytes
+ * @returns {Uint8Array} - Output bytes, the same length as the input
+ */
+function aesCtrBytes(handle, counter, data) {
+    return callBufferExport('aesCtrCrypt', handle, [counter, data], [false, true], data.length);
+}
+
+/**
+ * GCM-encrypt bytes
+ * @param {number} handle - Handle from aesCreate or aesCreateKey
+ * @param {Uint8Array} nonce - 12-byte nonce, never reused with the same key
+ * @param {Uint8Array} data - Plaintext bytes
+ * @param {Uint8Array} [aad] - Authenticated data that is not encrypted
+ * @returns {Uint8Array} - Ciphertext followed by the 16-byte tag
+ */
+function aesGcmEncryptBytes(handle, nonce, data, aad) {
+    aad = aad || new Uint8Array(0);
+    return callBufferExport('aesGcmEncrypt', handle, [nonce, aad, data], [true, true, true], data.length + 16);
+}
+
+/**
+ * GCM-decrypt bytes; throws if the tag does not verify
+ * @param {number} handle - Handle from aesCreate or aesCreateKey
+ * @param {Uint8Array} nonce - The nonce used for encryption
+ * @param {Uint8Array} data - Ciphertext followed by the tag
+ * @param {Uint8Array} [aad] - The authenticated data used for encryption
+ * @returns {Uint8Array} - Plaintext bytes
+ */
+function aesGcmDecryptBytes(handle, nonce, data, aad) {
+    aad = aad || new Uint8Array(0);
+    return callBufferExport('aesGcmDecrypt', handle, [nonce, aad, data], [true, true, true], Math.max(data.length - 16, 0));
+}
+
 // Export functions for use in other JavaScript modules
 if (typeof module !== 'undefined' && module.exports) {
     module.exports = {
         encryptString,
         decryptString,
+        encryptStringBase64,
+        decryptStringBase64,
         encryptInt,
         decryptInt,
         encryptFloat,
         decryptFloat,
         encryptLong,
-        decryptLong
+        decryptLong,
+        aesCreate,
+        aesEncrypt,
+        aesDecrypt,
+        aesDestroy,
+        aesCreateKey,
+        aesCbcEncryptBytes,
+        aesCbcDecryptBytes,
+        aesCtrBytes,
+        aesGcmEncryptBytes,
+        aesGcmDecryptBytes
     };
 } 
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "aes_xts.h"
+#include "aes_modes.h"
+#include "aes_stats.h"
+#include "aes_thread_pool.h"
+#include <cstring>
+#include <stdexcept>
+
+// AES-XTS (IEEE 1619).
+//
+// Block j of a data unit is encrypted as E_K1(P ^ T_j) ^ T_j, where T_0 is
+// the unit's sequence number encrypted under K2 and T_{j+1} = T_j * alpha in
+// GF(2^128). The initial tweaks of up to XTS_STRIPE_BLOCKS units are computed
+// with one multi-block kernel call, and within a unit the tweaks of a whole
+// stripe are generated first so the data goes through the kernel 32 blocks at
+// a time, as in CBC decryption.
+
+static const size_t XTS_STRIPE_BLOCKS = 32;
+
+// IEEE 1619 caps a data unit at 2^20 blocks
+static const size_t XTS_MAX_UNIT_SIZE = (static_cast<size_t>(1) << 20) * 16;
+
+// Writes the tweaks of the next count blocks, starting from (lo, hi) as the
+// two little-endian halves of the current tweak, and advances it past them.
+// Multiplying by alpha is a 128-bit left shift with the carry folded back in
+// as x^7 + x^2 + x + 1.
+static void xtsTweaks(uint64_t& lo, uint64_t& hi, unsigned char* tweaks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        storeLittleEndian64(tweaks + 16 * i, lo);
+        storeLittleEndian64(tweaks + 16 * i + 8, hi);
+        uint64_t carry = hi >> 63;
+        hi = (hi << 1) | (lo >> 63);
+        lo = (lo << 1) ^ (0x87 & (0 - carry));
+    }
+}
+
+// One data unit from its encrypted initial tweak
+static void xtsCryptUnit(const AESKernel& kernel, const AESKeySchedule& ks, bool encrypt,
+                         const unsigned char* tweak, const unsigned char* in, unsigned char* out, size_t len) {
+    AESBlocksFn crypt = encrypt ? kernel.encryptBlocks : kernel.decryptBlocks;
+    uint64_t lo = loadLittleEndian64(tweak);
+    uint64_t hi = loadLittleEndian64(tweak + 8);
+    
+    // With a partial final block the last full block is left for the
+    // ciphertext stealing step below
+    size_t tail = len % 16;
+    size_t blocks = len / 16 - (tail ? 1 : 0);
+    
+    alignas(16) unsigned char tweaks[XTS_STRIPE_BLOCKS * 16];
+    alignas(16) unsigned char stripe[XTS_STRIPE_BLOCKS * 16];
+    for (size_t done = 0; done < blocks; ) {
+        size_t n = blocks - done < XTS_STRIPE_BLOCKS ? blocks - done : XTS_STRIPE_BLOCKS;
+        xtsTweaks(lo, hi, tweaks, n);
+        xorBytes(stripe, in + done * 16, tweaks, n * 16);
+        crypt(ks, stripe, stripe, n);
+        xorBytes(out + done * 16, stripe, tweaks, n * 16);
+        done += n;
+    }
+    if (tail == 0) {
+        return;
+    }
+    
+    // Ciphertext stealing: the last full block is processed, its leading
+    // bytes become the partial final block, and the rest pads the final
+    // partial input into a full block that takes the full block's place.
+    // Decryption uses the two tweaks in the opposite order. The partial
+    // input is copied out before anything is written, so in may equal out.
+    xtsTweaks(lo, hi, tweaks, 2);
+    const unsigned char* first = tweaks + (encrypt ? 0 : 16);
+    const unsigned char* second = tweaks + (encrypt ? 16 : 0);
+    const unsigned char* full = in + blocks * 16;
+    
+    alignas(16) unsigned char block[16];
+    alignas(16) unsigned char stolen[16];
+    xorBlock(block, full, first);
+    crypt(ks, block, block, 1);
+    xorBlock(block, block, first);
+    
+    std::memcpy(stolen, full + 16, tail);
+    std::memcpy(stolen + tail, block + tail, 16 - tail);
+    std::memcpy(out + blocks * 16 + 16, block, tail);
+    
+    xorBlock(stolen, stolen, second);
+    crypt(ks, stolen, stolen, 1);
+    xorBlock(out + blocks * 16, stolen, second);
+}
+
+// Units [first, first + count) of a batch; the initial tweaks are encrypted a
+// stripe of units at a time
+static void xtsCryptUnits(const AESKernel& kernel, const AESKeySchedule& dataKs, const AESKeySchedule& tweakKs,
+                          bool encrypt, uint64_t firstUnit, const unsigned char* in, unsigned char* out,
+                          size_t unitSize, size_t count) {
+    alignas(16) unsigned char tweaks[XTS_STRIPE_BLOCKS * 16];
+    for (size_t done = 0; done < count; ) {
+        size_t n = count - done < XTS_STRIPE_BLOCKS ? count - done : XTS_STRIPE_BLOCKS;
+        for (size_t i = 0; i < n; i++) {
+            storeLittleEndian64(tweaks + 16 * i, firstUnit + done + i);
+            storeLittleEndian64(tweaks + 16 * i + 8, 0);
+        }
+        kernel.encryptBlocks(tweakKs, tweaks, tweaks, n);
+        for (size_t i = 0; i < n; i++) {
+            size_t offset = (done + i) * unitSize;
+            xtsCryptUnit(kernel, dataKs, encrypt, tweaks + 16 * i, in + offset, out + offset, unitSize);
+        }
+        done += n;
+    }
+}
+
+static void xtsCrypt(const AESKernel& kernel, const AESKeySchedule& dataKs, const AESKeySchedule& tweakKs,
+                     bool encrypt, uint64_t firstUnit, const unsigned char* in, unsigned char* out,
+                     size_t unitSize, size_t count, unsigned int threads) {
+    const size_t chunkBytes = parallelChunkBytes();
+    size_t unitsPerChunk = unitSize < chunkBytes ? chunkBytes / unitSize : 1;
+    size_t chunks = (count + unitsPerChunk - 1) / unitsPerChunk;
+    if (chunks <= 1 || AESThreadPool::instance().threadsFor(threads) == 1) {
+        xtsCryptUnits(kernel, dataKs, tweakKs, encrypt, firstUnit, in, out, unitSize, count);
+        return;
+    }
+    
+    AESThreadPool::instance().parallelFor(chunks, threads, [&](size_t chunk) {
+        size_t first = chunk * unitsPerChunk;
+        size_t units = count - first < unitsPerChunk ? count - first : unitsPerChunk;
+        size_t offset = first * unitSize;
+        xtsCryptUnits(kernel, dataKs, tweakKs, encrypt, firstUnit + first, in + offset, out + offset,
+                      unitSize, units);
+    });
+}
+
+void xtsEncrypt(const AESKernel& kernel, const AESKeySchedule& dataKs, const AESKeySchedule& tweakKs,
+                uint64_t firstUnit, const unsigned char* in, unsigned char* out, size_t unitSize, size_t count,
+                unsigned int threads) {
+    xtsCrypt(kernel, dataKs, tweakKs, true, firstUnit, in, out, unitSize, count, threads);
+}
+
+void xtsDecrypt(const AESKernel& kernel, const AESKeySchedule& dataKs, const AESKeySchedule& tweakKs,
+                uint64_t firstUnit, const unsigned char* in, unsigned char* out, size_t unitSize, size_t count,
+                unsigned int threads) {
+    xtsCrypt(kernel, dataKs, tweakKs, false, firstUnit, in, out, unitSize, count, threads);
+}
+
+AESXts::AESXts(const std::vector<unsigned char>& key)
+    : dataKey(checkKey(key.data(), key.size()), key.size() / 2), tweakKey(key.data() + key.size() / 2, key.size() / 2) {
+}
+
+AESXts::AESXts(const unsigned char* key, size_t keyLen)
+    : dataKey(checkKey(key, keyLen), keyLen / 2), tweakKey(key + keyLen / 2, keyLen / 2) {
+}
+
+// Runs before either half is expanded. Equal halves are rejected as in
+// SP 800-38E and OpenSSL: they make the tweak of the first block of a unit
+// the encryption of its sequence number under the data key.
+const unsigned char* AESXts::checkKey(const unsigned char* key, size_t keyLen) {
+    if (keyLen != KEY_SIZE && keyLen != KEY_SIZE_256) {
+        throw std::invalid_argument("XTS key must be 32 or 64 bytes (data key followed by tweak key)");
+    }
+    if (std::memcmp(key, key + keyLen / 2, keyLen / 2) == 0) {
+        throw std::invalid_argument("XTS data and tweak keys must differ");
+    }
+    return key;
+}
+
+const char* AESXts::kernelName() const {
+    return dataKey.kernelName();
+}
+
+static void checkUnitSize(size_t sectorSize) {
+    if (sectorSize < 16) {
+        throw std::invalid_argument("XTS sector must be at least one block");
+    }
+    if (sectorSize > XTS_MAX_UNIT_SIZE) {
+        throw std::invalid_argument("XTS sector is too large");
+    }
+}
+
+void AESXts::encryptSector(uint64_t sector, const uint8_t* in, uint8_t* out, size_t len) const {
+    encryptSectors(sector, in, out, len, 1, 1);
+}
+
+void AESXts::decryptSector(uint64_t sector, const uint8_t* in, uint8_t* out, size_t len) const {
+    decryptSectors(sector, in, out, len, 1, 1);
+}
+
+void AESXts::encryptSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorSize,
+                            size_t count, unsigned int threads) const {
+    checkUnitSize(sectorSize);
+    AES_STAT_SCOPE(AESStatOperation::XTS_ENCRYPT, dataKey.kernel().index, sectorSize * count,
+                   count * ((sectorSize + 15) / 16 + 1));
+    xtsEncrypt(dataKey.kernel(), dataKey.schedule(), tweakKey.schedule(), firstSector, in, out,
+               sectorSize, count, threads);
+}
+
+void AESXts::decryptSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorSize,
+                            size_t count, unsigned int threads) const {
+    checkUnitSize(sectorSize);
+    AES_STAT_SCOPE(AESStatOperation::XTS_DECRYPT, dataKey.kernel().index, sectorSize * count,
+                   count * ((sectorSize + 15) / 16 + 1));
+    xtsDecrypt(dataKey.kernel(), dataKey.schedule(), tweakKey.schedule(), firstSector, in, out,
+               sectorSize, count, threads);
+}
@@ -0,0 +1,54 @@
+#ifndef AES_XTS_H
+#define AES_XTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aes_encryption.h"
+
+// AES-XTS (IEEE 1619, NIST SP 800-38E) for encrypting block storage in
+// place. Each sector (data unit) is encrypted independently under its sector
+// number, so any sector can be read or rewritten without touching the others
+// and the ciphertext is exactly as long as the plaintext. XTS provides no
+// integrity: a modified sector decrypts to garbage instead of failing.
+//
+// Like AESKey, an instance is immutable after construction and can be shared
+// between threads.
+class AESXts {
+public:
+    // The data key K1 followed by the tweak key K2: 32 bytes for
+    // XTS-AES-128, 64 bytes for XTS-AES-256
+    static const size_t KEY_SIZE = 32;
+    static const size_t KEY_SIZE_256 = 64;
+    
+    // Throws std::invalid_argument unless the key is 32 or 64 bytes with two
+    // different halves
+    explicit AESXts(const std::vector<unsigned char>& key);
+    // key must point to keyLen bytes
+    explicit AESXts(const unsigned char* key, size_t keyLen);
+    
+    const char* kernelName() const;
+    
+    // One sector of len bytes (at least 16; a length that is not a multiple
+    // of the block size uses ciphertext stealing). in and out may be the
+    // same buffer.
+    void encryptSector(uint64_t sector, const uint8_t* in, uint8_t* out, size_t len) const;
+    void decryptSector(uint64_t sector, const uint8_t* in, uint8_t* out, size_t len) const;
+    
+    // count consecutive sectors of sectorSize bytes starting at firstSector,
+    // packed back to back. Large batches are split by sector across the
+    // worker pool; threads = 0 uses the pool default. The result is the same as
+    // calling encryptSector/decryptSector on each sector.
+    void encryptSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorSize,
+                        size_t count, unsigned int threads = 0) const;
+    void decryptSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t sectorSize,
+                        size_t count, unsigned int threads = 0) const;
+    
+private:
+    AESKey dataKey;
+    AESKey tweakKey;
+    
+    static const unsigned char* checkKey(const unsigned char* key, size_t keyLen);
+};
+
+#endif
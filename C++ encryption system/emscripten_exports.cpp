@@ -1,40 +1,117 @@
+#include "emscripten_exports.h"
 #include "aes_encryption.h"
-#include <string>
-#include <sstream>
-#include <iomanip>
+#include "aes_codec.h"
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
+#elif defined(_WIN32)
+// Define EMSCRIPTEN_KEEPALIVE for non-Emscripten builds; the shared library
+// exports only these functions
+#define EMSCRIPTEN_KEEPALIVE __declspec(dllexport)
 #else
-// Define EMSCRIPTEN_KEEPALIVE for non-Emscripten builds
-#define EMSCRIPTEN_KEEPALIVE
+#define EMSCRIPTEN_KEEPALIVE __attribute__((visibility("default")))
 #endif
 
-// Create a global instance with default values
-// In a real application, you might want to create instances on demand
-static AESEncryption* defaultAes = nullptr;
+// The legacy exports take the key and IV as strings on every call. Expanded
+// keys are kept in a small LRU cache, so calls that cycle through a few keys
+// only pay for the key schedule the first time each key is seen.
+static const size_t KEY_CACHE_CAPACITY = 8;
+
+struct CachedKey {
+    unsigned char bytes[16];
+    std::shared_ptr<const AESKey> key;
+};
 
-// Helper function to ensure we have a valid AES instance
-AESEncryption* getAesInstance(const std::string& key, const std::string& iv) {
-    if (defaultAes == nullptr) {
-        defaultAes = new AESEncryption(key, iv);
-    } else {
-        // Update the instance with new key/iv
-        delete defaultAes;
-        defaultAes = new AESEncryption(key, iv);
+static std::list<CachedKey> keyCache;    // most recently used first
+static std::mutex keyCacheMutex;
+
+// Zero-pads or truncates a string to 16 bytes. The string functions keep this
+// legacy behaviour; the AESEncryption string constructor rejects other lengths.
+static void padTo16(const char* text, unsigned char* out) {
+    std::memset(out, 0, 16);
+    std::memcpy(out, text, std::min<size_t>(std::strlen(text), 16));
+}
+
+static std::shared_ptr<const AESKey> getCachedKey(const char* keyStr) {
+    unsigned char bytes[16];
+    padTo16(keyStr, bytes);
+    
+    std::lock_guard<std::mutex> lock(keyCacheMutex);
+    for (std::list<CachedKey>::iterator it = keyCache.begin(); it != keyCache.end(); ++it) {
+        if (std::memcmp(it->bytes, bytes, sizeof(bytes)) == 0) {
+            keyCache.splice(keyCache.begin(), keyCache, it);
+            return it->key;
+        }
     }
-    return defaultAes;
+    
+    CachedKey entry;
+    std::memcpy(entry.bytes, bytes, sizeof(bytes));
+    entry.key = std::make_shared<const AESKey>(bytes, sizeof(bytes));
+    keyCache.push_front(entry);
+    if (keyCache.size() > KEY_CACHE_CAPACITY) {
+        keyCache.pop_back();
+    }
+    return entry.key;
 }
 
+// Cipher for one call: a cached expanded key plus the caller's IV
+static AESEncryption getAesInstance(const char* key, const char* iv) {
+    unsigned char ivBytes[16];
+    padTo16(iv, ivBytes);
+    return AESEncryption(getCachedKey(key), std::vector<unsigned char>(ivBytes, ivBytes + 16));
+}
+
+// Handle returned by aesCreate and aesCreateKey; owns one expanded key
+struct AESHandle {
+    std::shared_ptr<const AESKey> key;
+};
+
+// Runs one buffer operation and turns its exceptions into status codes.
+// Decryption failures are reported as failureStatus.
+template<typename Operation>
+static int runBufferOperation(Operation operation, int failureStatus = AES_ERROR_INTERNAL) {
+    try {
+        operation();
+        return AES_OK;
+    } catch (const std::invalid_argument&) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    } catch (const std::runtime_error&) {
+        return failureStatus;
+    } catch (const std::exception&) {
+        return AES_ERROR_INTERNAL;
+    }
+}
+
+// Checks the arguments shared by the buffer functions and the output capacity
+static int checkBuffers(const AESHandle* handle, const uint8_t* in, size_t len,
+                        const uint8_t* out, size_t* outLen, size_t required) {
+    if (handle == nullptr || outLen == nullptr || (in == nullptr && len > 0)) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    if (*outLen < required || (out == nullptr && required > 0)) {
+        *outLen = required;
+        return AES_ERROR_BUFFER_TOO_SMALL;
+    }
+    return AES_OK;
+}
+
+static const size_t GCM_TAG_SIZE = 16;
+
 // String encryption/decryption
 extern "C" {
 
 EMSCRIPTEN_KEEPALIVE
 const char* encryptString(const char* text, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        std::string result = aes->encryptString(text);
+        AESEncryption aes = getAesInstance(key, iv);
+        std::string result = aes.encryptString(text);
         
         // Allocate memory that will be managed by JavaScript
         char* output = (char*)malloc(result.length() + 1);
@@ -48,8 +125,39 @@ const char* encryptString(const char* text, const char* key, const char* iv) {
 EMSCRIPTEN_KEEPALIVE
 const char* decryptString(const char* encryptedHex, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        std::string result = aes->decryptString(encryptedHex);
+        AESEncryption aes = getAesInstance(key, iv);
+        std::string result = aes.decryptString(encryptedHex);
+        
+        // Allocate memory that will be managed by JavaScript
+        char* output = (char*)malloc(result.length() + 1);
+        strcpy(output, result.c_str());
+        return output;
+    } catch (const std::exception& e) {
+        return nullptr;
+    }
+}
+
+// Base64 variants of the string functions (a third shorter than hex)
+EMSCRIPTEN_KEEPALIVE
+const char* encryptStringBase64(const char* text, const char* key, const char* iv) {
+    try {
+        AESEncryption aes = getAesInstance(key, iv);
+        std::string result = aes.encryptString(text, AESEncoding::BASE64);
+        
+        // Allocate memory that will be managed by JavaScript
+        char* output = (char*)malloc(result.length() + 1);
+        strcpy(output, result.c_str());
+        return output;
+    } catch (const std::exception& e) {
+        return nullptr;
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char* decryptStringBase64(const char* encryptedBase64, const char* key, const char* iv) {
+    try {
+        AESEncryption aes = getAesInstance(key, iv);
+        std::string result = aes.decryptString(encryptedBase64, AESEncoding::BASE64);
         
         // Allocate memory that will be managed by JavaScript
         char* output = (char*)malloc(result.length() + 1);
@@ -64,15 +172,11 @@ const char* decryptString(const char* encryptedHex, const char* key, const char*
 EMSCRIPTEN_KEEPALIVE
 const char* encryptInt(int value, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        std::vector<unsigned char> encrypted = aes->encrypt<int>(value);
+        AESEncryption aes = getAesInstance(key, iv);
+        std::vector<unsigned char> encrypted = aes.encrypt<int>(value);
         
         // Convert to hex string
-        std::stringstream ss;
-        for (unsigned char byte : encrypted) {
-            ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        std::string result = ss.str();
+        std::string result = encodeBytes(encrypted.data(), encrypted.size(), AESEncoding::HEX);
         
         // Allocate memory that will be managed by JavaScript
         char* output = (char*)malloc(result.length() + 1);
@@ -86,17 +190,12 @@ const char* encryptInt(int value, const char* key, const char* iv) {
 EMSCRIPTEN_KEEPALIVE
 int decryptInt(const char* encryptedHex, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        
-        // Convert hex string back to bytes
-        std::vector<unsigned char> encryptedData;
-        for (size_t i = 0; i < strlen(encryptedHex); i += 2) {
-            std::string byteString = std::string(encryptedHex + i, 2);
-            unsigned char byte = static_cast<unsigned char>(std::stoi(byteString, nullptr, 16));
-            encryptedData.push_back(byte);
-        }
+        AESEncryption aes = getAesInstance(key, iv);
         
-        return aes->decrypt<int>(encryptedData);
+        // Convert hex string back to bytes (throws on malformed input)
+        std::vector<unsigned char> encryptedData = decodeBytes(encryptedHex, strlen(encryptedHex), AESEncoding::HEX);
+        
+        return aes.decrypt<int>(encryptedData);
     } catch (const std::exception& e) {
         return 0;
     }
@@ -106,15 +205,11 @@ int decryptInt(const char* encryptedHex, const char* key, const char* iv) {
 EMSCRIPTEN_KEEPALIVE
 const char* encryptFloat(float value, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        std::vector<unsigned char> encrypted = aes->encrypt<float>(value);
+        AESEncryption aes = getAesInstance(key, iv);
+        std::vector<unsigned char> encrypted = aes.encrypt<float>(value);
         
         // Convert to hex string
-        std::stringstream ss;
-        for (unsigned char byte : encrypted) {
-            ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        std::string result = ss.str();
+        std::string result = encodeBytes(encrypted.data(), encrypted.size(), AESEncoding::HEX);
         
         // Allocate memory that will be managed by JavaScript
         char* output = (char*)malloc(result.length() + 1);
@@ -128,17 +223,12 @@ const char* encryptFloat(float value, const char* key, const char* iv) {
 EMSCRIPTEN_KEEPALIVE
 float decryptFloat(const char* encryptedHex, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        
-        // Convert hex string back to bytes
-        std::vector<unsigned char> encryptedData;
-        for (size_t i = 0; i < strlen(encryptedHex); i += 2) {
-            std::string byteString = std::string(encryptedHex + i, 2);
-            unsigned char byte = static_cast<unsigned char>(std::stoi(byteString, nullptr, 16));
-            encryptedData.push_back(byte);
-        }
+        AESEncryption aes = getAesInstance(key, iv);
+        
+        // Convert hex string back to bytes (throws on malformed input)
+        std::vector<unsigned char> encryptedData = decodeBytes(encryptedHex, strlen(encryptedHex), AESEncoding::HEX);
         
-        return aes->decrypt<float>(encryptedData);
+        return aes.decrypt<float>(encryptedData);
     } catch (const std::exception& e) {
         return 0.0f;
     }
@@ -148,15 +238,11 @@ float decryptFloat(const char* encryptedHex, const char* key, const char* iv) {
 EMSCRIPTEN_KEEPALIVE
 const char* encryptLong(long value, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        std::vector<unsigned char> encrypted = aes->encrypt<long>(value);
+        AESEncryption aes = getAesInstance(key, iv);
+        std::vector<unsigned char> encrypted = aes.encrypt<long>(value);
         
         // Convert to hex string
-        std::stringstream ss;
-        for (unsigned char byte : encrypted) {
-            ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        std::string result = ss.str();
+        std::string result = encodeBytes(encrypted.data(), encrypted.size(), AESEncoding::HEX);
         
         // Allocate memory that will be managed by JavaScript
         char* output = (char*)malloc(result.length() + 1);
@@ -170,29 +256,206 @@ const char* encryptLong(long value, const char* key, const char* iv) {
 EMSCRIPTEN_KEEPALIVE
 long decryptLong(const char* encryptedHex, const char* key, const char* iv) {
     try {
-        AESEncryption* aes = getAesInstance(key, iv);
-        
-        // Convert hex string back to bytes
-        std::vector<unsigned char> encryptedData;
-        for (size_t i = 0; i < strlen(encryptedHex); i += 2) {
-            std::string byteString = std::string(encryptedHex + i, 2);
-            unsigned char byte = static_cast<unsigned char>(std::stoi(byteString, nullptr, 16));
-            encryptedData.push_back(byte);
-        }
+        AESEncryption aes = getAesInstance(key, iv);
         
-        return aes->decrypt<long>(encryptedData);
+        // Convert hex string back to bytes (throws on malformed input)
+        std::vector<unsigned char> encryptedData = decodeBytes(encryptedHex, strlen(encryptedHex), AESEncoding::HEX);
+        
+        return aes.decrypt<long>(encryptedData);
     } catch (const std::exception& e) {
         return 0L;
     }
 }
 
-// Cleanup function
+// Handle API: the key is expanded once in aesCreate and reused by every
+// aesEncrypt/aesDecrypt call until aesDestroy. Keys and IVs are strings
+// padded or truncated to 16 bytes, as in the functions above.
 EMSCRIPTEN_KEEPALIVE
-void cleanupAes() {
-    if (defaultAes != nullptr) {
-        delete defaultAes;
-        defaultAes = nullptr;
+AESHandle* aesCreate(const char* key) {
+    try {
+        unsigned char bytes[16];
+        padTo16(key, bytes);
+        AESHandle* handle = new AESHandle;
+        handle->key = std::make_shared<const AESKey>(bytes, sizeof(bytes));
+        return handle;
+    } catch (const std::exception& e) {
+        return nullptr;
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char* aesEncrypt(AESHandle* handle, const char* text, const char* iv) {
+    if (handle == nullptr) {
+        return nullptr;
     }
+    try {
+        unsigned char ivBytes[16];
+        padTo16(iv, ivBytes);
+        size_t length = std::strlen(text);
+        std::vector<unsigned char> encrypted(AESEncryption::encryptedSize(length));
+        handle->key->encryptCbc(ivBytes, reinterpret_cast<const uint8_t*>(text), length, encrypted.data());
+        
+        std::string result = encodeBytes(encrypted.data(), encrypted.size(), AESEncoding::HEX);
+        
+        // Allocate memory that will be managed by JavaScript
+        char* output = (char*)malloc(result.length() + 1);
+        strcpy(output, result.c_str());
+        return output;
+    } catch (const std::exception& e) {
+        return nullptr;
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char* aesDecrypt(AESHandle* handle, const char* encryptedHex, const char* iv) {
+    if (handle == nullptr) {
+        return nullptr;
+    }
+    try {
+        unsigned char ivBytes[16];
+        padTo16(iv, ivBytes);
+        std::vector<unsigned char> data = decodeBytes(encryptedHex, strlen(encryptedHex), AESEncoding::HEX);
+        size_t length = handle->key->decryptCbc(ivBytes, data.data(), data.size(), data.data());
+        
+        // Allocate memory that will be managed by JavaScript
+        char* output = (char*)malloc(length + 1);
+        std::memcpy(output, data.data(), length);
+        output[length] = '\0';
+        return output;
+    } catch (const std::exception& e) {
+        return nullptr;
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+void aesDestroy(AESHandle* handle) {
+    delete handle;
+}
+
+// Buffer API
+EMSCRIPTEN_KEEPALIVE
+const char* aesErrorString(int status) {
+    switch (status) {
+    case AES_OK: return "OK";
+    case AES_ERROR_INVALID_ARGUMENT: return "Invalid argument";
+    case AES_ERROR_BUFFER_TOO_SMALL: return "Output buffer is too small";
+    case AES_ERROR_INVALID_PADDING: return "Invalid padding";
+    case AES_ERROR_AUTHENTICATION: return "Authentication failed";
+    default: return "Internal error";
+    }
+}
+
+EMSCRIPTEN_KEEPALIVE
+int aesCreateKey(const uint8_t* key, size_t keyLen, AESHandle** handle) {
+    if (key == nullptr || handle == nullptr) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    *handle = nullptr;
+    return runBufferOperation([&] {
+        std::unique_ptr<AESHandle> created(new AESHandle);
+        created->key = std::make_shared<const AESKey>(key, keyLen);
+        *handle = created.release();
+    });
+}
+
+EMSCRIPTEN_KEEPALIVE
+size_t aesCbcEncryptedSize(size_t len) {
+    return AESEncryption::encryptedSize(len);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int aesCbcEncrypt(const AESHandle* handle, const uint8_t* iv, const uint8_t* in, size_t len,
+                  uint8_t* out, size_t* outLen) {
+    int status = checkBuffers(handle, in, len, out, outLen, AESEncryption::encryptedSize(len));
+    if (status != AES_OK) {
+        return status;
+    }
+    if (iv == nullptr) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    return runBufferOperation([&] {
+        *outLen = handle->key->encryptCbc(iv, in, len, out);
+    });
+}
+
+EMSCRIPTEN_KEEPALIVE
+int aesCbcDecrypt(const AESHandle* handle, const uint8_t* iv, const uint8_t* in, size_t len,
+                  uint8_t* out, size_t* outLen) {
+    int status = checkBuffers(handle, in, len, out, outLen, len);
+    if (status != AES_OK) {
+        return status;
+    }
+    if (iv == nullptr) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    return runBufferOperation([&] {
+        *outLen = handle->key->decryptCbc(iv, in, len, out);
+    }, AES_ERROR_INVALID_PADDING);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int aesCtrCrypt(const AESHandle* handle, const uint8_t* counter, const uint8_t* in, size_t len,
+                uint8_t* out, size_t* outLen) {
+    int status = checkBuffers(handle, in, len, out, outLen, len);
+    if (status != AES_OK) {
+        return status;
+    }
+    if (counter == nullptr) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    return runBufferOperation([&] {
+        handle->key->cryptCtr(counter, in, len, out);
+        *outLen = len;
+    });
+}
+
+EMSCRIPTEN_KEEPALIVE
+int aesGcmEncrypt(const AESHandle* handle, const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                  const uint8_t* in, size_t len, uint8_t* out, size_t* outLen) {
+    int status = checkBuffers(handle, in, len, out, outLen, len + GCM_TAG_SIZE);
+    if (status != AES_OK) {
+        return status;
+    }
+    if (nonce == nullptr || (aad == nullptr && aadLen > 0)) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    return runBufferOperation([&] {
+        handle->key->encryptGcm(nonce, nonceLen, aad, aadLen, in, len, out, out + len);
+        *outLen = len + GCM_TAG_SIZE;
+    });
+}
+
+EMSCRIPTEN_KEEPALIVE
+int aesGcmDecrypt(const AESHandle* handle, const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                  const uint8_t* in, size_t len, uint8_t* out, size_t* outLen) {
+    if (handle != nullptr && in != nullptr && len < GCM_TAG_SIZE) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    size_t plainLength = len < GCM_TAG_SIZE ? 0 : len - GCM_TAG_SIZE;
+    int status = checkBuffers(handle, in, len, out, outLen, plainLength);
+    if (status != AES_OK) {
+        return status;
+    }
+    if (nonce == nullptr || in == nullptr || (aad == nullptr && aadLen > 0)) {
+        return AES_ERROR_INVALID_ARGUMENT;
+    }
+    return runBufferOperation([&] {
+        handle->key->decryptGcm(nonce, nonceLen, aad, aadLen, in, plainLength, out, in + plainLength);
+        *outLen = plainLength;
+    }, AES_ERROR_AUTHENTICATION);
+}
+
+// Strings returned by the functions above come from malloc
+EMSCRIPTEN_KEEPALIVE
+void aesFree(const void* ptr) {
+    free(const_cast<void*>(ptr));
+}
+
+// Cleanup function: drops the cached keys of the string-keyed functions
+EMSCRIPTEN_KEEPALIVE
+void cleanupAes() {
+    std::lock_guard<std::mutex> lock(keyCacheMutex);
+    keyCache.clear();
 }
 
 } // extern "C" 
\ No newline at end of file
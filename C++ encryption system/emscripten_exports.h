@@ -0,0 +1,91 @@
+#ifndef EMSCRIPTEN_EXPORTS_H
+#define EMSCRIPTEN_EXPORTS_H
+
+/*
+ * C interface of the library, exported from the Emscripten module and from
+ * the native shared library (libaes_encryption).
+ *
+ * The buffer functions take pointer + length input and write into a buffer
+ * owned by the caller. On entry *outLen is the capacity of out; on return it
+ * holds the number of bytes written, or the size needed when the result is
+ * AES_ERROR_BUFFER_TOO_SMALL (so out may be NULL with *outLen = 0 to query
+ * the size). They return an AESStatus and never allocate the output.
+ *
+ * The older string functions return a NUL-terminated string allocated with
+ * malloc, or NULL on failure; release it with aesFree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AESHandle AESHandle;
+
+enum AESStatus {
+    AES_OK = 0,
+    AES_ERROR_INVALID_ARGUMENT = -1,
+    AES_ERROR_BUFFER_TOO_SMALL = -2,
+    AES_ERROR_INVALID_PADDING = -3,
+    AES_ERROR_AUTHENTICATION = -4,
+    AES_ERROR_INTERNAL = -5
+};
+
+/* Short description of a status code */
+const char* aesErrorString(int status);
+
+/* Expands a 16, 24 or 32-byte binary key (AES-128, AES-192 or AES-256);
+ * release the handle with aesDestroy */
+int aesCreateKey(const uint8_t* key, size_t keyLen, AESHandle** handle);
+void aesDestroy(AESHandle* handle);
+
+/* CBC with PKCS#7 padding and a 16-byte IV. Encryption writes
+ * aesCbcEncryptedSize(len) bytes; decryption needs len bytes of room and
+ * reports the unpadded length. */
+size_t aesCbcEncryptedSize(size_t len);
+int aesCbcEncrypt(const AESHandle* handle, const uint8_t* iv, const uint8_t* in, size_t len,
+                  uint8_t* out, size_t* outLen);
+int aesCbcDecrypt(const AESHandle* handle, const uint8_t* iv, const uint8_t* in, size_t len,
+                  uint8_t* out, size_t* outLen);
+
+/* CTR from a 16-byte initial counter block; encryption and decryption are the same call */
+int aesCtrCrypt(const AESHandle* handle, const uint8_t* counter, const uint8_t* in, size_t len,
+                uint8_t* out, size_t* outLen);
+
+/* GCM. The encrypted form is the ciphertext followed by the 16-byte tag. */
+int aesGcmEncrypt(const AESHandle* handle, const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                  const uint8_t* in, size_t len, uint8_t* out, size_t* outLen);
+int aesGcmDecrypt(const AESHandle* handle, const uint8_t* nonce, size_t nonceLen, const uint8_t* aad, size_t aadLen,
+                  const uint8_t* in, size_t len, uint8_t* out, size_t* outLen);
+
+/* String functions: keys and IVs are strings padded or truncated to 16 bytes,
+ * ciphertext is hex (or base64 for the *Base64 variants) */
+const char* encryptString(const char* text, const char* key, const char* iv);
+const char* decryptString(const char* encryptedHex, const char* key, const char* iv);
+const char* encryptStringBase64(const char* text, const char* key, const char* iv);
+const char* decryptStringBase64(const char* encryptedBase64, const char* key, const char* iv);
+const char* encryptInt(int value, const char* key, const char* iv);
+int decryptInt(const char* encryptedHex, const char* key, const char* iv);
+const char* encryptFloat(float value, const char* key, const char* iv);
+float decryptFloat(const char* encryptedHex, const char* key, const char* iv);
+const char* encryptLong(long value, const char* key, const char* iv);
+long decryptLong(const char* encryptedHex, const char* key, const char* iv);
+
+/* String handle functions; aesCreate pads the key string like the functions above */
+AESHandle* aesCreate(const char* key);
+const char* aesEncrypt(AESHandle* handle, const char* text, const char* iv);
+const char* aesDecrypt(AESHandle* handle, const char* encryptedHex, const char* iv);
+
+/* Releases a string returned by the functions above */
+void aesFree(const void* ptr);
+
+/* Drops the key cache used by the string functions */
+void cleanupAes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
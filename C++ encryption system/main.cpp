@@ -1,15 +1,570 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
 #include "aes_encryption.h"
+#include "aes_codec.h"
+#include "aes_container.h"
+#include "aes_mapped_file.h"
+#include "aes_pipeline.h"
+#include "aes_stream.h"
+#include "aes_thread_pool.h"
+#include "aes_tuning.h"
 
-int main() {
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <string.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Encrypted file layout written by the encrypt command:
+//   cbc, ctr: 16-byte random IV, then the ciphertext
+//   gcm:      12-byte random nonce, then the ciphertext, then the 16-byte tag
+//   chunked:  a seekable container (aes_container.h) with a random file id
+// The filter form (an input or output of -) writes the same cbc and ctr layout.
+static const size_t IV_SIZE = 16;
+static const size_t GCM_NONCE_SIZE = 12;
+static const size_t GCM_TAG_SIZE = 16;
+
+struct FileOptions {
+    bool encrypting;
+    std::string input;
+    std::string output;
+    std::string mode;
+    std::vector<unsigned char> key;
+    unsigned int threads;
+    size_t chunkSize;       // chunked encryption
+    size_t rangeOffset;     // chunked decryption of part of the file
+    size_t rangeLength;     // SIZE_MAX: to the end
+    bool hasRange;
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " encrypt|decrypt --in FILE --out FILE [options]\n"
+              << "       " << program << " enc|dec INPUT OUTPUT [options]\n"
+              << "       " << program << " tune [CACHE_FILE]\n"
+              << "       " << program << "               (runs the built-in demo)\n"
+              << "\n"
+              << "enc and dec are short for encrypt and decrypt. An INPUT or OUTPUT of - is\n"
+              << "standard input or output; the file is then streamed through a pipeline that\n"
+              << "reads, encrypts and writes at the same time (chunked, ctr and cbc), for example\n"
+              << "  tar cf - dir | " << program << " enc - - --key-file k | ssh host 'cat > dir.aesc'\n"
+              << "  " << program << " dec dir.aesc - --key-file k | tar xf -\n"
+              << "Chunked decryption needs the container as a file, since its tags are at the end.\n"
+              << "\n"
+              << "tune measures the kernels, chunk sizes and thread counts on this host and prints\n"
+              << "the fastest configuration, reusing CACHE_FILE when it matches the host. Set\n"
+              << "AES_TUNING=auto or AES_TUNING=CACHE_FILE to apply it at startup.\n"
+              << "\n"
+              << "Options:\n"
+              << "  --mode MODE          ctr, cbc, gcm or chunked (default gcm, or chunked with -)\n"
+              << "  --key HEX            16, 24 or 32-byte key (AES-128/192/256) as 32, 48 or 64 hex digits\n"
+              << "  --key-file FILE      file holding the key as raw bytes or hex digits\n"
+              << "  --threads N          worker threads for ctr, gcm, chunked and cbc decryption (default: all cores\n"
+              << "                       or the tuned count; ctr and cbc filters always use the default)\n"
+              << "  --chunk-size N       chunked: bytes per chunk, a multiple of 16 (default 65536)\n"
+              << "  --offset N           chunked decrypt: first plaintext byte to write (default 0)\n"
+              << "  --length N           chunked decrypt: bytes to write (default: to the end)\n";
+}
+
+static bool isKeySize(size_t size) {
+    return size == 16 || size == 24 || size == 32;
+}
+
+static std::vector<unsigned char> parseHexKey(const std::string& hex) {
+    if (hex.size() % 2 != 0 || !isKeySize(hex.size() / 2)) {
+        throw std::invalid_argument("Key must be 32, 48 or 64 hex digits (16, 24 or 32 bytes)");
+    }
+    std::vector<unsigned char> key(hex.size() / 2);
+    if (!hexDecode(hex.data(), hex.size(), key.data())) {
+        throw std::invalid_argument("Key contains a non-hex character");
+    }
+    return key;
+}
+
+// A file of 32 hex digits is read as an AES-128 key even though 32 raw
+// bytes would also be a valid length
+static std::vector<unsigned char> readKeyFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open key file '" + path + "'");
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string hex = contents;
+    while (!hex.empty() && (hex.back() == '\n' || hex.back() == '\r')) {
+        hex.pop_back();
+    }
+    std::vector<unsigned char> key(hex.size() / 2);
+    if (hex.size() % 2 == 0 && isKeySize(key.size()) && hexDecode(hex.data(), hex.size(), key.data())) {
+        return key;
+    }
+    if (isKeySize(contents.size())) {
+        return std::vector<unsigned char>(contents.begin(), contents.end());
+    }
+    return parseHexKey(hex);
+}
+
+static void randomBytes(unsigned char* out, size_t len) {
+    std::random_device random;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = static_cast<unsigned char>(random());
+    }
+}
+
+struct FileResult {
+    size_t written;
+    const char* kernel;
+};
+
+// Set once the output file has been created or truncated. A failed command
+// removes the output only then, so it never deletes a file it did not write.
+static bool outputCreated = false;
+
+// A mapped output file that records its creation
+class OutputFile : public AESMappedFile {
+public:
+    OutputFile(const std::string& path, size_t size) : AESMappedFile(path, AESMappedFile::WRITE, size) {
+        outputCreated = true;
+    }
+};
+
+// Chunked mode: a whole container is written in one pass, while decryption
+// only maps and decrypts the chunks of the requested range
+static FileResult processContainer(const FileOptions& options) {
+    std::shared_ptr<const AESKey> key = std::make_shared<const AESKey>(options.key);
+    
+    if (options.encrypting) {
+        AESMappedFile input(options.input, AESMappedFile::READ);
+        size_t total = AESContainer::encryptedSize(input.size(), options.chunkSize);
+        OutputFile output(options.output, total);
+        unsigned char fileId[AESContainer::FILE_ID_SIZE];
+        randomBytes(fileId, sizeof(fileId));
+        AESContainer::encrypt(*key, fileId, input.data(), input.size(), output.data(), options.chunkSize, options.threads);
+        output.close(total);
+        return FileResult{total, key->kernelName()};
+    }
+    
+    AESContainerReader reader(key, options.input);
+    size_t offset = options.rangeOffset;
+    if (offset > reader.size()) {
+        throw std::out_of_range("--offset is past the end of the plaintext");
+    }
+    size_t length = std::min(options.rangeLength, reader.size() - offset);
+    OutputFile output(options.output, length);
+    reader.read(offset, length, output.data(), options.threads);
+    output.close(length);
+    return FileResult{length, key->kernelName()};
+}
+
+#ifdef _WIN32
+static int openFd(const std::string& path, bool writing) {
+    if (path == "-") {
+        _setmode(writing ? 1 : 0, _O_BINARY);
+        return writing ? 1 : 0;
+    }
+    int fd = writing ? _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644)
+                     : _open(path.c_str(), _O_RDONLY | _O_BINARY);
+    if (fd < 0) {
+        throw std::runtime_error((writing ? "Cannot create '" : "Cannot open '") + path + "'");
+    }
+    outputCreated = outputCreated || writing;
+    return fd;
+}
+
+static void closeFd(int fd) {
+    if (fd > 2) {
+        _close(fd);
+    }
+}
+
+// Whether both paths name the same existing file
+static bool sameFile(const std::string& a, const std::string& b) {
+    char fullA[_MAX_PATH];
+    char fullB[_MAX_PATH];
+    return _fullpath(fullA, a.c_str(), sizeof(fullA)) != nullptr && _fullpath(fullB, b.c_str(), sizeof(fullB)) != nullptr &&
+           _stricmp(fullA, fullB) == 0 && _access(fullA, 0) == 0;
+}
+
+static void writeAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        int n = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(len, 1 << 30)));
+        if (n <= 0) {
+            throw std::runtime_error("Write failed");
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+#else
+static int openFd(const std::string& path, bool writing) {
+    if (path == "-") {
+        return writing ? STDOUT_FILENO : STDIN_FILENO;
+    }
+    int fd = writing ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error((writing ? "Cannot create '" : "Cannot open '") + path + "'");
+    }
+    outputCreated = outputCreated || writing;
+    return fd;
+}
+
+static void closeFd(int fd) {
+    if (fd > STDERR_FILENO) {
+        ::close(fd);
+    }
+}
+
+// Whether both paths name the same existing file, including through links
+static bool sameFile(const std::string& a, const std::string& b) {
+    struct stat infoA;
+    struct stat infoB;
+    return ::stat(a.c_str(), &infoA) == 0 && ::stat(b.c_str(), &infoB) == 0 && infoA.st_dev == infoB.st_dev &&
+           infoA.st_ino == infoB.st_ino;
+}
+
+static void writeAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("Write failed");
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+#endif
+
+// Chunked decryption to a stream: the chunk tags are stored at the end of the
+// container, so the input must be a file. Each piece is authenticated before
+// any of it is written.
+static FileResult writeContainerRange(const FileOptions& options, int outFd) {
+    if (options.input == "-") {
+        throw std::invalid_argument("Chunked decryption reads the chunk tags from the end of the container, "
+                                    "so the input must be a file rather than -");
+    }
+    std::shared_ptr<const AESKey> key = std::make_shared<const AESKey>(options.key);
+    AESContainerReader reader(key, options.input);
+    size_t offset = options.rangeOffset;
+    if (offset > reader.size()) {
+        throw std::out_of_range("--offset is past the end of the plaintext");
+    }
+    size_t end = offset + std::min(options.rangeLength, reader.size() - offset);
+    
+    size_t pieceSize = reader.chunkSize() * std::max<size_t>(1, AESPipeline::DEFAULT_BUFFER_SIZE / reader.chunkSize());
+    std::vector<uint8_t> piece(std::min(pieceSize, end - offset));
+    for (size_t position = offset; position < end; ) {
+        // Pieces after the first start on a chunk boundary
+        size_t bytes = std::min(pieceSize - position % reader.chunkSize(), end - position);
+        reader.read(position, bytes, piece.data(), options.threads);
+        writeAll(outFd, piece.data(), bytes);
+        position += bytes;
+    }
+    return FileResult{end - offset, key->kernelName()};
+}
+
+// Filter mode: the input is read as a stream, so pipes and terminals work and
+// output starts before the input ends. Chunked containers are written as
+// they are sealed, one chunk at a time. GCM needs the whole input before its
+// single tag can be checked, so it stays file-only.
+static FileResult processFilter(const FileOptions& options, const char** io) {
+    if (options.mode != "ctr" && options.mode != "cbc" && options.mode != "chunked") {
+        throw std::invalid_argument("Mode '" + options.mode + "' cannot stream through - (use chunked, ctr or cbc)");
+    }
+    bool chunked = options.mode == "chunked";
+    AESStream::Mode mode = options.mode == "ctr" ? AESStream::CTR : AESStream::CBC;
+    
+    std::unique_ptr<AESEncryption> aes;
+    std::unique_ptr<AESStream> stream;
+    std::shared_ptr<const AESKey> containerKey;
+    std::unique_ptr<AESContainerWriter> writer;
+    
+    // Every pipeline buffer but the last is full, so with buffers of whole
+    // chunks each one seals into the same number of bytes
+    size_t bufferSize = AESPipeline::DEFAULT_BUFFER_SIZE;
+    if (chunked && options.encrypting) {
+        containerKey = std::make_shared<const AESKey>(options.key);
+        unsigned char fileId[AESContainer::FILE_ID_SIZE];
+        randomBytes(fileId, sizeof(fileId));
+        writer.reset(new AESContainerWriter(containerKey, fileId, options.chunkSize, options.threads));
+        bufferSize = options.chunkSize * std::max<size_t>(1, bufferSize / options.chunkSize);
+    }
+    bool headerWritten = false;
+    
+    // The IV or container header goes before the first output block; the IV
+    // comes off the first input buffer, which the pipeline fills completely
+    // unless the input ends
+    AESPipeline::Transform transform = [&](const uint8_t* in, size_t len, bool last, uint8_t* out) {
+        size_t written = 0;
+        if (writer) {
+            if (!headerWritten) {
+                std::copy(writer->header(), writer->header() + AESContainer::HEADER_SIZE, out);
+                written = AESContainer::HEADER_SIZE;
+                headerWritten = true;
+            }
+            writer->write(in, len, out + written);
+            return written + len;
+        }
+        if (!stream) {
+            std::vector<unsigned char> iv(IV_SIZE);
+            if (options.encrypting) {
+                randomBytes(iv.data(), iv.size());
+                std::copy(iv.begin(), iv.end(), out);
+                written = IV_SIZE;
+            } else {
+                if (len < IV_SIZE) {
+                    throw std::runtime_error("Input is too short to be an encrypted file");
+                }
+                std::copy(in, in + IV_SIZE, iv.begin());
+                in += IV_SIZE;
+                len -= IV_SIZE;
+            }
+            aes.reset(new AESEncryption(options.key, iv));
+            stream.reset(new AESStream(*aes, mode, options.encrypting ? AESStream::ENCRYPT : AESStream::DECRYPT));
+        }
+        written += stream->update(in, len, out + written);
+        if (last) {
+            written += stream->final(out + written);
+        }
+        return written;
+    };
+    
+    if (chunked && !options.encrypting) {
+        int outFd = openFd(options.output, true);
+        try {
+            FileResult result = writeContainerRange(options, outFd);
+            closeFd(outFd);
+            return result;
+        } catch (...) {
+            closeFd(outFd);
+            throw;
+        }
+    }
+    
+    int inFd = openFd(options.input, false);
+    int outFd = -1;
+    try {
+        outFd = openFd(options.output, true);
+        AESPipeline pipeline(inFd, outFd, bufferSize);
+        *io = pipeline.ioName();
+        uint64_t written = pipeline.run(transform);
+        if (writer) {
+            // The index and footer follow the last chunk
+            std::vector<uint8_t> trailer = writer->finish();
+            writeAll(outFd, trailer.data(), trailer.size());
+            written += trailer.size();
+        }
+        closeFd(inFd);
+        closeFd(outFd);
+        return FileResult{static_cast<size_t>(written), writer ? containerKey->kernelName() : aes->kernelName()};
+    } catch (...) {
+        closeFd(inFd);
+        closeFd(outFd);
+        throw;
+    }
+}
+
+// Encrypts or decrypts one file through memory mappings
+static FileResult processFile(const FileOptions& options) {
+    if (options.mode == "chunked") {
+        return processContainer(options);
+    }
+    
+    AESMappedFile input(options.input, AESMappedFile::READ);
+    const uint8_t* in = input.data();
+    size_t length = input.size();
+    
+    if (options.mode == "gcm") {
+        std::vector<unsigned char> zeroIv(IV_SIZE, 0);
+        AESEncryption aes(options.key, zeroIv);
+        
+        if (options.encrypting) {
+            OutputFile output(options.output, GCM_NONCE_SIZE + length + GCM_TAG_SIZE);
+            uint8_t* out = output.data();
+            randomBytes(out, GCM_NONCE_SIZE);
+            aes.encryptGcm(out, GCM_NONCE_SIZE, nullptr, 0, in, length, out + GCM_NONCE_SIZE,
+                           out + GCM_NONCE_SIZE + length, options.threads);
+            output.close(output.size());
+            return FileResult{output.size(), aes.kernelName()};
+        }
+        
+        if (length < GCM_NONCE_SIZE + GCM_TAG_SIZE) {
+            throw std::runtime_error("Input is too short to be a GCM-encrypted file");
+        }
+        size_t plainLength = length - GCM_NONCE_SIZE - GCM_TAG_SIZE;
+        OutputFile output(options.output, plainLength);
+        aes.decryptGcm(in, GCM_NONCE_SIZE, nullptr, 0, in + GCM_NONCE_SIZE, plainLength, output.data(),
+                       in + GCM_NONCE_SIZE + plainLength, options.threads);
+        output.close(plainLength);
+        return FileResult{plainLength, aes.kernelName()};
+    }
+    
+    if (options.mode != "ctr" && options.mode != "cbc") {
+        throw std::invalid_argument("Unknown mode '" + options.mode + "' (expected ctr, cbc, gcm or chunked)");
+    }
+    bool ctr = options.mode == "ctr";
+    
+    if (options.encrypting) {
+        std::vector<unsigned char> iv(IV_SIZE);
+        randomBytes(iv.data(), iv.size());
+        AESEncryption aes(options.key, iv);
+        
+        size_t total = IV_SIZE + (ctr ? length : AESEncryption::encryptedSize(length));
+        OutputFile output(options.output, total);
+        std::copy(iv.begin(), iv.end(), output.data());
+        if (ctr) {
+            aes.encryptCtr(in, length, output.data() + IV_SIZE, options.threads);
+        } else {
+            aes.encrypt(in, length, output.data() + IV_SIZE);
+        }
+        output.close(total);
+        return FileResult{total, aes.kernelName()};
+    }
+    
+    if (length < IV_SIZE) {
+        throw std::runtime_error("Input is too short to be an encrypted file");
+    }
+    AESEncryption aes(options.key, std::vector<unsigned char>(in, in + IV_SIZE));
+    
+    size_t cipherLength = length - IV_SIZE;
+    OutputFile output(options.output, cipherLength);
+    size_t plainLength = cipherLength;
+    if (ctr) {
+        aes.decryptCtr(in + IV_SIZE, cipherLength, output.data(), options.threads);
+    } else {
+        plainLength = aes.decrypt(in + IV_SIZE, cipherLength, output.data(), options.threads);
+    }
+    output.close(plainLength);
+    return FileResult{plainLength, aes.kernelName()};
+}
+
+static int runFileCommand(int argc, char* argv[]) {
+    FileOptions options;
+    std::string command = argv[1];
+    options.encrypting = command == "encrypt" || command == "enc";
+    options.threads = 0;
+    options.chunkSize = AESContainer::DEFAULT_CHUNK_SIZE;
+    options.rangeOffset = 0;
+    options.rangeLength = static_cast<size_t>(-1);
+    options.hasRange = false;
+    
+    std::vector<std::string> positional;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-" || arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            printUsage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--in") {
+            options.input = value;
+        } else if (arg == "--out") {
+            options.output = value;
+        } else if (arg == "--mode") {
+            options.mode = value;
+        } else if (arg == "--key") {
+            options.key = parseHexKey(value);
+        } else if (arg == "--key-file") {
+            options.key = readKeyFile(value);
+        } else if (arg == "--threads") {
+            options.threads = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (arg == "--chunk-size") {
+            options.chunkSize = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+        } else if (arg == "--offset") {
+            options.rangeOffset = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+            options.hasRange = true;
+        } else if (arg == "--length") {
+            options.rangeLength = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+            options.hasRange = true;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    
+    if (positional.size() > 2 || (!positional.empty() && !(options.input.empty() && options.output.empty()))) {
+        std::cerr << "Give the input and output either as INPUT OUTPUT or with --in and --out" << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (positional.size() == 2) {
+        options.input = positional[0];
+        options.output = positional[1];
+    }
+    if (options.input.empty() || options.output.empty() || options.key.empty()) {
+        std::cerr << "An input, an output and a key are required" << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+    bool filter = options.input == "-" || options.output == "-";
+    if (options.mode.empty()) {
+        // Filters default to the streamable authenticated mode
+        options.mode = filter ? "chunked" : "gcm";
+    }
+    if (options.hasRange && (options.encrypting || options.mode != "chunked")) {
+        std::cerr << "--offset and --length only apply to chunked decryption" << std::endl;
+        return 2;
+    }
+    // The output is truncated before the input has been read
+    if (options.input != "-" && options.output != "-" && sameFile(options.input, options.output)) {
+        std::cerr << "The input and output are the same file; write to a different file" << std::endl;
+        return 2;
+    }
+    
+    const char* io = nullptr;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    FileResult result;
+    try {
+        result = filter ? processFilter(options, &io) : processFile(options);
+    } catch (...) {
+        // Never leave a partial or unauthenticated output behind
+        if (outputCreated && options.output != "-") {
+            std::remove(options.output.c_str());
+        }
+        throw;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    unsigned int threads = AESThreadPool::instance().threadsFor(options.threads);
+    std::cerr << (options.encrypting ? "Encrypted " : "Decrypted ") << result.written << " bytes ("
+              << options.mode << ") in " << std::fixed << std::setprecision(3) << seconds << " s, "
+              << std::setprecision(2) << (seconds > 0 ? result.written / seconds / 1e9 : 0.0) << " GB/s ["
+              << result.kernel << " kernel, "
+              << (options.mode == "cbc" && options.encrypting ? 1 : threads) << " threads"
+              << (io != nullptr ? std::string(", ") + io + " I/O" : std::string()) << "]" << std::endl;
+    return 0;
+}
+
+// Built-in demonstration of the string and typed APIs
+static int runDemo() {
     try {
         // Create an AES encryption instance with a key and IV
         std::string key = "MySecretKey12345";  // 16 bytes for AES-128
         std::string iv = "InitVector123456";   // 16 bytes
         
         AESEncryption aes(key, iv);
+        std::cout << "Block kernel: " << aes.kernelName() << std::endl;
+        std::cout << std::endl;
         
         // String encryption/decryption
         std::string plaintext = "Hello, this is a secret message!";
@@ -28,12 +583,7 @@ int main() {
         
         std::vector<unsigned char> encryptedInt = aes.encrypt<int>(originalInt);
         
-        // Convert to hex for display
-        std::cout << "Encrypted int (hex): ";
-        for (unsigned char byte : encryptedInt) {
-            std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        std::cout << std::dec << std::endl;
+        std::cout << "Encrypted int (hex): " << encodeBytes(encryptedInt.data(), encryptedInt.size(), AESEncoding::HEX) << std::endl;
         
         int decryptedInt = aes.decrypt<int>(encryptedInt);
         std::cout << "Decrypted int: " << decryptedInt << std::endl;
@@ -45,12 +595,7 @@ int main() {
         
         std::vector<unsigned char> encryptedFloat = aes.encrypt<float>(originalFloat);
         
-        // Convert to hex for display
-        std::cout << "Encrypted float (hex): ";
-        for (unsigned char byte : encryptedFloat) {
-            std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        std::cout << std::dec << std::endl;
+        std::cout << "Encrypted float (hex): " << encodeBytes(encryptedFloat.data(), encryptedFloat.size(), AESEncoding::HEX) << std::endl;
         
         float decryptedFloat = aes.decrypt<float>(encryptedFloat);
         std::cout << "Decrypted float: " << decryptedFloat << std::endl;
@@ -62,12 +607,7 @@ int main() {
         
         std::vector<unsigned char> encryptedLong = aes.encrypt<long int>(originalLong);
         
-        // Convert to hex for display
-        std::cout << "Encrypted long (hex): ";
-        for (unsigned char byte : encryptedLong) {
-            std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
-        }
-        std::cout << std::dec << std::endl;
+        std::cout << "Encrypted long (hex): " << encodeBytes(encryptedLong.data(), encryptedLong.size(), AESEncoding::HEX) << std::endl;
         
         long int decryptedLong = aes.decrypt<long int>(encryptedLong);
         std::cout << "Decrypted long: " << decryptedLong << std::endl;
@@ -78,4 +618,27 @@ int main() {
     }
     
     return 0;
-} 
\ No newline at end of file
+} 
+
+int main(int argc, char* argv[]) {
+    if (argc == 1) {
+        return runDemo();
+    }
+    
+    std::string command = argv[1];
+    if (command == "tune" && argc <= 3) {
+        std::cout << aesAutotune(argc == 3 ? argv[2] : "").describe() << std::endl;
+        return 0;
+    }
+    if (command != "encrypt" && command != "decrypt" && command != "enc" && command != "dec") {
+        printUsage(argv[0]);
+        return command == "--help" || command == "-h" ? 0 : 2;
+    }
+    
+    try {
+        return runFileCommand(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
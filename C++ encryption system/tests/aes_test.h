@@ -0,0 +1,66 @@
+#ifndef AES_TEST_H
+#define AES_TEST_H
+
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <vector>
+
+// Minimal test harness for aes_tests. Each tests/*_tests.cpp file registers
+// its tests with AES_TEST; aes_tests.cpp runs them on the active kernel and
+// counts the checks that fail.
+
+typedef std::vector<unsigned char> Bytes;
+
+// Records a failure (and prints what) unless ok
+void check(bool ok, const std::string& what);
+
+// Decodes a hex test vector
+Bytes hex(const std::string& text);
+// len bytes of a fixed pattern that differs with the seed
+Bytes sequence(size_t len, unsigned int seed);
+
+template <typename Fn>
+bool throws(Fn fn) {
+    try {
+        fn();
+    } catch (const std::exception&) {
+        return true;
+    }
+    return false;
+}
+
+// Sizes around block, chunk and kernel batch boundaries, and the thread
+// counts the parallel paths are compared at
+static const size_t ROUND_TRIP_SIZES[] = { 0, 1, 15, 16, 17, 63, 64, 127, 128, 129, 255, 4096, 4097, 65536 + 48, 300007 };
+static const unsigned int ROUND_TRIP_THREADS[] = { 1, 4 };
+
+// Sets a small pool chunk size for its lifetime, so the larger inputs span
+// many pool tasks
+class SmallChunks {
+public:
+    SmallChunks();
+    ~SmallChunks();
+    
+private:
+    size_t previous;
+};
+
+struct AESTestCase {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<AESTestCase>& testCases();
+
+struct AESTestRegistration {
+    AESTestRegistration(const char* name, void (*run)()) { testCases().push_back(AESTestCase{ name, run }); }
+};
+
+// Defines and registers a test: AES_TEST(name) { ... }
+#define AES_TEST(name) \
+    static void name(); \
+    static AESTestRegistration name##Registration(#name, name); \
+    static void name()
+
+#endif
@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "aes_codec.h"
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_test.h"
+
+// Runs the registered tests on the active kernel, or only the ones named on
+// the command line. CTest runs this once per kernel with AES_KERNEL set (see
+// CMakeLists.txt); a kernel the host does not support exits with SKIP_CODE.
+// Prints each failed check and exits non-zero if there was one.
+
+static const int SKIP_CODE = 77;
+
+static int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+Bytes hex(const std::string& text) {
+    return decodeBytes(text, AESEncoding::HEX);
+}
+
+Bytes sequence(size_t len, unsigned int seed) {
+    Bytes bytes(len);
+    for (size_t i = 0; i < len; i++) {
+        bytes[i] = static_cast<unsigned char>((i * 131 + seed * 17 + (i >> 8)) & 0xff);
+    }
+    return bytes;
+}
+
+SmallChunks::SmallChunks() : previous(parallelChunkBytes()) {
+    setParallelChunkBytes(4096);
+}
+
+SmallChunks::~SmallChunks() {
+    setParallelChunkBytes(previous);
+}
+
+std::vector<AESTestCase>& testCases() {
+    static std::vector<AESTestCase> cases;
+    return cases;
+}
+
+static bool selected(const char* name, int argc, char** argv) {
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    const char* requested = std::getenv("AES_KERNEL");
+    if (requested != nullptr && *requested != '\0' && forcedKernel() == nullptr) {
+        std::printf("Kernel '%s' is not available on this host; skipped\n", requested);
+        return SKIP_CODE;
+    }
+    
+    int run = 0;
+    for (const AESTestCase& test : testCases()) {
+        if (!selected(test.name, argc, argv)) {
+            continue;
+        }
+        run++;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "FAILED: %s: unexpected exception: %s\n", test.name, e.what());
+            failures++;
+        }
+    }
+    if (run == 0) {
+        std::fprintf(stderr, "No test matches the names given\n");
+        return 2;
+    }
+    
+    std::printf("%s kernel: %d test%s, %d failure%s\n", activeKernel().name, run, run == 1 ? "" : "s", failures,
+                failures == 1 ? "" : "s");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "aes_async.h"
+#include "aes_encryption.h"
+#include "aes_test.h"
+
+// The output a job gets when it runs on its own through the synchronous API
+static Bytes runAlone(const AESJob& job) {
+    if (job.operation == AESJob::CBC_ENCRYPT) {
+        Bytes out(AESEncryption::encryptedSize(job.data.size()));
+        job.cipher.encrypt(job.data.data(), job.data.size(), out.data());
+        return out;
+    }
+    if (job.operation == AESJob::CBC_DECRYPT) {
+        Bytes out(job.data.size());
+        out.resize(job.cipher.decrypt(job.data.data(), job.data.size(), out.data(), 1));
+        return out;
+    }
+    return job.cipher.encryptCtr(job.data, 1);
+}
+
+// A mix of small jobs: every operation, two key families, many IVs and a
+// few jobs that fail
+static std::vector<AESJob> mixedJobs(size_t count) {
+    AESEncryption first(std::make_shared<const AESKey>(sequence(16, 80)), sequence(16, 81));
+    AESEncryption second(std::make_shared<const AESKey>(sequence(32, 82)), sequence(16, 83));
+    std::vector<AESJob> jobs;
+    for (size_t i = 0; i < count; i++) {
+        const AESEncryption& family = i % 5 == 4 ? second : first;
+        const AESEncryption cipher = family.withIv(sequence(16, static_cast<unsigned int>(i % 7)));
+        const Bytes plain = sequence(i % 90, static_cast<unsigned int>(i));
+        if (i % 3 == 0) {
+            jobs.push_back(AESJob(AESJob::CBC_ENCRYPT, cipher, plain));
+        } else if (i % 3 == 1) {
+            Bytes sealed(AESEncryption::encryptedSize(plain.size()));
+            cipher.encrypt(plain.data(), plain.size(), sealed.data());
+            // Every 31st decryption has a corrupt padding block or a partial block
+            if (i % 31 == 1) {
+                sealed.back() ^= 0x55;
+            } else if (i % 31 == 4) {
+                sealed.pop_back();
+            }
+            jobs.push_back(AESJob(AESJob::CBC_DECRYPT, cipher, sealed));
+        } else {
+            jobs.push_back(AESJob(AESJob::CTR, cipher, plain));
+        }
+    }
+    return jobs;
+}
+
+// Checks each future against the job run on its own: the same output, or an
+// error where the synchronous call throws
+static void checkResults(const std::vector<AESJob>& jobs, std::vector<std::future<Bytes> >& results,
+                         const std::string& name) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        Bytes expected;
+        bool expectedError = false;
+        try {
+            expected = runAlone(jobs[i]);
+        } catch (const std::exception&) {
+            expectedError = true;
+        }
+        Bytes actual;
+        bool actualError = false;
+        try {
+            actual = results[i].get();
+        } catch (const std::exception&) {
+            actualError = true;
+        }
+        if (actualError != expectedError || actual != expected) {
+            mismatches++;
+        }
+    }
+    check(mismatches == 0, name + ": " + std::to_string(mismatches) + " of " + std::to_string(jobs.size()) +
+                               " jobs differ from running alone");
+}
+
+// The worker is held in the first job's callback while the rest queue up, so
+// it then takes them in coalesced batches. Every job must get what it gets
+// running alone.
+AES_TEST(asyncCoalescedJobs) {
+    const std::vector<AESJob> jobs = mixedJobs(600);
+    AESAsyncQueue queue(1, 64 * 1024);
+    
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> holding;
+    queue.submit(AESJob(AESJob::CTR, jobs[0].cipher, Bytes(16)), [&](Bytes, std::exception_ptr) {
+        holding.set_value();
+        released.wait();
+    });
+    holding.get_future().wait();
+    
+    std::vector<std::future<Bytes> > results;
+    for (const AESJob& job : jobs) {
+        results.push_back(queue.submit(job));
+    }
+    release.set_value();
+    checkResults(jobs, results, "coalesced batches");
+}
+
+// Jobs submitted from several threads at once to several workers, with
+// stealing between their queues
+AES_TEST(asyncConcurrentSubmitters) {
+    const std::vector<AESJob> jobs = mixedJobs(2000);
+    AESAsyncQueue queue(4);
+    std::vector<std::future<Bytes> > results(jobs.size());
+    std::vector<std::thread> submitters;
+    for (size_t t = 0; t < 4; t++) {
+        submitters.push_back(std::thread([&, t] {
+            for (size_t i = t; i < jobs.size(); i += 4) {
+                results[i] = queue.submit(jobs[i]);
+            }
+        }));
+    }
+    for (std::thread& submitter : submitters) {
+        submitter.join();
+    }
+    checkResults(jobs, results, "concurrent submitters");
+}
+
+// Large jobs run alone and may use the pool
+AES_TEST(asyncLargeJobs) {
+    SmallChunks chunks;
+    AESEncryption cipher(sequence(16, 84), sequence(16, 85));
+    std::vector<AESJob> jobs;
+    jobs.push_back(AESJob(AESJob::CTR, cipher, sequence(300007, 86)));
+    jobs.push_back(AESJob(AESJob::CBC_ENCRYPT, cipher, sequence(100000, 87)));
+    jobs.push_back(AESJob(AESJob::CBC_DECRYPT, cipher, runAlone(jobs[1])));
+    
+    AESAsyncQueue queue(2);
+    std::vector<std::future<Bytes> > results;
+    for (const AESJob& job : jobs) {
+        results.push_back(queue.submit(job));
+    }
+    checkResults(jobs, results, "large jobs");
+}
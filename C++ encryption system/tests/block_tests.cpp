@@ -0,0 +1,101 @@
+#include <cstring>
+#include <string>
+#include "aes_encryption.h"
+#include "aes_kernels.h"
+#include "aes_test.h"
+
+// Byte image of round key r of a schedule (FIPS-197 byte order)
+static Bytes roundKey(const AESKeySchedule& ks, int r) {
+    Bytes bytes(16);
+    std::memcpy(bytes.data(), &ks.encKeys[4 * r], 16);
+    return bytes;
+}
+
+// FIPS-197 appendix A.1: the first and last round keys of the AES-128 example
+AES_TEST(keyExpansion128) {
+    AESKey key(hex("2b7e151628aed2a6abf7158809cf4f3c"));
+    const AESKeySchedule& ks = key.schedule();
+    check(ks.rounds == 10, "AES-128 has 10 rounds");
+    check(roundKey(ks, 0) == hex("2b7e151628aed2a6abf7158809cf4f3c"), "AES-128 round key 0");
+    check(roundKey(ks, 1) == hex("a0fafe1788542cb123a339392a6c7605"), "AES-128 round key 1");
+    check(roundKey(ks, 10) == hex("d014f9a8c9ee2589e13f0cc8b6630ca6"), "AES-128 round key 10");
+}
+
+// FIPS-197 appendix C.1, through the raw block function of the key's kernel
+AES_TEST(blockVector128) {
+    AESKey key(hex("000102030405060708090a0b0c0d0e0f"));
+    const Bytes plain = hex("00112233445566778899aabbccddeeff");
+    Bytes out(16);
+    key.kernel().encryptBlocks(key.schedule(), plain.data(), out.data(), 1);
+    check(out == hex("69c4e0d86a7b0430d8cdb78070b4c55a"), "FIPS-197 C.1 encrypt");
+    Bytes back(16);
+    key.kernel().decryptBlocks(key.schedule(), out.data(), back.data(), 1);
+    check(back == plain, "FIPS-197 C.1 decrypt");
+}
+
+// FIPS-197 appendices A.2 and A.3: the last round keys of the AES-192 and
+// AES-256 examples
+AES_TEST(keyExpansion192And256) {
+    AESKey key192(hex("8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b"));
+    check(key192.schedule().rounds == 12 && key192.keySize() == 24, "AES-192 has 12 rounds");
+    check(roundKey(key192.schedule(), 12) == hex("e98ba06f448c773c8ecc720401002202"), "AES-192 round key 12");
+    
+    AESKey key256(hex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4"));
+    check(key256.schedule().rounds == 14 && key256.keySize() == 32, "AES-256 has 14 rounds");
+    check(roundKey(key256.schedule(), 14) == hex("fe4890d1e6188d0b046df344706c631e"), "AES-256 round key 14");
+}
+
+// FIPS-197 appendices C.2 and C.3
+AES_TEST(blockVectors192And256) {
+    static const char* const vectors[][2] = {
+        { "000102030405060708090a0b0c0d0e0f1011121314151617", "dda97ca4864cdfe06eaf70a0ec0d7191" },
+        { "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f", "8ea2b7ca516745bfeafc49904b496089" },
+    };
+    const Bytes plain = hex("00112233445566778899aabbccddeeff");
+    for (const auto& vector : vectors) {
+        AESKey key(hex(vector[0]));
+        Bytes out(16);
+        key.kernel().encryptBlocks(key.schedule(), plain.data(), out.data(), 1);
+        check(out == hex(vector[1]), std::string("FIPS-197 encrypt, key ") + vector[0]);
+        Bytes back(16);
+        key.kernel().decryptBlocks(key.schedule(), out.data(), back.data(), 1);
+        check(back == plain, std::string("FIPS-197 decrypt, key ") + vector[0]);
+    }
+}
+
+// Only 16, 24 and 32-byte keys are accepted, through either constructor
+AES_TEST(keyLengths) {
+    const Bytes bytes = sequence(40, 25);
+    const size_t lengths[] = { 0, 15, 17, 23, 25, 31, 33, 40 };
+    for (size_t len : lengths) {
+        check(throws([&] { AESKey key(Bytes(bytes.begin(), bytes.begin() + len)); }),
+              "AESKey rejects a " + std::to_string(len) + "-byte key");
+        check(throws([&] { AESKey key(bytes.data(), len); }),
+              "AESKey rejects a " + std::to_string(len) + "-byte key pointer");
+    }
+    check(throws([] { AESEncryption cipher(std::string(20, 'k'), std::string(16, 'i')); }),
+          "AESEncryption rejects a 20-byte key string");
+}
+
+// A run of blocks gives the same output as one call per block, for counts on
+// both sides of every kernel's batch width and every key size, and decrypts
+// back in place
+AES_TEST(blockRuns) {
+    for (size_t keyBytes = 16; keyBytes <= 32; keyBytes += 8) {
+        AESKey key(sequence(keyBytes, 20));
+        const AESKernel& kernel = key.kernel();
+        for (size_t blocks = 1; blocks <= 40; blocks++) {
+            const std::string name = std::to_string(keyBytes * 8) + "-bit key, " + std::to_string(blocks) + " blocks";
+            const Bytes plain = sequence(blocks * 16, static_cast<unsigned int>(blocks));
+            Bytes run(plain.size());
+            kernel.encryptBlocks(key.schedule(), plain.data(), run.data(), blocks);
+            Bytes single(plain.size());
+            for (size_t i = 0; i < blocks; i++) {
+                kernel.encryptBlocks(key.schedule(), &plain[i * 16], &single[i * 16], 1);
+            }
+            check(run == single, "block run matches single blocks, " + name);
+            kernel.decryptBlocks(key.schedule(), run.data(), run.data(), blocks);
+            check(run == plain, "block run decrypts in place, " + name);
+        }
+    }
+}
@@ -0,0 +1,205 @@
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "aes_encryption.h"
+#include "emscripten_exports.h"
+#include "aes_test.h"
+
+// Copies a string returned by the C interface and releases it; a null result
+// becomes "(null)"
+static std::string take(const char* result) {
+    if (result == nullptr) {
+        return "(null)";
+    }
+    std::string copy(result);
+    aesFree(result);
+    return copy;
+}
+
+// The C interface zero-pads key and IV strings to 16 bytes
+static std::string expectedHex(const std::string& text, const std::string& key, const std::string& iv) {
+    std::string paddedKey = key;
+    std::string paddedIv = iv;
+    paddedKey.resize(16);
+    paddedIv.resize(16);
+    return AESEncryption(paddedKey, paddedIv).encryptString(text);
+}
+
+// Cycling through more keys than the cache holds evicts and re-expands them
+// without changing any result, also after cleanupAes and across threads
+AES_TEST(stringFunctionsKeyCache) {
+    const std::string text = "cache test message";
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20; i++) {
+        keys.push_back("key number " + std::to_string(i));
+    }
+    
+    for (int pass = 0; pass < 3; pass++) {
+        const std::string name = "pass " + std::to_string(pass);
+        bool same = true;
+        for (const std::string& key : keys) {
+            const std::string sealed = take(encryptString(text.c_str(), key.c_str(), "iv"));
+            same = same && sealed == expectedHex(text, key, "iv");
+            same = same && take(decryptString(sealed.c_str(), key.c_str(), "iv")) == text;
+        }
+        check(same, "string functions match AESEncryption while keys cycle, " + name);
+        if (pass == 1) {
+            cleanupAes();
+        }
+    }
+    
+    std::vector<std::thread> threads;
+    std::vector<char> same(4, 1);
+    for (size_t t = 0; t < same.size(); t++) {
+        threads.push_back(std::thread([&, t] {
+            for (int round = 0; round < 50; round++) {
+                const std::string& key = keys[(t * 5 + round) % keys.size()];
+                if (take(encryptString(text.c_str(), key.c_str(), "iv")) != expectedHex(text, key, "iv")) {
+                    same[t] = 0;
+                }
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    check(same == std::vector<char>(4, 1), "string functions share the key cache between threads");
+    
+    check(take(decryptString("not hex", "key", "iv")) == "(null)", "decryptString rejects malformed hex");
+    check(decryptInt(take(encryptInt(-123456, "key", "iv")).c_str(), "key", "iv") == -123456, "int round trip");
+    check(decryptLong(take(encryptLong(-123456789L, "key", "iv")).c_str(), "key", "iv") == -123456789L,
+          "long round trip");
+    check(take(decryptStringBase64(take(encryptStringBase64(text.c_str(), "key", "iv")).c_str(), "key", "iv")) == text,
+          "base64 string round trip");
+}
+
+// A handle gives the string functions' ciphertext with one key expansion
+AES_TEST(stringHandles) {
+    AESHandle* handle = aesCreate("handle key");
+    check(handle != nullptr, "aesCreate returns a handle");
+    if (handle == nullptr) {
+        return;
+    }
+    const std::string text = "handle test message, longer than one block";
+    const std::string sealed = take(aesEncrypt(handle, text.c_str(), "handle iv"));
+    check(sealed == expectedHex(text, "handle key", "handle iv"), "aesEncrypt matches encryptString");
+    check(take(aesDecrypt(handle, sealed.c_str(), "handle iv")) == text, "aesDecrypt round trip");
+    check(take(aesDecrypt(handle, "0011", "handle iv")) == "(null)", "aesDecrypt rejects a partial block");
+    aesDestroy(handle);
+    
+    check(take(aesEncrypt(nullptr, text.c_str(), "iv")) == "(null)", "aesEncrypt rejects a null handle");
+    check(take(aesDecrypt(nullptr, sealed.c_str(), "iv")) == "(null)", "aesDecrypt rejects a null handle");
+}
+
+// A size query (null output, zero capacity) and a buffer one byte short both
+// return AES_ERROR_BUFFER_TOO_SMALL with the size needed in *outLen
+AES_TEST(bufferSizeQueries) {
+    const Bytes key = sequence(16, 60);
+    AESHandle* handle = nullptr;
+    check(aesCreateKey(key.data(), key.size(), &handle) == AES_OK && handle != nullptr, "aesCreateKey");
+    if (handle == nullptr) {
+        return;
+    }
+    const Bytes iv = sequence(16, 61);
+    const Bytes nonce = sequence(12, 62);
+    const Bytes plain = sequence(100, 63);
+    const size_t len = plain.size();
+    
+    size_t outLen = 0;
+    check(aesCbcEncrypt(handle, iv.data(), plain.data(), len, nullptr, &outLen) == AES_ERROR_BUFFER_TOO_SMALL &&
+              outLen == aesCbcEncryptedSize(len),
+          "aesCbcEncrypt size query");
+    outLen = 0;
+    check(aesCbcDecrypt(handle, iv.data(), plain.data(), 96, nullptr, &outLen) == AES_ERROR_BUFFER_TOO_SMALL &&
+              outLen == 96,
+          "aesCbcDecrypt size query");
+    outLen = 0;
+    check(aesCtrCrypt(handle, iv.data(), plain.data(), len, nullptr, &outLen) == AES_ERROR_BUFFER_TOO_SMALL &&
+              outLen == len,
+          "aesCtrCrypt size query");
+    outLen = 0;
+    check(aesGcmEncrypt(handle, nonce.data(), nonce.size(), nullptr, 0, plain.data(), len, nullptr, &outLen) ==
+                  AES_ERROR_BUFFER_TOO_SMALL &&
+              outLen == len + 16,
+          "aesGcmEncrypt size query");
+    outLen = 0;
+    check(aesGcmDecrypt(handle, nonce.data(), nonce.size(), nullptr, 0, plain.data(), len, nullptr, &outLen) ==
+                  AES_ERROR_BUFFER_TOO_SMALL &&
+              outLen == len - 16,
+          "aesGcmDecrypt size query");
+    
+    Bytes out(aesCbcEncryptedSize(len));
+    outLen = out.size() - 1;
+    check(aesCbcEncrypt(handle, iv.data(), plain.data(), len, out.data(), &outLen) == AES_ERROR_BUFFER_TOO_SMALL &&
+              outLen == out.size(),
+          "aesCbcEncrypt reports the size needed for a short buffer");
+    aesDestroy(handle);
+}
+
+// The buffer functions give the AESKey output and map failures to status codes
+AES_TEST(bufferFunctions) {
+    const Bytes key = sequence(32, 64);
+    AESHandle* handle = nullptr;
+    check(aesCreateKey(key.data(), 15, &handle) == AES_ERROR_INVALID_ARGUMENT && handle == nullptr,
+          "aesCreateKey rejects a 15-byte key");
+    check(aesCreateKey(key.data(), key.size(), &handle) == AES_OK && handle != nullptr, "aesCreateKey");
+    if (handle == nullptr) {
+        return;
+    }
+    AESKey reference(key);
+    const Bytes iv = sequence(16, 65);
+    const Bytes nonce = sequence(12, 66);
+    const Bytes aad = sequence(10, 67);
+    const Bytes plain = sequence(1000, 68);
+    const size_t len = plain.size();
+    
+    Bytes cbc(aesCbcEncryptedSize(len));
+    size_t outLen = cbc.size();
+    check(aesCbcEncrypt(handle, iv.data(), plain.data(), len, cbc.data(), &outLen) == AES_OK && outLen == cbc.size(),
+          "aesCbcEncrypt");
+    Bytes expected(cbc.size());
+    reference.encryptCbc(iv.data(), plain.data(), len, expected.data());
+    check(cbc == expected, "aesCbcEncrypt matches encryptCbc");
+    Bytes back(cbc.size());
+    outLen = back.size();
+    check(aesCbcDecrypt(handle, iv.data(), cbc.data(), cbc.size(), back.data(), &outLen) == AES_OK && outLen == len &&
+              Bytes(back.begin(), back.begin() + len) == plain,
+          "aesCbcDecrypt reports the unpadded length");
+    cbc[cbc.size() - 17] ^= 0x01;
+    outLen = back.size();
+    check(aesCbcDecrypt(handle, iv.data(), cbc.data(), cbc.size(), back.data(), &outLen) == AES_ERROR_INVALID_PADDING,
+          "aesCbcDecrypt reports invalid padding");
+    
+    Bytes ctr(len);
+    outLen = ctr.size();
+    check(aesCtrCrypt(handle, iv.data(), plain.data(), len, ctr.data(), &outLen) == AES_OK && outLen == len,
+          "aesCtrCrypt");
+    reference.cryptCtr(iv.data(), plain.data(), len, expected.data());
+    check(ctr == Bytes(expected.begin(), expected.begin() + len), "aesCtrCrypt matches cryptCtr");
+    
+    Bytes gcm(len + 16);
+    outLen = gcm.size();
+    check(aesGcmEncrypt(handle, nonce.data(), nonce.size(), aad.data(), aad.size(), plain.data(), len, gcm.data(),
+                        &outLen) == AES_OK && outLen == gcm.size(),
+          "aesGcmEncrypt");
+    outLen = len;
+    check(aesGcmDecrypt(handle, nonce.data(), nonce.size(), aad.data(), aad.size(), gcm.data(), gcm.size(),
+                        back.data(), &outLen) == AES_OK && outLen == len &&
+              Bytes(back.begin(), back.begin() + len) == plain,
+          "aesGcmDecrypt round trip");
+    gcm.back() ^= 0x01;
+    outLen = len;
+    check(aesGcmDecrypt(handle, nonce.data(), nonce.size(), aad.data(), aad.size(), gcm.data(), gcm.size(),
+                        back.data(), &outLen) == AES_ERROR_AUTHENTICATION,
+          "aesGcmDecrypt reports a failed tag");
+    
+    outLen = ctr.size();
+    check(aesCtrCrypt(nullptr, iv.data(), plain.data(), len, ctr.data(), &outLen) == AES_ERROR_INVALID_ARGUMENT,
+          "aesCtrCrypt rejects a null handle");
+    check(aesCtrCrypt(handle, iv.data(), plain.data(), len, ctr.data(), nullptr) == AES_ERROR_INVALID_ARGUMENT,
+          "aesCtrCrypt rejects a null outLen");
+    check(std::strcmp(aesErrorString(AES_ERROR_BUFFER_TOO_SMALL), aesErrorString(AES_OK)) != 0,
+          "aesErrorString describes each status");
+    aesDestroy(handle);
+}
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "aes_encryption.h"
+#include "aes_test.h"
+
+// SP 800-38A F.2.1 (AES-128 CBC)
+AES_TEST(cbcVector) {
+    const Bytes key = hex("2b7e151628aed2a6abf7158809cf4f3c");
+    const Bytes plain = hex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                            "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+    const Bytes cbc = hex("7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+                          "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7");
+    
+    AESEncryption cbcCipher(key, hex("000102030405060708090a0b0c0d0e0f"));
+    Bytes out(AESEncryption::encryptedSize(plain.size()));
+    cbcCipher.encrypt(plain.data(), plain.size(), out.data());
+    check(Bytes(out.begin(), out.begin() + plain.size()) == cbc, "SP 800-38A CBC-AES128 encrypt");
+    Bytes back(out.size());
+    size_t len = cbcCipher.decrypt(out.data(), out.size(), back.data());
+    check(len == plain.size() && Bytes(back.begin(), back.begin() + len) == plain, "SP 800-38A CBC-AES128 decrypt");
+}
+
+// CBC encryption is sequential; decryption runs in stripes on the pool and
+// must give the same plaintext on any thread count, in place too
+AES_TEST(cbcRoundTrips) {
+    SmallChunks chunks;
+    for (size_t keyBytes = 16; keyBytes <= 32; keyBytes += 8) {
+        AESEncryption cipher(std::make_shared<const AESKey>(sequence(keyBytes, 1)), sequence(16, 2));
+        for (size_t size : ROUND_TRIP_SIZES) {
+            const std::string name = std::to_string(keyBytes * 8) + "-bit key, " + std::to_string(size) + " bytes";
+            const Bytes plain = sequence(size, static_cast<unsigned int>(size));
+            Bytes cbc(AESEncryption::encryptedSize(size));
+            cipher.encrypt(plain.data(), size, cbc.data());
+            
+            for (unsigned int threads : ROUND_TRIP_THREADS) {
+                const std::string withThreads = name + ", " + std::to_string(threads) + " threads";
+                Bytes back(cbc.size());
+                size_t len = cipher.decrypt(cbc.data(), cbc.size(), back.data(), threads);
+                check(len == size && std::equal(plain.begin(), plain.end(), back.begin()),
+                      "CBC round trip, " + withThreads);
+                
+                Bytes inPlace = cbc;
+                len = cipher.sharedKey()->decryptCbc(sequence(16, 2).data(), inPlace.data(), inPlace.size(),
+                                                     inPlace.data(), threads);
+                check(len == size && std::equal(plain.begin(), plain.end(), inPlace.begin()),
+                      "CBC round trip in place, " + withThreads);
+            }
+        }
+    }
+}
+
+// Ciphertext that is not whole blocks, or whose padding is wrong, is rejected
+AES_TEST(cbcRejectsBadInput) {
+    AESEncryption cipher(sequence(16, 22), sequence(16, 23));
+    const Bytes plain = sequence(4000, 24);
+    Bytes cbc(AESEncryption::encryptedSize(plain.size()));
+    cipher.encrypt(plain.data(), plain.size(), cbc.data());
+    Bytes back(cbc.size());
+    
+    check(throws([&] { cipher.decrypt(cbc.data(), cbc.size() - 1, back.data()); }),
+          "CBC rejects a partial block");
+    Bytes modified = cbc;
+    modified[modified.size() - 17] ^= 0x01;
+    check(throws([&] { cipher.decrypt(modified.data(), modified.size(), back.data(), 4); }),
+          "CBC rejects invalid padding");
+}
+
+// Every message of a batch gets the ciphertext encryptCbc gives it alone, for
+// counts on both sides of every kernel's lane count, mixed lengths that make
+// lanes refill at different times, and in place
+AES_TEST(cbcMessagesMatchEncryptCbc) {
+    SmallChunks chunks;
+    const size_t counts[] = { 1, 3, 4, 5, 8, 9, 16, 17, 33, 1000 };
+    for (size_t keyBytes = 16; keyBytes <= 32; keyBytes += 8) {
+        AESKey key(sequence(keyBytes, 25));
+        for (size_t count : counts) {
+            std::vector<Bytes> ivs;
+            std::vector<Bytes> plain;
+            std::vector<Bytes> expected;
+            for (size_t i = 0; i < count; i++) {
+                ivs.push_back(sequence(16, static_cast<unsigned int>(i)));
+                const size_t len = i % 11 == 10 ? 5000 + i : (i * 37) % 200;
+                plain.push_back(sequence(len, static_cast<unsigned int>(i + 1)));
+                expected.push_back(Bytes(AESEncryption::encryptedSize(len)));
+                key.encryptCbc(ivs[i].data(), plain[i].data(), len, expected[i].data());
+            }
+            
+            for (unsigned int threads : ROUND_TRIP_THREADS) {
+                const std::string name = std::to_string(keyBytes * 8) + "-bit key, " + std::to_string(count) +
+                                         " messages, " + std::to_string(threads) + " threads";
+                std::vector<Bytes> out;
+                std::vector<Bytes> inPlace;
+                std::vector<AESCbcMessage> messages;
+                std::vector<AESCbcMessage> inPlaceMessages;
+                for (size_t i = 0; i < count; i++) {
+                    out.push_back(Bytes(expected[i].size()));
+                    inPlace.push_back(plain[i]);
+                    inPlace[i].resize(expected[i].size());
+                }
+                for (size_t i = 0; i < count; i++) {
+                    messages.push_back(AESCbcMessage{ ivs[i].data(), plain[i].data(), plain[i].size(), out[i].data() });
+                    inPlaceMessages.push_back(
+                        AESCbcMessage{ ivs[i].data(), inPlace[i].data(), plain[i].size(), inPlace[i].data() });
+                }
+                key.encryptCbcMessages(messages.data(), messages.size(), threads);
+                check(out == expected, "CBC messages match encryptCbc, " + name);
+                key.encryptCbcMessages(inPlaceMessages.data(), inPlaceMessages.size(), threads);
+                check(inPlace == expected, "CBC messages match encryptCbc in place, " + name);
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "aes_codec.h"
+#include "aes_test.h"
+
+static std::string text(const Bytes& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+static Bytes bytes(const std::string& text) {
+    return Bytes(text.begin(), text.end());
+}
+
+// RFC 4648 section 10
+AES_TEST(base64Vectors) {
+    static const char* const vectors[][2] = {
+        { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" },
+    };
+    for (const auto& vector : vectors) {
+        const Bytes plain = bytes(vector[0]);
+        const std::string name = std::string("base64 of \"") + vector[0] + "\"";
+        check(encodeBytes(plain.data(), plain.size(), AESEncoding::BASE64) == vector[1], name + " encodes");
+        check(decodeBytes(vector[1], AESEncoding::BASE64) == plain, name + " decodes");
+    }
+}
+
+// Every length up to a few vector widths, against a byte-at-a-time reference
+AES_TEST(codecRoundTrips) {
+    for (size_t len = 0; len <= 100; len++) {
+        const std::string name = std::to_string(len) + " bytes";
+        const Bytes plain = sequence(len, static_cast<unsigned int>(len));
+        std::string reference;
+        for (unsigned char byte : plain) {
+            char digits[3];
+            std::snprintf(digits, sizeof(digits), "%02x", byte);
+            reference += digits;
+        }
+        
+        const std::string encoded = encodeBytes(plain.data(), plain.size(), AESEncoding::HEX);
+        check(encoded == reference, "hex matches the reference, " + name);
+        check(decodeBytes(encoded, AESEncoding::HEX) == plain, "hex round trip, " + name);
+        std::string upper = encoded;
+        for (char& c : upper) {
+            c = static_cast<char>(c >= 'a' ? c - 'a' + 'A' : c);
+        }
+        check(decodeBytes(upper, AESEncoding::HEX) == plain, "uppercase hex decodes, " + name);
+        
+        const std::string base64 = encodeBytes(plain.data(), plain.size(), AESEncoding::BASE64);
+        check(base64.size() == base64EncodedSize(len), "base64 size, " + name);
+        check(decodeBytes(base64, AESEncoding::BASE64) == plain, "base64 round trip, " + name);
+        
+        check(encodeBytes(plain.data(), plain.size(), AESEncoding::RAW) == text(plain), "raw is unchanged, " + name);
+    }
+}
+
+// Malformed text is rejected with std::invalid_argument
+AES_TEST(codecRejectsMalformedText) {
+    static const char* const badHex[] = { "0", "abc", "0g", "zz00", "00 11" };
+    for (const char* input : badHex) {
+        check(throws([&] { decodeBytes(input, AESEncoding::HEX); }), std::string("hex rejects \"") + input + "\"");
+    }
+    // Bad length, characters outside the alphabet, whitespace, padding in the
+    // middle and non-zero bits after the last whole byte
+    static const char* const badBase64[] = { "Zg=", "Zm9", "Zm9v!A==", "Zm9v\nYg==", "Zg==Zg==", "Zh==", "Zm9=" };
+    for (const char* input : badBase64) {
+        bool invalidArgument = false;
+        try {
+            decodeBytes(input, AESEncoding::BASE64);
+        } catch (const std::invalid_argument&) {
+            invalidArgument = true;
+        }
+        check(invalidArgument, std::string("base64 rejects \"") + input + "\"");
+    }
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "aes_container.h"
+#include "aes_encryption.h"
+#include "aes_test.h"
+
+// Every range reads back, and a modified chunk is rejected
+AES_TEST(containerReads) {
+    auto key = std::make_shared<const AESKey>(sequence(32, 13));
+    const Bytes fileId = sequence(AESContainer::FILE_ID_SIZE, 14);
+    const size_t chunkSizes[] = { 16, 4096, 100000 };
+    const size_t lengths[] = { 0, 1, 4096, 250001 };
+    
+    for (size_t chunkSize : chunkSizes) {
+        for (size_t length : lengths) {
+            const std::string name = std::to_string(length) + " bytes in " + std::to_string(chunkSize) + "-byte chunks";
+            const Bytes plain = sequence(length, 15);
+            Bytes sealed(AESContainer::encryptedSize(length, chunkSize));
+            AESContainer::encrypt(*key, fileId.data(), plain.data(), length, sealed.data(), chunkSize, 4);
+            
+            AESContainerReader reader(key, sealed.data(), sealed.size());
+            check(reader.size() == length && reader.read(0, length) == plain, "container read, " + name);
+            if (length > 2) {
+                const size_t offset = length / 3;
+                const size_t len = length / 2;
+                check(reader.read(offset, len) == Bytes(plain.begin() + offset, plain.begin() + offset + len),
+                      "container range read, " + name);
+            }
+            check(throws([&] { reader.read(length, 1); }), "container rejects a range past the end, " + name);
+            
+            if (length > 0) {
+                Bytes modified = sealed;
+                modified[AESContainer::HEADER_SIZE + length / 2] ^= 1;
+                check(throws([&] {
+                          AESContainerReader tampered(key, modified.data(), modified.size());
+                          tampered.read(0, length);
+                      }),
+                      "container rejects a modified chunk, " + name);
+            }
+        }
+    }
+}
+
+// The authenticated index catches swapped chunks, a truncated container, a
+// changed length and the wrong key before any chunk is read
+AES_TEST(containerRejectsRearrangedData) {
+    auto key = std::make_shared<const AESKey>(sequence(16, 26));
+    const Bytes fileId = sequence(AESContainer::FILE_ID_SIZE, 27);
+    const size_t chunkSize = 4096;
+    const Bytes plain = sequence(5 * chunkSize + 100, 28);
+    Bytes sealed(AESContainer::encryptedSize(plain.size(), chunkSize));
+    AESContainer::encrypt(*key, fileId.data(), plain.data(), plain.size(), sealed.data(), chunkSize);
+    
+    Bytes swapped = sealed;
+    const Bytes::iterator firstChunk = swapped.begin() + AESContainer::HEADER_SIZE;
+    std::swap_ranges(firstChunk, firstChunk + chunkSize, firstChunk + chunkSize);
+    check(throws([&] {
+              AESContainerReader reader(key, swapped.data(), swapped.size());
+              reader.read(0, plain.size());
+          }),
+          "container rejects swapped chunks");
+    
+    const Bytes truncated(sealed.begin(), sealed.end() - 1);
+    check(throws([&] { AESContainerReader reader(key, truncated.data(), truncated.size()); }),
+          "container rejects a truncated container");
+    
+    Bytes longer = sealed;
+    longer[longer.size() - AESContainer::FOOTER_SIZE] ^= 1;
+    check(throws([&] { AESContainerReader reader(key, longer.data(), longer.size()); }),
+          "container rejects a changed length");
+    
+    auto otherKey = std::make_shared<const AESKey>(sequence(16, 29));
+    check(throws([&] { AESContainerReader reader(otherKey, sealed.data(), sealed.size()); }),
+          "container rejects the wrong key");
+}
+
+// The file reader maps the container and gives the in-memory result
+AES_TEST(containerFileReader) {
+    auto key = std::make_shared<const AESKey>(sequence(32, 30));
+    const Bytes fileId = sequence(AESContainer::FILE_ID_SIZE, 31);
+    const Bytes plain = sequence(300000, 32);
+    Bytes sealed(AESContainer::encryptedSize(plain.size(), 65536));
+    AESContainer::encrypt(*key, fileId.data(), plain.data(), plain.size(), sealed.data(), 65536);
+    
+    const std::string path = "aes_tests_container.tmp";
+    {
+        std::ofstream file(path.c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(sealed.data()), static_cast<std::streamsize>(sealed.size()));
+    }
+    {
+        AESContainerReader reader(key, path);
+        check(reader.chunkCount() == 5 && reader.read(70000, 100000) ==
+                  Bytes(plain.begin() + 70000, plain.begin() + 170000),
+              "container file range read");
+    }
+    std::remove(path.c_str());
+}
+
+// The writer, fed several chunks at a time, produces the one-shot container
+AES_TEST(containerWriter) {
+    auto key = std::make_shared<const AESKey>(sequence(32, 13));
+    const Bytes fileId = sequence(AESContainer::FILE_ID_SIZE, 14);
+    const size_t chunkSizes[] = { 16, 4096, 100000 };
+    const size_t lengths[] = { 0, 1, 4096, 250001 };
+    
+    for (size_t chunkSize : chunkSizes) {
+        for (size_t length : lengths) {
+            const std::string name = std::to_string(length) + " bytes in " + std::to_string(chunkSize) + "-byte chunks";
+            const Bytes plain = sequence(length, 15);
+            Bytes sealed(AESContainer::encryptedSize(length, chunkSize));
+            AESContainer::encrypt(*key, fileId.data(), plain.data(), length, sealed.data(), chunkSize, 4);
+            
+            AESContainerWriter writer(key, fileId.data(), chunkSize, 4);
+            Bytes written(writer.header(), writer.header() + AESContainer::HEADER_SIZE);
+            const size_t piece = chunkSize * 3;
+            for (size_t offset = 0; offset < length; offset += piece) {
+                const size_t len = std::min(piece, length - offset);
+                Bytes out(len);
+                writer.write(plain.data() + offset, len, out.data());
+                written.insert(written.end(), out.begin(), out.end());
+            }
+            const std::vector<uint8_t> trailer = writer.finish();
+            written.insert(written.end(), trailer.begin(), trailer.end());
+            check(written == sealed, "container writer matches encrypt(), " + name);
+        }
+    }
+    
+    // Only the last write may cover a partial chunk
+    AESContainerWriter writer(key, fileId.data(), 4096, 1);
+    Bytes plain(5000);
+    Bytes out(5000);
+    writer.write(plain.data(), 100, out.data());
+    check(throws([&] { writer.write(plain.data(), 4096, out.data()); }),
+          "container writer rejects a write after a partial chunk");
+}
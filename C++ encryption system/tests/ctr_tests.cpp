@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include "aes_encryption.h"
+#include "aes_kernels.h"
+#include "aes_test.h"
+
+// SP 800-38A F.5.1 and F.5.2 (CTR-AES128)
+AES_TEST(ctrVector) {
+    const Bytes plain = hex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                            "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710");
+    const Bytes ctr = hex("874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+                          "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee");
+    AESEncryption cipher(hex("2b7e151628aed2a6abf7158809cf4f3c"), hex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"));
+    check(cipher.encryptCtr(plain) == ctr, "SP 800-38A CTR-AES128 encrypt");
+    check(cipher.decryptCtr(ctr) == plain, "SP 800-38A CTR-AES128 decrypt");
+}
+
+// CTR computed one block at a time with a 128-bit big-endian counter
+static Bytes ctrOneBlockAtATime(const AESKey& key, Bytes counter, const Bytes& in) {
+    Bytes out(in.size());
+    Bytes keystream(16);
+    for (size_t offset = 0; offset < in.size(); offset += 16) {
+        key.kernel().encryptBlocks(key.schedule(), counter.data(), keystream.data(), 1);
+        for (size_t i = offset; i < std::min(offset + 16, in.size()); i++) {
+            out[i] = in[i] ^ keystream[i - offset];
+        }
+        for (int i = 15; i >= 0; i--) {
+            if (++counter[i] != 0) {
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+// The counter carries from the low 64 bits into the high ones, and the
+// all-ones block wraps to zero, on every thread count
+AES_TEST(ctrCounterCarry) {
+    SmallChunks chunks;
+    AESKey key(sequence(16, 30));
+    const Bytes plain = sequence(300007, 31);
+    const char* const counters[] = { "0123456789abcdeffffffffffffffff0", "fffffffffffffffffffffffffffffff8" };
+    for (const char* counter : counters) {
+        const Bytes expected = ctrOneBlockAtATime(key, hex(counter), plain);
+        for (unsigned int threads : ROUND_TRIP_THREADS) {
+            const std::string name = std::string(counter) + ", " + std::to_string(threads) + " threads";
+            Bytes out(plain.size());
+            key.cryptCtr(hex(counter).data(), plain.data(), plain.size(), out.data(), threads);
+            check(out == expected, "CTR counter carry from " + name);
+        }
+    }
+}
+
+// The parallel paths match one thread and invert exactly, in place too
+AES_TEST(ctrRoundTrips) {
+    SmallChunks chunks;
+    for (size_t keyBytes = 16; keyBytes <= 32; keyBytes += 8) {
+        AESEncryption cipher(std::make_shared<const AESKey>(sequence(keyBytes, 1)), sequence(16, 2));
+        for (size_t size : ROUND_TRIP_SIZES) {
+            const std::string name = std::to_string(keyBytes * 8) + "-bit key, " + std::to_string(size) + " bytes";
+            const Bytes plain = sequence(size, static_cast<unsigned int>(size));
+            Bytes reference(size + 1);
+            cipher.encryptCtr(plain.data(), size, reference.data(), 1);
+            
+            for (unsigned int threads : ROUND_TRIP_THREADS) {
+                const std::string withThreads = name + ", " + std::to_string(threads) + " threads";
+                Bytes ctr(size + 1);
+                cipher.encryptCtr(plain.data(), size, ctr.data(), threads);
+                check(ctr == reference, "CTR matches one thread, " + withThreads);
+                cipher.decryptCtr(ctr.data(), size, ctr.data(), threads);
+                check(std::equal(plain.begin(), plain.end(), ctr.begin()), "CTR round trip in place, " + withThreads);
+            }
+        }
+    }
+}
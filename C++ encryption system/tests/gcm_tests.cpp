@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include "aes_encryption.h"
+#include "aes_test.h"
+
+// Test cases 1, 2, 4 and 16 of McGrew and Viega, "The Galois/Counter Mode of
+// Operation": empty input, one zero block, and 60 bytes with 20 bytes of
+// associated data under a 128 and a 256-bit key
+AES_TEST(gcmVectors) {
+    static const char* const vectors[][6] = {
+        // key, nonce, aad, plaintext, ciphertext, tag
+        { "00000000000000000000000000000000", "000000000000000000000000", "", "", "",
+          "58e2fccefa7e3061367f1d57a4e7455a" },
+        { "00000000000000000000000000000000", "000000000000000000000000", "", "00000000000000000000000000000000",
+          "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf" },
+        { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+          "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525"
+          "b16aedf5aa0de657ba637b39",
+          "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa05"
+          "1ba30b396a0aac973d58e091",
+          "5bc94fbc3221a5db94fae95ae7121a47" },
+        { "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+          "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+          "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525"
+          "b16aedf5aa0de657ba637b39",
+          "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa8cb08e48590dbb3da7b08b1056828838"
+          "c5f61e6393ba7a0abcc9f662",
+          "76fc6ece0f4e1768cddf8853bb2d551b" },
+    };
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const std::string name = "GCM test vector " + std::to_string(i);
+        AESKey key(hex(vectors[i][0]));
+        const Bytes nonce = hex(vectors[i][1]);
+        const Bytes aad = hex(vectors[i][2]);
+        const Bytes plain = hex(vectors[i][3]);
+        const Bytes expected = hex(vectors[i][4]);
+        const Bytes expectedTag = hex(vectors[i][5]);
+        
+        Bytes out(plain.size() + 1);
+        Bytes tag(16);
+        key.encryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), plain.data(), plain.size(), out.data(),
+                       tag.data());
+        check(Bytes(out.begin(), out.begin() + plain.size()) == expected, name + " ciphertext");
+        check(tag == expectedTag, name + " tag");
+        
+        Bytes back(plain.size() + 1);
+        key.decryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), out.data(), plain.size(), back.data(),
+                       tag.data());
+        check(Bytes(back.begin(), back.begin() + plain.size()) == plain, name + " decrypt");
+        
+        tag[0] ^= 1;
+        check(throws([&] {
+                  key.decryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), out.data(), plain.size(),
+                                 back.data(), tag.data());
+              }),
+              name + " rejects a modified tag");
+    }
+}
+
+// The parallel paths match one thread and invert exactly
+AES_TEST(gcmRoundTrips) {
+    SmallChunks chunks;
+    const Bytes nonce = sequence(12, 5);
+    const Bytes aad = sequence(21, 6);
+    for (size_t keyBytes = 16; keyBytes <= 32; keyBytes += 8) {
+        AESEncryption cipher(std::make_shared<const AESKey>(sequence(keyBytes, 1)), sequence(16, 2));
+        for (size_t size : ROUND_TRIP_SIZES) {
+            const std::string name = std::to_string(keyBytes * 8) + "-bit key, " + std::to_string(size) + " bytes";
+            const Bytes plain = sequence(size, static_cast<unsigned int>(size));
+            Bytes reference(size + 1);
+            Bytes referenceTag(16);
+            cipher.encryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), plain.data(), size,
+                              reference.data(), referenceTag.data(), 1);
+            
+            for (unsigned int threads : ROUND_TRIP_THREADS) {
+                const std::string withThreads = name + ", " + std::to_string(threads) + " threads";
+                Bytes gcm(size + 1);
+                Bytes tag(16);
+                cipher.encryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), plain.data(), size, gcm.data(),
+                                  tag.data(), threads);
+                check(gcm == reference && tag == referenceTag, "GCM matches one thread, " + withThreads);
+                Bytes back(size + 1);
+                cipher.decryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), gcm.data(), size, back.data(),
+                                  tag.data(), threads);
+                check(std::equal(plain.begin(), plain.end(), back.begin()), "GCM round trip, " + withThreads);
+            }
+        }
+    }
+}
+
+// A modified ciphertext, tag or associated data is rejected, and the pointer
+// form leaves the output zeroed
+AES_TEST(gcmRejectsModifiedInput) {
+    AESKey key(sequence(16, 40));
+    const Bytes nonce = sequence(12, 41);
+    const Bytes aad = sequence(30, 42);
+    const Bytes plain = sequence(1000, 43);
+    Bytes sealed(plain.size());
+    Bytes tag(16);
+    key.encryptGcm(nonce.data(), nonce.size(), aad.data(), aad.size(), plain.data(), plain.size(), sealed.data(),
+                   tag.data());
+    
+    const char* const parts[] = { "associated data", "ciphertext", "tag" };
+    for (int part = 0; part < 3; part++) {
+        Bytes modifiedAad = aad;
+        Bytes modifiedSealed = sealed;
+        Bytes modifiedTag = tag;
+        if (part == 0) {
+            modifiedAad[7] ^= 0x80;
+        } else if (part == 1) {
+            modifiedSealed[500] ^= 0x80;
+        } else {
+            modifiedTag[15] ^= 0x80;
+        }
+        Bytes back(plain.size(), 0xaa);
+        const bool rejected = throws([&] {
+            key.decryptGcm(nonce.data(), nonce.size(), modifiedAad.data(), modifiedAad.size(), modifiedSealed.data(),
+                           modifiedSealed.size(), back.data(), modifiedTag.data());
+        });
+        check(rejected, std::string("GCM rejects modified ") + parts[part]);
+        check(back == Bytes(plain.size(), 0), std::string("GCM zeroes the output for modified ") + parts[part]);
+    }
+}
+
+// The hash key belongs to each AESKey: interleaving two keys gives the same
+// output as using each on its own
+AES_TEST(gcmKeysAreIndependent) {
+    AESKey first(sequence(16, 44));
+    AESKey second(sequence(32, 45));
+    const Bytes nonce = sequence(12, 46);
+    const Bytes plain = sequence(777, 47);
+    Bytes reference(plain.size() + 16);
+    first.encryptGcm(nonce.data(), nonce.size(), nullptr, 0, plain.data(), plain.size(), reference.data(),
+                     reference.data() + plain.size());
+    
+    Bytes other(plain.size() + 16);
+    second.encryptGcm(nonce.data(), nonce.size(), nullptr, 0, plain.data(), plain.size(), other.data(),
+                      other.data() + plain.size());
+    Bytes again(plain.size() + 16);
+    first.encryptGcm(nonce.data(), nonce.size(), nullptr, 0, plain.data(), plain.size(), again.data(),
+                     again.data() + plain.size());
+    check(again == reference, "GCM output of a key is unchanged by another key");
+    check(other != reference, "GCM output differs between keys");
+}
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "aes_encryption.h"
+#include "aes_pipeline.h"
+#include "aes_stream.h"
+#include "aes_test.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+
+static bool makePipe(int fds[2]) {
+    return ::_pipe(fds, 64 * 1024, _O_BINARY) == 0;
+}
+
+static int openForReading(const std::string& path) {
+    return ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+}
+
+static long writeSome(int fd, const void* buffer, size_t len) {
+    return ::_write(fd, buffer, static_cast<unsigned int>(len));
+}
+
+static long readSome(int fd, void* buffer, size_t len) {
+    return ::_read(fd, buffer, static_cast<unsigned int>(len));
+}
+
+static void closeFd(int fd) {
+    ::_close(fd);
+}
+
+// Sets AES_PIPE_IO for the pipelines created next; null clears it
+static void setPipeIo(const char* value) {
+    ::_putenv_s("AES_PIPE_IO", value == nullptr ? "" : value);
+}
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool makePipe(int fds[2]) {
+    // A failed run leaves a feeder writing to a pipe nobody reads any more;
+    // it must get EPIPE rather than end the process
+    std::signal(SIGPIPE, SIG_IGN);
+    return ::pipe(fds) == 0;
+}
+
+static int openForReading(const std::string& path) {
+    return ::open(path.c_str(), O_RDONLY);
+}
+
+static long writeSome(int fd, const void* buffer, size_t len) {
+    return static_cast<long>(::write(fd, buffer, len));
+}
+
+static long readSome(int fd, void* buffer, size_t len) {
+    return static_cast<long>(::read(fd, buffer, len));
+}
+
+static void closeFd(int fd) {
+    ::close(fd);
+}
+
+// Sets AES_PIPE_IO for the pipelines created next; null clears it
+static void setPipeIo(const char* value) {
+    if (value == nullptr) {
+        ::unsetenv("AES_PIPE_IO");
+    } else {
+        ::setenv("AES_PIPE_IO", value, 1);
+    }
+}
+#endif
+
+// Writes data to fd in uneven pieces and closes it, so the pipeline sees
+// short reads
+static void feed(int fd, const Bytes& data) {
+    size_t offset = 0;
+    size_t piece = 1;
+    while (offset < data.size()) {
+        long written = writeSome(fd, data.data() + offset, std::min(piece, data.size() - offset));
+        if (written <= 0) {
+            break;
+        }
+        offset += static_cast<size_t>(written);
+        piece = piece * 7 % 10007 + 1;
+    }
+    closeFd(fd);
+}
+
+// Reads fd to the end
+static void drain(int fd, Bytes& out) {
+    unsigned char buffer[4096];
+    long got;
+    while ((got = readSome(fd, buffer, sizeof(buffer))) > 0) {
+        out.insert(out.end(), buffer, buffer + got);
+    }
+}
+
+// CBC encryption through a stream, as the filter does
+static AESPipeline::Transform cbcTransform(AESStreamEncryptor& stream) {
+    return [&stream](const uint8_t* in, size_t len, bool last, uint8_t* out) {
+        size_t written = stream.update(in, len, out);
+        if (last) {
+            written += stream.final(out + written);
+        }
+        return written;
+    };
+}
+
+// Pipe to pipe with small buffers, so the ring wraps many times: the output
+// must equal the one-shot ciphertext for every input size
+static void runPipes(const char* io) {
+    setPipeIo(io);
+    AESEncryption cipher(sequence(16, 90), sequence(16, 91));
+    const size_t sizes[] = { 0, 1, 4095, 4096, 4097, 300007 };
+    for (size_t size : sizes) {
+        const Bytes plain = sequence(size, static_cast<unsigned int>(size));
+        Bytes expected(AESEncryption::encryptedSize(size));
+        cipher.encrypt(plain.data(), size, expected.data());
+        
+        int in[2];
+        int out[2];
+        if (!makePipe(in) || !makePipe(out)) {
+            check(false, "pipes for the pipeline test");
+            return;
+        }
+        Bytes result;
+        std::thread feeder(feed, in[1], std::cref(plain));
+        std::thread drainer(drain, out[0], std::ref(result));
+        uint64_t total = 0;
+        std::string name;
+        try {
+            AESPipeline pipeline(in[0], out[1], 4096, 3);
+            name = std::string(pipeline.ioName()) + ", " + std::to_string(size) + " bytes";
+            if (io != nullptr) {
+                check(std::strcmp(pipeline.ioName(), io) == 0, std::string("AES_PIPE_IO=") + io + " is honoured");
+            }
+            AESStreamEncryptor stream(cipher, AESStream::CBC);
+            total = pipeline.run(cbcTransform(stream));
+        } catch (const std::exception& e) {
+            check(false, std::string("pipeline run: ") + e.what());
+        }
+        closeFd(in[0]);
+        closeFd(out[1]);
+        feeder.join();
+        drainer.join();
+        closeFd(out[0]);
+        check(result == expected && total == expected.size(), "pipeline matches one-shot CBC, " + name);
+    }
+}
+
+// A transform that throws stops the pipeline and run() rethrows its error
+static void runFailure(const char* io) {
+    setPipeIo(io);
+    const Bytes plain = sequence(100000, 92);
+    const std::string path = "aes_tests_pipeline.tmp";
+    {
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            check(false, "temporary file for the pipeline test");
+            return;
+        }
+        std::fwrite(plain.data(), 1, plain.size(), file);
+        std::fclose(file);
+    }
+    int inFd = openForReading(path);
+    int out[2];
+    if (inFd < 0 || !makePipe(out)) {
+        check(false, "files for the pipeline test");
+        return;
+    }
+    Bytes result;
+    std::thread drainer(drain, out[0], std::ref(result));
+    std::string message;
+    {
+        AESPipeline pipeline(inFd, out[1], 4096, 3);
+        size_t calls = 0;
+        try {
+            pipeline.run([&calls](const uint8_t* in, size_t len, bool, uint8_t* copy) -> size_t {
+                if (++calls == 3) {
+                    throw std::runtime_error("transform failed");
+                }
+                std::memcpy(copy, in, len);
+                return len;
+            });
+        } catch (const std::runtime_error& e) {
+            message = e.what();
+        }
+    }
+    closeFd(inFd);
+    closeFd(out[1]);
+    drainer.join();
+    closeFd(out[0]);
+    std::remove(path.c_str());
+    check(message == "transform failed", std::string("pipeline rethrows a transform error, ") + (io ? io : "default"));
+    check(result.size() <= 2 * 4096, std::string("pipeline stops writing after an error, ") + (io ? io : "default"));
+}
+
+AES_TEST(pipelineBlocking) {
+    runPipes("blocking");
+    runFailure("blocking");
+    setPipeIo(nullptr);
+}
+
+// io_uring where the kernel allows it; otherwise this falls back to blocking
+// I/O, which the test reports
+AES_TEST(pipelineIoUring) {
+    setPipeIo(nullptr);
+    {
+        AESPipeline probe(0, 1, 4096, 2);
+        if (std::strcmp(probe.ioName(), "io_uring") != 0) {
+            std::printf("io_uring is not available; the default pipeline test ran with blocking I/O\n");
+        }
+    }
+    runPipes(nullptr);
+    runFailure(nullptr);
+}
@@ -0,0 +1,152 @@
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "aes_siv.h"
+#include "aes_test.h"
+
+// RFC 5297 appendix A.1 (deterministic) and A.2 (nonce-based)
+AES_TEST(sivVectors) {
+    AESSiv deterministic(hex("fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"));
+    std::vector<Bytes> aad(1, hex("101112131415161718191a1b1c1d1e1f2021222324252627"));
+    const Bytes plain = hex("112233445566778899aabbccddee");
+    const Bytes expected = hex("85632d07c6e8f37f950acd320a2ecc9340c02b9690c4dc04daef7f6afe5c");
+    check(deterministic.encrypt(plain, aad) == expected, "RFC 5297 A.1 encrypt");
+    check(deterministic.decrypt(expected, aad) == plain, "RFC 5297 A.1 decrypt");
+    
+    AESSiv nonceBased(hex("7f7e7d7c7b7a79787776757473727170404142434445464748494a4b4c4d4e4f"));
+    std::vector<Bytes> components;
+    components.push_back(hex("00112233445566778899aabbccddeeffdeaddadadeaddadaffeeddccbbaa99887766554433221100"));
+    components.push_back(hex("102030405060708090a0"));
+    components.push_back(hex("09f911029d74e35bd84156c5635688c0"));
+    const Bytes text = hex("7468697320697320736f6d6520706c61696e7465787420746f20656e6372797074207573696e67205349562d414553");
+    const Bytes sealed = hex("7bdb6e3b432667eb06f4d14bff2fbd0fcb900f2fddbe404326601965c889bf17"
+                             "dba77ceb094fa663b7a3f748ba8af829ea64ad544a272e9c485b62a3fd5c0d");
+    check(nonceBased.encrypt(text, components) == sealed, "RFC 5297 A.2 encrypt");
+    check(nonceBased.decrypt(sealed, components) == text, "RFC 5297 A.2 decrypt");
+    
+    Bytes modified = sealed;
+    modified.back() ^= 1;
+    check(throws([&] { nonceBased.decrypt(modified, components); }), "RFC 5297 A.2 rejects a modified ciphertext");
+}
+
+// Round trips around block and chunk boundaries for each key size; one
+// message is also the same as the batch of that one message
+AES_TEST(sivRoundTrips) {
+    SmallChunks chunks;
+    for (size_t keyBytes = 16; keyBytes <= 32; keyBytes += 8) {
+        AESSiv siv(sequence(2 * keyBytes, 4));
+        const Bytes aad = sequence(21, 6);
+        const std::vector<Bytes> components(1, aad);
+        for (size_t size : ROUND_TRIP_SIZES) {
+            const std::string name = std::to_string(keyBytes * 8) + "-bit key, " + std::to_string(size) + " bytes";
+            const Bytes plain = sequence(size, static_cast<unsigned int>(size));
+            const Bytes sealed = siv.encrypt(plain, components);
+            check(sealed.size() == size + AESSiv::TAG_SIZE && siv.decrypt(sealed, components) == plain,
+                  "SIV round trip, " + name);
+            
+            for (unsigned int threads : ROUND_TRIP_THREADS) {
+                Bytes batched(AESSiv::encryptedSize(size));
+                AESSivMessage message{ plain.data(), plain.size(), batched.data() };
+                siv.encryptMessages(&message, 1, aad.data(), aad.size(), threads);
+                check(batched == sealed, "SIV single message matches encrypt(), " + name + ", " +
+                                             std::to_string(threads) + " threads");
+            }
+        }
+    }
+}
+
+// Batched SIV messages equal one encrypt() per message
+AES_TEST(sivMessages) {
+    AESSiv siv(sequence(32, 7));
+    const Bytes aad = sequence(9, 8);
+    std::vector<Bytes> plain;
+    std::vector<Bytes> sealed;
+    for (size_t i = 0; i < 70; i++) {
+        plain.push_back(sequence(i * 3, static_cast<unsigned int>(i)));
+        sealed.push_back(Bytes(AESSiv::encryptedSize(plain.back().size())));
+    }
+    std::vector<AESSivMessage> messages;
+    for (size_t i = 0; i < plain.size(); i++) {
+        messages.push_back(AESSivMessage{ plain[i].data(), plain[i].size(), sealed[i].data() });
+    }
+    siv.encryptMessages(messages.data(), messages.size(), aad.data(), aad.size(), 4);
+    
+    std::vector<Bytes> components(1, aad);
+    bool same = true;
+    for (size_t i = 0; i < plain.size(); i++) {
+        same = same && sealed[i] == siv.encrypt(plain[i], components);
+    }
+    check(same, "SIV messages match encrypt()");
+    
+    std::vector<Bytes> opened;
+    for (size_t i = 0; i < plain.size(); i++) {
+        opened.push_back(Bytes(plain[i].size()));
+    }
+    std::vector<AESSivMessage> sealedMessages;
+    for (size_t i = 0; i < plain.size(); i++) {
+        sealedMessages.push_back(AESSivMessage{ sealed[i].data(), sealed[i].size(), opened[i].data() });
+    }
+    siv.decryptMessages(sealedMessages.data(), sealedMessages.size(), aad.data(), aad.size(), 4);
+    check(opened == plain, "SIV messages round trip");
+    
+    sealed[40][3] ^= 1;
+    check(throws([&] {
+              siv.decryptMessages(sealedMessages.data(), sealedMessages.size(), aad.data(), aad.size(), 4);
+          }),
+          "SIV messages reject a modified message");
+}
+
+// A failed batch zeroes every output, including those of empty messages whose
+// output pointer is null, and throws
+AES_TEST(sivMessagesWithEmptyPlaintext) {
+    AESSiv siv(sequence(32, 9));
+    std::vector<Bytes> plain;
+    std::vector<Bytes> sealed;
+    for (size_t i = 0; i < 40; i++) {
+        plain.push_back(sequence(i % 4 == 0 ? 0 : i, static_cast<unsigned int>(i)));
+        sealed.push_back(Bytes(AESSiv::encryptedSize(plain.back().size())));
+    }
+    std::vector<AESSivMessage> messages;
+    for (size_t i = 0; i < plain.size(); i++) {
+        messages.push_back(AESSivMessage{ plain[i].data(), plain[i].size(), sealed[i].data() });
+    }
+    siv.encryptMessages(messages.data(), messages.size(), nullptr, 0, 4);
+    
+    std::vector<Bytes> opened;
+    std::vector<AESSivMessage> sealedMessages;
+    for (size_t i = 0; i < plain.size(); i++) {
+        opened.push_back(Bytes(plain[i].size(), 0xaa));
+    }
+    for (size_t i = 0; i < plain.size(); i++) {
+        uint8_t* out = opened[i].empty() ? nullptr : opened[i].data();
+        sealedMessages.push_back(AESSivMessage{ sealed[i].data(), sealed[i].size(), out });
+    }
+    siv.decryptMessages(sealedMessages.data(), sealedMessages.size(), nullptr, 0, 4);
+    check(opened == plain, "SIV messages with empty plaintexts round trip");
+    
+    sealed[8][0] ^= 1;
+    check(throws([&] { siv.decryptMessages(sealedMessages.data(), sealedMessages.size(), nullptr, 0, 4); }),
+          "SIV messages reject a modified empty message");
+    bool zeroed = true;
+    for (const Bytes& out : opened) {
+        zeroed = zeroed && out == Bytes(out.size(), 0);
+    }
+    check(zeroed, "SIV messages zero every output on failure");
+}
+
+// Values encrypt deterministically into a std::array, and a key of the wrong
+// length is rejected
+AES_TEST(sivValues) {
+    AESSiv siv(sequence(48, 10));
+    const std::array<uint8_t, sizeof(uint64_t) + AESSiv::TAG_SIZE> first = siv.encrypt(uint64_t(123456789));
+    check(first == siv.encrypt(uint64_t(123456789)), "SIV values are deterministic");
+    check(first != siv.encrypt(uint64_t(123456788)), "SIV values differ for different plaintexts");
+    check(siv.decrypt<uint64_t>(first) == 123456789, "SIV value round trip");
+    check(siv.decryptString(siv.encryptString("column value")) == "column value", "SIV string round trip");
+    
+    const size_t lengths[] = { 16, 31, 33, 47, 65 };
+    for (size_t len : lengths) {
+        check(throws([&] { AESSiv bad(sequence(len, 11)); }), "SIV rejects a " + std::to_string(len) + "-byte key");
+    }
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include "aes_encryption.h"
+#include "aes_stream.h"
+#include "aes_test.h"
+
+// Feeds data through a stream in pieces of the given size and closes it
+static Bytes runStream(AESStream& stream, const Bytes& data, size_t piece) {
+    Bytes result;
+    for (size_t offset = 0; offset < data.size(); offset += piece) {
+        Bytes chunk(data.begin() + offset, data.begin() + std::min(offset + piece, data.size()));
+        Bytes out = stream.update(chunk);
+        result.insert(result.end(), out.begin(), out.end());
+    }
+    Bytes out = stream.final();
+    result.insert(result.end(), out.begin(), out.end());
+    return result;
+}
+
+// Streaming in uneven pieces gives the one-shot output
+AES_TEST(streamsMatchOneShot) {
+    AESEncryption cipher(sequence(16, 10), sequence(16, 11));
+    const Bytes plain = sequence(10007, 12);
+    const size_t pieces[] = { 1, 15, 16, 17, 1000, 4096 };
+    
+    Bytes cbc(AESEncryption::encryptedSize(plain.size()));
+    cipher.encrypt(plain.data(), plain.size(), cbc.data());
+    const Bytes ctr = cipher.encryptCtr(plain);
+    
+    for (size_t piece : pieces) {
+        const std::string name = std::to_string(piece) + "-byte pieces";
+        AESStreamEncryptor cbcStream(cipher, AESStream::CBC);
+        AESStreamEncryptor ctrStream(cipher, AESStream::CTR);
+        check(runStream(cbcStream, plain, piece) == cbc, "CBC stream matches one-shot, " + name);
+        check(runStream(ctrStream, plain, piece) == ctr, "CTR stream matches one-shot, " + name);
+        
+        AESStreamDecryptor cbcDecryptor(cipher, AESStream::CBC);
+        check(runStream(cbcDecryptor, cbc, piece) == plain, "CBC stream round trip, " + name);
+    }
+}
+
+// CTR decryption streams back, and a stream keeps working after its cipher
+// is gone
+AES_TEST(streamsCtrAndLifetime) {
+    const Bytes plain = sequence(5003, 16);
+    std::unique_ptr<AESEncryption> cipher(new AESEncryption(sequence(32, 17), sequence(16, 18)));
+    const Bytes ctr = cipher->encryptCtr(plain);
+    Bytes cbc(AESEncryption::encryptedSize(plain.size()));
+    cipher->encrypt(plain.data(), plain.size(), cbc.data());
+    
+    AESStreamDecryptor ctrStream(*cipher, AESStream::CTR);
+    AESStreamDecryptor cbcStream(*cipher, AESStream::CBC);
+    cipher.reset();
+    check(runStream(ctrStream, ctr, 333) == plain, "CTR stream decrypts");
+    check(runStream(cbcStream, cbc, 333) == plain, "CBC stream outlives its cipher");
+}
+
+// A CBC stream cut short, or with bad padding, fails in final()
+AES_TEST(streamsRejectBadCbcInput) {
+    AESEncryption cipher(sequence(16, 19), sequence(16, 20));
+    const Bytes plain = sequence(100, 21);
+    Bytes cbc(AESEncryption::encryptedSize(plain.size()));
+    cipher.encrypt(plain.data(), plain.size(), cbc.data());
+    
+    const Bytes truncated(cbc.begin(), cbc.end() - 1);
+    check(throws([&] {
+              AESStreamDecryptor stream(cipher, AESStream::CBC);
+              runStream(stream, truncated, 16);
+          }),
+          "CBC stream rejects a partial last block");
+    Bytes modified = cbc;
+    modified[modified.size() - 17] ^= 0x01;
+    check(throws([&] {
+              AESStreamDecryptor stream(cipher, AESStream::CBC);
+              runStream(stream, modified, 16);
+          }),
+          "CBC stream rejects invalid padding");
+}
@@ -0,0 +1,120 @@
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "aes_encryption.h"
+#include "aes_kernels.h"
+#include "aes_modes.h"
+#include "aes_tuning.h"
+#include "aes_test.h"
+
+// Restores the tuning in use when it was created
+class SavedTuning {
+public:
+    SavedTuning() : saved(aesTuning()) {}
+    ~SavedTuning() { aesSetTuning(saved); }
+    
+private:
+    AESTuning saved;
+};
+
+static std::string firstLine(const std::string& path) {
+    std::ifstream file(path.c_str());
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Invalid settings are rejected; a valid one reads back as "manual" and does
+// not change any output
+AES_TEST(tuningManualSettings) {
+    SavedTuning saved;
+    const AESTuning current = aesTuning();
+    
+    AESTuning bad = current;
+    bad.kernel = "no such kernel";
+    check(throws([&] { aesSetTuning(bad); }), "aesSetTuning rejects an unknown kernel");
+    bad = current;
+    bad.threads = 0;
+    check(throws([&] { aesSetTuning(bad); }), "aesSetTuning rejects zero threads");
+    bad = current;
+    bad.chunkBytes = 0;
+    check(throws([&] { aesSetTuning(bad); }), "aesSetTuning rejects a zero chunk size");
+    bad.chunkBytes = 17;
+    check(throws([&] { aesSetTuning(bad); }), "aesSetTuning rejects a chunk size that is not a multiple of 16");
+    
+    AESEncryption cipher(sequence(16, 100), sequence(16, 101));
+    const Bytes plain = sequence(300007, 102);
+    const Bytes expected = cipher.encryptCtr(plain, 0);
+    
+    AESTuning manual = current;
+    manual.threads = 1;
+    manual.chunkBytes = 4096 + 16;
+    aesSetTuning(manual);
+    const AESTuning applied = aesTuning();
+    check(applied.source == "manual" && applied.kernel == current.kernel && applied.threads == 1 &&
+              applied.chunkBytes == manual.chunkBytes && parallelChunkBytes() == manual.chunkBytes,
+          "aesSetTuning applies a valid setting as \"manual\": " + applied.describe());
+    check(cipher.encryptCtr(plain, 0) == expected, "a manual setting does not change CTR output");
+}
+
+// The first run calibrates and writes the cache, the second reads it back,
+// and a cache from another version is recalibrated. A kernel forced with
+// AES_KERNEL is kept, and T-table is never chosen on its own.
+AES_TEST(tuningCacheRoundTrip) {
+    SavedTuning saved;
+    const std::string path = "aes_tests_tuning.tmp";
+    std::remove(path.c_str());
+    
+    const AESTuning calibrated = aesAutotune(path);
+    check(calibrated.source == "calibrated", "aesAutotune calibrates without a cache: " + calibrated.describe());
+    check(firstLine(path) == "# aes_encryption tuning cache; delete to recalibrate", "aesAutotune writes the cache");
+    if (forcedKernel() != nullptr) {
+        check(calibrated.kernel == forcedKernel()->name, "aesAutotune keeps the forced kernel");
+    } else {
+        check(calibrated.kernel != "ttable", "aesAutotune does not choose the T-table kernel");
+    }
+    
+    const AESTuning cached = aesAutotune(path);
+    check(cached.source == "cache" && cached.kernel == calibrated.kernel && cached.threads == calibrated.threads &&
+              cached.chunkBytes == calibrated.chunkBytes,
+          "aesAutotune reads back the cached setting: " + cached.describe());
+    const AESTuning applied = aesTuning();
+    check(applied.source == "cache" && applied.chunkBytes == cached.chunkBytes, "aesAutotune applies the cache");
+    
+    {
+        std::ofstream file(path.c_str(), std::ios::trunc);
+        file << "version 999\nkernel " << calibrated.kernel << "\nthreads 1\nchunk 4096\n";
+    }
+    check(aesAutotune(path).source == "calibrated", "aesAutotune recalibrates on a cache from another version");
+    check(aesAutotune(path).source == "cache", "aesAutotune rewrites a stale cache");
+    std::remove(path.c_str());
+}
+
+// Calibration passes each candidate chunk size to its own calls, so bulk
+// calls running meanwhile see only the old setting or the result
+AES_TEST(tuningCalibrationKeepsSetting) {
+    SavedTuning saved;
+    AESTuning manual = aesTuning();
+    manual.chunkBytes = 4096 + 16;
+    aesSetTuning(manual);
+    
+    std::atomic<bool> done(false);
+    // The first value other than the old one the poller sees
+    std::atomic<size_t> changed(0);
+    std::thread poller([&] {
+        while (!done.load() && changed.load() == 0) {
+            size_t chunkBytes = parallelChunkBytes();
+            if (chunkBytes != manual.chunkBytes) {
+                changed.store(chunkBytes);
+            }
+        }
+    });
+    const AESTuning calibrated = aesAutotune();
+    done.store(true);
+    poller.join();
+    check(changed.load() == 0 || changed.load() == calibrated.chunkBytes,
+          "calibration leaves the chunk size alone until it applies the result, saw " +
+              std::to_string(changed.load()));
+}
@@ -0,0 +1,122 @@
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "aes_encryption.h"
+#include "aes_test.h"
+
+// iv + n as a 128-bit big-endian integer
+static Bytes ivPlus(Bytes iv, uint64_t n) {
+    for (int i = 15; i >= 0 && n != 0; i--) {
+        n += iv[i];
+        iv[i] = static_cast<unsigned char>(n);
+        n >>= 8;
+    }
+    return iv;
+}
+
+struct Reading {
+    int32_t sensor;
+    double value;
+};
+
+// Record i of a batch is the CBC encryption of value i under IV + i, so it
+// decrypts on its own; the batch decrypts back in one call. The IV's low
+// bytes carry partway through, and the large batches run on the pool.
+AES_TEST(batchValues) {
+    const Bytes iv = hex("000102030405060708090a0b0c0dfff0");
+    AESEncryption cipher(sequence(16, 50), iv);
+    const size_t counts[] = { 0, 1, 7, 33, 5000 };
+    for (size_t count : counts) {
+        const std::string name = std::to_string(count) + " values";
+        std::vector<int64_t> values(count);
+        for (size_t i = 0; i < count; i++) {
+            values[i] = static_cast<int64_t>(i * 7919) - 3000;
+        }
+        const AESBatch batch = cipher.encryptBatch(values);
+        check(batch.size() == count, "batch has one record per value, " + name);
+        bool same = true;
+        for (size_t i = 0; i < count; i++) {
+            const Bytes record(batch.record(i), batch.record(i) + batch.recordSize(i));
+            same = same && record == cipher.withIv(ivPlus(iv, i)).encrypt(values[i]);
+        }
+        check(same, "batch records match encrypt() under IV + i, " + name);
+        check(cipher.decryptBatch<int64_t>(batch) == values, "batch round trip, " + name);
+    }
+    
+    std::vector<Reading> readings;
+    for (int i = 0; i < 100; i++) {
+        readings.push_back(Reading{ i, i * 0.25 });
+    }
+    const std::vector<Reading> back = cipher.decryptBatch<Reading>(cipher.encryptBatch(readings));
+    bool same = back.size() == readings.size();
+    for (size_t i = 0; same && i < back.size(); i++) {
+        same = back[i].sensor == readings[i].sensor && back[i].value == readings[i].value;
+    }
+    check(same, "batch round trip of structs");
+}
+
+// Strings of mixed lengths, including empty and whole-block ones
+AES_TEST(batchStrings) {
+    const Bytes iv = sequence(16, 52);
+    AESEncryption cipher(sequence(32, 51), iv);
+    std::vector<std::string> values;
+    for (size_t i = 0; i < 300; i++) {
+        const Bytes bytes = sequence(i % 41, static_cast<unsigned int>(i));
+        values.push_back(std::string(bytes.begin(), bytes.end()));
+    }
+    const AESBatch batch = cipher.encryptBatch(values);
+    bool same = true;
+    for (size_t i = 0; i < values.size(); i++) {
+        const std::string record(batch.record(i), batch.record(i) + batch.recordSize(i));
+        same = same && record == cipher.withIv(ivPlus(iv, i)).encryptString(values[i], AESEncoding::RAW);
+    }
+    check(same, "string batch records match encryptString() under IV + i");
+    check(cipher.decryptStringBatch(batch) == values, "string batch round trip");
+    
+    AESBatch broken = batch;
+    broken.offsets[1] += 1;
+    check(throws([&] { cipher.decryptStringBatch(broken); }), "string batch rejects offsets off a block boundary");
+}
+
+struct Block16 {
+    uint64_t high;
+    uint64_t low;
+};
+
+struct Odd15 {
+    char bytes[15];
+};
+
+static_assert(AESEncryption::paddedSize<int32_t> == 16, "a 4-byte value pads to one block");
+static_assert(AESEncryption::paddedSize<Block16> == 32, "a whole block gets a block of padding");
+static_assert(AESEncryption::paddedSize<Odd15> == 16, "15 bytes pad to one block");
+
+// encryptFixed gives encrypt<T>'s ciphertext in a std::array, and the array
+// overload of decrypt<T> inverts it
+template <typename T>
+static bool fixedMatches(const AESEncryption& cipher, const T& value) {
+    const std::array<uint8_t, AESEncryption::paddedSize<T> > sealed = cipher.encryptFixed(value);
+    const Bytes expected = cipher.encrypt(value);
+    const T back = cipher.decrypt<T>(sealed);
+    return Bytes(sealed.begin(), sealed.end()) == expected && std::memcmp(&back, &value, sizeof(T)) == 0;
+}
+
+AES_TEST(fixedValues) {
+    AESEncryption cipher(sequence(24, 53), sequence(16, 54));
+    check(fixedMatches(cipher, static_cast<int32_t>(-7)), "encryptFixed of an int32_t");
+    check(fixedMatches(cipher, 3.25), "encryptFixed of a double");
+    check(fixedMatches(cipher, Block16{ 0x0123456789abcdefULL, 0xfedcba9876543210ULL }),
+          "encryptFixed of a 16-byte struct");
+    Odd15 odd;
+    std::memcpy(odd.bytes, "fifteen bytes!!", sizeof(odd.bytes));
+    check(fixedMatches(cipher, odd), "encryptFixed of a 15-byte struct");
+    
+    std::array<uint8_t, AESEncryption::paddedSize<int32_t> > sealed = cipher.encryptFixed(static_cast<int32_t>(42));
+    sealed[15] ^= 0x20;
+    check(throws([&] { cipher.decrypt<int32_t>(sealed); }), "decrypt<T> of an array rejects invalid padding");
+    // A 4-byte value decrypted as 8 bytes would read past the plaintext
+    const std::array<uint8_t, 16> small = cipher.encryptFixed(static_cast<int32_t>(42));
+    check(throws([&] { cipher.decrypt<int64_t>(small); }), "decrypt<T> of an array rejects a too-small value");
+}
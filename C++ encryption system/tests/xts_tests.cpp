@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <string>
+#include "aes_xts.h"
+#include "aes_test.h"
+
+// IEEE 1619-2007 vector 2: one 32-byte data unit, sector 0x3333333333
+AES_TEST(xtsVector) {
+    AESXts xts(hex("11111111111111111111111111111111" "22222222222222222222222222222222"));
+    const Bytes plain(32, 0x44);
+    const Bytes expected = hex("c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0");
+    Bytes out(32);
+    xts.encryptSector(0x3333333333ULL, plain.data(), out.data(), out.size());
+    check(out == expected, "IEEE 1619 XTS vector 2 encrypt");
+    Bytes back(32);
+    xts.decryptSector(0x3333333333ULL, out.data(), back.data(), back.size());
+    check(back == plain, "IEEE 1619 XTS vector 2 decrypt");
+}
+
+// Single sectors of every size, with ciphertext stealing where the size is
+// not whole blocks, and runs of 512-byte sectors on one and four threads
+AES_TEST(xtsRoundTrips) {
+    SmallChunks chunks;
+    // XTS has no 192-bit variant
+    for (size_t keyBytes = 32; keyBytes <= 64; keyBytes += 32) {
+        AESXts xts(sequence(keyBytes, 3));
+        for (size_t size : ROUND_TRIP_SIZES) {
+            const std::string name = std::to_string(keyBytes * 4) + "-bit key, " + std::to_string(size) + " bytes";
+            const Bytes plain = sequence(size, static_cast<unsigned int>(size));
+            if (size >= 16) {
+                Bytes sealed(size);
+                xts.encryptSector(7, plain.data(), sealed.data(), size);
+                Bytes back(size);
+                xts.decryptSector(7, sealed.data(), back.data(), size);
+                check(back == plain, "XTS sector round trip, " + name);
+            }
+            
+            const size_t sectors = size / 512;
+            if (sectors > 0) {
+                Bytes one(sectors * 512);
+                Bytes many(sectors * 512);
+                xts.encryptSectors(9, plain.data(), one.data(), 512, sectors, 1);
+                xts.encryptSectors(9, plain.data(), many.data(), 512, sectors, 4);
+                check(one == many, "XTS sectors match one thread, " + name);
+                Bytes back(sectors * 512);
+                xts.decryptSectors(9, many.data(), back.data(), 512, sectors, 4);
+                check(std::equal(back.begin(), back.end(), plain.begin()), "XTS sectors round trip, " + name);
+            }
+        }
+    }
+}
+
+// A run of sectors equals one encryptSector call per sector number, also for
+// a sector size that needs ciphertext stealing
+AES_TEST(xtsSectorsMatchSingleSectors) {
+    AESXts xts(sequence(64, 70));
+    const size_t sectorSizes[] = { 16, 520, 4096 };
+    for (size_t sectorSize : sectorSizes) {
+        const std::string name = std::to_string(sectorSize) + "-byte sectors";
+        const size_t count = 37;
+        const Bytes plain = sequence(sectorSize * count, 71);
+        Bytes run(plain.size());
+        xts.encryptSectors(0xfffffffeULL, plain.data(), run.data(), sectorSize, count, 4);
+        Bytes single(plain.size());
+        for (size_t i = 0; i < count; i++) {
+            xts.encryptSector(0xfffffffeULL + i, &plain[i * sectorSize], &single[i * sectorSize], sectorSize);
+        }
+        check(run == single, "XTS sectors match single sectors, " + name);
+        xts.decryptSectors(0xfffffffeULL, run.data(), run.data(), sectorSize, count, 4);
+        check(run == plain, "XTS sectors decrypt in place, " + name);
+    }
+}
+
+// Keys of the wrong length or with equal halves, and sectors shorter than a
+// block, are rejected
+AES_TEST(xtsRejectsBadArguments) {
+    check(throws([] { AESXts xts(sequence(48, 72)); }), "XTS rejects a 48-byte key");
+    Bytes equalHalves = sequence(16, 73);
+    equalHalves.insert(equalHalves.end(), equalHalves.begin(), equalHalves.end());
+    check(throws([&] { AESXts xts(equalHalves); }), "XTS rejects equal key halves");
+    
+    AESXts xts(sequence(32, 74));
+    Bytes data(15);
+    check(throws([&] { xts.encryptSector(0, data.data(), data.data(), data.size()); }),
+          "XTS rejects a 15-byte sector");
+}